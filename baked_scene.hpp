@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+
+#include "scene.hpp"
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "compressed_bvh.hpp"
+
+/* 1 - the app takes its fixed scene from the arrays baked at compile time (baked_scene.hpp) instead
+ * of building it at start, unless a mesh is given on the command line */
+#ifndef GREEN_SCENE_BAKED
+#define GREEN_SCENE_BAKED 0
+#endif
+
+namespace green::core
+{
+
+/* primitives with their compiled records, the binary bvh and the wide_bvh<GREEN_BVH_WIDTH> nodes,
+ * computed by bake_primitives() in a constant expression. A constexpr variable lands in the read only
+ * data of the binary and is traversed in place by scene_attach_baked() / baked_group(), no structure
+ * is built at start. The binary tree is a full sweep SAH build, collapsed as by wide_bvh::build() */
+template <size_t N>
+struct baked_primitives
+{
+    /* a binary tree over N items has at most 2N - 1 nodes, the collapsed one has fewer */
+    static constexpr size_t             node_capacity = N > 0 ? 2 * N - 1 : 1;
+
+    std::array<primitive, N>                                    primitives;
+    std::array<compiled_primitive, N>                           compiled;
+    std::array<bvh_node, node_capacity>                         binary{};
+    std::array<wide_bvh_node<GREEN_BVH_WIDTH>, node_capacity>   nodes{};     /* none with GREEN_BVH_COMPRESSED or a width of 2 */
+    std::array<int32_t, node_capacity>                          lane_of{};   /* wide_bvh::get_lane_of() */
+    std::array<int32_t, N>                                      indices{};
+    std::array<int32_t, N>                                      unbounded{};
+    int32_t                                                     binary_count = 0;
+    int32_t                                                     node_count = 0;
+    int32_t                                                     index_count = 0;
+    int32_t                                                     unbounded_count = 0;
+    bounds_type                                                 bounds;     /* of the bounded primitives */
+};
+
+/* the arrays of primitives, builds the tree at compile time when the result is constexpr */
+template <size_t N>
+constexpr baked_primitives<N> bake_primitives(const std::array<primitive, N>& primitives);
+
+/* primitive with its material, for the constexpr arrays given to bake_primitives() */
+template <class G>
+constexpr primitive baked_primitive(const G& geometry, const fvec3& diffuse, float specular, float roughness, bool transparent = false,
+    float glowing = 0.0f);
+
+/* points s at the baked primitives: the primitives, the records and the nodes are read in place, an
+ * edit copies the blocks it writes. The groups of the instances come from baked_group(). The packed primitives and the top level
+ * are built as after scene_load_acceleration(), both are cheap. With GREEN_BVH_COMPRESSED the compressed
+ * nodes are quantized from the baked binary bvh. Edits refit the structures (scene_update_acceleration()) */
+template <size_t N>
+void scene_attach_baked(scene& s, const baked_primitives<N>& baked, thread_pool* pool = nullptr);
+
+/* group over the baked primitives, for scene::groups */
+template <size_t N>
+primitive_group baked_group(const baked_primitives<N>& baked);
+
+
+
+/* smallest float above v, std::nextafter() is not constexpr */
+constexpr float baked_next_up(float v)
+{
+    if (v != v || v == std::numeric_limits<float>::infinity()) {
+        return v;
+    }
+    if (v == 0.0f) {
+        return std::numeric_limits<float>::denorm_min();
+    }
+    uint32_t bits = std::bit_cast<uint32_t>(v);
+    return std::bit_cast<float>(v > 0.0f ? bits + 1 : bits - 1);
+}
+
+/* binary nodes of the bake, children are adjacent as in bvh */
+template <size_t N>
+struct baked_binary_tree
+{
+    std::array<bvh_node, baked_primitives<N>::node_capacity>    nodes{};
+    int32_t                                                     node_count = 0;
+};
+
+/* sweep SAH over the items [begin, end) of indices, the costs of bvh::build() */
+template <size_t N>
+constexpr void baked_split(baked_binary_tree<N>& tree, std::array<int32_t, N>& indices, const std::array<bounds_type, N>& bounds,
+    int32_t node, int32_t begin, int32_t end)
+{
+    bvh_node& current = tree.nodes[node];
+    current.bounds = bounds_type();
+    for (int32_t i = begin; i < end; i++) {
+        current.bounds.extend(bounds[indices[i]]);
+    }
+    const int32_t count = end - begin;
+    const float leaf_cost = bvh::intersection_cost * count;
+    const float area = current.bounds.surface_area();
+
+    float best_cost = std::numeric_limits<float>::infinity();
+    int32_t best_axis = -1;
+    int32_t best_split = 0;
+    std::array<float, N> right_area{};
+    for (int32_t axis = 0; axis < 3 && count > 1; axis++) {
+        std::sort(indices.begin() + begin, indices.begin() + end, [&](int32_t a, int32_t b) {
+            float ca = axis == 0 ? bounds[a].center().x : (axis == 1 ? bounds[a].center().y : bounds[a].center().z);
+            float cb = axis == 0 ? bounds[b].center().x : (axis == 1 ? bounds[b].center().y : bounds[b].center().z);
+            return ca < cb || (ca == cb && a < b);
+        });
+        bounds_type right;
+        for (int32_t i = end - 1; i > begin; i--) {
+            right.extend(bounds[indices[i]]);
+            right_area[i - begin] = right.surface_area();
+        }
+        bounds_type left;
+        for (int32_t i = begin + 1; i < end; i++) {
+            left.extend(bounds[indices[i - 1]]);
+            float cost = bvh::traversal_cost
+                + bvh::intersection_cost * (left.surface_area() * (i - begin) + right_area[i - begin] * (end - i)) / area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = i;
+            }
+        }
+    }
+    if (count == 1 || (best_cost >= leaf_cost && count <= bvh::max_leaf_size) || !(area > 0.0f)) {
+        current.left_first = begin;
+        current.count = count;
+        return;
+    }
+    std::sort(indices.begin() + begin, indices.begin() + end, [&](int32_t a, int32_t b) {
+        float ca = best_axis == 0 ? bounds[a].center().x : (best_axis == 1 ? bounds[a].center().y : bounds[a].center().z);
+        float cb = best_axis == 0 ? bounds[b].center().x : (best_axis == 1 ? bounds[b].center().y : bounds[b].center().z);
+        return ca < cb || (ca == cb && a < b);
+    });
+    int32_t left = tree.node_count;
+    tree.node_count += 2;
+    current.left_first = left;
+    current.count = 0;
+    baked_split(tree, indices, bounds, left, begin, best_split);
+    baked_split(tree, indices, bounds, left + 1, best_split, end);
+}
+
+/* wide_bvh::set_lane_bounds() */
+template <int32_t W>
+constexpr void baked_lane_bounds(wide_bvh_node<W>& node, int32_t lane, const bounds_type& bounds)
+{
+    fvec3 c = bounds.center();
+    fvec3 s = bounds.max - c;
+    fvec3 s2 = c - bounds.min;
+    node.center_x[lane] = c.x;
+    node.center_y[lane] = c.y;
+    node.center_z[lane] = c.z;
+    node.size_x[lane] = baked_next_up(math::max(s.x, s2.x));
+    node.size_y[lane] = baked_next_up(math::max(s.y, s2.y));
+    node.size_z[lane] = baked_next_up(math::max(s.z, s2.z));
+}
+
+/* wide_bvh::collapse() */
+template <size_t N>
+constexpr int32_t baked_collapse(baked_primitives<N>& baked, const baked_binary_tree<N>& tree, int32_t binary_index)
+{
+    constexpr int32_t W = GREEN_BVH_WIDTH;
+    const auto& nodes = tree.nodes;
+    int32_t children[W] = {};
+    int32_t n = 0;
+    if (nodes[binary_index].count > 0) {
+        children[n++] = binary_index;
+    } else {
+        children[n++] = nodes[binary_index].left_first;
+        children[n++] = nodes[binary_index].left_first + 1;
+    }
+    while (n < W) {
+        int32_t best = -1;
+        float best_area = -1.0f;
+        for (int32_t i = 0; i < n; i++) {
+            const bvh_node& child = nodes[children[i]];
+            if (child.count == 0 && child.bounds.surface_area() > best_area) {
+                best_area = child.bounds.surface_area();
+                best = i;
+            }
+        }
+        if (best == -1) {
+            break;
+        }
+        int32_t opened = children[best];
+        children[best] = nodes[opened].left_first;
+        children[n++] = nodes[opened].left_first + 1;
+    }
+
+    int32_t index = baked.node_count++;
+    for (int32_t lane = 0; lane < W; lane++) {
+        if (lane >= n) {
+            auto& node = baked.nodes[index];
+            node.center_x[lane] = node.center_y[lane] = node.center_z[lane] = 0.0f;
+            node.size_x[lane] = node.size_y[lane] = node.size_z[lane] = -std::numeric_limits<float>::infinity();
+            node.child[lane] = -1;
+            node.count[lane] = 0;
+            continue;
+        }
+        const bvh_node& child = nodes[children[lane]];
+        int32_t child_index = child.count > 0 ? child.left_first : baked_collapse(baked, tree, children[lane]);
+        auto& node = baked.nodes[index];
+        baked_lane_bounds(node, lane, child.bounds);
+        node.child[lane] = child_index;
+        node.count[lane] = child.count;
+        baked.lane_of[children[lane]] = index * W + lane;
+    }
+    return index;
+}
+
+/* bake_primitives */
+template <size_t N>
+constexpr baked_primitives<N> bake_primitives(const std::array<primitive, N>& primitives)
+{
+    baked_primitives<N> ret = [&]<size_t... I>(std::index_sequence<I...>) {
+        return baked_primitives<N>{primitives, {compile_primitive(primitives[I])...}, {}, {}, {}, {}, {}, 0, 0, 0, 0, bounds_type()};
+    }(std::make_index_sequence<N>());
+
+    std::array<bounds_type, N> bounds;
+    for (size_t i = 0; i < N; i++) {
+        if (primitive_bounds(primitives[i], bounds[i])) {
+            ret.indices[ret.index_count++] = static_cast<int32_t>(i);
+            ret.bounds.extend(bounds[i]);
+        } else {
+            ret.unbounded[ret.unbounded_count++] = static_cast<int32_t>(i);
+        }
+    }
+    if (ret.index_count == 0) {
+        return ret;
+    }
+    baked_binary_tree<N> tree;
+    tree.node_count = 1;
+    baked_split(tree, ret.indices, bounds, 0, 0, ret.index_count);
+    ret.binary = tree.nodes;
+    ret.binary_count = tree.node_count;
+    ret.lane_of.fill(-1);
+    if constexpr (GREEN_BVH_WIDTH > 2 && !GREEN_BVH_COMPRESSED) {
+        baked_collapse(ret, tree, 0);
+    }
+    return ret;
+}
+
+/* baked_primitive */
+template <class G>
+constexpr primitive baked_primitive(const G& geometry, const fvec3& diffuse, float specular, float roughness, bool transparent, float glowing)
+{
+    primitive ret(geometry);
+    ret.diffuse = diffuse;
+    ret.specular = specular;
+    ret.roughness = roughness;
+    ret.transparent = transparent;
+    ret.glowing = glowing;
+    return ret;
+}
+
+/* the scene or a group at the baked arrays, storage aliases them without owning anything */
+template <class T, size_t N>
+void attach_baked(T& owner, const baked_primitives<N>& baked)
+{
+    std::shared_ptr<const void> storage(std::shared_ptr<const void>(), &baked);
+    owner.primitives.attach(std::span(baked.primitives), storage);
+    owner.compiled.attach(std::span(baked.compiled), storage);
+    auto binary = std::make_shared<bvh>();
+    binary->attach(std::span(baked.binary.data(), baked.binary_count), std::span(baked.indices.data(), baked.index_count),
+        std::span(baked.unbounded.data(), baked.unbounded_count), static_cast<int32_t>(N), bvh_build_mode::sweep_sah, storage);
+#if GREEN_BVH_ORIENTED_LEAVES
+    binary->orient_leaves(owner.primitives);
+#endif
+    owner.accel = binary;
+    owner.wide_accel = nullptr;
+    owner.compressed_accel = nullptr;
+#if GREEN_BVH_COMPRESSED
+    owner.compressed_accel = std::make_shared<compressed_bvh>(*binary);
+#elif GREEN_BVH_WIDTH > 2
+    auto accel = std::make_shared<wide_bvh<GREEN_BVH_WIDTH>>();
+    accel->attach(std::span(baked.nodes.data(), baked.node_count), std::span(baked.indices.data(), baked.index_count),
+        std::span(baked.unbounded.data(), baked.unbounded_count), std::span(baked.lane_of.data(), baked.binary_count), storage);
+    owner.wide_accel = accel;
+#endif
+}
+
+/* scene_attach_baked */
+template <size_t N>
+void scene_attach_baked(scene& s, const baked_primitives<N>& baked, thread_pool* pool)
+{
+    s.native = nullptr;
+    attach_baked(s, baked);
+    scene_build_packed(s);
+    scene_update_instances(s, pool);
+}
+
+/* baked_group */
+template <size_t N>
+primitive_group baked_group(const baked_primitives<N>& baked)
+{
+    primitive_group ret;
+    attach_baked(ret, baked);
+    ret.bounds = baked.bounds;
+    return ret;
+}
+
+} /* namespace green::core */
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace green::core
+{
+
+/* array of T cut into blocks of block_size items, each block held by a shared_ptr. A copy shares all
+ * the blocks with its source; a write goes through mutate() (or an append), which copies the block
+ * first while another vector shares it, so an edited copy owns only the blocks it wrote and the source
+ * never changes under its readers. Reading an item costs one more indirection than std::vector. The
+ * items of attach() are read in place until a write copies their block */
+template <class T>
+class block_vector
+{
+public:
+    using value_type = T;
+    /* about a page of items per block */
+    static constexpr size_t     block_size = std::bit_floor(std::max<size_t>(1, 4096 / sizeof(T)));
+    static constexpr size_t     block_shift = std::countr_zero(block_size);
+
+    class const_iterator;
+
+public:
+                    block_vector() = default;
+    explicit        block_vector(const std::vector<T>& items);
+    template <std::input_iterator I>
+                    block_vector(I first, I last);
+
+    size_t          size() const noexcept;
+    bool            empty() const noexcept;
+    const T&        operator[](size_t i) const noexcept;
+    const T&        front() const noexcept;
+    const T&        back() const noexcept;
+    const_iterator  begin() const noexcept;
+    const_iterator  end() const noexcept;
+
+    /* item i for writing, its block is copied first when it is shared or attached */
+    T&              mutate(size_t i);
+    void            push_back(const T& item);
+    template <class... A>
+    T&              emplace_back(A&&... args);
+    template <std::input_iterator I>
+    void            assign(I first, I last);
+    void            assign(size_t count, const T& item);
+    void            resize(size_t count, const T& item);
+    void            clear() noexcept;
+
+    /* reads items in place, storage keeps their memory alive. Nothing is copied */
+    void            attach(std::span<const T> items, std::shared_ptr<const void> storage);
+
+    /* the items as contiguous runs, for the callers writing them out */
+    size_t          get_block_count() const noexcept;
+    std::span<const T>  get_block(size_t block) const noexcept;
+    /* true when both vectors read the block from the same memory */
+    bool            shares_block(const block_vector& other, size_t block) const noexcept;
+
+private:
+    using block_type = std::vector<T>;
+
+    size_t          block_length(size_t block) const noexcept;
+    /* the block for writing, unshared and cut to the items below m_size */
+    block_type&     own_block(size_t block);
+    block_type&     append_block();
+
+private:
+    std::vector<const T*>                       m_data;     /* first item of every block */
+    std::vector<std::shared_ptr<block_type>>    m_blocks;   /* null for the attached blocks */
+    std::shared_ptr<const void>                 m_storage;  /* of the attached blocks */
+    size_t                                      m_size = 0;
+}; /* class block_vector */
+
+/* random access over the items, the iterator of range-for and of the algorithms */
+template <class T>
+class block_vector<T>::const_iterator
+{
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+public:
+                    const_iterator() = default;
+                    const_iterator(const block_vector* owner, size_t index) noexcept
+                        : m_owner{owner}
+                        , m_index{index}
+                    {}
+
+    reference       operator*() const noexcept { return (*m_owner)[m_index]; }
+    pointer         operator->() const noexcept { return &(*m_owner)[m_index]; }
+    reference       operator[](difference_type n) const noexcept { return (*m_owner)[m_index + n]; }
+
+    const_iterator& operator++() noexcept { m_index++; return *this; }
+    const_iterator  operator++(int) noexcept { const_iterator ret = *this; m_index++; return ret; }
+    const_iterator& operator--() noexcept { m_index--; return *this; }
+    const_iterator  operator--(int) noexcept { const_iterator ret = *this; m_index--; return ret; }
+    const_iterator& operator+=(difference_type n) noexcept { m_index += n; return *this; }
+    const_iterator& operator-=(difference_type n) noexcept { m_index -= n; return *this; }
+
+    friend const_iterator   operator+(const_iterator it, difference_type n) noexcept { return it += n; }
+    friend const_iterator   operator+(difference_type n, const_iterator it) noexcept { return it += n; }
+    friend const_iterator   operator-(const_iterator it, difference_type n) noexcept { return it -= n; }
+    friend difference_type  operator-(const const_iterator& a, const const_iterator& b) noexcept
+    {
+        return static_cast<difference_type>(a.m_index) - static_cast<difference_type>(b.m_index);
+    }
+    friend bool                 operator==(const const_iterator& a, const const_iterator& b) noexcept { return a.m_index == b.m_index; }
+    friend std::strong_ordering operator<=>(const const_iterator& a, const const_iterator& b) noexcept { return a.m_index <=> b.m_index; }
+
+private:
+    const block_vector* m_owner = nullptr;
+    size_t              m_index = 0;
+}; /* class block_vector::const_iterator */
+
+
+
+/* block_vector::block_vector */
+template <class T>
+block_vector<T>::block_vector(const std::vector<T>& items)
+{
+    assign(items.begin(), items.end());
+}
+
+/* block_vector::block_vector */
+template <class T>
+template <std::input_iterator I>
+block_vector<T>::block_vector(I first, I last)
+{
+    assign(first, last);
+}
+
+/* block_vector::size */
+template <class T>
+inline size_t block_vector<T>::size() const noexcept
+{
+    return m_size;
+}
+
+/* block_vector::empty */
+template <class T>
+inline bool block_vector<T>::empty() const noexcept
+{
+    return m_size == 0;
+}
+
+/* block_vector::operator[] */
+template <class T>
+inline const T& block_vector<T>::operator[](size_t i) const noexcept
+{
+    return m_data[i >> block_shift][i & (block_size - 1)];
+}
+
+/* block_vector::front */
+template <class T>
+inline const T& block_vector<T>::front() const noexcept
+{
+    return (*this)[0];
+}
+
+/* block_vector::back */
+template <class T>
+inline const T& block_vector<T>::back() const noexcept
+{
+    return (*this)[m_size - 1];
+}
+
+/* block_vector::begin */
+template <class T>
+inline typename block_vector<T>::const_iterator block_vector<T>::begin() const noexcept
+{
+    return const_iterator(this, 0);
+}
+
+/* block_vector::end */
+template <class T>
+inline typename block_vector<T>::const_iterator block_vector<T>::end() const noexcept
+{
+    return const_iterator(this, m_size);
+}
+
+/* block_vector::mutate */
+template <class T>
+inline T& block_vector<T>::mutate(size_t i)
+{
+    return own_block(i >> block_shift)[i & (block_size - 1)];
+}
+
+/* block_vector::push_back */
+template <class T>
+void block_vector<T>::push_back(const T& item)
+{
+    emplace_back(item);
+}
+
+/* block_vector::emplace_back */
+template <class T>
+template <class... A>
+T& block_vector<T>::emplace_back(A&&... args)
+{
+    block_type& block = m_size % block_size == 0 ? append_block() : own_block(m_blocks.size() - 1);
+    block.emplace_back(std::forward<A>(args)...);
+    m_size++;
+    return block.back();
+}
+
+/* block_vector::assign */
+template <class T>
+template <std::input_iterator I>
+void block_vector<T>::assign(I first, I last)
+{
+    clear();
+    while (first != last) {
+        block_type& block = append_block();
+        for (; first != last && block.size() < block_size; ++first) {
+            block.push_back(*first);
+        }
+        m_size += block.size();
+    }
+}
+
+/* block_vector::assign */
+template <class T>
+void block_vector<T>::assign(size_t count, const T& item)
+{
+    clear();
+    resize(count, item);
+}
+
+/* block_vector::resize */
+template <class T>
+void block_vector<T>::resize(size_t count, const T& item)
+{
+    if (count <= m_size) {
+        /* the items past the end of a shared block stay there for the vectors sharing it */
+        const size_t blocks = (count + block_size - 1) >> block_shift;
+        m_data.resize(blocks);
+        m_blocks.resize(blocks);
+        m_size = count;
+        return;
+    }
+    while (m_size < count) {
+        block_type& block = m_size % block_size == 0 ? append_block() : own_block(m_blocks.size() - 1);
+        size_t n = std::min(block_size - block.size(), count - m_size);
+        block.insert(block.end(), n, item);
+        m_size += n;
+    }
+}
+
+/* block_vector::clear */
+template <class T>
+void block_vector<T>::clear() noexcept
+{
+    m_data.clear();
+    m_blocks.clear();
+    m_storage = nullptr;
+    m_size = 0;
+}
+
+/* block_vector::attach */
+template <class T>
+void block_vector<T>::attach(std::span<const T> items, std::shared_ptr<const void> storage)
+{
+    clear();
+    for (size_t first = 0; first < items.size(); first += block_size) {
+        m_data.push_back(items.data() + first);
+        m_blocks.push_back(nullptr);
+    }
+    m_storage = std::move(storage);
+    m_size = items.size();
+}
+
+/* block_vector::get_block_count */
+template <class T>
+inline size_t block_vector<T>::get_block_count() const noexcept
+{
+    return m_data.size();
+}
+
+/* block_vector::get_block */
+template <class T>
+inline std::span<const T> block_vector<T>::get_block(size_t block) const noexcept
+{
+    return std::span<const T>(m_data[block], block_length(block));
+}
+
+/* block_vector::shares_block */
+template <class T>
+inline bool block_vector<T>::shares_block(const block_vector& other, size_t block) const noexcept
+{
+    return block < m_data.size() && block < other.m_data.size() && m_data[block] == other.m_data[block];
+}
+
+/* block_vector::block_length */
+template <class T>
+inline size_t block_vector<T>::block_length(size_t block) const noexcept
+{
+    return std::min(block_size, m_size - (block << block_shift));
+}
+
+/* block_vector::own_block */
+template <class T>
+typename block_vector<T>::block_type& block_vector<T>::own_block(size_t block)
+{
+    std::shared_ptr<block_type>& owner = m_blocks[block];
+    const size_t length = block_length(block);
+    /* a use count of 1 means no other vector holds the block, so nobody reads it meanwhile. The fence
+     * orders the reads of the vector released last before the writes made here */
+    if (!owner || owner.use_count() != 1) {
+        auto copy = std::make_shared<block_type>();
+        copy->reserve(block_size);
+        copy->assign(m_data[block], m_data[block] + length);
+        owner = std::move(copy);
+        m_data[block] = owner->data();
+    } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (owner->size() > length) {
+            owner->erase(owner->begin() + length, owner->end());
+        }
+    }
+    return *owner;
+}
+
+/* block_vector::append_block */
+template <class T>
+typename block_vector<T>::block_type& block_vector<T>::append_block()
+{
+    /* reserved once, the items never move while the block grows */
+    auto block = std::make_shared<block_type>();
+    block->reserve(block_size);
+    m_data.push_back(block->data());
+    m_blocks.push_back(std::move(block));
+    return *m_blocks.back();
+}
+
+} /* namespace green::core */
@@ -0,0 +1,1232 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+#include <core/timer.hpp>
+
+#include "ray_intersection_test.hpp"
+#include "parallel.hpp"
+#include "thread_pool.h"
+
+namespace green::core
+{
+
+static inline float axis_value(const fvec3& v, int32_t axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static inline void set_axis_value(fvec3& v, int32_t axis, float value)
+{
+    (axis == 0 ? v.x : (axis == 1 ? v.y : v.z)) = value;
+}
+
+/* the common part of two boxes, empty when they do not overlap */
+static inline bounds_type bounds_overlap(const bounds_type& a, const bounds_type& b)
+{
+    bounds_type ret(fvec3(math::max(a.min.x, b.min.x), math::max(a.min.y, b.min.y), math::max(a.min.z, b.min.z)),
+        fvec3(math::min(a.max.x, b.max.x), math::min(a.max.y, b.max.y), math::min(a.max.z, b.max.z)));
+    return ret.is_empty() ? bounds_type() : ret;
+}
+
+/* shared state of one build, the workers only touch disjoint ranges of indices and codes */
+struct bvh_build_context
+{
+    bvh_build_mode                  mode;
+    const std::vector<bounds_type>& bounds;
+    const std::vector<fvec3>&       centroids;
+    std::vector<int32_t>&           indices;
+    std::vector<uint32_t>           codes;      /* lbvh: morton code of indices[i] */
+};
+
+/* subtree left for a worker, node is a placeholder already linked to its parent */
+struct bvh_build_task
+{
+    int32_t     node;
+    int32_t     first;
+    int32_t     count;
+    int32_t     depth;
+};
+
+/* calls fn(begin, end) for chunks of [0, n), on the pool workers when there is a pool */
+template <class F>
+static void parallel_chunks(thread_pool* pool, int32_t n, F&& fn)
+{
+    int32_t chunks = pool ? static_cast<int32_t>(pool->get_thread_count()) : 1;
+    if (chunks <= 1 || n < bvh::min_task_size) {
+        fn(0, n);
+        return;
+    }
+    parallel_for(pool, 0, n, (n + chunks - 1) / chunks, fn);
+}
+
+/* spreads the lower 10 bits so that there are two zero bits between them */
+static inline uint32_t morton_expand_bits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+/* sorts ctx.indices by the 30 bit morton codes of the centroids */
+static void morton_sort(bvh_build_context& ctx, thread_pool* pool)
+{
+    const int32_t n = static_cast<int32_t>(ctx.indices.size());
+    bounds_type centroid_bounds;
+    for (int32_t i: ctx.indices) {
+        centroid_bounds.extend(ctx.centroids[i]);
+    }
+    fvec3 extent = centroid_bounds.max - centroid_bounds.min;
+    fvec3 scale(extent.x > 0.0f ? 1023.0f / extent.x : 0.0f, extent.y > 0.0f ? 1023.0f / extent.y : 0.0f, extent.z > 0.0f ? 1023.0f / extent.z : 0.0f);
+
+    std::vector<uint64_t> keys(n);
+    parallel_chunks(pool, n, [&](int32_t begin, int32_t end) {
+        for (int32_t i = begin; i < end; i++) {
+            fvec3 c = (ctx.centroids[ctx.indices[i]] - centroid_bounds.min) * scale;
+            uint32_t code = morton_expand_bits(static_cast<uint32_t>(c.x)) * 4
+                + morton_expand_bits(static_cast<uint32_t>(c.y)) * 2
+                + morton_expand_bits(static_cast<uint32_t>(c.z));
+            /* the primitive index in the low bits keeps the order deterministic */
+            keys[i] = (static_cast<uint64_t>(code) << 32) | static_cast<uint32_t>(ctx.indices[i]);
+        }
+    });
+
+    /* sort chunks on the workers, then merge neighbours pairwise */
+    int32_t chunks = pool && n >= bvh::min_task_size ? static_cast<int32_t>(pool->get_thread_count()) : 1;
+    std::vector<int32_t> bounds(chunks + 1);
+    for (int32_t i = 0; i <= chunks; i++) {
+        bounds[i] = static_cast<int32_t>(static_cast<int64_t>(n) * i / chunks);
+    }
+    if (chunks == 1) {
+        std::sort(keys.begin(), keys.end());
+    } else {
+        parallel_for(pool, 0, chunks, 1, [&keys, &bounds](int32_t c, int32_t) {
+            std::sort(keys.begin() + bounds[c], keys.begin() + bounds[c + 1]);
+        });
+    }
+    for (int32_t step = 1; step < chunks; step *= 2) {
+        task_group merges(pool);
+        for (int32_t c = 0; c + step < chunks; c += 2 * step) {
+            merges.run([&keys, &bounds, c, step, chunks] {
+                int32_t last = math::min(c + 2 * step, chunks);
+                std::inplace_merge(keys.begin() + bounds[c], keys.begin() + bounds[c + step], keys.begin() + bounds[last]);
+            });
+        }
+        merges.wait();
+    }
+
+    ctx.codes.resize(n);
+    for (int32_t i = 0; i < n; i++) {
+        ctx.codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+        ctx.indices[i] = static_cast<int32_t>(keys[i] & 0xFFFFFFFFu);
+    }
+}
+
+static void sort_by_axis(bvh_build_context& ctx, int32_t first, int32_t count, int32_t axis)
+{
+    std::sort(ctx.indices.begin() + first, ctx.indices.begin() + first + count, [&](int32_t a, int32_t b) {
+        float ca = axis_value(ctx.centroids[a], axis);
+        float cb = axis_value(ctx.centroids[b], axis);
+        return ca < cb || (ca == cb && a < b);
+    });
+}
+
+/* full sweep over the sorted centroids of every axis, returns 0 when a leaf is cheaper */
+static int32_t find_split_sweep(bvh_build_context& ctx, int32_t first, int32_t count, const bounds_type& node_bounds, const bounds_type& centroid_bounds)
+{
+    float best_cost = count * bvh::intersection_cost;
+    int32_t best_axis = -1;
+    int32_t best_split = 0;
+    int32_t sorted_axis = -1;
+    float parent_area = node_bounds.surface_area();
+    if (parent_area <= 0.0f) {
+        return 0;
+    }
+    std::vector<float> right_area(count);
+    for (int32_t axis = 0; axis < 3; axis++) {
+        if (axis_value(centroid_bounds.min, axis) == axis_value(centroid_bounds.max, axis)) {
+            continue;
+        }
+        sort_by_axis(ctx, first, count, axis);
+        sorted_axis = axis;
+
+        bounds_type acc;
+        for (int32_t i = count - 1; i > 0; i--) {
+            acc.extend(ctx.bounds[ctx.indices[first + i]]);
+            right_area[i] = acc.surface_area();
+        }
+        acc = bounds_type();
+        for (int32_t i = 1; i < count; i++) {
+            acc.extend(ctx.bounds[ctx.indices[first + i - 1]]);
+            float cost = bvh::traversal_cost + bvh::intersection_cost * (acc.surface_area() * i + right_area[i] * (count - i)) / parent_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = i;
+            }
+        }
+    }
+    if (best_axis != -1 && best_axis != sorted_axis) {
+        sort_by_axis(ctx, first, count, best_axis);
+    }
+    return best_split;
+}
+
+/* surface area heuristic at the bin borders, returns 0 when a leaf is cheaper */
+static int32_t find_split_binned(bvh_build_context& ctx, int32_t first, int32_t count, const bounds_type& node_bounds, const bounds_type& centroid_bounds)
+{
+    constexpr int32_t bins = bvh::sah_bins;
+    float best_cost = count * bvh::intersection_cost;
+    int32_t best_axis = -1;
+    int32_t best_bin = 0;
+    float parent_area = node_bounds.surface_area();
+    if (parent_area <= 0.0f) {
+        return 0;
+    }
+    auto bin_of = [&](int32_t prim, int32_t axis, float scale) {
+        float c = axis_value(ctx.centroids[prim], axis) - axis_value(centroid_bounds.min, axis);
+        return math::min(static_cast<int32_t>(c * scale), bins - 1);
+    };
+    for (int32_t axis = 0; axis < 3; axis++) {
+        float extent = axis_value(centroid_bounds.max, axis) - axis_value(centroid_bounds.min, axis);
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float scale = bins / extent;
+        bounds_type bin_bounds[bins];
+        int32_t bin_count[bins] = {};
+        for (int32_t i = first; i < first + count; i++) {
+            int32_t b = bin_of(ctx.indices[i], axis, scale);
+            bin_bounds[b].extend(ctx.bounds[ctx.indices[i]]);
+            bin_count[b]++;
+        }
+        float right_area[bins];
+        int32_t right_count[bins];
+        bounds_type acc;
+        int32_t acc_count = 0;
+        for (int32_t b = bins - 1; b > 0; b--) {
+            acc.extend(bin_bounds[b]);
+            acc_count += bin_count[b];
+            right_area[b] = acc.surface_area();
+            right_count[b] = acc_count;
+        }
+        acc = bounds_type();
+        acc_count = 0;
+        for (int32_t b = 1; b < bins; b++) {
+            acc.extend(bin_bounds[b - 1]);
+            acc_count += bin_count[b - 1];
+            if (acc_count == 0 || right_count[b] == 0) {
+                continue;
+            }
+            float cost = bvh::traversal_cost + bvh::intersection_cost * (acc.surface_area() * acc_count + right_area[b] * right_count[b]) / parent_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+    if (best_axis == -1) {
+        return 0;
+    }
+    float scale = bins / (axis_value(centroid_bounds.max, best_axis) - axis_value(centroid_bounds.min, best_axis));
+    auto mid = std::partition(ctx.indices.begin() + first, ctx.indices.begin() + first + count, [&](int32_t prim) {
+        return bin_of(prim, best_axis, scale) < best_bin;
+    });
+    return static_cast<int32_t>(mid - (ctx.indices.begin() + first));
+}
+
+/* split at the highest bit that differs inside the range of sorted codes */
+static int32_t find_split_lbvh(bvh_build_context& ctx, int32_t first, int32_t count)
+{
+    if (count <= bvh::lbvh_leaf_size) {
+        return 0;
+    }
+    uint32_t first_code = ctx.codes[first];
+    uint32_t last_code = ctx.codes[first + count - 1];
+    if (first_code == last_code) {
+        return count / 2;
+    }
+    int32_t prefix = __builtin_clz(first_code ^ last_code);
+    /* binary search of the last code sharing more than prefix bits with the first one */
+    int32_t split = first;
+    int32_t step = count;
+    do {
+        step = (step + 1) / 2;
+        int32_t candidate = split + step;
+        if (candidate < first + count && __builtin_clz(first_code ^ ctx.codes[candidate]) > prefix) {
+            split = candidate;
+        }
+    } while (step > 1);
+    return split - first + 1;
+}
+
+/* builds the subtree of nodes[node_index], subtrees small enough for a task are pushed to deferred instead */
+static void build_node(bvh_build_context& ctx, std::vector<bvh_node>& nodes, int32_t node_index,
+    int32_t first, int32_t count, int32_t depth, int32_t task_size, std::vector<bvh_build_task>* deferred)
+{
+    bounds_type node_bounds;
+    bounds_type centroid_bounds;
+    for (int32_t i = first; i < first + count; i++) {
+        node_bounds.extend(ctx.bounds[ctx.indices[i]]);
+        centroid_bounds.extend(ctx.centroids[ctx.indices[i]]);
+    }
+    nodes[node_index].bounds = node_bounds;
+    nodes[node_index].left_first = first;
+    nodes[node_index].count = count;
+
+    if (deferred && count <= task_size) {
+        deferred->push_back({node_index, first, count, depth});
+        return;
+    }
+
+    int32_t split = 0;
+    if (count > 1 && depth < bvh::max_depth) {
+        switch (ctx.mode) {
+        case bvh_build_mode::sweep_sah:
+            split = find_split_sweep(ctx, first, count, node_bounds, centroid_bounds);
+            break;
+        case bvh_build_mode::binned_sah:
+        case bvh_build_mode::sbvh:
+            split = find_split_binned(ctx, first, count, node_bounds, centroid_bounds);
+            break;
+        case bvh_build_mode::lbvh:
+            split = find_split_lbvh(ctx, first, count);
+            break;
+        }
+        if (split == 0 && count > bvh::max_leaf_size) {
+            /* the leaf is cheaper but too large, split in the middle of the widest axis */
+            fvec3 extent = centroid_bounds.max - centroid_bounds.min;
+            int32_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            if (ctx.mode != bvh_build_mode::lbvh) {
+                sort_by_axis(ctx, first, count, axis);
+            }
+            split = count / 2;
+        }
+    }
+    if (split == 0) {
+        return;
+    }
+
+    int32_t left = static_cast<int32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[node_index].left_first = left;
+    nodes[node_index].count = 0;
+    build_node(ctx, nodes, left, first, split, depth + 1, task_size, deferred);
+    build_node(ctx, nodes, left + 1, first + split, count - split, depth + 1, task_size, deferred);
+}
+
+/* a primitive, or the part of it between the planes of the spatial splits above */
+struct sbvh_reference
+{
+    int32_t         item;
+    bounds_type     bounds;
+};
+
+/* state of one sbvh build, the leaves append their items to indices in depth first order, so every
+ * subtree still owns a contiguous range */
+struct sbvh_build_context
+{
+    const block_vector<primitive>*  primitives;     /* null: the references are clipped as boxes */
+    std::vector<int32_t>&           indices;
+    float                           min_overlap;    /* overlap area of the object split children worth a spatial split */
+    int32_t                         budget;         /* duplicates left */
+};
+
+/* best split of a node, cost is infinite when there is none */
+struct sbvh_split
+{
+    float           cost = std::numeric_limits<float>::infinity();
+    int32_t         axis = -1;
+    int32_t         bin = 0;        /* object split: first bin of the right side */
+    float           position = 0.0f;    /* spatial split: the plane */
+    bounds_type     left;
+    bounds_type     right;
+    int32_t         left_count = 0;
+    int32_t         right_count = 0;
+};
+
+/* bounds of the part of the reference with the axis coordinate in [lo, hi], empty when there is none */
+static bounds_type sbvh_clip(const sbvh_build_context& ctx, const sbvh_reference& ref, int32_t axis, float lo, float hi)
+{
+    bounds_type ret = ref.bounds;
+    if (ctx.primitives && (*ctx.primitives)[ref.item].type == geometry_type::capsule) {
+        /* the points of the capsule in the slab are within the radius of the part of the segment in
+         * the slab grown by the radius. The parameters and the radius are widened against rounding */
+        const capsule_type& c = (*ctx.primitives)[ref.item].capsule;
+        float a = axis_value(c.point1, axis);
+        float d = axis_value(c.point2, axis) - a;
+        float t0 = 0.0f;
+        float t1 = 1.0f;
+        if (d != 0.0f) {
+            float ta = (lo - c.radius - a) / d;
+            float tb = (hi + c.radius - a) / d;
+            if (ta > tb) {
+                std::swap(ta, tb);
+            }
+            t0 = math::max(t0, ta - 1e-5f);
+            t1 = math::min(t1, tb + 1e-5f);
+        } else if (a < lo - c.radius || a > hi + c.radius) {
+            return bounds_type();
+        }
+        if (!(t0 <= t1)) {
+            return bounds_type();
+        }
+        fvec3 dir = c.point2 - c.point1;
+        fvec3 p0 = c.point1 + dir * t0;
+        fvec3 p1 = c.point1 + dir * t1;
+        float r = c.radius + 1e-5f * (c.radius + math::max(c.point1.abs().max(), c.point2.abs().max()));
+        bounds_type part(p0 - r, p0 + r);
+        part.extend(bounds_type(p1 - r, p1 + r));
+        ret = bounds_overlap(ret, part);
+    }
+    if (axis_value(ret.min, axis) < lo) {
+        set_axis_value(ret.min, axis, lo);
+    }
+    if (axis_value(ret.max, axis) > hi) {
+        set_axis_value(ret.max, axis, hi);
+    }
+    return ret.is_empty() ? bounds_type() : ret;
+}
+
+/* find_split_binned() over the centroids of the references */
+static sbvh_split sbvh_object_split(const std::vector<sbvh_reference>& refs, const bounds_type& centroid_bounds, float parent_area)
+{
+    constexpr int32_t bins = bvh::sah_bins;
+    sbvh_split best;
+    for (int32_t axis = 0; axis < 3; axis++) {
+        float lo = axis_value(centroid_bounds.min, axis);
+        float extent = axis_value(centroid_bounds.max, axis) - lo;
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float scale = bins / extent;
+        bounds_type bin_bounds[bins];
+        int32_t bin_count[bins] = {};
+        for (const auto& ref: refs) {
+            int32_t b = math::min(static_cast<int32_t>((axis_value(ref.bounds.center(), axis) - lo) * scale), bins - 1);
+            bin_bounds[b].extend(ref.bounds);
+            bin_count[b]++;
+        }
+        bounds_type right_bounds[bins];
+        int32_t right_count[bins];
+        bounds_type acc;
+        int32_t acc_count = 0;
+        for (int32_t b = bins - 1; b > 0; b--) {
+            acc.extend(bin_bounds[b]);
+            acc_count += bin_count[b];
+            right_bounds[b] = acc;
+            right_count[b] = acc_count;
+        }
+        acc = bounds_type();
+        acc_count = 0;
+        for (int32_t b = 1; b < bins; b++) {
+            acc.extend(bin_bounds[b - 1]);
+            acc_count += bin_count[b - 1];
+            if (acc_count == 0 || right_count[b] == 0) {
+                continue;
+            }
+            float cost = bvh::traversal_cost + bvh::intersection_cost
+                * (acc.surface_area() * acc_count + right_bounds[b].surface_area() * right_count[b]) / parent_area;
+            if (cost < best.cost) {
+                best = {cost, axis, b, 0.0f, acc, right_bounds[b], acc_count, right_count[b]};
+            }
+        }
+    }
+    return best;
+}
+
+/* surface area heuristic at the bin borders of the node bounds, a reference counts on both sides of
+ * the planes it straddles with the bounds of its clipped parts */
+static sbvh_split sbvh_spatial_split(const sbvh_build_context& ctx, const std::vector<sbvh_reference>& refs, const bounds_type& node_bounds,
+    float parent_area)
+{
+    constexpr int32_t bins = bvh::sah_bins;
+    const int32_t count = static_cast<int32_t>(refs.size());
+    sbvh_split best;
+    for (int32_t axis = 0; axis < 3; axis++) {
+        float lo = axis_value(node_bounds.min, axis);
+        float extent = axis_value(node_bounds.max, axis) - lo;
+        if (extent <= 0.0f) {
+            continue;
+        }
+        float width = extent / bins;
+        auto bin_of = [&](float v) {
+            return math::clamp(static_cast<int32_t>((v - lo) / width), 0, bins - 1);
+        };
+        bounds_type bin_bounds[bins];
+        int32_t entry[bins] = {};
+        int32_t exit[bins] = {};
+        for (const auto& ref: refs) {
+            int32_t first = bin_of(axis_value(ref.bounds.min, axis));
+            int32_t last = math::max(first, bin_of(axis_value(ref.bounds.max, axis)));
+            for (int32_t b = first; b <= last; b++) {
+                float plane_lo = b == first ? -std::numeric_limits<float>::infinity() : lo + b * width;
+                float plane_hi = b == last ? std::numeric_limits<float>::infinity() : lo + (b + 1) * width;
+                bin_bounds[b].extend(first == last ? ref.bounds : sbvh_clip(ctx, ref, axis, plane_lo, plane_hi));
+            }
+            entry[first]++;
+            exit[last]++;
+        }
+        bounds_type right_bounds[bins];
+        int32_t right_count[bins];
+        bounds_type acc;
+        int32_t acc_count = 0;
+        for (int32_t b = bins - 1; b > 0; b--) {
+            acc.extend(bin_bounds[b]);
+            acc_count += exit[b];
+            right_bounds[b] = acc;
+            right_count[b] = acc_count;
+        }
+        acc = bounds_type();
+        acc_count = 0;
+        for (int32_t b = 1; b < bins; b++) {
+            acc.extend(bin_bounds[b - 1]);
+            acc_count += entry[b - 1];
+            /* the references straddling the plane are duplicated */
+            if (acc_count == 0 || right_count[b] == 0 || acc_count + right_count[b] - count > ctx.budget) {
+                continue;
+            }
+            float cost = bvh::traversal_cost + bvh::intersection_cost
+                * (acc.surface_area() * acc_count + right_bounds[b].surface_area() * right_count[b]) / parent_area;
+            if (cost < best.cost) {
+                best = {cost, axis, b, lo + b * width, acc, right_bounds[b], acc_count, right_count[b]};
+            }
+        }
+    }
+    return best;
+}
+
+/* sends the references to the sides of the plane. A straddling reference goes to one side when that
+ * is cheaper than the duplicate (reference unsplitting), the split reference is clipped to each side */
+static void sbvh_partition_spatial(sbvh_build_context& ctx, std::vector<sbvh_reference>& refs, const sbvh_split& split,
+    std::vector<sbvh_reference>& left, std::vector<sbvh_reference>& right)
+{
+    const float area_l = split.left.surface_area();
+    const float area_r = split.right.surface_area();
+    const float nl = static_cast<float>(split.left_count);
+    const float nr = static_cast<float>(split.right_count);
+    for (const auto& ref: refs) {
+        if (axis_value(ref.bounds.max, split.axis) <= split.position) {
+            left.push_back(ref);
+            continue;
+        }
+        if (axis_value(ref.bounds.min, split.axis) >= split.position) {
+            right.push_back(ref);
+            continue;
+        }
+        bounds_type bl = split.left;
+        bounds_type br = split.right;
+        bl.extend(ref.bounds);
+        br.extend(ref.bounds);
+        float cost_split = area_l * nl + area_r * nr;
+        float cost_left = bl.surface_area() * nl + area_r * (nr - 1.0f);
+        float cost_right = area_l * (nl - 1.0f) + br.surface_area() * nr;
+        if (cost_left < cost_split && cost_left <= cost_right) {
+            left.push_back(ref);
+            continue;
+        }
+        if (cost_right < cost_split) {
+            right.push_back(ref);
+            continue;
+        }
+        /* the clipped box of a capsule may miss one side */
+        bounds_type part_l = sbvh_clip(ctx, ref, split.axis, -std::numeric_limits<float>::infinity(), split.position);
+        bounds_type part_r = sbvh_clip(ctx, ref, split.axis, split.position, std::numeric_limits<float>::infinity());
+        if (!part_l.is_empty()) {
+            left.push_back({ref.item, part_l});
+        }
+        if (!part_r.is_empty()) {
+            right.push_back({ref.item, part_r});
+        }
+        if (!part_l.is_empty() && !part_r.is_empty()) {
+            ctx.budget--;
+        }
+    }
+}
+
+/* builds the subtree of nodes[node_index] over refs, which are consumed */
+static void sbvh_build_node(sbvh_build_context& ctx, std::vector<bvh_node>& nodes, int32_t node_index, std::vector<sbvh_reference>& refs, int32_t depth)
+{
+    const int32_t count = static_cast<int32_t>(refs.size());
+    bounds_type node_bounds;
+    bounds_type centroid_bounds;
+    for (const auto& ref: refs) {
+        node_bounds.extend(ref.bounds);
+        centroid_bounds.extend(ref.bounds.center());
+    }
+    nodes[node_index].bounds = node_bounds;
+
+    std::vector<sbvh_reference> left;
+    std::vector<sbvh_reference> right;
+    float parent_area = node_bounds.surface_area();
+    if (count > 1 && depth < bvh::max_depth && parent_area > 0.0f) {
+        sbvh_split object = sbvh_object_split(refs, centroid_bounds, parent_area);
+        sbvh_split spatial;
+        if (ctx.budget > 0 && (object.axis == -1 || bounds_overlap(object.left, object.right).surface_area() > ctx.min_overlap)) {
+            spatial = sbvh_spatial_split(ctx, refs, node_bounds, parent_area);
+        }
+        bool split = math::min(object.cost, spatial.cost) < count * bvh::intersection_cost || count > bvh::max_leaf_size;
+        if (split && spatial.cost < object.cost) {
+            sbvh_partition_spatial(ctx, refs, spatial, left, right);
+            /* every reference was sent to one side */
+            if (left.empty() || right.empty()) {
+                left.clear();
+                right.clear();
+            }
+        }
+        if (split && left.empty() && object.axis != -1) {
+            float lo = axis_value(centroid_bounds.min, object.axis);
+            float scale = bvh::sah_bins / (axis_value(centroid_bounds.max, object.axis) - lo);
+            for (const auto& ref: refs) {
+                int32_t b = math::min(static_cast<int32_t>((axis_value(ref.bounds.center(), object.axis) - lo) * scale), bvh::sah_bins - 1);
+                (b < object.bin ? left : right).push_back(ref);
+            }
+        }
+        if (split && left.empty() && count > bvh::max_leaf_size) {
+            /* no split found but the leaf is too large, split in the middle of the widest axis */
+            fvec3 extent = centroid_bounds.max - centroid_bounds.min;
+            int32_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+            std::sort(refs.begin(), refs.end(), [axis](const sbvh_reference& a, const sbvh_reference& b) {
+                return axis_value(a.bounds.center(), axis) < axis_value(b.bounds.center(), axis);
+            });
+            left.assign(refs.begin(), refs.begin() + count / 2);
+            right.assign(refs.begin() + count / 2, refs.end());
+        }
+    }
+    if (left.empty()) {
+        nodes[node_index].left_first = static_cast<int32_t>(ctx.indices.size());
+        nodes[node_index].count = count;
+        for (const auto& ref: refs) {
+            ctx.indices.push_back(ref.item);
+        }
+        return;
+    }
+
+    /* the references of this node are no longer needed below it */
+    std::vector<sbvh_reference>().swap(refs);
+    int32_t l = static_cast<int32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[node_index].left_first = l;
+    nodes[node_index].count = 0;
+    sbvh_build_node(ctx, nodes, l, left, depth + 1);
+    sbvh_build_node(ctx, nodes, l + 1, right, depth + 1);
+}
+
+/* bvh::bvh */
+bvh::bvh(const block_vector<primitive>& primitives, bvh_build_mode mode, thread_pool* pool)
+{
+    build(primitives, mode, pool);
+}
+
+/* bvh::build */
+void bvh::build(const block_vector<primitive>& primitives, bvh_build_mode mode, thread_pool* pool)
+{
+    timer t;
+    std::vector<bounds_type> bounds(primitives.size());
+    parallel_chunks(pool, static_cast<int32_t>(primitives.size()), [&](int32_t begin, int32_t end) {
+        for (int32_t i = begin; i < end; i++) {
+            primitive_bounds(primitives[i], bounds[i]);
+        }
+    });
+    build_nodes(bounds, &primitives, mode, pool);
+    m_build_stats.build_msec = t.get_elapsed_msec();
+}
+
+/* bvh::build */
+void bvh::build(const std::vector<bounds_type>& bounds, bvh_build_mode mode, thread_pool* pool)
+{
+    build_nodes(bounds, nullptr, mode, pool);
+}
+
+/* bvh::build_nodes */
+void bvh::build_nodes(const std::vector<bounds_type>& bounds, const block_vector<primitive>* primitives, bvh_build_mode mode, thread_pool* pool)
+{
+    timer t;
+    m_nodes.clear();
+    m_indices.clear();
+    m_unbounded.clear();
+    m_leaf_oriented.clear();
+    m_oriented.clear();
+    m_build_stats = bvh_build_stats();
+    m_build_stats.mode = mode;
+
+    const int32_t n = static_cast<int32_t>(bounds.size());
+    m_leaf_of.assign(n, -1);
+    m_parents.clear();
+    m_build_area.clear();
+    m_degraded.clear();
+    m_degraded_list.clear();
+    m_garbage = 0;
+    m_cost_sum = 0.0;
+    std::vector<fvec3> centroids(n);
+    parallel_chunks(pool, n, [&](int32_t begin, int32_t end) {
+        for (int32_t i = begin; i < end; i++) {
+            centroids[i] = bounds[i].center();
+        }
+    });
+    /* built in contiguous vectors, moved to the blocks at the end */
+    std::vector<int32_t> indices;
+    for (int32_t i = 0; i < n; i++) {
+        (bounds[i].is_empty() ? m_unbounded : indices).push_back(i);
+    }
+    if (indices.empty()) {
+        m_build_stats.build_msec = t.get_elapsed_msec();
+        return;
+    }
+
+    bvh_build_context ctx{mode, bounds, centroids, indices, {}};
+    if (mode == bvh_build_mode::lbvh) {
+        morton_sort(ctx, pool);
+    }
+
+    const int32_t count = static_cast<int32_t>(indices.size());
+    std::vector<bvh_node> nodes;
+    nodes.reserve(2 * count);
+    nodes.emplace_back();
+    if (mode == bvh_build_mode::sbvh) {
+        std::vector<sbvh_reference> refs(count);
+        bounds_type root;
+        for (int32_t i = 0; i < count; i++) {
+            refs[i] = {indices[i], bounds[indices[i]]};
+            root.extend(refs[i].bounds);
+        }
+        sbvh_build_context sctx{primitives, indices, root.surface_area() * sbvh_overlap_ratio,
+            static_cast<int32_t>(count * sbvh_duplicate_ratio)};
+        indices.clear();
+        sbvh_build_node(sctx, nodes, 0, refs, 0);
+    } else if (!pool || pool->get_thread_count() < 2 || count < 2 * min_task_size) {
+        build_node(ctx, nodes, 0, 0, count, 0, 0, nullptr);
+    } else {
+        /* about four subtrees per worker keep the workers busy when the split is uneven */
+        int32_t task_size = math::max(min_task_size, count / static_cast<int32_t>(4 * pool->get_thread_count()));
+        std::vector<bvh_build_task> tasks;
+        build_node(ctx, nodes, 0, 0, count, 0, task_size, &tasks);
+
+        std::vector<std::vector<bvh_node>> subtrees(tasks.size());
+        parallel_for(pool, 0, static_cast<int32_t>(tasks.size()), 1, [&ctx, &subtrees, &tasks](int32_t i, int32_t) {
+            const bvh_build_task& task = tasks[i];
+            subtrees[i].reserve(2 * task.count);
+            subtrees[i].emplace_back();
+            build_node(ctx, subtrees[i], 0, task.first, task.count, task.depth, 0, nullptr);
+        });
+        /* the subtree root replaces the placeholder, the other nodes are appended */
+        for (size_t i = 0; i < tasks.size(); i++) {
+            const auto& subtree = subtrees[i];
+            int32_t base = static_cast<int32_t>(nodes.size()) - 1;
+            for (size_t j = 0; j < subtree.size(); j++) {
+                bvh_node node = subtree[j];
+                if (node.count == 0) {
+                    node.left_first += base;
+                }
+                if (j == 0) {
+                    nodes[tasks[i].node] = node;
+                } else {
+                    nodes.push_back(node);
+                }
+            }
+        }
+        m_build_stats.task_count = static_cast<int32_t>(tasks.size());
+    }
+    m_nodes.assign(nodes.begin(), nodes.end());
+    m_indices.assign(indices.begin(), indices.end());
+
+    index_subtree(0, -1);
+    m_reference_cost = m_cost_sum;
+
+    m_build_stats.build_msec = t.get_elapsed_msec();
+    m_build_stats.sah_cost = get_sah_cost();
+    m_build_stats.node_count = static_cast<int32_t>(m_nodes.size());
+}
+
+/* bvh::attach */
+void bvh::attach(std::span<const bvh_node> nodes, std::span<const int32_t> indices, std::span<const int32_t> unbounded,
+    int32_t primitive_count, bvh_build_mode mode, std::shared_ptr<const void> storage)
+{
+    m_nodes.attach(nodes, storage);
+    m_indices.attach(indices, std::move(storage));
+    m_unbounded.assign(unbounded.begin(), unbounded.end());
+    m_leaf_oriented.clear();
+    m_oriented.clear();
+    m_build_stats = bvh_build_stats();
+    m_build_stats.mode = mode;
+    m_update_stats = bvh_update_stats();
+
+    m_leaf_of.assign(primitive_count, -1);
+    m_parents.clear();
+    m_build_area.clear();
+    m_degraded.clear();
+    m_degraded_list.clear();
+    m_garbage = 0;
+    m_cost_sum = 0.0;
+    if (!m_nodes.empty()) {
+        index_subtree(0, -1);
+        /* the nodes left unreachable by the subtree rebuilds before the save */
+        for (size_t i = 1; i < m_nodes.size(); i++) {
+            m_garbage += m_parents[i] == -1;
+        }
+    }
+    m_reference_cost = m_cost_sum;
+    m_build_stats.sah_cost = get_sah_cost();
+    m_build_stats.node_count = static_cast<int32_t>(m_nodes.size());
+}
+
+/* bvh::closest_hit */
+int32_t bvh::closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id) const
+{
+    float dist_near;
+    int32_t dist_sub;
+    int32_t ret = -1;
+    near = tmax;
+    sub_id = -1;
+
+    /* primitives behind the closest hit are rejected by the test itself */
+    auto test_primitive = [&](int32_t i) {
+        if (primitive_intersection_test(primitives[i], ray, tmin, near, dist_near, dist_sub)
+            && (dist_near < near || (dist_near == near && (ret == -1 || i < ret)))) {
+            near = dist_near;
+            ret = i;
+            sub_id = dist_sub;
+        }
+    };
+
+    for (int32_t i: m_unbounded) {
+        test_primitive(i);
+    }
+    traverse(ray, tmin, near, test_primitive);
+    return ret;
+}
+
+/* bvh::closest_hit */
+int32_t bvh::closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near,
+    bvh_traversal_stats& stats) const
+{
+    float dist_near;
+    int32_t dist_sub;
+    int32_t sub_id;
+    int32_t ret = -1;
+    near = tmax;
+    auto test_primitive = [&](int32_t i) {
+        stats.tests++;
+        if (primitive_intersection_test(primitives[i], ray, tmin, near, dist_near, dist_sub)
+            && (dist_near < near || (dist_near == near && (ret == -1 || i < ret)))) {
+            near = dist_near;
+            ret = i;
+            sub_id = dist_sub;
+        }
+    };
+
+    for (int32_t i: m_unbounded) {
+        test_primitive(i);
+    }
+    walk_leaves<true>(ray, tmin, near, [&](int32_t leaf) {
+        const bvh_node& node = m_nodes[leaf];
+        for (int32_t i = node.left_first; i < node.left_first + node.count && near >= tmin; i++) {
+            test_primitive(m_indices[i]);
+        }
+    }, [](int32_t) {}, &stats);
+    return ret;
+}
+
+/* bvh::occluded */
+bool bvh::occluded(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax) const
+{
+    for (int32_t i: m_unbounded) {
+        if (primitive_occlusion_test(primitives[i], ray, tmin, tmax)) {
+            return true;
+        }
+    }
+    bool ret = false;
+    float near = tmax;
+    traverse(ray, tmin, near, [&](int32_t i) {
+        if (primitive_occlusion_test(primitives[i], ray, tmin, tmax)) {
+            ret = true;
+            near = -std::numeric_limits<float>::infinity();
+        }
+    });
+    return ret;
+}
+
+/* bvh::closest_hit_packet */
+void bvh::closest_hit_packet(const block_vector<compiled_primitive>& primitives, const ray_packet& packet, uint32_t active, int32_t* ids, float* near,
+    int32_t* sub_ids) const
+{
+    alignas(32) float dist_near[ray_packet::width];
+    int32_t dist_sub[ray_packet::width];
+    for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+        ids[lane] = -1;
+        near[lane] = packet.tmax[lane];
+        sub_ids[lane] = -1;
+    }
+
+    /* the tie rule of closest_hit() per hit lane */
+    auto test_primitive = [&](int32_t i, uint32_t mask) {
+        for (uint32_t hit = primitive_packet_intersection_test(primitives[i], packet, mask, near, dist_near, dist_sub); hit; hit &= hit - 1) {
+            int32_t lane = std::countr_zero(hit);
+            if (dist_near[lane] < near[lane] || (dist_near[lane] == near[lane] && (ids[lane] == -1 || i < ids[lane]))) {
+                near[lane] = dist_near[lane];
+                ids[lane] = i;
+                sub_ids[lane] = dist_sub[lane];
+            }
+        }
+    };
+
+    for (int32_t i: m_unbounded) {
+        test_primitive(i, active);
+    }
+    traverse_packet(packet, active, near, test_primitive);
+}
+
+/* bvh::occluded_packet */
+uint32_t bvh::occluded_packet(const block_vector<compiled_primitive>& primitives, const ray_packet& packet, uint32_t active) const
+{
+    uint32_t ret = 0;
+    for (int32_t i: m_unbounded) {
+        ret |= primitive_packet_occlusion_test(primitives[i], packet, active & ~ret);
+        if (ret == active) {
+            return ret;
+        }
+    }
+    /* an occluded lane leaves the traversal */
+    alignas(32) float near[ray_packet::width];
+    for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+        near[lane] = (ret >> lane) & 1u ? -std::numeric_limits<float>::infinity() : packet.tmax[lane];
+    }
+    traverse_packet(packet, active & ~ret, near, [&](int32_t i, uint32_t mask) {
+        for (uint32_t hit = primitive_packet_occlusion_test(primitives[i], packet, mask); hit; hit &= hit - 1) {
+            int32_t lane = std::countr_zero(hit);
+            ret |= 1u << lane;
+            near[lane] = -std::numeric_limits<float>::infinity();
+        }
+    });
+    return ret;
+}
+
+/* bvh::orient_leaves */
+void bvh::orient_leaves(const block_vector<primitive>& primitives)
+{
+    m_leaf_oriented.assign(m_nodes.size(), -1);
+    m_oriented.clear();
+    for (int32_t i = 0; i < static_cast<int32_t>(m_nodes.size()); i++) {
+        if (m_nodes[i].count > 0) {
+            orient_leaf(primitives, i);
+        }
+    }
+}
+
+/* bvh::orient_leaf */
+void bvh::orient_leaf(const block_vector<primitive>& primitives, int32_t leaf)
+{
+    const bvh_node& node = m_nodes[leaf];
+    /* refit() reuses the slot of the leaf */
+    int32_t slot = m_leaf_oriented[leaf];
+    if (slot != -1) {
+        m_leaf_oriented.mutate(leaf) = -1;
+    }
+
+    /* the directions are summed with the sign of the longest one */
+    fvec3 longest(0.0f);
+    float longest_len = -1.0f;
+    for (int32_t k = node.left_first; k < node.left_first + node.count; k++) {
+        const primitive& p = primitives[m_indices[k]];
+        if (p.type != geometry_type::capsule) {
+            return;
+        }
+        fvec3 d = p.capsule.point2 - p.capsule.point1;
+        if (d.dot(d) > longest_len) {
+            longest_len = d.dot(d);
+            longest = d;
+        }
+    }
+    fvec3 sum(0.0f);
+    for (int32_t k = node.left_first; k < node.left_first + node.count; k++) {
+        const capsule_type& c = primitives[m_indices[k]].capsule;
+        fvec3 d = c.point2 - c.point1;
+        if (d.dot(longest) < 0.0f) {
+            sum -= d;
+        } else {
+            sum += d;
+        }
+    }
+    if (!(sum.dot(sum) > 0.0f)) {
+        return;
+    }
+
+    bvh_oriented_bounds ob;
+    ob.axes[0] = sum.normalize();
+    fvec3 helper = math::abs(ob.axes[0].x) < 0.9f ? fvec3(1.0f, 0.0f, 0.0f) : fvec3(0.0f, 1.0f, 0.0f);
+    ob.axes[1] = ob.axes[0].cross(helper).normalize();
+    ob.axes[2] = ob.axes[0].cross(ob.axes[1]);
+    auto to_frame = [&](const fvec3& p) {
+        return fvec3(p.dot(ob.axes[0]), p.dot(ob.axes[1]), p.dot(ob.axes[2]));
+    };
+    /* the capsules are their segments grown by the radius along every axis of the frame */
+    bounds_type frame;
+    float magnitude = 0.0f;
+    for (int32_t k = node.left_first; k < node.left_first + node.count; k++) {
+        const capsule_type& c = primitives[m_indices[k]].capsule;
+        fvec3 p1 = to_frame(c.point1);
+        fvec3 p2 = to_frame(c.point2);
+        frame.extend(bounds_type(p1 - c.radius, p1 + c.radius));
+        frame.extend(bounds_type(p2 - c.radius, p2 + c.radius));
+        magnitude = math::max(magnitude, math::max(c.point1.abs().max(), c.point2.abs().max()) + c.radius);
+    }
+    /* the items are only hit inside the leaf box (the sbvh references are clipped), its projection on
+     * the frame bounds them too */
+    fvec3 center = to_frame(node.bounds.center());
+    fvec3 half = node.bounds.max - node.bounds.center();
+    fvec3 reach(half.dot(ob.axes[0].abs()), half.dot(ob.axes[1].abs()), half.dot(ob.axes[2].abs()));
+    frame = bounds_overlap(frame, bounds_type(center - reach, center + reach));
+    if (frame.is_empty()) {
+        return;
+    }
+    /* the rotation rounds at the scale of the coordinates */
+    float pad = 1e-5f * magnitude;
+    frame = bounds_type(frame.min - pad, frame.max + pad);
+    fvec3 mid = frame.center();
+    ob.center = ob.axes[0] * mid.x + ob.axes[1] * mid.y + ob.axes[2] * mid.z;
+    ob.half = frame.max - mid;
+    if (frame.surface_area() < oriented_area_ratio * node.bounds.surface_area()) {
+        if (slot == -1) {
+            slot = static_cast<int32_t>(m_oriented.size());
+            m_oriented.push_back(ob);
+        } else {
+            m_oriented.mutate(slot) = ob;
+        }
+        m_leaf_oriented.mutate(leaf) = slot;
+    }
+}
+
+/* bvh::get_sah_cost */
+float bvh::get_sah_cost() const noexcept
+{
+    if (m_nodes.empty()) {
+        return 0.0f;
+    }
+    float root_area = m_nodes[0].bounds.surface_area();
+    if (root_area <= 0.0f) {
+        return 0.0f;
+    }
+    return static_cast<float>(m_cost_sum / root_area);
+}
+
+/* bvh::node_cost */
+double bvh::node_cost(const bvh_node& node) const noexcept
+{
+    float area = node.bounds.surface_area();
+    return node.count > 0 ? area * node.count * intersection_cost : area * traversal_cost;
+}
+
+/* bvh::index_subtree */
+void bvh::index_subtree(int32_t root, int32_t parent)
+{
+    const size_t size = m_nodes.size();
+    m_parents.resize(size, -1);
+    m_build_area.resize(size, 0.0f);
+    m_degraded.resize(size, 0);
+
+    std::vector<int32_t> stack{root};
+    m_parents.mutate(root) = parent;
+    while (!stack.empty()) {
+        int32_t i = stack.back();
+        stack.pop_back();
+        const bvh_node& node = m_nodes[i];
+        m_build_area.mutate(i) = node.bounds.surface_area();
+        if (m_degraded[i]) {
+            m_degraded.mutate(i) = 0;
+        }
+        m_cost_sum += node_cost(node);
+        if (node.count > 0) {
+            for (int32_t k = node.left_first; k < node.left_first + node.count; k++) {
+                m_leaf_of.mutate(m_indices[k]) = i;
+            }
+        } else {
+            m_parents.mutate(node.left_first) = i;
+            m_parents.mutate(node.left_first + 1) = i;
+            stack.push_back(node.left_first);
+            stack.push_back(node.left_first + 1);
+        }
+    }
+}
+
+/* bvh::rebuild_subtree */
+int32_t bvh::rebuild_subtree(const block_vector<primitive>& primitives, int32_t root)
+{
+    /* every subtree owns a contiguous range of m_indices */
+    int32_t lo = root;
+    int32_t hi = root;
+    while (m_nodes[lo].count == 0) {
+        lo = m_nodes[lo].left_first;
+    }
+    while (m_nodes[hi].count == 0) {
+        hi = m_nodes[hi].left_first + 1;
+    }
+    const int32_t first = m_nodes[lo].left_first;
+    const int32_t count = m_nodes[hi].left_first + m_nodes[hi].count - first;
+    int32_t depth = 0;
+    for (int32_t i = m_parents[root]; i != -1; i = m_parents[i]) {
+        depth++;
+    }
+
+    /* retire the old nodes */
+    std::vector<int32_t> stack{root};
+    while (!stack.empty()) {
+        int32_t i = stack.back();
+        stack.pop_back();
+        m_cost_sum -= node_cost(m_nodes[i]);
+        if (m_degraded[i]) {
+            m_degraded.mutate(i) = 0;
+        }
+        if (i != root) {
+            m_garbage++;
+        }
+        if (m_nodes[i].count == 0) {
+            stack.push_back(m_nodes[i].left_first);
+            stack.push_back(m_nodes[i].left_first + 1);
+        }
+    }
+
+    /* build over local primitive ids, then map them back */
+    std::vector<bounds_type> bounds(count);
+    std::vector<fvec3> centroids(count);
+    std::vector<int32_t> local(count);
+    std::vector<int32_t> ids(m_indices.begin() + first, m_indices.begin() + first + count);
+    for (int32_t j = 0; j < count; j++) {
+        primitive_bounds(primitives[ids[j]], bounds[j]);
+        centroids[j] = bounds[j].center();
+        local[j] = j;
+    }
+    bvh_build_context ctx{m_build_stats.mode, bounds, centroids, local, {}};
+    if (ctx.mode == bvh_build_mode::lbvh) {
+        morton_sort(ctx, nullptr);
+    }
+    std::vector<bvh_node> subtree;
+    subtree.reserve(2 * count);
+    subtree.emplace_back();
+    build_node(ctx, subtree, 0, 0, count, depth, 0, nullptr);
+    for (int32_t j = 0; j < count; j++) {
+        m_indices.mutate(first + j) = ids[local[j]];
+    }
+
+    int32_t base = static_cast<int32_t>(m_nodes.size()) - 1;
+    for (size_t j = 0; j < subtree.size(); j++) {
+        bvh_node node = subtree[j];
+        node.left_first += node.count == 0 ? base : first;
+        if (j == 0) {
+            m_nodes.mutate(root) = node;
+        } else {
+            m_nodes.push_back(node);
+        }
+    }
+    index_subtree(root, m_parents[root]);
+    return count;
+}
+
+/* bvh::refit */
+void bvh::refit(const block_vector<primitive>& primitives, const std::vector<int32_t>& moved)
+{
+    m_update_stats = bvh_update_stats();
+    if (m_build_stats.mode == bvh_build_mode::sbvh) {
+        /* the references were clipped to the old geometry and a primitive may be in several leaves */
+        if (!moved.empty()) {
+            bool oriented = !m_leaf_oriented.empty();
+            build(primitives, bvh_build_mode::sbvh, nullptr);
+            if (oriented) {
+                orient_leaves(primitives);
+            }
+            m_update_stats.rebuilt_subtrees = 1;
+            m_update_stats.rebuilt_primitives = static_cast<int32_t>(primitives.size());
+            m_update_stats.topology_changed = true;
+        }
+        m_update_stats.sah_cost = get_sah_cost();
+        return;
+    }
+    auto& changed = m_update_stats.changed_nodes;
+    auto same = [](const bounds_type& a, const bounds_type& b) {
+        return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z
+            && a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+    };
+
+    /* bottom-up, stops at the first node that keeps its bounds. Only the nodes on these paths are
+     * written, so a copy of the bvh copies only their blocks */
+    for (int32_t p: moved) {
+        for (int32_t i = m_leaf_of[p]; i != -1; i = m_parents[i]) {
+            const bvh_node& node = m_nodes[i];
+            bounds_type b;
+            if (node.count > 0) {
+                for (int32_t k = node.left_first; k < node.left_first + node.count; k++) {
+                    bounds_type pb;
+                    primitive_bounds(primitives[m_indices[k]], pb);
+                    b.extend(pb);
+                }
+            } else {
+                b = m_nodes[node.left_first].bounds;
+                b.extend(m_nodes[node.left_first + 1].bounds);
+            }
+            if (same(b, node.bounds)) {
+                break;
+            }
+            m_cost_sum -= node_cost(node);
+            /* node is not read after the write, mutate() may have copied its block */
+            bvh_node& written = m_nodes.mutate(i);
+            written.bounds = b;
+            m_cost_sum += node_cost(written);
+            changed.push_back(i);
+            if (!m_degraded[i] && b.surface_area() > m_build_area[i] * degraded_area_ratio) {
+                m_degraded.mutate(i) = 1;
+                m_degraded_list.push_back(i);
+            }
+        }
+    }
+    m_update_stats.refitted_nodes = static_cast<int32_t>(changed.size());
+
+    /* quality monitor, the cost is not normalized since a growing root would hide the degradation */
+    if (m_cost_sum > m_reference_cost * m_rebuild_threshold && !m_degraded_list.empty()) {
+        std::vector<int32_t> roots;
+        for (int32_t d: m_degraded_list) {
+            if (!m_degraded[d]) {
+                continue;
+            }
+            int32_t top = d;
+            for (int32_t i = m_parents[d]; i != -1; i = m_parents[i]) {
+                if (m_degraded[i]) {
+                    top = i;
+                }
+            }
+            if (std::find(roots.begin(), roots.end(), top) == roots.end()) {
+                roots.push_back(top);
+            }
+        }
+        for (int32_t root: roots) {
+            m_update_stats.rebuilt_primitives += rebuild_subtree(primitives, root);
+        }
+        m_degraded_list.clear();
+        m_update_stats.rebuilt_subtrees = static_cast<int32_t>(roots.size());
+        m_update_stats.topology_changed = true;
+
+        /* too many dead nodes, start over */
+        bool oriented = !m_leaf_oriented.empty();
+        if (m_garbage > static_cast<int32_t>(m_nodes.size()) / 2) {
+            build(primitives, m_build_stats.mode, nullptr);
+        }
+        if (oriented) {
+            orient_leaves(primitives);
+        }
+        m_reference_cost = math::max(m_reference_cost, m_cost_sum);
+    } else if (!m_leaf_oriented.empty()) {
+        for (int32_t i: changed) {
+            if (m_nodes[i].count > 0) {
+                orient_leaf(primitives, i);
+            }
+        }
+    }
+    m_update_stats.sah_cost = get_sah_cost();
+}
+
+} /* namespace green::core */
@@ -0,0 +1,461 @@
+#pragma once
+
+#include <bit>
+#include <limits>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "block_vector.hpp"
+#include "scene.hpp"
+#include "ray_intersection_test.hpp"
+#include "ray_packet.hpp"
+
+namespace green::core
+{
+
+class thread_pool;
+
+enum class bvh_build_mode
+{
+    sweep_sah,      /* exact surface area heuristic, sorts every axis at every node */
+    binned_sah,     /* surface area heuristic evaluated at 16 bins per axis */
+    lbvh,           /* split at the highest differing bit of the sorted morton codes */
+    /* binned_sah plus spatial splits: a primitive straddling the best plane may be split in two
+     * references clipped to each side, so it can be in several leaves. Capsules are clipped along
+     * their segment, the others (and all the items of the bounds build) as boxes. Serial, refit()
+     * rebuilds the whole tree */
+    sbvh
+};
+
+struct bvh_build_stats
+{
+    bvh_build_mode  mode = bvh_build_mode::sweep_sah;
+    double          build_msec = 0.0;
+    float           sah_cost = 0.0f;
+    int32_t         node_count = 0;
+    int32_t         task_count = 0;     /* subtrees built by the thread_pool workers */
+};
+
+/* result of the last bvh::refit() */
+struct bvh_update_stats
+{
+    int32_t                 refitted_nodes = 0;
+    int32_t                 rebuilt_subtrees = 0;
+    int32_t                 rebuilt_primitives = 0;
+    float                   sah_cost = 0.0f;
+    /* nodes were rebuilt, the changed_nodes are not enough to update derived structures */
+    bool                    topology_changed = false;
+    /* nodes with new bounds */
+    std::vector<int32_t>    changed_nodes;
+};
+
+/* counters of the closest_hit() overload taking them */
+struct bvh_traversal_stats
+{
+    int64_t         nodes = 0;          /* interior nodes and leaves popped from the stack */
+    int64_t         leaves = 0;
+    int64_t         oriented_culls = 0; /* leaves rejected by their oriented box */
+    int64_t         tests = 0;          /* primitive intersection tests */
+};
+
+/* box in the frame of the orthonormal axes, a leaf of capsules is often much tighter in the frame
+ * of their direction than in the world axes */
+struct bvh_oriented_bounds
+{
+    fvec3           axes[3];
+    fvec3           center;     /* world */
+    fvec3           half;       /* along the axes */
+
+    /* the slab test of bounds_type on the ray moved to the frame. The rotation rounds at the scale of
+     * the distance to the center, the box is grown by it */
+    bool            intersection_test(const ray_type& ray, float tmin, float tmax) const noexcept;
+};
+
+/* leaf: count > 0, left_first - first index in bvh::get_indices()
+ * interior: count == 0, left_first - left child, right child is left_first + 1 */
+struct bvh_node
+{
+    bounds_type     bounds;
+    int32_t         left_first;
+    int32_t         count;
+};
+
+/* bounding volume hierarchy over the bounded scene primitives. Planes have no finite bounds
+ * and are kept in a separate list that is tested for every ray. With a thread_pool the top
+ * of the tree is split on the calling thread and the subtrees below are built by the workers */
+class bvh
+{
+public:
+    static constexpr int32_t    max_leaf_size = 8;
+    static constexpr int32_t    max_depth = 60;
+    static constexpr float      traversal_cost = 1.0f;
+    static constexpr float      intersection_cost = 2.0f;
+    static constexpr int32_t    sah_bins = 16;
+    static constexpr int32_t    lbvh_leaf_size = 4;
+    /* subtrees with fewer primitives are not handed to the workers */
+    static constexpr int32_t    min_task_size = 4096;
+    /* refit marks nodes grown over this ratio of their area at build time as degraded */
+    static constexpr float      degraded_area_ratio = 1.5f;
+    /* sbvh: spatial splits are tried when the children of the object split overlap by this ratio
+     * of the root area, the splits stop when the duplicates reach this ratio of the primitives */
+    static constexpr float      sbvh_overlap_ratio = 1e-5f;
+    static constexpr float      sbvh_duplicate_ratio = 0.5f;
+    /* orient_leaves() keeps the oriented boxes under this ratio of the leaf area */
+    static constexpr float      oriented_area_ratio = 0.7f;
+
+public:
+                    bvh() = default;
+    explicit        bvh(const block_vector<primitive>& primitives, bvh_build_mode mode = bvh_build_mode::sweep_sah, thread_pool* pool = nullptr);
+
+    void            build(const block_vector<primitive>& primitives, bvh_build_mode mode = bvh_build_mode::sweep_sah, thread_pool* pool = nullptr);
+    /* over arbitrary boxes, item i is bounds[i], empty boxes go to get_unbounded(). Used for the
+     * instances of the top level, refit() is only valid for the primitive build */
+    void            build(const std::vector<bounds_type>& bounds, bvh_build_mode mode = bvh_build_mode::sweep_sah, thread_pool* pool = nullptr);
+
+    /* reads the nodes and the indices of a build() over primitive_count primitives in place (a mapped
+     * file), storage keeps their memory alive. The refit state is derived from the nodes, so refit()
+     * works as after the build and copies only the blocks it writes */
+    void            attach(std::span<const bvh_node> nodes, std::span<const int32_t> indices, std::span<const int32_t> unbounded,
+                        int32_t primitive_count, bvh_build_mode mode, std::shared_ptr<const void> storage);
+
+    /* updates the bounds of the leaves of the moved primitives and of their ancestors. When the
+     * SAH cost grows over rebuild_threshold times the cost after the last rebuild, the topmost
+     * degraded subtrees are rebuilt. Moved primitives have to stay bounded (not planes) */
+    void            refit(const block_vector<primitive>& primitives, const std::vector<int32_t>& moved);
+
+    /* adds an oriented box to the leaves holding only capsules, traverse() tests it before the items
+     * of the leaf. The axis is the mean direction of the capsules, the box is clipped to the one of
+     * the leaf. Cleared by build(), kept up to date by refit() */
+    void            orient_leaves(const block_vector<primitive>& primitives);
+
+    void            set_rebuild_threshold(float threshold) noexcept;
+    const bvh_update_stats&         get_update_stats() const noexcept;
+
+    /* the same result as raycast_brute_force(), including ties (the lowest index wins). Only the
+     * distance and the sub_id of primitive_intersection_test() are computed, the normals of the hit
+     * follow from them */
+    int32_t         closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near,
+                        int32_t& sub_id) const;
+
+    /* closest_hit() adding the visited nodes and the tests to stats, for the benchmarks */
+    int32_t         closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near,
+                        bvh_traversal_stats& stats) const;
+
+    /* any primitive hit, not necessarily the closest one */
+    bool            occluded(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax) const;
+
+    /* closest_hit() for the lanes in active sharing one traversal, ids, near and sub_ids are arrays of
+     * ray_packet::width (near 32 byte aligned). The result of each lane is the one of closest_hit() */
+    void            closest_hit_packet(const block_vector<compiled_primitive>& primitives, const ray_packet& packet, uint32_t active, int32_t* ids, float* near,
+                        int32_t* sub_ids) const;
+
+    /* occluded() for the lanes in active, returns the mask of the occluded lanes */
+    uint32_t        occluded_packet(const block_vector<compiled_primitive>& primitives, const ray_packet& packet, uint32_t active) const;
+
+    /* calls test(item) front to back for the bounded items in the leaves overlapping [tmin, near],
+     * test lowers near on a hit, a near below tmin ends the traversal. The unbounded items are left
+     * to the caller */
+    template <class F>
+    void            traverse(const ray_type& ray, float tmin, float& near, F&& test) const;
+
+    /* traverse() calling test(node) once per leaf, for the callers testing the items of a leaf
+     * together (triangle_mesh). The items are get_indices()[left_first, left_first + count) */
+    template <class F>
+    void            traverse_leaves(const ray_type& ray, float tmin, float& near, F&& test) const;
+
+    /* traverse_leaves() calling pushed(node) for the farther child when both children are pushed, before
+     * the nearer one is visited. For the callers whose leaves may be slow to read (a paged
+     * triangle_mesh), the farther one can be fetched meanwhile */
+    template <class F, class P>
+    void            traverse_leaves(const ray_type& ray, float tmin, float& near, F&& test, P&& pushed) const;
+
+    /* traverse() for the lanes in active: calls test(item, mask) for the leaves overlapping the rays
+     * of mask, near is the array of the lanes. A lane leaves the traversal when its near drops below
+     * the entry of a node or below its tmin. The nearer child for the first lane common to both is
+     * visited first */
+    template <class F>
+    void            traverse_packet(const ray_packet& packet, uint32_t active, float* near, F&& test) const;
+
+    /* traverse_packet() calling pushed(node) for the child visited second, as traverse_leaves() */
+    template <class F, class P>
+    void            traverse_packet(const ray_packet& packet, uint32_t active, float* near, F&& test, P&& pushed) const;
+
+    /* expected cost of a random ray relative to the root surface area */
+    float           get_sah_cost() const noexcept;
+
+    const bvh_build_stats&          get_build_stats() const noexcept;
+
+    const block_vector<bvh_node>&   get_nodes() const noexcept;
+    const block_vector<int32_t>&    get_indices() const noexcept;
+    const std::vector<int32_t>&     get_unbounded() const noexcept;
+
+private:
+    /* build() of the bounds, primitives is null for the bounds build (the items clipped as boxes by sbvh) */
+    void            build_nodes(const std::vector<bounds_type>& bounds, const block_vector<primitive>* primitives, bvh_build_mode mode, thread_pool* pool);
+    /* traverse_leaves(), Counted adds the visits to stats */
+    template <bool Counted, class F, class P>
+    void            walk_leaves(const ray_type& ray, float tmin, float& near, F&& test, P&& pushed, bvh_traversal_stats* stats) const;
+    void            orient_leaf(const block_vector<primitive>& primitives, int32_t leaf);
+    void            index_subtree(int32_t root, int32_t parent);
+    int32_t         rebuild_subtree(const block_vector<primitive>& primitives, int32_t root);
+    double          node_cost(const bvh_node& node) const noexcept;
+
+private:
+    /* in blocks: a copy of the bvh shares them, refit() copies only the blocks of the nodes it writes */
+    block_vector<bvh_node>  m_nodes;
+    block_vector<int32_t>   m_indices;      /* primitive indices referenced by the leaves */
+    std::vector<int32_t>    m_unbounded;    /* primitives tested for every ray */
+    block_vector<int32_t>   m_leaf_oriented;    /* node -> m_oriented index or -1, empty without orient_leaves() */
+    block_vector<bvh_oriented_bounds>   m_oriented;
+    bvh_build_stats         m_build_stats;
+
+    /* incremental update state */
+    block_vector<int32_t>   m_parents;
+    block_vector<int32_t>   m_leaf_of;          /* primitive index -> leaf, -1 for unbounded */
+    block_vector<float>     m_build_area;
+    block_vector<char>      m_degraded;
+    std::vector<int32_t>    m_degraded_list;
+    int32_t                 m_garbage = 0;      /* nodes unreachable after subtree rebuilds */
+    double                  m_cost_sum = 0.0;   /* get_sah_cost() * root surface area */
+    double                  m_reference_cost = 0.0;     /* m_cost_sum after the last (re)build */
+    float                   m_rebuild_threshold = 1.3f;
+    bvh_update_stats        m_update_stats;
+}; /* class bvh */
+
+
+
+/* bvh::get_nodes */
+inline const block_vector<bvh_node>& bvh::get_nodes() const noexcept
+{
+    return m_nodes;
+}
+
+/* bvh::get_indices */
+inline const block_vector<int32_t>& bvh::get_indices() const noexcept
+{
+    return m_indices;
+}
+
+/* bvh::get_build_stats */
+inline const bvh_build_stats& bvh::get_build_stats() const noexcept
+{
+    return m_build_stats;
+}
+
+/* bvh::set_rebuild_threshold */
+inline void bvh::set_rebuild_threshold(float threshold) noexcept
+{
+    m_rebuild_threshold = threshold;
+}
+
+/* bvh::get_update_stats */
+inline const bvh_update_stats& bvh::get_update_stats() const noexcept
+{
+    return m_update_stats;
+}
+
+/* bvh::get_unbounded */
+inline const std::vector<int32_t>& bvh::get_unbounded() const noexcept
+{
+    return m_unbounded;
+}
+
+/* bvh::traverse */
+template <class F>
+void bvh::traverse(const ray_type& ray, float tmin, float& near, F&& test) const
+{
+    traverse_leaves(ray, tmin, near, [&](int32_t leaf) {
+        const bvh_node& node = m_nodes[leaf];
+        for (int32_t i = node.left_first; i < node.left_first + node.count && near >= tmin; i++) {
+            test(m_indices[i]);
+        }
+    });
+}
+
+/* bvh_oriented_bounds::intersection_test */
+inline bool bvh_oriented_bounds::intersection_test(const ray_type& ray, float tmin, float tmax) const noexcept
+{
+    fvec3 o = ray.origin - center;
+    fvec3 ro(o.dot(axes[0]), o.dot(axes[1]), o.dot(axes[2]));
+    fvec3 rd(ray.dir.dot(axes[0]), ray.dir.dot(axes[1]), ray.dir.dot(axes[2]));
+    fvec3 h = half + 1e-5f * o.abs().max();
+    float near;
+    return bounds_type(fvec3(0.0f) - h, h).intersection_test(ro, ray_safe_inverse(rd), tmin, tmax, near);
+}
+
+/* bvh::traverse_leaves */
+template <class F>
+void bvh::traverse_leaves(const ray_type& ray, float tmin, float& near, F&& test) const
+{
+    walk_leaves<false>(ray, tmin, near, test, [](int32_t) {}, nullptr);
+}
+
+/* bvh::traverse_leaves */
+template <class F, class P>
+void bvh::traverse_leaves(const ray_type& ray, float tmin, float& near, F&& test, P&& pushed) const
+{
+    walk_leaves<false>(ray, tmin, near, test, pushed, nullptr);
+}
+
+/* bvh::walk_leaves */
+template <bool Counted, class F, class P>
+void bvh::walk_leaves(const ray_type& ray, float tmin, float& near, F&& test, P&& pushed, bvh_traversal_stats* stats) const
+{
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    struct stack_entry
+    {
+        int32_t node;
+        float   near;
+    };
+    stack_entry stack[max_depth + 4];
+    int32_t sp = 0;
+
+    float tl;
+    float tr;
+    if (m_nodes[0].bounds.intersection_test(ray.origin, ray.inv_dir, tmin, near, tl)) {
+        stack[sp++] = {0, tl};
+    }
+    while (sp > 0) {
+        stack_entry e = stack[--sp];
+        /* a closer hit was found after the node was pushed */
+        if (e.near > near) {
+            continue;
+        }
+        const bvh_node& node = m_nodes[e.node];
+        if constexpr (Counted) {
+            stats->nodes++;
+        }
+        if (node.count > 0) {
+            if constexpr (Counted) {
+                stats->leaves++;
+            }
+            if (!m_leaf_oriented.empty() && m_leaf_oriented[e.node] != -1
+                && !m_oriented[m_leaf_oriented[e.node]].intersection_test(ray, tmin, near)) {
+                if constexpr (Counted) {
+                    stats->oriented_culls++;
+                }
+                continue;
+            }
+            test(e.node);
+            if (near < tmin) {
+                return;
+            }
+            continue;
+        }
+        int32_t l = node.left_first;
+        int32_t r = l + 1;
+        bool hit_l = m_nodes[l].bounds.intersection_test(ray.origin, ray.inv_dir, tmin, near, tl);
+        bool hit_r = m_nodes[r].bounds.intersection_test(ray.origin, ray.inv_dir, tmin, near, tr);
+        if (hit_l && hit_r) {
+            /* the nearer child is popped first */
+            if (tl > tr) {
+                std::swap(l, r);
+                std::swap(tl, tr);
+            }
+            stack[sp++] = {r, tr};
+            stack[sp++] = {l, tl};
+            pushed(r);
+        } else if (hit_l) {
+            stack[sp++] = {l, tl};
+        } else if (hit_r) {
+            stack[sp++] = {r, tr};
+        }
+    }
+}
+
+/* bvh::traverse_packet */
+template <class F>
+void bvh::traverse_packet(const ray_packet& packet, uint32_t active, float* near, F&& test) const
+{
+    traverse_packet(packet, active, near, test, [](int32_t) {});
+}
+
+/* bvh::traverse_packet */
+template <class F, class P>
+void bvh::traverse_packet(const ray_packet& packet, uint32_t active, float* near, F&& test, P&& pushed) const
+{
+    if (m_nodes.empty() || active == 0) {
+        return;
+    }
+
+    struct stack_entry
+    {
+        int32_t     node;
+        uint32_t    mask;
+        float       near;   /* the nearest entry of the lanes of mask */
+    };
+    stack_entry stack[max_depth + 4];
+    int32_t sp = 0;
+
+    auto min_entry = [](uint32_t mask, const float* entry) {
+        float ret = entry[std::countr_zero(mask)];
+        for (mask &= mask - 1; mask; mask &= mask - 1) {
+            ret = math::min(ret, entry[std::countr_zero(mask)]);
+        }
+        return ret;
+    };
+    /* the lanes of mask still open behind dist */
+    auto open_lanes = [&](uint32_t mask, float dist) {
+        uint32_t ret = 0;
+        for (; mask; mask &= mask - 1) {
+            int32_t lane = std::countr_zero(mask);
+            if (near[lane] >= dist && near[lane] >= packet.tmin[lane]) {
+                ret |= 1u << lane;
+            }
+        }
+        return ret;
+    };
+
+    alignas(32) float tl[ray_packet::width];
+    alignas(32) float tr[ray_packet::width];
+    uint32_t mask = packet_bounds_test(m_nodes[0].bounds, packet, active, near, tl);
+    if (mask) {
+        stack[sp++] = {0, mask, min_entry(mask, tl)};
+    }
+    while (sp > 0) {
+        stack_entry e = stack[--sp];
+        /* the lanes with a closer hit found after the node was pushed are dropped */
+        mask = open_lanes(e.mask, e.near);
+        if (mask == 0) {
+            continue;
+        }
+        const bvh_node& node = m_nodes[e.node];
+        if (node.count > 0) {
+            for (int32_t i = node.left_first; i < node.left_first + node.count && mask; i++) {
+                test(m_indices[i], mask);
+                mask = open_lanes(mask, -std::numeric_limits<float>::infinity());
+            }
+            continue;
+        }
+        int32_t l = node.left_first;
+        int32_t r = l + 1;
+        uint32_t mask_l = packet_bounds_test(m_nodes[l].bounds, packet, mask, near, tl);
+        uint32_t mask_r = packet_bounds_test(m_nodes[r].bounds, packet, mask, near, tr);
+        if (mask_l && mask_r) {
+            float near_l = min_entry(mask_l, tl);
+            float near_r = min_entry(mask_r, tr);
+            uint32_t common = mask_l & mask_r;
+            bool swap = common ? tl[std::countr_zero(common)] > tr[std::countr_zero(common)] : near_l > near_r;
+            if (swap) {
+                stack[sp++] = {l, mask_l, near_l};
+                stack[sp++] = {r, mask_r, near_r};
+                pushed(l);
+            } else {
+                stack[sp++] = {r, mask_r, near_r};
+                stack[sp++] = {l, mask_l, near_l};
+                pushed(r);
+            }
+        } else if (mask_l) {
+            stack[sp++] = {l, mask_l, min_entry(mask_l, tl)};
+        } else if (mask_r) {
+            stack[sp++] = {r, mask_r, min_entry(mask_r, tr)};
+        }
+    }
+}
+
+} /* namespace green::core */
@@ -0,0 +1,287 @@
+#include "bvh_benchmark.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include <sys/resource.h>
+
+#include <core/timer.hpp>
+
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "compressed_bvh.hpp"
+#include "triangle_mesh.hpp"
+
+namespace green::core
+{
+
+struct benchmark_ray
+{
+    fvec3   origin;
+    fvec3   direction;
+};
+
+/* traces the rays through one layout, the hits of the first layout are the reference */
+template <class A>
+static void benchmark_layout(const char* name, const A& accel, size_t node_bytes, const block_vector<compiled_primitive>& primitives,
+    const std::vector<benchmark_ray>& rays, std::vector<int32_t>& reference)
+{
+    float near;
+    int32_t sub_id;
+    std::vector<int32_t> hits(rays.size());
+    timer t;
+    for (size_t i = 0; i < rays.size(); i++) {
+        hits[i] = accel.closest_hit(primitives, ray_type(rays[i].origin, rays[i].direction), 0.0f, std::numeric_limits<float>::infinity(), near, sub_id);
+    }
+    double msec = t.get_elapsed_msec();
+    if (reference.empty()) {
+        reference = hits;
+    }
+    int32_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        mismatches += hits[i] != reference[i];
+    }
+    std::cout << name << ": " << msec << " ms, " << static_cast<double>(rays.size()) / (msec * 1000.0) << " Mrays/s, node memory: "
+        << node_bytes / 1024 << " KiB, mismatches: " << mismatches << std::endl;
+}
+
+/* random rays starting inside the bounds */
+static std::vector<benchmark_ray> benchmark_rays(const bounds_type& bounds, int32_t ray_count)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<benchmark_ray> rays(ray_count);
+    for (auto& ray: rays) {
+        ray.origin = bounds.min + (bounds.max - bounds.min) * fvec3(unit(rng), unit(rng), unit(rng));
+        ray.direction = fvec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f).normalize_self();
+    }
+    return rays;
+}
+
+/* traces the rays through one build counting the visits, the hits of the first build are the reference */
+static void benchmark_build(const char* name, const bvh& accel, const block_vector<compiled_primitive>& primitives,
+    const std::vector<benchmark_ray>& rays, std::vector<int32_t>& reference)
+{
+    float near;
+    int32_t sub_id;
+    std::vector<int32_t> hits(rays.size());
+    timer t;
+    for (size_t i = 0; i < rays.size(); i++) {
+        hits[i] = accel.closest_hit(primitives, ray_type(rays[i].origin, rays[i].direction), 0.0f, std::numeric_limits<float>::infinity(), near, sub_id);
+    }
+    double msec = t.get_elapsed_msec();
+    bvh_traversal_stats stats;
+    for (size_t i = 0; i < rays.size(); i++) {
+        accel.closest_hit(primitives, ray_type(rays[i].origin, rays[i].direction), 0.0f, std::numeric_limits<float>::infinity(), near, stats);
+    }
+    if (reference.empty()) {
+        reference = hits;
+    }
+    int32_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        mismatches += hits[i] != reference[i];
+    }
+    double count = static_cast<double>(rays.size());
+    std::cout << name << ": build " << accel.get_build_stats().build_msec << " ms, " << accel.get_nodes().size() << " nodes, "
+        << accel.get_indices().size() << " references, sah cost: " << accel.get_sah_cost() << ", " << msec << " ms, "
+        << count / (msec * 1000.0) << " Mrays/s, per ray: " << stats.nodes / count << " nodes, " << stats.leaves / count << " leaves, "
+        << stats.oriented_culls / count << " oriented culls, " << stats.tests / count << " tests, mismatches: " << mismatches << std::endl;
+}
+
+/* page faults of the process so far, major (read from the disk) and minor */
+static int64_t process_page_faults()
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_majflt + usage.ru_minflt;
+}
+
+/* traces the rays through one mesh, one at a time or in batches of batch_size, the hits of the first run are the reference */
+static void benchmark_mesh(const char* name, const triangle_mesh& mesh, int32_t batch_size, const std::vector<benchmark_ray>& rays,
+    std::vector<int32_t>& reference)
+{
+    const int32_t count = static_cast<int32_t>(rays.size());
+    std::vector<ray_type> batch(batch_size);
+    std::vector<float> tmax(batch_size, std::numeric_limits<float>::infinity());
+    std::vector<float> near(batch_size);
+    std::vector<int32_t> hits(count);
+    int64_t process_faults = process_page_faults();
+    timer t;
+    if (batch_size <= 1) {
+        for (int32_t i = 0; i < count; i++) {
+            hits[i] = mesh.closest_hit(ray_type(rays[i].origin, rays[i].direction), 0.0f, std::numeric_limits<float>::infinity(), near[0]);
+        }
+    } else {
+        for (int32_t first = 0; first < count; first += batch_size) {
+            int32_t n = std::min(batch_size, count - first);
+            for (int32_t i = 0; i < n; i++) {
+                batch[i] = ray_type(rays[first + i].origin, rays[first + i].direction);
+            }
+            mesh.closest_hit_batch(batch.data(), n, 0.0f, tmax.data(), hits.data() + first, near.data());
+        }
+    }
+    double msec = t.get_elapsed_msec();
+    process_faults = process_page_faults() - process_faults;
+    if (reference.empty()) {
+        reference = hits;
+    }
+    int32_t mismatches = 0;
+    for (int32_t i = 0; i < count; i++) {
+        mismatches += hits[i] != reference[i];
+    }
+    std::cout << name << ": " << msec << " ms, " << count / (msec * 1000.0) << " Mrays/s";
+    if (const geometry_pager* pager = mesh.get_pager()) {
+        geometry_pager_stats stats = pager->get_stats();
+        int64_t accesses = std::max<int64_t>(1, stats.accesses + stats.deferred);
+        std::cout << ", pages: " << pager->get_max_resident_pages() << " of " << pager->get_page_count() << ", faults per access: "
+            << static_cast<double>(stats.faults) / accesses << ", process faults per access: " << static_cast<double>(process_faults) / accesses
+            << ", prefetches: " << stats.prefetches << ", evictions: " << stats.evictions << ", deferred leaves per ray: "
+            << static_cast<double>(stats.deferred) / count;
+    }
+    std::cout << ", mismatches: " << mismatches << std::endl;
+}
+
+/* bvh_benchmark_primitives */
+block_vector<primitive> bvh_benchmark_primitives(int32_t count, float size, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(-size, size);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<primitive> primitives;
+    primitives.reserve(count);
+    for (int32_t i = 0; i < count; i++) {
+        fvec3 c(pos(rng), pos(rng), pos(rng));
+        switch (i % 3) {
+        case 0:
+            primitives.emplace_back(sphere_type(c, 0.05f + 0.25f * unit(rng)));
+            break;
+        case 1:
+            primitives.emplace_back(capsule_type(c, c + fvec3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f), 0.02f + 0.08f * unit(rng)));
+            break;
+        default:
+            primitives.emplace_back(aabb_type(c, fvec3(0.05f + 0.25f * unit(rng), 0.05f + 0.25f * unit(rng), 0.05f + 0.25f * unit(rng))));
+            break;
+        }
+        primitives.back().diffuse = fvec3(unit(rng), unit(rng), unit(rng));
+    }
+    return block_vector<primitive>(primitives);
+}
+
+/* bvh_benchmark */
+void bvh_benchmark(const block_vector<primitive>& primitives, int32_t ray_count)
+{
+    bvh binary(primitives, bvh_build_mode::binned_sah);
+    if (binary.get_nodes().empty()) {
+        std::cout << "bvh_benchmark: no bounded primitives" << std::endl;
+        return;
+    }
+    wide_bvh<4> wide4(binary);
+    wide_bvh<8> wide8(binary);
+    compressed_bvh compressed(binary);
+
+    /* rays start inside the scene bounds */
+    std::vector<benchmark_ray> rays = benchmark_rays(binary.get_nodes()[0].bounds, ray_count);
+
+    std::cout << "bvh_benchmark: " << primitives.size() << " primitives, " << ray_count << " rays, primitive memory: "
+        << primitives.size() * sizeof(primitive) / 1024 << " KiB" << std::endl;
+    block_vector<compiled_primitive> compiled = compile_primitives(primitives);
+    std::vector<int32_t> reference;
+    benchmark_layout("bvh2", binary, binary.get_nodes().size() * sizeof(bvh_node), compiled, rays, reference);
+    benchmark_layout("bvh4", wide4, wide4.get_nodes().size() * sizeof(wide_bvh_node<4>), compiled, rays, reference);
+    benchmark_layout("bvh8", wide8, wide8.get_nodes().size() * sizeof(wide_bvh_node<8>), compiled, rays, reference);
+    benchmark_layout("bvh4 compressed", compressed, compressed.get_nodes().size() * sizeof(compressed_bvh_node), compiled, rays, reference);
+}
+
+/* bvh_benchmark_capsule_lattice */
+block_vector<primitive> bvh_benchmark_capsule_lattice(int32_t cells, float length, float radius)
+{
+    std::vector<primitive> primitives;
+    primitives.reserve(3 * cells * cells * cells);
+    for (int32_t x = 0; x < cells; x++) {
+        for (int32_t y = 0; y < cells; y++) {
+            for (int32_t z = 0; z < cells; z++) {
+                fvec3 p(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+                primitives.emplace_back(capsule_type(p, p + fvec3(length, length, length), radius));
+                primitives.emplace_back(capsule_type(p + fvec3(length, 0.0f, 0.0f), p + fvec3(0.0f, length, 0.0f), radius));
+                primitives.emplace_back(capsule_type(p + fvec3(0.0f, 0.0f, length), p + fvec3(0.0f, length, 0.0f), radius));
+            }
+        }
+    }
+    return block_vector<primitive>(primitives);
+}
+
+/* bvh_benchmark_splits */
+void bvh_benchmark_splits(const block_vector<primitive>& primitives, int32_t ray_count)
+{
+    bvh binned(primitives, bvh_build_mode::binned_sah);
+    if (binned.get_nodes().empty()) {
+        std::cout << "bvh_benchmark_splits: no bounded primitives" << std::endl;
+        return;
+    }
+    bvh spatial(primitives, bvh_build_mode::sbvh);
+    std::vector<benchmark_ray> rays = benchmark_rays(binned.get_nodes()[0].bounds, ray_count);
+
+    std::cout << "bvh_benchmark_splits: " << primitives.size() << " primitives, " << ray_count << " rays" << std::endl;
+    block_vector<compiled_primitive> compiled = compile_primitives(primitives);
+    std::vector<int32_t> reference;
+    benchmark_build("binned sah", binned, compiled, rays, reference);
+    benchmark_build("sbvh", spatial, compiled, rays, reference);
+    binned.orient_leaves(primitives);
+    spatial.orient_leaves(primitives);
+    benchmark_build("binned sah oriented", binned, compiled, rays, reference);
+    benchmark_build("sbvh oriented", spatial, compiled, rays, reference);
+}
+
+/* bvh_benchmark_triangles */
+void bvh_benchmark_triangles(int32_t count, float size, uint32_t seed, std::vector<fvec3>& vertices, std::vector<int32_t>& indices)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(-size, size);
+    std::uniform_real_distribution<float> edge(-0.5f, 0.5f);
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(3 * count);
+    indices.reserve(3 * count);
+    for (int32_t i = 0; i < count; i++) {
+        fvec3 c(pos(rng), pos(rng), pos(rng));
+        for (int32_t k = 0; k < 3; k++) {
+            indices.push_back(static_cast<int32_t>(vertices.size()));
+            vertices.push_back(c + fvec3(edge(rng), edge(rng), edge(rng)));
+        }
+    }
+}
+
+/* bvh_benchmark_paged */
+void bvh_benchmark_paged(const std::vector<fvec3>& vertices, const std::vector<int32_t>& indices, int32_t ray_count, const std::string& directory)
+{
+    constexpr int32_t batch_size = 4096;
+    triangle_mesh memory(vertices, indices);
+    if (memory.get_accel().get_nodes().empty()) {
+        std::cout << "bvh_benchmark_paged: no bounded triangles" << std::endl;
+        return;
+    }
+    std::vector<benchmark_ray> rays = benchmark_rays(memory.get_bounds(), ray_count);
+    std::cout << "bvh_benchmark_paged: " << memory.get_triangle_count() << " triangles, " << ray_count << " rays" << std::endl;
+    std::vector<int32_t> reference;
+    benchmark_mesh("memory", memory, 1, rays, reference);
+
+    /* all the pages, then a quarter and a sixteenth of them */
+    triangle_mesh paged(vertices, indices);
+    if (!paged.page_out(directory + "/benchmark.pages", std::numeric_limits<int32_t>::max())) {
+        return;
+    }
+    geometry_pager* pager = paged.get_pager();
+    const int32_t page_count = pager->get_page_count();
+    for (int32_t divisor: {1, 4, 16}) {
+        std::string name = "paged 1/" + std::to_string(divisor);
+        pager->set_max_resident_pages(page_count / divisor);
+        pager->reset_stats();
+        benchmark_mesh((name + " single").c_str(), paged, 1, rays, reference);
+        pager->reset_stats();
+        benchmark_mesh((name + " batch").c_str(), paged, batch_size, rays, reference);
+    }
+}
+
+} /* namespace green::core */
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "scene.hpp"
+
+namespace green::core
+{
+
+/* random spheres, capsules and boxes in a cube of the given size, the same for the same seed */
+block_vector<primitive> bvh_benchmark_primitives(int32_t count, float size, uint32_t seed);
+
+/* capsules along the body diagonal and two face diagonals of a length^3 cube from every point of a
+ * cells^3 lattice of unit cells: long thin capsules crossing each other, their boxes overlap a lot */
+block_vector<primitive> bvh_benchmark_capsule_lattice(int32_t cells, float length, float radius);
+
+/* traces the same random rays through the binned_sah and sbvh builds, with and without oriented
+ * leaves, and prints the time and the nodes visited and primitives tested per ray of each */
+void bvh_benchmark_splits(const block_vector<primitive>& primitives, int32_t ray_count);
+
+/* traces the same random rays through every node layout built over the primitives and prints the
+ * time, the node memory and the mismatches against bvh::closest_hit() of each layout */
+void bvh_benchmark(const block_vector<primitive>& primitives, int32_t ray_count);
+
+/* random small triangles in a cube of the given size, vertices and indices for triangle_mesh */
+void bvh_benchmark_triangles(int32_t count, float size, uint32_t seed, std::vector<fvec3>& vertices, std::vector<int32_t>& indices);
+
+/* traces the same random rays through a mesh of the triangles kept in memory and paged out to
+ * directory with several residency budgets, one ray at a time and in batches. Prints the time, the
+ * faults per page access of the pager and of the process and the mismatches against the memory mesh */
+void bvh_benchmark_paged(const std::vector<fvec3>& vertices, const std::vector<int32_t>& indices, int32_t ray_count, const std::string& directory);
+
+} /* namespace green::core */
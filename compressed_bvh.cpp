@@ -0,0 +1,416 @@
+#include "compressed_bvh.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "ray_intersection_test.hpp"
+
+namespace green::core
+{
+
+/* per ray invariants of the node slab test */
+struct compressed_ray_type
+{
+    fvec3           origin;
+    fvec3           inv_dir;
+    float           tmin;
+};
+
+/* the same rounding margin as bounds_type::intersection_test() */
+constexpr float compressed_far_scale = 1.0f + 2.0f * 3.0f * std::numeric_limits<float>::epsilon() * 0.5f;
+constexpr int32_t compressed_min_exponent = -126;
+constexpr int32_t compressed_max_exponent = 127;
+
+/* 2^exponent built from the bits, exponent is in [-126, 127] */
+static inline float exponent_scale(int32_t exponent)
+{
+    return std::bit_cast<float>(static_cast<uint32_t>(exponent + 127) << 23);
+}
+
+/* quantizes one axis of n child boxes into the frame starting at origin, returns the exponent of the
+ * frame. The decoded min never exceeds lo and the decoded max is never below hi */
+static int32_t quantize_axis(float origin, float extent, const float* lo, const float* hi, int32_t n, uint8_t* qmin, uint8_t* qmax)
+{
+    int32_t exponent = compressed_min_exponent;
+    if (extent > 0.0f) {
+        exponent = math::clamp(static_cast<int32_t>(std::ceil(std::log2(extent / 255.0f))), compressed_min_exponent, compressed_max_exponent);
+    }
+    for (;; exponent++) {
+        float scale = exponent_scale(exponent);
+        bool fits = true;
+        for (int32_t i = 0; i < n && fits; i++) {
+            int32_t a = math::clamp(static_cast<int32_t>(std::floor((lo[i] - origin) / scale)), 0, 255);
+            while (a > 0 && origin + static_cast<float>(a) * scale > lo[i]) {
+                a--;
+            }
+            float bf = std::ceil((hi[i] - origin) / scale);
+            if (bf > 255.0f) {
+                fits = false;
+                break;
+            }
+            int32_t b = math::max(static_cast<int32_t>(bf), a);
+            while (b <= 255 && origin + static_cast<float>(b) * scale < hi[i]) {
+                b++;
+            }
+            fits = b <= 255;
+            qmin[i] = static_cast<uint8_t>(a);
+            qmax[i] = static_cast<uint8_t>(b);
+        }
+        if (fits || exponent == compressed_max_exponent) {
+            return exponent;
+        }
+    }
+}
+
+/* bounds_type::intersection_test() of every valid lane on the decoded boxes */
+static inline uint32_t node_intersection_test_scalar(const compressed_bvh_node& node, const compressed_ray_type& ray, float max_dist, float* near)
+{
+    float sx = exponent_scale(node.exponent_x);
+    float sy = exponent_scale(node.exponent_y);
+    float sz = exponent_scale(node.exponent_z);
+    uint32_t mask = 0;
+    for (int32_t lane = 0; lane < compressed_bvh::width; lane++) {
+        if (!(node.valid_mask & (1u << lane))) {
+            continue;
+        }
+        bounds_type b(fvec3(node.origin_x + static_cast<float>(node.min_x[lane]) * sx,
+                node.origin_y + static_cast<float>(node.min_y[lane]) * sy,
+                node.origin_z + static_cast<float>(node.min_z[lane]) * sz),
+            fvec3(node.origin_x + static_cast<float>(node.max_x[lane]) * sx,
+                node.origin_y + static_cast<float>(node.max_y[lane]) * sy,
+                node.origin_z + static_cast<float>(node.max_z[lane]) * sz));
+        if (b.intersection_test(ray.origin, ray.inv_dir, ray.tmin, max_dist, near[lane])) {
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#if defined(__SSE2__)
+/* 4 quantized offsets to floats */
+static inline __m128 decode_sse(const uint8_t* q, float origin, float scale)
+{
+    int32_t packed;
+    __builtin_memcpy(&packed, q, sizeof(packed));
+    __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+    return _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(scale)));
+}
+
+/* the scalar test for the 4 lanes at once, the decoded boxes are bit exact */
+static inline uint32_t node_intersection_test_sse(const compressed_bvh_node& node, const compressed_ray_type& ray, float max_dist, float* near)
+{
+    __m128 ox = _mm_set1_ps(ray.origin.x);
+    __m128 oy = _mm_set1_ps(ray.origin.y);
+    __m128 oz = _mm_set1_ps(ray.origin.z);
+    __m128 ix = _mm_set1_ps(ray.inv_dir.x);
+    __m128 iy = _mm_set1_ps(ray.inv_dir.y);
+    __m128 iz = _mm_set1_ps(ray.inv_dir.z);
+    float sx = exponent_scale(node.exponent_x);
+    float sy = exponent_scale(node.exponent_y);
+    float sz = exponent_scale(node.exponent_z);
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(decode_sse(node.min_x, node.origin_x, sx), ox), ix);
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(decode_sse(node.min_y, node.origin_y, sy), oy), iy);
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(decode_sse(node.min_z, node.origin_z, sz), oz), iz);
+    __m128 t2x = _mm_mul_ps(_mm_sub_ps(decode_sse(node.max_x, node.origin_x, sx), ox), ix);
+    __m128 t2y = _mm_mul_ps(_mm_sub_ps(decode_sse(node.max_y, node.origin_y, sy), oy), iy);
+    __m128 t2z = _mm_mul_ps(_mm_sub_ps(decode_sse(node.max_z, node.origin_z, sz), oz), iz);
+    __m128 tN = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_min_ps(t1z, t2z));
+    __m128 tF = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_max_ps(t1z, t2z));
+    tF = _mm_mul_ps(tF, _mm_set1_ps(compressed_far_scale));
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(tN, tF), _mm_cmpge_ps(tF, _mm_set1_ps(ray.tmin)));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(tN, _mm_set1_ps(max_dist)));
+    _mm_storeu_ps(near, tN);
+    return static_cast<uint32_t>(_mm_movemask_ps(hit)) & node.valid_mask;
+}
+#endif
+
+/* returns the mask of the intersected lanes, near is written for these lanes */
+static inline uint32_t node_intersection_test(const compressed_bvh_node& node, const compressed_ray_type& ray, float max_dist, float* near)
+{
+#if defined(__SSE2__)
+    return node_intersection_test_sse(node, ray, max_dist, near);
+#else
+    return node_intersection_test_scalar(node, ray, max_dist, near);
+#endif
+}
+
+/* compressed_bvh::compressed_bvh */
+compressed_bvh::compressed_bvh(const bvh& binary)
+{
+    build(binary);
+}
+
+/* compressed_bvh::build */
+void compressed_bvh::build(const bvh& binary)
+{
+    /* the leaves reference the same ranges, the blocks of indices are shared with the binary bvh */
+    m_indices = binary.get_indices();
+    m_unbounded.assign(binary.get_unbounded().begin(), binary.get_unbounded().end());
+    std::vector<compressed_bvh_node> nodes;
+    std::vector<int32_t> lanes;
+    std::vector<int32_t> node_of(binary.get_nodes().size(), -1);
+    if (!binary.get_nodes().empty()) {
+        nodes.reserve(binary.get_nodes().size() / (width - 1) + 1);
+        collapse(binary, 0, nodes, lanes, node_of);
+    }
+    m_nodes.assign(nodes.begin(), nodes.end());
+    m_lanes.assign(lanes.begin(), lanes.end());
+    m_node_of.assign(node_of.begin(), node_of.end());
+}
+
+/* compressed_bvh::attach */
+void compressed_bvh::attach(std::span<const compressed_bvh_node> nodes, std::span<const int32_t> indices, std::span<const int32_t> unbounded,
+    std::span<const int32_t> lanes, std::span<const int32_t> node_of, std::shared_ptr<const void> storage)
+{
+    m_nodes.attach(nodes, storage);
+    m_indices.attach(indices, storage);
+    m_unbounded.attach(unbounded, storage);
+    m_lanes.attach(lanes, storage);
+    m_node_of.attach(node_of, std::move(storage));
+}
+
+/* compressed_bvh::refit */
+void compressed_bvh::refit(const bvh& binary)
+{
+    const bvh_update_stats& stats = binary.get_update_stats();
+    /* nodes attached without their m_node_of */
+    if (stats.topology_changed || m_node_of.size() != binary.get_nodes().size()) {
+        build(binary);
+        return;
+    }
+    /* the changed binary nodes are paths to the root, the nodes holding them are the paths of this tree */
+    std::vector<int32_t> changed;
+    for (int32_t i: stats.changed_nodes) {
+        if (m_node_of[i] != -1) {
+            changed.push_back(m_node_of[i]);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    for (int32_t k: changed) {
+        int32_t children[width];
+        int32_t n = 0;
+        while (n < width && m_lanes[k * width + n] != -1) {
+            children[n] = m_lanes[k * width + n];
+            n++;
+        }
+        encode(binary, children, n, m_nodes.mutate(k));
+    }
+}
+
+/* compressed_bvh::collapse */
+int32_t compressed_bvh::collapse(const bvh& binary, int32_t binary_index, std::vector<compressed_bvh_node>& out, std::vector<int32_t>& lanes,
+    std::vector<int32_t>& node_of)
+{
+    const auto& nodes = binary.get_nodes();
+    int32_t children[width];
+    int32_t n = 0;
+    if (nodes[binary_index].count > 0) {
+        /* the root is a leaf */
+        children[n++] = binary_index;
+    } else {
+        children[n++] = nodes[binary_index].left_first;
+        children[n++] = nodes[binary_index].left_first + 1;
+    }
+    /* open the interior child with the largest surface area until the node is full */
+    while (n < width) {
+        int32_t best = -1;
+        float best_area = -1.0f;
+        for (int32_t i = 0; i < n; i++) {
+            const bvh_node& child = nodes[children[i]];
+            if (child.count == 0 && child.bounds.surface_area() > best_area) {
+                best_area = child.bounds.surface_area();
+                best = i;
+            }
+        }
+        if (best == -1) {
+            break;
+        }
+        int32_t opened = children[best];
+        children[best] = nodes[opened].left_first;
+        children[n++] = nodes[opened].left_first + 1;
+    }
+
+    int32_t index = static_cast<int32_t>(out.size());
+    out.emplace_back();
+    {
+        compressed_bvh_node& node = out[index];
+        node = compressed_bvh_node();
+        encode(binary, children, n, node);
+        for (int32_t lane = n; lane < width; lane++) {
+            node.child[lane] = -1;
+        }
+    }
+    lanes.resize(out.size() * width, -1);
+    for (int32_t lane = 0; lane < n; lane++) {
+        lanes[index * width + lane] = children[lane];
+        node_of[children[lane]] = index;
+    }
+    for (int32_t lane = 0; lane < n; lane++) {
+        const bvh_node& child = nodes[children[lane]];
+        /* collapse() appends to out, the reference is taken after it */
+        int32_t child_index = child.count > 0 ? child.left_first : collapse(binary, children[lane], out, lanes, node_of);
+        compressed_bvh_node& node = out[index];
+        node.child[lane] = child_index;
+        node.count[lane] = static_cast<int16_t>(child.count);
+    }
+    return index;
+}
+
+/* compressed_bvh::encode */
+void compressed_bvh::encode(const bvh& binary, const int32_t* children, int32_t n, compressed_bvh_node& node)
+{
+    /* the frame is the union of the children */
+    bounds_type frame;
+    float lo[3][width];
+    float hi[3][width];
+    for (int32_t i = 0; i < n; i++) {
+        const bounds_type& b = binary.get_nodes()[children[i]].bounds;
+        frame.extend(b);
+        lo[0][i] = b.min.x;
+        lo[1][i] = b.min.y;
+        lo[2][i] = b.min.z;
+        hi[0][i] = b.max.x;
+        hi[1][i] = b.max.y;
+        hi[2][i] = b.max.z;
+    }
+    node.origin_x = frame.min.x;
+    node.origin_y = frame.min.y;
+    node.origin_z = frame.min.z;
+    fvec3 extent = frame.max - frame.min;
+    node.exponent_x = static_cast<int8_t>(quantize_axis(frame.min.x, extent.x, lo[0], hi[0], n, node.min_x, node.max_x));
+    node.exponent_y = static_cast<int8_t>(quantize_axis(frame.min.y, extent.y, lo[1], hi[1], n, node.min_y, node.max_y));
+    node.exponent_z = static_cast<int8_t>(quantize_axis(frame.min.z, extent.z, lo[2], hi[2], n, node.min_z, node.max_z));
+    node.valid_mask = static_cast<uint8_t>((1u << n) - 1);
+}
+
+/* compressed_bvh::closest_hit */
+int32_t compressed_bvh::closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id) const
+{
+    float dist_near;
+    int32_t dist_sub;
+    int32_t ret = -1;
+    near = tmax;
+    sub_id = -1;
+
+    /* primitives behind the closest hit are rejected by the test itself */
+    auto test_primitive = [&](int32_t i) {
+        if (primitive_intersection_test(primitives[i], ray, tmin, near, dist_near, dist_sub)
+            && (dist_near < near || (dist_near == near && (ret == -1 || i < ret)))) {
+            near = dist_near;
+            ret = i;
+            sub_id = dist_sub;
+        }
+    };
+
+    for (int32_t i: m_unbounded) {
+        test_primitive(i);
+    }
+    if (m_nodes.empty()) {
+        return ret;
+    }
+
+    compressed_ray_type node_ray{ray.origin, ray.inv_dir, tmin};
+
+    /* count > 0 - leaf, otherwise child is a node */
+    struct stack_entry
+    {
+        int32_t     child;
+        int32_t     count;
+        float       near;
+    };
+    stack_entry stack[max_stack_size];
+    int32_t sp = 0;
+    stack[sp++] = {0, 0, tmin};
+
+    alignas(16) float dist[width];
+    int32_t order[width];
+    while (sp > 0) {
+        stack_entry e = stack[--sp];
+        /* a closer hit was found after the entry was pushed */
+        if (e.near > near) {
+            continue;
+        }
+        if (e.count > 0) {
+            for (int32_t i = e.child; i < e.child + e.count; i++) {
+                test_primitive(m_indices[i]);
+            }
+            continue;
+        }
+        const compressed_bvh_node& node = m_nodes[e.child];
+        uint32_t mask = node_intersection_test(node, node_ray, near, dist);
+        /* insertion sort of the intersected lanes by distance */
+        int32_t hits = 0;
+        while (mask != 0) {
+            int32_t lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            int32_t k = hits++;
+            while (k > 0 && dist[order[k - 1]] > dist[lane]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = lane;
+        }
+        /* the nearest child is popped first */
+        for (int32_t k = hits - 1; k >= 0; k--) {
+            int32_t lane = order[k];
+            stack[sp++] = {node.child[lane], node.count[lane], dist[lane]};
+        }
+    }
+    return ret;
+}
+
+/* compressed_bvh::occluded */
+bool compressed_bvh::occluded(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax) const
+{
+    for (int32_t i: m_unbounded) {
+        if (primitive_occlusion_test(primitives[i], ray, tmin, tmax)) {
+            return true;
+        }
+    }
+    if (m_nodes.empty()) {
+        return false;
+    }
+
+    compressed_ray_type node_ray{ray.origin, ray.inv_dir, tmin};
+
+    /* count > 0 - leaf, otherwise child is a node */
+    struct stack_entry
+    {
+        int32_t     child;
+        int32_t     count;
+    };
+    stack_entry stack[max_stack_size];
+    int32_t sp = 0;
+    stack[sp++] = {0, 0};
+
+    alignas(16) float dist[width];
+    while (sp > 0) {
+        stack_entry e = stack[--sp];
+        if (e.count > 0) {
+            for (int32_t i = e.child; i < e.child + e.count; i++) {
+                if (primitive_occlusion_test(primitives[m_indices[i]], ray, tmin, tmax)) {
+                    return true;
+                }
+            }
+            continue;
+        }
+        const compressed_bvh_node& node = m_nodes[e.child];
+        uint32_t mask = node_intersection_test(node, node_ray, tmax, dist);
+        while (mask != 0) {
+            int32_t lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            stack[sp++] = {node.child[lane], node.count[lane]};
+        }
+    }
+    return false;
+}
+
+} /* namespace green::core */
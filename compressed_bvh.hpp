@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "block_vector.hpp"
+#include "bvh.hpp"
+
+namespace green::core
+{
+
+/* 4 children in one cache line. The child boxes are 8 bit offsets in the frame of the node:
+ * min = origin + q * 2^exponent, the offsets are rounded outwards so the boxes never shrink.
+ * lane: count > 0 - leaf, child - first index in compressed_bvh::get_indices()
+ *       count == 0 - interior, child - index of the node
+ *       not in valid_mask - empty */
+struct alignas(64) compressed_bvh_node
+{
+    float           origin_x;
+    float           origin_y;
+    float           origin_z;
+    int8_t          exponent_x;
+    int8_t          exponent_y;
+    int8_t          exponent_z;
+    uint8_t         valid_mask;
+    uint8_t         min_x[4];
+    uint8_t         min_y[4];
+    uint8_t         min_z[4];
+    uint8_t         max_x[4];
+    uint8_t         max_y[4];
+    uint8_t         max_z[4];
+    int32_t         child[4];
+    int16_t         count[4];
+};
+
+static_assert(sizeof(compressed_bvh_node) == 64);
+
+/* 4 wide bvh with quantized child boxes, 64 bytes a node, half the memory of wide_bvh<4> nodes. The
+ * boxes are slightly larger than the exact ones, so a ray visits a few more nodes */
+class compressed_bvh
+{
+public:
+    static constexpr int32_t    width = 4;
+    static constexpr int32_t    max_stack_size = bvh::max_depth * (width - 1) + 2;
+
+public:
+                    compressed_bvh() = default;
+    explicit        compressed_bvh(const bvh& binary);
+
+    void            build(const bvh& binary);
+
+    /* follows bvh::refit(): a node is quantized in the frame of its lanes, so the nodes holding a changed
+     * lane are quantized again unless the topology changed. A copy shares the blocks of nodes with its
+     * source, the refit copies the blocks of the nodes it writes */
+    void            refit(const bvh& binary);
+
+    /* the same result as bvh::closest_hit() */
+    int32_t         closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near,
+                        int32_t& sub_id) const;
+
+    /* the same result as bvh::occluded(), the children are not sorted */
+    bool            occluded(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax) const;
+
+    /* traverses nodes stored elsewhere (a mapped file), storage keeps the memory alive. Nothing is
+     * copied. lanes and node_of are get_lanes() and get_node_of() of the build, refit() then quantizes
+     * the nodes again as after it. Without them refit() builds again */
+    void            attach(std::span<const compressed_bvh_node> nodes, std::span<const int32_t> indices, std::span<const int32_t> unbounded,
+                        std::span<const int32_t> lanes, std::span<const int32_t> node_of, std::shared_ptr<const void> storage);
+
+    const block_vector<compressed_bvh_node>&    get_nodes() const noexcept;
+    const block_vector<int32_t>&                get_indices() const noexcept;
+    const block_vector<int32_t>&                get_unbounded() const noexcept;
+    /* node * width + lane -> binary node, -1 for the empty lanes */
+    const block_vector<int32_t>&                get_lanes() const noexcept;
+    /* binary node -> node with it as a lane, -1 if collapsed */
+    const block_vector<int32_t>&                get_node_of() const noexcept;
+
+private:
+    /* appends the node of binary_index and its subtree to nodes */
+    static int32_t  collapse(const bvh& binary, int32_t binary_index, std::vector<compressed_bvh_node>& nodes, std::vector<int32_t>& lanes,
+                        std::vector<int32_t>& node_of);
+    /* the frame and the quantized boxes of the n lanes over the binary nodes children */
+    static void     encode(const bvh& binary, const int32_t* children, int32_t n, compressed_bvh_node& node);
+
+private:
+    /* owned blocks or attached memory, a copy of the compressed_bvh shares both */
+    block_vector<compressed_bvh_node>   m_nodes;
+    block_vector<int32_t>               m_indices;
+    block_vector<int32_t>               m_unbounded;
+    block_vector<int32_t>               m_lanes;        /* node * width + lane -> binary node, -1 for the empty lanes */
+    block_vector<int32_t>               m_node_of;      /* binary node -> node with it as a lane, -1 if collapsed. Empty when unknown */
+}; /* class compressed_bvh */
+
+
+
+/* compressed_bvh::get_nodes */
+inline const block_vector<compressed_bvh_node>& compressed_bvh::get_nodes() const noexcept
+{
+    return m_nodes;
+}
+
+/* compressed_bvh::get_indices */
+inline const block_vector<int32_t>& compressed_bvh::get_indices() const noexcept
+{
+    return m_indices;
+}
+
+/* compressed_bvh::get_unbounded */
+inline const block_vector<int32_t>& compressed_bvh::get_unbounded() const noexcept
+{
+    return m_unbounded;
+}
+
+/* compressed_bvh::get_lanes */
+inline const block_vector<int32_t>& compressed_bvh::get_lanes() const noexcept
+{
+    return m_lanes;
+}
+
+/* compressed_bvh::get_node_of */
+inline const block_vector<int32_t>& compressed_bvh::get_node_of() const noexcept
+{
+    return m_node_of;
+}
+
+} /* namespace green::core */
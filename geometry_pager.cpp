@@ -0,0 +1,240 @@
+#include "geometry_pager.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace green::core
+{
+
+/* geometry_pager::~geometry_pager */
+geometry_pager::~geometry_pager()
+{
+    close();
+}
+
+/* geometry_pager::open */
+bool geometry_pager::open(const std::string& path, size_t page_size, int32_t max_resident_pages)
+{
+    close();
+    const long system_page_size = ::sysconf(_SC_PAGESIZE);
+    if (page_size == 0 || (system_page_size > 0 && page_size % static_cast<size_t>(system_page_size) != 0)) {
+        std::cout << "geometry_pager::open() error: the page size " << page_size << " is not a multiple of the system page size" << std::endl;
+        return false;
+    }
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cout << "geometry_pager::open() error: cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        std::cout << "geometry_pager::open() error: " << path << " is empty" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        std::cout << "geometry_pager::open() error: cannot map " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    /* the traversal jumps between the pages, the kernel read ahead is left to prefetch() */
+    ::madvise(data, size, MADV_RANDOM);
+
+    /* the fd is kept for the page cache advice */
+    m_fd = fd;
+    m_data = static_cast<const char*>(data);
+    m_size = size;
+    m_page_size = page_size;
+    m_page_count = static_cast<int32_t>((size + page_size - 1) / page_size);
+    set_max_resident_pages(max_resident_pages);
+    m_state = std::make_unique<std::atomic<uint8_t>[]>(m_page_count);
+    m_last_use = std::make_unique<std::atomic<uint64_t>[]>(m_page_count);
+    m_prefetch_epoch = std::make_unique<std::atomic<uint64_t>[]>(m_page_count);
+    for (int32_t i = 0; i < m_page_count; i++) {
+        m_state[i].store(absent, std::memory_order_relaxed);
+        m_last_use[i].store(0, std::memory_order_relaxed);
+        m_prefetch_epoch[i].store(0, std::memory_order_relaxed);
+    }
+    m_epoch.store(1, std::memory_order_relaxed);
+    m_lru.assign(m_page_count, lru_link());
+    m_lru_front = -1;
+    m_lru_back = -1;
+    m_lru_count = 0;
+    reset_stats();
+    return true;
+}
+
+/* geometry_pager::close */
+void geometry_pager::close()
+{
+    if (m_data) {
+        ::munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_size = 0;
+    m_page_count = 0;
+    m_lru.clear();
+    m_lru_front = -1;
+    m_lru_back = -1;
+    m_lru_count = 0;
+}
+
+/* geometry_pager::advise */
+void geometry_pager::advise(int32_t page, int advice) const
+{
+    const size_t offset = static_cast<size_t>(page) * m_page_size;
+    const size_t size = std::min(m_page_size, m_size - offset);
+    ::madvise(const_cast<char*>(m_data) + offset, size, advice);
+    ::posix_fadvise(m_fd, static_cast<off_t>(offset), static_cast<off_t>(size), advice == MADV_DONTNEED ? POSIX_FADV_DONTNEED : POSIX_FADV_WILLNEED);
+}
+
+/* geometry_pager::push_back */
+void geometry_pager::push_back(int32_t page)
+{
+    lru_link& link = m_lru[page];
+    link.prev = m_lru_back;
+    link.next = -1;
+    link.use = m_last_use[page].load(std::memory_order_relaxed);
+    if (m_lru_back != -1) {
+        m_lru[m_lru_back].next = page;
+    } else {
+        m_lru_front = page;
+    }
+    m_lru_back = page;
+    m_lru_count++;
+}
+
+/* geometry_pager::unlink */
+void geometry_pager::unlink(int32_t page)
+{
+    lru_link& link = m_lru[page];
+    if (link.prev != -1) {
+        m_lru[link.prev].next = link.next;
+    } else {
+        m_lru_front = link.next;
+    }
+    if (link.next != -1) {
+        m_lru[link.next].prev = link.prev;
+    } else {
+        m_lru_back = link.prev;
+    }
+    link.prev = -1;
+    link.next = -1;
+    m_lru_count--;
+}
+
+/* geometry_pager::evict_to */
+void geometry_pager::evict_to(int32_t count)
+{
+    /* touch() of a resident page only stamps m_last_use, without the lock. A page touched since it was
+     * queued is moved to the back when it reaches the front, at most once a pass over the list, so an
+     * eviction costs O(1) for every touch in between */
+    const int32_t listed = m_lru_count;
+    int32_t requeued = 0;
+    while (m_lru_count > count) {
+        const int32_t page = m_lru_front;
+        unlink(page);
+        if (requeued < listed && m_last_use[page].load(std::memory_order_relaxed) > m_lru[page].use) {
+            push_back(page);
+            requeued++;
+            continue;
+        }
+        m_state[page].store(absent, std::memory_order_release);
+        advise(page, MADV_DONTNEED);
+        m_epoch.fetch_add(1, std::memory_order_relaxed);
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/* geometry_pager::fault */
+void geometry_pager::fault(int32_t page)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_state[page].load(std::memory_order_relaxed) == resident) {
+        return;
+    }
+    m_faults.fetch_add(1, std::memory_order_relaxed);
+    evict_to(get_max_resident_pages() - 1);
+    advise(page, MADV_WILLNEED);
+    m_last_use[page].store(m_clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    push_back(page);
+    m_state[page].store(resident, std::memory_order_release);
+}
+
+/* geometry_pager::make_resident */
+void geometry_pager::make_resident(int32_t page)
+{
+    if (m_state[page].load(std::memory_order_acquire) != resident) {
+        fault(page);
+    }
+    m_last_use[page].store(m_clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+/* geometry_pager::prefetch */
+void geometry_pager::prefetch(int32_t page)
+{
+    if (m_state[page].load(std::memory_order_acquire) == resident) {
+        return;
+    }
+    /* a page prefetched a budget of evictions ago and not touched since would have been evicted if it
+     * had been resident, it is asked again */
+    const uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+    uint64_t last = m_prefetch_epoch[page].load(std::memory_order_relaxed);
+    if (last != 0 && epoch - last < static_cast<uint64_t>(get_max_resident_pages())) {
+        return;
+    }
+    if (m_prefetch_epoch[page].compare_exchange_strong(last, epoch, std::memory_order_relaxed)) {
+        advise(page, MADV_WILLNEED);
+        m_prefetches.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/* geometry_pager::set_max_resident_pages */
+void geometry_pager::set_max_resident_pages(int32_t max_resident_pages)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_resident.store(std::max(1, max_resident_pages), std::memory_order_relaxed);
+    evict_to(m_max_resident.load(std::memory_order_relaxed));
+}
+
+/* geometry_pager::get_stats */
+geometry_pager_stats geometry_pager::get_stats() const noexcept
+{
+    geometry_pager_stats stats;
+    stats.accesses = m_accesses.load(std::memory_order_relaxed);
+    stats.faults = m_faults.load(std::memory_order_relaxed);
+    stats.prefetches = m_prefetches.load(std::memory_order_relaxed);
+    stats.evictions = m_evictions.load(std::memory_order_relaxed);
+    stats.deferred = m_deferred.load(std::memory_order_relaxed);
+    return stats;
+}
+
+/* geometry_pager::reset_stats */
+void geometry_pager::reset_stats() noexcept
+{
+    m_accesses.store(0, std::memory_order_relaxed);
+    m_faults.store(0, std::memory_order_relaxed);
+    m_prefetches.store(0, std::memory_order_relaxed);
+    m_evictions.store(0, std::memory_order_relaxed);
+    m_deferred.store(0, std::memory_order_relaxed);
+}
+
+/* geometry_pager::get_resident_page_count */
+int32_t geometry_pager::get_resident_page_count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lru_count;
+}
+
+} /* namespace green::core */
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace green::core
+{
+
+/* counters of a geometry_pager since the last reset_stats() */
+struct geometry_pager_stats
+{
+    int64_t         accesses = 0;       /* touch() calls */
+    int64_t         faults = 0;         /* touch() and make_resident() of pages that were not resident */
+    int64_t         prefetches = 0;     /* prefetch() of pages neither resident nor prefetched recently */
+    int64_t         evictions = 0;
+    int64_t         deferred = 0;       /* leaves queued by the batch traversals until their page is resident */
+};
+
+/* read only file of fixed size pages, mapped whole, with at most max_resident_pages of them kept in
+ * memory. The least recently touched page is dropped from the mapping and from the page cache when a
+ * page over the budget is made resident. The data stays valid when a page is evicted under a reader,
+ * the next access reads it from the file again, so the residency only decides the memory and the
+ * faults, never the results. touch() of a resident page takes no lock */
+class geometry_pager
+{
+public:
+                    geometry_pager() = default;
+                    geometry_pager(const geometry_pager&) = delete;
+                    ~geometry_pager();
+
+    geometry_pager& operator=(const geometry_pager&) = delete;
+
+    /* page_size is a multiple of the system page size. Returns false and prints the error when the
+     * file can not be mapped */
+    bool            open(const std::string& path, size_t page_size, int32_t max_resident_pages);
+    void            close();
+
+    /* page is about to be read by the calling thread, it is made resident first when it is not */
+    void            touch(int32_t page);
+    /* touch() without counting the access, for the batches serving the rays queued on page */
+    void            make_resident(int32_t page);
+    /* asks the kernel to read page ahead, the traversal goes on without waiting. The page is read into
+     * the page cache and not counted against the budget until it is touched. It is asked again when
+     * prefetch() comes back to it after max_resident_pages evictions, the kernel may have dropped it */
+    void            prefetch(int32_t page);
+    bool            is_resident(int32_t page) const noexcept;
+
+    /* a smaller budget evicts the least recently touched pages over it */
+    void            set_max_resident_pages(int32_t max_resident_pages);
+
+    geometry_pager_stats    get_stats() const noexcept;
+    void                    reset_stats() noexcept;
+    void                    add_deferred(int64_t count) noexcept;
+
+    const void*     get_data() const noexcept;
+    size_t          get_page_size() const noexcept;
+    int32_t         get_page_count() const noexcept;
+    int32_t         get_max_resident_pages() const noexcept;
+    int32_t         get_resident_page_count() const;
+
+private:
+    enum page_state : uint8_t
+    {
+        absent,
+        resident
+    };
+
+    /* links of a resident page in the lru list */
+    struct lru_link
+    {
+        int32_t     prev = -1;
+        int32_t     next = -1;
+        uint64_t    use = 0;        /* m_last_use when the page was queued at the back */
+    };
+
+    void            fault(int32_t page);
+    /* evicts the least recently touched pages until count remain, m_mutex is held */
+    void            evict_to(int32_t count);
+    /* m_mutex is held */
+    void            push_back(int32_t page);
+    void            unlink(int32_t page);
+    void            advise(int32_t page, int advice) const;
+
+private:
+    int             m_fd = -1;
+    const char*     m_data = nullptr;
+    size_t          m_size = 0;
+    size_t          m_page_size = 0;
+    int32_t         m_page_count = 0;
+    std::atomic<int32_t>    m_max_resident{0};
+    std::unique_ptr<std::atomic<uint8_t>[]>     m_state;
+    std::unique_ptr<std::atomic<uint64_t>[]>    m_last_use;     /* m_clock at the last touch() */
+    std::unique_ptr<std::atomic<uint64_t>[]>    m_prefetch_epoch;   /* m_epoch at the last prefetch(), 0 for none */
+    std::atomic<uint64_t>   m_clock{0};
+    std::atomic<uint64_t>   m_epoch{1};     /* 1 + the evictions since open() */
+    mutable std::mutex      m_mutex;        /* the lru list and the transitions to and from resident */
+    std::vector<lru_link>   m_lru;          /* by page, the resident pages from the least recently used one */
+    int32_t                 m_lru_front = -1;
+    int32_t                 m_lru_back = -1;
+    int32_t                 m_lru_count = 0;
+
+    std::atomic<int64_t>    m_accesses{0};
+    std::atomic<int64_t>    m_faults{0};
+    std::atomic<int64_t>    m_prefetches{0};
+    std::atomic<int64_t>    m_evictions{0};
+    std::atomic<int64_t>    m_deferred{0};
+}; /* class geometry_pager */
+
+
+
+/* geometry_pager::touch */
+inline void geometry_pager::touch(int32_t page)
+{
+    m_accesses.fetch_add(1, std::memory_order_relaxed);
+    if (m_state[page].load(std::memory_order_acquire) != resident) {
+        fault(page);
+    }
+    m_last_use[page].store(m_clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+/* geometry_pager::is_resident */
+inline bool geometry_pager::is_resident(int32_t page) const noexcept
+{
+    return m_state[page].load(std::memory_order_acquire) == resident;
+}
+
+/* geometry_pager::add_deferred */
+inline void geometry_pager::add_deferred(int64_t count) noexcept
+{
+    m_deferred.fetch_add(count, std::memory_order_relaxed);
+}
+
+/* geometry_pager::get_data */
+inline const void* geometry_pager::get_data() const noexcept
+{
+    return m_data;
+}
+
+/* geometry_pager::get_page_size */
+inline size_t geometry_pager::get_page_size() const noexcept
+{
+    return m_page_size;
+}
+
+/* geometry_pager::get_page_count */
+inline int32_t geometry_pager::get_page_count() const noexcept
+{
+    return m_page_count;
+}
+
+/* geometry_pager::get_max_resident_pages */
+inline int32_t geometry_pager::get_max_resident_pages() const noexcept
+{
+    return m_max_resident.load(std::memory_order_relaxed);
+}
+
+} /* namespace green::core */
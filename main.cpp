@@ -6,7 +6,14 @@
 #include <vector>
 #include <string>
 #include <thread>
-
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <bit>
+#include <limits>
+#include <utility>
+
+#include "parallel.hpp"
 #include "thread_pool.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -18,18 +25,30 @@
 #include <core/timer.hpp>
 #include <engine/camera.hpp>
 #include "ray_intersection_test.hpp"
+#include "scene.hpp"
+#include "scene_snapshot.hpp"
+#include "bvh.hpp"
+#include "bvh_benchmark.hpp"
+#include "ray_packet.hpp"
+#include "scene_cache.hpp"
+#include "scene_codegen.hpp"
+#include "baked_scene.hpp"
+#include "triangle_mesh.hpp"
+#include "mesh_loader.hpp"
+#include "tile_scheduler.hpp"
+#include "thread_pool_benchmark.hpp"
 
 using namespace green::core;
 using namespace green::core::math;
 
-using pixel_storage_fvec3 = basic_matrix<fvec3>;
-
 typedef unsigned char   byte;
 typedef unsigned short  word;
 typedef unsigned int    dword;
 
 constexpr word bitmap_signature = 0x4d42;
 
+constexpr float ray_max_distance = std::numeric_limits<float>::infinity();
+
 #pragma pack(push, 1)
 struct bitmap_file_header   /* 14 bytes */
 {
@@ -81,7 +100,8 @@ struct bitmap_header
 };
 #pragma pack(pop)
 
-bool bitmap_save_to_file(const pixel_storage_fvec3& image, const std::string& filename)
+/* the rows are converted on the pool, then written at once */
+bool bitmap_save_to_file(const pixel_storage_fvec3& image, const std::string& filename, thread_pool* pool = nullptr)
 {
     bitmap_header full;
 
@@ -103,30 +123,27 @@ bool bitmap_save_to_file(const pixel_storage_fvec3& image, const std::string& fi
         return false;
     }
 
-    auto buf_size = image.get_columns() * 3;
-    byte* buffer = new byte[buf_size];
-    bool ret = true;
+    size_t buf_size = static_cast<size_t>(image.get_columns()) * 3;
+    std::vector<byte> buffer(buf_size * image.get_rows());
 
     /* Write bitmap data */
-    for (int i = 0; i < image.get_rows(); i++) {
-        auto* data = image.get_row_ptr(image.get_rows() - i - 1);
-        auto* dst = buffer;
-        for (int j = 0; j < image.get_columns(); j++) {
-            *dst++ = static_cast<byte>(data->b * 255.0);
-            *dst++ = static_cast<byte>(data->g * 255.0);
-            *dst++ = static_cast<byte>(data->r * 255.0);
-            data++;
-        }
-        if (!file.write(static_cast<char*>(static_cast<void*>(buffer)), buf_size)) {
-            std::cout << "image::save_to_file() error: writing error" << std::endl;
-            ret = false;
-            goto go_ret;
+    parallel_for(pool, 0, image.get_rows(), 16, [&](int32_t lo, int32_t hi) {
+        for (int i = lo; i < hi; i++) {
+            auto* data = image.get_row_ptr(image.get_rows() - i - 1);
+            auto* dst = buffer.data() + buf_size * i;
+            for (int j = 0; j < image.get_columns(); j++) {
+                *dst++ = static_cast<byte>(data->b * 255.0);
+                *dst++ = static_cast<byte>(data->g * 255.0);
+                *dst++ = static_cast<byte>(data->r * 255.0);
+                data++;
+            }
         }
+    });
+    if (!file.write(static_cast<char*>(static_cast<void*>(buffer.data())), buffer.size())) {
+        std::cout << "image::save_to_file() error: writing error" << std::endl;
+        return false;
     }
-
-go_ret:
-    delete[] buffer;
-    return ret;
+    return true;
 }
 
 pixel_storage_fvec3 bitmap_load_from_file(const std::string& filename) {
@@ -221,112 +238,6 @@ bool plane_intersection_test(const fvec3& origin, const fvec3& direction, const
 }
 
 
-struct aabb_type
-{
-    aabb_type(const fvec3& center, const fvec3& size)
-        : center(center)
-        , size(size)
-    {}
-
-    fvec3 center;
-    fvec3 size;
-};
-
-struct plane_type
-{
-    plane_type(const fvec3& pos, const fvec3& norm)
-        : position{pos}
-        , normal{norm}
-    {}
-
-    fvec3 position;
-    fvec3 normal;
-};
-
-struct sphere_type
-{
-    sphere_type(const fvec3& pos, float r)
-        : position{pos}
-        , radius{r}
-    {}
-
-    fvec3 position;
-    float radius;
-};
-
-struct capsule_type
-{
-    capsule_type(const fvec3& p1, const fvec3& p2, float r)
-        : point1{p1}
-        , point2{p2}
-        , radius{r}
-    {}
-
-    fvec3 point1;
-    fvec3 point2;
-    float radius;
-};
-
-enum geometry_type
-{
-    plane,
-    sphere,
-    capsule,
-    aabb
-};
-
-struct primitive
-{
-    primitive(const sphere_type& sphere)
-        : type(geometry_type::sphere)
-        , sphere(sphere)
-    {}
-
-    primitive(const plane_type& plane)
-        : type(geometry_type::plane)
-        , plane(plane)
-    {}
-
-    primitive(const capsule_type& capsule)
-        : type(geometry_type::capsule)
-        , capsule(capsule)
-    {}
-
-    primitive(const aabb_type& aabb)
-        : type(geometry_type::aabb)
-        , aabb(aabb)
-    {}
-
-    geometry_type       type;
-    //                  цвет
-    fvec3              diffuse;
-    //                  Отраженная часть (reflection)
-    //                  Преломленная часть (refraction)
-    float               specular;
-    //                  шероховатость
-    float               roughness;
-
-    float               glowing = 0.0f;
-
-    bool                transparent = false;
-    union
-    {
-        plane_type      plane;
-        sphere_type     sphere;
-        capsule_type    capsule;
-        aabb_type       aabb;
-    };
-};
-
-struct scene
-{
-    int32_t                 skip_index = -1;
-    std::vector<primitive>  primitives;
-    fvec3                  light_dir;
-    fvec3                  light_color;
-    pixel_storage_fvec3    sky;
-};
-
 fvec3 getSky(const scene& s, const fvec3& rd)
 {
     float u = (math::atan2(rd.x, rd.y) / pi) * 0.5 + 0.5;
@@ -353,47 +264,6 @@ fvec3 refract(const fvec3& direction, const fvec3& normal, float eta)
     return eta * direction - (eta * dotndir + std::sqrt(k)) * normal;
 }
 
-int raycast(const scene& s, int skip_index, const fvec3& origin, const fvec3& direction, float& near, float& far, fvec3& normal_near, fvec3& normal_far)
-{
-    bool cur_result;
-    float dist_near;
-    float dist_far;
-    fvec3 far_normal;
-    fvec3 near_normal;
-    near = 9e99;
-    int i = 0;
-    int ret = -1;
-    for (auto p: s.primitives) {
-        if (skip_index == i) {
-            i++;
-            continue;
-        }
-        switch (p.type) {
-        case geometry_type::plane:
-            cur_result = ray_pane_intersection_test(origin, direction, p.plane.normal, p.plane.position.dot(p.plane.normal), dist_near, near_normal);
-            break;
-        case geometry_type::sphere:
-            cur_result = ray_sphere_intersection_test(origin, direction, p.sphere.position, p.sphere.radius, dist_near, dist_far, near_normal, far_normal);
-            break;
-        case geometry_type::capsule:
-            cur_result = ray_capsule_intersection_test(origin, direction, p.capsule.point1, p.capsule.point2, p.capsule.radius, dist_near, dist_far, near_normal, far_normal);
-            break;
-        case geometry_type::aabb:
-            cur_result = ray_aabb_intersection_test(origin, direction, p.aabb.center, p.aabb.size, dist_near, dist_far, near_normal, far_normal);
-            break;
-        }
-        if (cur_result && dist_near < near) {
-            near = dist_near;
-            far = dist_far;
-            normal_near = near_normal;
-            normal_far = far_normal;
-            ret = i;
-        }
-        i++;
-    }
-    return ret;
-}
-
 float frand(float min, float max)
 {
     return min + static_cast<float>(rand()) / static_cast<float>(RAND_MAX) * (max - min);
@@ -404,7 +274,32 @@ float mix(float a, float b, float coef)
     return a * (1.0f - coef) + b * coef;
 }
 
-void simple_rendering(scene& s, const fvec3& origin, pixel_storage_fvec3& img)
+/* the primary rays of the pixels x0 .. x0 + 7 of a row, returns the mask of the lanes inside the image */
+uint32_t primary_span_packet(const fvec3& origin, int x0, int width, float half_width, float dx, float z_p, ray_packet& packet)
+{
+    uint32_t active = 0;
+    for (int lane = 0; lane < ray_packet::width && x0 + lane < width; lane++) {
+        fvec3 direction(static_cast<float>(x0 + lane - half_width) * dx, 1.0, z_p);
+        direction.normalize_self();
+        packet.set(lane, origin, direction, 0.0f, ray_max_distance);
+        active |= 1u << lane;
+    }
+    return active;
+}
+
+/* the shadow rays towards the light from the hits of the lanes in mask, returns the occluded lanes */
+uint32_t shadow_packet_occluded(const scene& s, const ray_packet& primary, const ray_packet_hit& hit, uint32_t mask, const fvec3& light)
+{
+    ray_packet shadow;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int lane = std::countr_zero(m);
+        fvec3 intersect = intersection_point(primary.origin(lane), primary.direction(lane), hit.near[lane]);
+        shadow.set(lane, intersect, light, raycast_epsilon(intersect), ray_max_distance);
+    }
+    return raycast_occluded_packet(s, shadow, mask);
+}
+
+void simple_rendering(const scene& s, const fvec3& origin, pixel_storage_fvec3& img, thread_pool* pool)
 {
     float ratio = static_cast<float>(img.get_columns()) / img.get_rows();
     float dx = (1.0 / img.get_columns()) * ratio;
@@ -413,60 +308,55 @@ void simple_rendering(scene& s, const fvec3& origin, pixel_storage_fvec3& img)
     float half_height = img.get_rows() / 2.0;
 
     fvec3 light = -s.light_dir;
-    fvec3 far_n;
-    float far;
 
-    for (int y = 0; y < img.get_rows(); y++) {
-        fvec3* data = img.get_row_ptr(y);
-        float z_p = static_cast<float>(half_height - y) * dy;
-        for (int x = 0; x < img.get_columns(); x++) {
-            fvec3 direction(static_cast<float>(x - half_width) * dx, 1.0, z_p);
-            direction.normalize_self();
-
-            float dist;
-            fvec3 norm;
-            fvec3 intersect;
-
-            s.skip_index = -1;
-            int index = raycast(s, s.skip_index, origin, direction, dist, far, norm, far_n);
-            if (index == -1) {
-                *data = getSky(s, direction);
-            } else {
-                auto& p = s.primitives[index];
-                auto color = p.diffuse;
-
-                float diffuse_light = clamp(light.dot(norm) * 0.5f + 0.5f, 0.0f, 1.0f) * 0.5f + 0.1f;
-                fvec3 reflected = reflect(direction, norm);
-                float specular_light = max(0.0f, reflected.dot(light));
-                specular_light *= specular_light;
-                specular_light *= specular_light;
-                specular_light *= specular_light;
-                specular_light *= specular_light;
-
-                specular_light = clamp(specular_light, 0.0f, 0.7f);
-
-                float dist2;
-                fvec3 norm2;
-
-                s.skip_index = index;
-                intersect = intersection_point(origin, direction, dist);
-                int ind = raycast(s, s.skip_index, intersect, light, dist2, far, norm2, far_n);
-                if (ind != -1) {
-                    diffuse_light *= 0.6;
-                    specular_light *= 0.04;
-                }
+    parallel_for(pool, 0, img.get_rows(), 4, [&](int32_t y0, int32_t y1) {
+        for (int y = y0; y < y1; y++) {
+            fvec3* data = img.get_row_ptr(y);
+            float z_p = static_cast<float>(half_height - y) * dy;
+            for (int x0 = 0; x0 < img.get_columns(); x0 += ray_packet::width) {
+                ray_packet primary;
+                ray_packet_hit hit;
+                uint32_t active = primary_span_packet(origin, x0, img.get_columns(), half_width, dx, z_p, primary);
+                uint32_t hit_mask = raycast_packet(s, primary, active, hit);
+                uint32_t occluded = shadow_packet_occluded(s, primary, hit, hit_mask, light);
+                for (uint32_t mask = active; mask; mask &= mask - 1) {
+                    int lane = std::countr_zero(mask);
+                    fvec3 direction = primary.direction(lane);
+                    fvec3* pixel = data + x0 + lane;
+                    if (hit.id[lane] == -1) {
+                        *pixel = getSky(s, direction);
+                        continue;
+                    }
+                    const auto& p = scene_primitive(s, hit.id[lane]);
+                    const fvec3& norm = hit.normal_near[lane];
+                    auto color = p.diffuse;
+
+                    float diffuse_light = clamp(light.dot(norm) * 0.5f + 0.5f, 0.0f, 1.0f) * 0.5f + 0.1f;
+                    fvec3 reflected = reflect(direction, norm);
+                    float specular_light = max(0.0f, reflected.dot(light));
+                    specular_light *= specular_light;
+                    specular_light *= specular_light;
+                    specular_light *= specular_light;
+                    specular_light *= specular_light;
+
+                    specular_light = clamp(specular_light, 0.0f, 0.7f);
+
+                    if ((occluded >> lane) & 1u) {
+                        diffuse_light *= 0.6;
+                        specular_light *= 0.04;
+                    }
 
-                data->r = clamp(diffuse_light * color.x + specular_light * s.light_color.x, 0.0f, 1.0f);
-                data->g = clamp(diffuse_light * color.y + specular_light * s.light_color.y, 0.0f, 1.0f);
-                data->b = clamp(diffuse_light * color.z + specular_light * s.light_color.z, 0.0f, 1.0f);
+                    pixel->r = clamp(diffuse_light * color.x + specular_light * s.light_color.x, 0.0f, 1.0f);
+                    pixel->g = clamp(diffuse_light * color.y + specular_light * s.light_color.y, 0.0f, 1.0f);
+                    pixel->b = clamp(diffuse_light * color.z + specular_light * s.light_color.z, 0.0f, 1.0f);
+                }
             }
-            data++;
         }
-    }
+    });
 }
 
 
-void normal_rendering(scene& s, const fvec3& origin, pixel_storage_fvec3& img)
+void normal_rendering(const scene& s, const fvec3& origin, pixel_storage_fvec3& img, thread_pool* pool)
 {
     float ratio = static_cast<float>(img.get_columns()) / img.get_rows();
     float dx = (1.0 / img.get_columns()) * ratio;
@@ -474,28 +364,25 @@ void normal_rendering(scene& s, const fvec3& origin, pixel_storage_fvec3& img)
     float half_width = img.get_columns() / 2.0;
     float half_height = img.get_rows() / 2.0;
 
-    fvec3 far_n;
-    float far;
-
-    for (int y = 0; y < img.get_rows(); y++) {
-        fvec3* data = img.get_row_ptr(y);
-        float z_p = static_cast<float>(half_height - y) * dy;
-        for (int x = 0; x < img.get_columns(); x++) {
-            fvec3 direction(static_cast<float>(x - half_width) * dx, 1.0, z_p);
-            direction.normalize_self();
-
-            float dist;
-            fvec3 norm;
-
-            s.skip_index = -1;
-            int index = raycast(s, s.skip_index, origin, direction, dist, far, norm, far_n);
-            *data = index == -1 ? fvec3(0.5, 0.5, 1.0) : norm * 0.5 + 0.5;
-            data++;
+    parallel_for(pool, 0, img.get_rows(), 4, [&](int32_t y0, int32_t y1) {
+        for (int y = y0; y < y1; y++) {
+            fvec3* data = img.get_row_ptr(y);
+            float z_p = static_cast<float>(half_height - y) * dy;
+            for (int x0 = 0; x0 < img.get_columns(); x0 += ray_packet::width) {
+                ray_packet primary;
+                ray_packet_hit hit;
+                uint32_t active = primary_span_packet(origin, x0, img.get_columns(), half_width, dx, z_p, primary);
+                raycast_packet(s, primary, active, hit);
+                for (uint32_t mask = active; mask; mask &= mask - 1) {
+                    int lane = std::countr_zero(mask);
+                    data[x0 + lane] = hit.id[lane] == -1 ? fvec3(0.5, 0.5, 1.0) : hit.normal_near[lane] * 0.5 + 0.5;
+                }
+            }
         }
-    }
+    });
 }
 
-void fast_simple_rendering(scene& s, const fvec3& origin, pixel_storage_fvec3& img)
+void fast_simple_rendering(const scene& s, const fvec3& origin, pixel_storage_fvec3& img, thread_pool* pool)
 {
     float ratio = static_cast<float>(img.get_columns()) / img.get_rows();
     float dx = (1.0 / img.get_columns()) * ratio;
@@ -504,47 +391,45 @@ void fast_simple_rendering(scene& s, const fvec3& origin, pixel_storage_fvec3& i
     float half_height = img.get_rows() / 2.0;
 
     fvec3 light = -s.light_dir;
-    fvec3 far_n;
-    float far;
 
-    for (int y = 0; y < img.get_rows(); y++) {
-        fvec3* data = img.get_row_ptr(y);
-        float z_p = static_cast<float>(half_height - y) * dy;
-        for (int x = 0; x < img.get_columns(); x++) {
-            fvec3 direction(static_cast<float>(x - half_width) * dx, 1.0, z_p);
-            direction.normalize_self();
-
-            float dist;
-            fvec3 norm;
-            fvec3 intersect;
-
-            s.skip_index = -1;
-            int index = raycast(s, s.skip_index, origin, direction, dist, far, norm, far_n);
-            if (index == -1) {
-                *data = getSky(s, direction);
-            } else {
-                auto& p = s.primitives[index];
-                auto color = p.diffuse;
+    parallel_for(pool, 0, img.get_rows(), 4, [&](int32_t y0, int32_t y1) {
+        for (int y = y0; y < y1; y++) {
+            fvec3* data = img.get_row_ptr(y);
+            float z_p = static_cast<float>(half_height - y) * dy;
+            for (int x0 = 0; x0 < img.get_columns(); x0 += ray_packet::width) {
+                ray_packet primary;
+                ray_packet_hit hit;
+                uint32_t active = primary_span_packet(origin, x0, img.get_columns(), half_width, dx, z_p, primary);
+                uint32_t hit_mask = raycast_packet(s, primary, active, hit);
+                uint32_t occluded = shadow_packet_occluded(s, primary, hit, hit_mask, light);
+                for (uint32_t mask = active; mask; mask &= mask - 1) {
+                    int lane = std::countr_zero(mask);
+                    fvec3 direction = primary.direction(lane);
+                    fvec3* pixel = data + x0 + lane;
+                    if (hit.id[lane] == -1) {
+                        *pixel = getSky(s, direction);
+                        continue;
+                    }
+                    const auto& p = scene_primitive(s, hit.id[lane]);
+                    const fvec3& norm = hit.normal_near[lane];
+                    auto color = p.diffuse;
                 
-                float diffuse_light = (light.dot(norm) >= 0.0f ? 1.0f : 0.5f);
-                fvec3 reflected = reflect(direction, norm);
-                float specular_light = reflected.dot(light) >= 0.8f ? 0.8f : 0.0f;
-
-                s.skip_index = index;
-                intersect = intersection_point(origin, direction, dist);
-                int ind = raycast(s, s.skip_index, intersect, light, dist, far, norm, far_n);
-                if (ind != -1) {
-                    diffuse_light *= 0.6;
-                    specular_light *= 0.04;
-                }
+                    float diffuse_light = (light.dot(norm) >= 0.0f ? 1.0f : 0.5f);
+                    fvec3 reflected = reflect(direction, norm);
+                    float specular_light = reflected.dot(light) >= 0.8f ? 0.8f : 0.0f;
 
-                *data = fvec3(diffuse_light * color.x + specular_light * s.light_color.x,
-                    diffuse_light * color.y + specular_light * s.light_color.y,
-                    diffuse_light * color.z + specular_light * s.light_color.z).clamp_self(0.0, 1.0);
+                    if ((occluded >> lane) & 1u) {
+                        diffuse_light *= 0.6;
+                        specular_light *= 0.04;
+                    }
+
+                    *pixel = fvec3(diffuse_light * color.x + specular_light * s.light_color.x,
+                        diffuse_light * color.y + specular_light * s.light_color.y,
+                        diffuse_light * color.z + specular_light * s.light_color.z).clamp_self(0.0, 1.0);
+                }
             }
-            data++;
         }
-    }
+    });
 }
 
 bool random_statement(float p)
@@ -557,62 +442,86 @@ fvec3 random_on_sphere()
     return fvec3(frand(-1.0, 1.0), frand(-1.0, 1.0), frand(-1.0, 1.0)).normalize_self();
 }
 
-fvec3 raytrace(const scene& s, int& skip_index, fvec3& origin, fvec3& direction)
+/* scatters the ray at the hit found by raycast() for it (index, distances and normals), see raytrace().
+ * F - the scene_feature material bits of the scene, the branches of the others are compiled out */
+template <uint32_t F>
+fvec3 raytrace_hit(const scene& s, int index, float dist, float dist_far, const fvec3& norm, const fvec3& norm_far, int& hit_index, fvec3& origin,
+    fvec3& direction)
 {
-    float dist;
-    float dist_far;
-    fvec3 norm;
-    fvec3 norm_far;
     fvec3 intersect;
 
-    int index = raycast(s, skip_index, origin, direction, dist, dist_far, norm, norm_far);
-    skip_index = index;
+    hit_index = index;
     if (index == -1) {
         return getSky(s, direction);
     } else {
         intersect = intersection_point(origin, direction, dist);
-        auto& p = s.primitives[index];
+        const auto& p = scene_primitive(s, index);
         fvec3 diffuse = p.diffuse;
-        float specular = p.specular;
-        float roughness = p.roughness;
 
-        if (random_statement(p.glowing)) {
-            index = -1;
-            return diffuse;
+        if constexpr ((F & scene_feature_emissive) != 0) {
+            if (random_statement(p.glowing)) {
+                index = -1;
+                return diffuse;
+            }
         }
 
-        if (p.transparent && random_statement(-direction.dot(norm))) {
-            direction = -refract(direction, norm_far, -1.0);
-            origin = intersection_point(origin, direction, dist_far);
-            return fvec3(1.0, 1.0, 1.0);
+        if constexpr ((F & scene_feature_transparent) != 0) {
+            if (p.transparent && random_statement(-direction.dot(norm))) {
+                direction = -refract(direction, norm_far, -1.0);
+                origin = intersection_point(origin, direction, dist_far);
+                return fvec3(1.0, 1.0, 1.0);
+            }
         }
 
-        fvec3 reflected = reflect(direction, norm);
-
-        if (random_statement(specular)) {
-            float fresnel = 1.0 - std::abs(norm.dot(direction));
-            if (random_statement(fresnel * fresnel)) {
-                direction = reflected;
+        if constexpr ((F & scene_feature_specular) != 0) {
+            float specular = p.specular;
+            if (random_statement(specular)) {
+                fvec3 reflected = reflect(direction, norm);
+                float fresnel = 1.0 - std::abs(norm.dot(direction));
+                if (random_statement(fresnel * fresnel)) {
+                    direction = reflected;
+                    origin = intersect;
+                    return diffuse;
+                }
                 origin = intersect;
-                return diffuse;
+                direction = reflected;
+                return diffuse * specular;
             }
-            origin = intersect;
-            direction = reflect(direction, norm);
-            return diffuse * specular;
         }
 
         fvec3 r = random_on_sphere();
         fvec3 diffuse_rand = (r * r.dot(norm)).normalize_self();
         origin = intersect;
-        direction = fvec3(
-            mix(reflected.x, diffuse_rand.x, roughness),
-            mix(reflected.y, diffuse_rand.y, roughness),
-            mix(reflected.z, diffuse_rand.z, roughness));
+        if constexpr ((F & scene_feature_glossy) != 0) {
+            fvec3 reflected = reflect(direction, norm);
+            float roughness = p.roughness;
+            direction = fvec3(
+                mix(reflected.x, diffuse_rand.x, roughness),
+                mix(reflected.y, diffuse_rand.y, roughness),
+                mix(reflected.z, diffuse_rand.z, roughness));
+        } else {
+            /* mix() with a roughness of 1 */
+            direction = diffuse_rand;
+        }
         return diffuse;
     }
 }
 
-void physic_rendering(scene& s, const fvec3& origin_, pixel_storage_fvec3& img)
+/* hit_index - id of the surface the ray starts at or -1, set to the id of the hit */
+template <uint32_t F>
+fvec3 raytrace(const scene& s, int& hit_index, fvec3& origin, fvec3& direction)
+{
+    float dist;
+    float dist_far;
+    fvec3 norm;
+    fvec3 norm_far;
+
+    float tmin = hit_index == -1 ? 0.0f : raycast_epsilon(origin);
+    int index = raycast(s, origin, direction, tmin, ray_max_distance, dist, dist_far, norm, norm_far);
+    return raytrace_hit<F>(s, index, dist, dist_far, norm, norm_far, hit_index, origin, direction);
+}
+
+void physic_rendering(const scene& s, const fvec3& origin_, pixel_storage_fvec3& img, thread_pool* pool)
 {
     float ratio = static_cast<float>(img.get_columns()) / img.get_rows();
     float dx = (1.0 / img.get_columns()) * ratio;
@@ -620,112 +529,170 @@ void physic_rendering(scene& s, const fvec3& origin_, pixel_storage_fvec3& img)
     float half_width = img.get_columns() / 2.0;
     float half_height = img.get_rows() / 2.0;
 
-    for (int y = 0; y < img.get_rows(); y++) {
-        fvec3* data = img.get_row_ptr(y);
-        float z_p = static_cast<float>(half_height - y) * dy;
-        for (int x = 0; x < img.get_columns(); x++) {
-            fvec3 direction_(static_cast<float>(x - half_width) * dx, 1.0, z_p);
-            direction_.normalize_self();
-
-            constexpr int steps = 8;
-
-            fvec3 color(0.0, 0.0, 0.0);
-
-            constexpr int iters = 32 * 1;
-
-            for (int k = 0; k < iters; k++) {
-                fvec3 origin = origin_;
-                int skip_index = -1;
-                fvec3 col(1.0, 1.0, 1.0);
-                fvec3 direction = direction_;
-
-                int i;
-                for (i = 0; i < steps; i++) {
-                    fvec3 cl = raytrace(s, skip_index, origin, direction);
-                    col = col * cl;
-                    if (skip_index == -1) {
+    parallel_for(pool, 0, img.get_rows(), 1, [&](int32_t y0, int32_t y1) {
+        for (int y = y0; y < y1; y++) {
+            fvec3* data = img.get_row_ptr(y);
+            float z_p = static_cast<float>(half_height - y) * dy;
+            for (int x = 0; x < img.get_columns(); x++) {
+                fvec3 direction_(static_cast<float>(x - half_width) * dx, 1.0, z_p);
+                direction_.normalize_self();
+
+                constexpr int steps = 8;
+
+                fvec3 color(0.0, 0.0, 0.0);
+
+                constexpr int iters = 32 * 1;
+
+                for (int k = 0; k < iters; k++) {
+                    fvec3 origin = origin_;
+                    int hit_index = -1;
+                    fvec3 col(1.0, 1.0, 1.0);
+                    fvec3 direction = direction_;
+
+                    int i;
+                    for (i = 0; i < steps; i++) {
+                        fvec3 cl = raytrace<scene_feature_materials>(s, hit_index, origin, direction);
+                        col = col * cl;
+                        if (hit_index == -1) {
+                            break;
+                        }
+                    }
+                    if (i == steps) {
+                        col = fvec3(0.0, 0.0, 0.0);
+                    } else if (i == 0) {
+                        color = col * iters;
                         break;
                     }
-                }
-                if (i == steps) {
-                    col = fvec3(0.0, 0.0, 0.0);
-                } else if (i == 0) {
-                    color = col * iters;
-                    break;
-                }
 
-                color = color + col;
-            }
+                    color = color + col;
+                }
 
-            color *= 1.0 / iters;
+                color *= 1.0 / iters;
 
-            *data = color.clamp(0.0, 1.0);
-            data++;
+                *data = color.clamp(0.0, 1.0);
+                data++;
+            }
         }
-    }
+    });
 }
 
-void render_pass_line(const scene& s, const fvec3& origin_, float z_p, float dx, int width, fvec3* dst)
+/* primary - the hit of the first ray of every iteration, the ray is the same for all of them */
+template <uint32_t F>
+fvec3 render_pixel(const scene& s, const fvec3& origin_, const fvec3& direction_, const ray_packet_hit& primary, int lane)
 {
-    int half_width = width / 2;
-    for (int x = 0; x < width; x++) {
-        fvec3 direction_(static_cast<float>(x - half_width) * dx, 1.0, z_p);
-        direction_.normalize_self();
-
-        constexpr int steps = 8;
+    constexpr int steps = 8;
 
-        fvec3 color(0.0, 0.0, 0.0);
+    fvec3 color(0.0, 0.0, 0.0);
 
-        constexpr int iters = 16 * 16;
+    constexpr int iters = 16 * 16;
 
-        for (int k = 0; k < iters; k++) {
-            fvec3 origin = origin_;
-            int skip_index = -1;
-            fvec3 col(1.0, 1.0, 1.0);
-            fvec3 direction = direction_;
+    for (int k = 0; k < iters; k++) {
+        fvec3 origin = origin_;
+        int hit_index = -1;
+        fvec3 col(1.0, 1.0, 1.0);
+        fvec3 direction = direction_;
 
-            int i;
-            for (i = 0; i < steps; i++) {
-                fvec3 cl = raytrace(s, skip_index, origin, direction);
-                col = col * cl;
-                if (skip_index == -1) {
-                    break;
-                }
-            }
-            if (i == steps) {
-                col = fvec3(0.0, 0.0, 0.0);
-            } else if (i == 0) {
-                color = col * iters;
+        int i;
+        for (i = 0; i < steps; i++) {
+            fvec3 cl = i == 0 ? raytrace_hit<F>(s, primary.id[lane], primary.near[lane], primary.far[lane], primary.normal_near[lane], primary.normal_far[lane],
+                hit_index, origin, direction) : raytrace<F>(s, hit_index, origin, direction);
+            col = col * cl;
+            if (hit_index == -1) {
                 break;
             }
-
-            color = color + col;
+        }
+        if (i == steps) {
+            col = fvec3(0.0, 0.0, 0.0);
+        } else if (i == 0) {
+            color = col * iters;
+            break;
         }
 
-        color *= 1.0 / iters;
+        color = color + col;
+    }
 
-        *dst = color.clamp(0.0, 1.0);
-        dst++;
+    color *= 1.0 / iters;
+
+    return color.clamp(0.0, 1.0);
+}
+
+/* two rows of the columns [x_begin, x_end) in blocks of 4 x 2 pixels, dst_below is nullptr for the last
+ * row of an odd height. The primary rays of a block are cast as one packet, the bounces are incoherent
+ * and traced one by one */
+template <uint32_t F>
+void render_pass_line(const scene& s, const fvec3& origin_, float z_p, float z_p_below, float dx, int width, int x_begin, int x_end, fvec3* dst,
+    fvec3* dst_below)
+{
+    constexpr int block_width = ray_packet::width / 2;
+    int half_width = width / 2;
+    for (int x0 = x_begin; x0 < x_end; x0 += block_width) {
+        ray_packet primary;
+        uint32_t active = 0;
+        for (int lane = 0; lane < ray_packet::width; lane++) {
+            int x = x0 + lane % block_width;
+            bool below = lane >= block_width;
+            if (x >= x_end || (below && dst_below == nullptr)) {
+                continue;
+            }
+            fvec3 direction_(static_cast<float>(x - half_width) * dx, 1.0, below ? z_p_below : z_p);
+            direction_.normalize_self();
+            primary.set(lane, origin_, direction_, 0.0f, ray_max_distance);
+            active |= 1u << lane;
+        }
+
+        ray_packet_hit hit;
+        raycast_packet(s, primary, active, hit);
+        for (uint32_t mask = active; mask; mask &= mask - 1) {
+            int lane = std::countr_zero(mask);
+            fvec3* pixel = (lane < block_width ? dst : dst_below) + x0 + lane % block_width;
+            *pixel = render_pixel<F>(s, origin_, primary.direction(lane), hit, lane);
+        }
     }
 }
 
-void render_pass(scene& s, const fvec3& origin_, pixel_storage_fvec3& img)
+/* the rows of the tile by two for the 4 x 2 packets */
+template <uint32_t F>
+void render_pass_tile(const scene& s, const fvec3& origin_, const render_tile& tile, pixel_storage_fvec3& img)
 {
     float ratio = static_cast<float>(img.get_columns()) / img.get_rows();
     float dx = (1.0 / img.get_columns()) * ratio;
     float dy = 1.0 / img.get_rows();
     float half_height = img.get_rows() / 2.0;
 
-    thread_pool scheduler(8);
-
-    for (int y = 0; y < img.get_rows(); y++) {
+    for (int y = tile.y0; y < tile.y1; y += 2) {
         fvec3* data = img.get_row_ptr(y);
+        fvec3* data_below = y + 1 < tile.y1 ? img.get_row_ptr(y + 1) : nullptr;
         float z_p = static_cast<float>(half_height - y) * dy;
-        //render_pass_line(s, origin_, z_p, dx, img.get_columns(), data);
-        scheduler.enqueue(render_pass_line, s, origin_, z_p, dx, img.get_columns(), data);
+        float z_p_below = static_cast<float>(half_height - (y + 1)) * dy;
+        render_pass_line<F>(s, origin_, z_p, z_p_below, dx, img.get_columns(), tile.x0, tile.x1, data, data_below);
     }
+}
+
+using render_tile_kernel = void (*)(const scene&, const fvec3&, const render_tile&, pixel_storage_fvec3&);
 
-    //scheduler.join();
+/* render_pass_tile() for every combination of the scene_feature material bits, indexed by them */
+template <uint32_t... F>
+constexpr std::array<render_tile_kernel, sizeof...(F)> make_tile_kernels(std::integer_sequence<uint32_t, F...>)
+{
+    return {render_pass_tile<F>...};
+}
+
+constexpr auto tile_kernels = make_tile_kernels(std::make_integer_sequence<uint32_t, scene_feature_materials + 1>());
+
+/* the tiles on the threads of the pool with work stealing, a tile of the transparent sphere costs many
+ * tiles of sky. Every tile is rendered from the version current when it starts, an edit published
+ * meanwhile is seen by the tiles after it and the tiles in flight keep their version */
+void render_pass(const scene_versions& versions, const fvec3& origin_, pixel_storage_fvec3& img, thread_pool* pool)
+{
+    tile_scheduler scheduler(pool);
+    scheduler.run(img.get_columns(), img.get_rows(), [&](const render_tile& tile) {
+        shared_ptr<const scene_snapshot> snapshot = versions.acquire();
+        tile_kernels[snapshot->get_features() & scene_feature_materials](snapshot->get_scene(), origin_, tile, img);
+    });
+
+    const tile_scheduler_stats& stats = scheduler.get_stats();
+    std::cout << "render: " << stats.tiles << " tiles on " << scheduler.get_thread_count() << " threads, " << stats.steals << " steals, "
+        << stats.msec << " ms, tail " << stats.tail_msec << " ms" << std::endl;
 }
 
 
@@ -738,97 +705,109 @@ void gamma_correction_pass(pixel_storage_fvec3& image)
     }
 }
 
-int main()
+/* the wireframe box placed by an instance, the scale stays in the group so the radius is not scaled */
+constexpr capsule_type wireframe_edge(const fvec3& a, const fvec3& b)
+{
+    constexpr fvec3 scale(2.0, 3.0, 1.5);
+    return capsule_type(a * scale, b * scale, 0.1f);
+}
+
+/* the fixed scene, constexpr so that GREEN_SCENE_BAKED can build its structures at compile time */
+constexpr std::array wireframe_primitives = {
+    baked_primitive(wireframe_edge(fvec3(-1.0, -1.0, -1.0), fvec3(-1.0,  1.0, -1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(-1.0, -1.0, -1.0), fvec3(1.0, -1.0, -1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(-1.0,  1.0, -1.0), fvec3(1.0,  1.0, -1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(1.0, -1.0, -1.0), fvec3(1.0,  1.0, -1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+
+    baked_primitive(wireframe_edge(fvec3(-1.0, -1.0, -1.0), fvec3(-1.0,  -1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(-1.0,  1.0, -1.0), fvec3(-1.0, 1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3( 1.0, -1.0, -1.0), fvec3(1.0,  -1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(1.0,  1.0, -1.0), fvec3(1.0,  1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+
+    baked_primitive(wireframe_edge(fvec3(-1.0, -1.0, 1.0), fvec3(-1.0,  1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(-1.0, -1.0, 1.0), fvec3(1.0, -1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(-1.0,  1.0, 1.0), fvec3(1.0,  1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f),
+    baked_primitive(wireframe_edge(fvec3(1.0, -1.0, 1.0), fvec3(1.0,  1.0, 1.0)), fvec3(0, 1, 0), 0.0f, 1.0f)
+};
+
+constexpr std::array scene_primitives = {
+    baked_primitive(sphere_type(fvec3(-2.0, 6.0, 1.0), 1.25), fvec3(1, 0, 0), 1.0f, 0.5f),
+    baked_primitive(capsule_type(fvec3(-4.0, 7.0, 0.0), fvec3(4.0, 7.5, -0.5), 1.15), fvec3(0, 1, 0), 0.5f, 1.0f),
+    baked_primitive(sphere_type(fvec3(3.0, 6.0, 1.0), 1.0), fvec3(0, 1, 1), 0.5f, 1.0f),
+    baked_primitive(sphere_type(fvec3(-1.0, 3.0, -3.0), 1.25), fvec3(1, 1, 0), 1.0f, 0.0f),
+    baked_primitive(sphere_type(fvec3(2.0, -14.0, 1.3), 2.4), fvec3(0, 1, 1), 1.0f, 0.0f, true),
+    baked_primitive(aabb_type(fvec3(2.0, -3.0, -1.0), fvec3(1.0, 1.5, 1.0)), fvec3(0, 0.5, 1), 1.0f, 0.4f),
+    baked_primitive(aabb_type(fvec3(-5.0, -3.0, 5.0), fvec3(3.0, 1.5, 1.2)), fvec3(0.0, 0.5, 1), 1.0f, 0.4f)
+};
+
+int main(int argc, char** argv)
 {
+#ifdef GREEN_THREAD_POOL_BENCHMARK
+    /* the benchmark makes its own pools and uses nothing of the scene */
+    thread_pool_benchmark(1 << 20);
+    return 0;
+#endif
+
     pixel_storage_fvec3 img(12800, 7200);
 
+    /* one pool for the whole run, from the mesh load to the bitmap */
+    thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+
     scene scene;
 
     green::camera cam(fvec3(0, -22, 2), fvec3(0, 1, 0), fvec3(0, 0, 1));
     cam.set_perspective_projection(pi / 3.0, static_cast<float>(img.get_columns()) / img.get_rows(), 0.1, 1000);
 
-    float w = 0.1;
     fvec3 spos(3.0, 10.0, 5.0);
-    fvec3 sscale(2.0, 3.0, 1.5);
 
     // H
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0, -1.0, -1.0), fvec3(-1.0,  1.0, -1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0, -1.0, -1.0), fvec3(1.0, -1.0, -1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0,  1.0, -1.0), fvec3(1.0,  1.0, -1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(1.0, -1.0, -1.0), fvec3(1.0,  1.0, -1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0, -1.0, -1.0), fvec3(-1.0,  -1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0,  1.0, -1.0), fvec3(-1.0, 1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3( 1.0, -1.0, -1.0), fvec3(1.0,  -1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(1.0,  1.0, -1.0), fvec3(1.0,  1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0, -1.0, 1.0), fvec3(-1.0,  1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0, -1.0, 1.0), fvec3(1.0, -1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(-1.0,  1.0, 1.0), fvec3(1.0,  1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.emplace_back(capsule_type(fvec3(1.0, -1.0, 1.0), fvec3(1.0,  1.0, 1.0), w));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-
-    for (auto& p: scene.primitives) {
-        p.capsule.point1 *= sscale;
-        p.capsule.point2 *= sscale;
-        p.capsule.point1 += spos;
-        p.capsule.point2 += spos;
+#if GREEN_SCENE_BAKED
+    /* the structures of the fixed scene are baked at compile time, a mesh needs the runtime build */
+    static constexpr auto baked_wireframe = bake_primitives(wireframe_primitives);
+    static constexpr auto baked_scene = bake_primitives(scene_primitives);
+    const bool baked = argc <= 1;
+#endif
+    primitive_group wireframe;
+#if GREEN_SCENE_BAKED
+    if (baked) {
+        wireframe = baked_group(baked_wireframe);
+    } else
+#endif
+    {
+        wireframe.primitives.assign(wireframe_primitives.begin(), wireframe_primitives.end());
     }
+    scene.groups.push_back(std::make_shared<primitive_group>(std::move(wireframe)));
+    scene.instances.emplace_back(0, fquat(0.0, 0.0, 0.0, 1.0), spos);
 
     // scene.primitives.emplace_back(plane_type(fvec3(0.0, 0.0, -5.0), fvec3(0.0, 0.0, 1.0)));
     // scene.primitives.back().diffuse = fvec3(0.2, 0.4, 1);
     // scene.primitives.back().specular = 0.2;
     // scene.primitives.back().roughness = 0.9f;
     // scene.primitives.back().glowing = 0.6;
-    scene.primitives.emplace_back(sphere_type(fvec3(-2.0, 6.0, 1.0), 1.25));
-    scene.primitives.back().diffuse = fvec3(1, 0, 0);
-    scene.primitives.back().specular = 1.0;
-    scene.primitives.back().roughness = 0.5f;
-    scene.primitives.emplace_back(capsule_type(fvec3(-4.0, 7.0, 0.0), fvec3(4.0, 7.5, -0.5), 1.15));
-    scene.primitives.back().diffuse = fvec3(0, 1, 0);
-    scene.primitives.back().specular = 0.5;
-    scene.primitives.back().roughness = 1.0f;
-    scene.primitives.emplace_back(sphere_type(fvec3(3.0, 6.0, 1.0), 1.0));
-    scene.primitives.back().diffuse = fvec3(0, 1, 1);
-    scene.primitives.back().specular = 0.5;
-    scene.primitives.back().roughness = 1.0f;
-
-    scene.primitives.emplace_back(sphere_type(fvec3(-1.0, 3.0, -3.0), 1.25));
-    scene.primitives.back().diffuse = fvec3(1, 1, 0);
-    scene.primitives.back().specular = 1.0;
-    scene.primitives.back().roughness = 0.0f;
-
-    scene.primitives.emplace_back(sphere_type(fvec3(2.0, -14.0, 1.3), 2.4));
-    scene.primitives.back().diffuse = fvec3(0, 1, 1);
-    scene.primitives.back().specular = 1.0;
-    scene.primitives.back().roughness = 0.0f;
-    scene.primitives.back().transparent = true;
+    scene.primitives.assign(scene_primitives.begin(), scene_primitives.end());
 
     scene.light_dir = fvec3(1, 1, -1).normalize_self();
     scene.light_color = fvec3(0.9, 0.9, 1.0);
 
-
-    scene.primitives.emplace_back(aabb_type(fvec3(2.0, -3.0, -1.0), fvec3(1.0, 1.5, 1.0)));
-    scene.primitives.back().diffuse = fvec3(0, 0.5, 1);
-    scene.primitives.back().specular = 1.0;
-    scene.primitives.back().roughness = 0.4f;
-
-    scene.primitives.emplace_back(aabb_type(fvec3(-5.0, -3.0, 5.0), fvec3(3.0, 1.5, 1.2)));
-    scene.primitives.back().diffuse = fvec3(0.0, 0.5, 1);
-    scene.primitives.back().specular = 1.0;
-    scene.primitives.back().roughness = 0.4f;
-
+    /* an OBJ or PLY mesh given on the command line is added as one more primitive */
+    if (argc > 1) {
+        auto mesh = load_mesh(argv[1], bvh_build_mode::binned_sah, &pool);
+        if (mesh) {
+            std::cout << "mesh: " << mesh->get_triangle_count() << " triangles" << std::endl;
+#if GREEN_MESH_RESIDENT_PAGES > 0
+            std::string pages = "mesh_pages/" + std::filesystem::path(argv[1]).filename().string() + ".pages";
+            if (mesh->page_out(pages, GREEN_MESH_RESIDENT_PAGES)) {
+                std::cout << "mesh: " << mesh->get_pager()->get_page_count() << " pages in " << pages << ", " << GREEN_MESH_RESIDENT_PAGES
+                    << " resident" << std::endl;
+            }
+#endif
+            scene.meshes.push_back(mesh);
+            primitive& p = scene.primitives.emplace_back(mesh_type(*mesh));
+            p.diffuse = fvec3(0.8, 0.8, 0.8);
+            p.specular = 0.2;
+            p.roughness = 0.8f;
+        }
+    }
 
     fvec3 origin(0, -22, 2);
 
@@ -845,17 +824,19 @@ int main()
     }
 
     pixel_storage_fvec3 img_sky = pixel_storage_fvec3(iw, ih);
-    unsigned char* id = imgData;
-    fvec3* px = img_sky.get_storage_ptr();
-    for (int y = 0; y < ih * iw; y++) {
-        px->r = static_cast<float>(id[0]) / 255.0;
-        px->g = static_cast<float>(id[1]) / 255.0;
-        px->b = static_cast<float>(id[2]) / 255.0;
-        id += ic;
-        px++;
-    }
+    parallel_for(&pool, 0, ih, 16, [&](int32_t y0, int32_t y1) {
+        unsigned char* id = imgData + static_cast<size_t>(y0) * iw * ic;
+        fvec3* px = img_sky.get_storage_ptr() + static_cast<size_t>(y0) * iw;
+        for (int y = y0 * iw; y < y1 * iw; y++) {
+            px->r = static_cast<float>(id[0]) / 255.0;
+            px->g = static_cast<float>(id[1]) / 255.0;
+            px->b = static_cast<float>(id[2]) / 255.0;
+            id += ic;
+            px++;
+        }
+    });
 
-     bitmap_save_to_file(img_sky, "my_image.bmp");
+     bitmap_save_to_file(img_sky, "my_image.bmp", &pool);
 
 
     stbi_image_free(imgData);
@@ -863,11 +844,47 @@ int main()
     scene.sky = img_sky;
     std::cout <<"loaded" << std::endl;
 
-    render_pass(scene, origin, img);
+#if GREEN_SCENE_BAKED
+    if (baked) {
+        scene_attach_baked(scene, baked_scene);
+        std::cout << "bvh width: " << GREEN_BVH_WIDTH << " baked at compile time" << std::endl;
+    } else
+#endif
+    {
+        bool loaded = scene_build_acceleration_cached(scene, "bvh_cache", bvh_build_mode::binned_sah, &pool);
+        if (loaded) {
+            std::cout << "bvh width: " << GREEN_BVH_WIDTH << " loaded from bvh_cache" << std::endl;
+        } else {
+            const auto& build_stats = scene.accel->get_build_stats();
+            std::cout << "bvh width: " << GREEN_BVH_WIDTH << " build: " << build_stats.build_msec << " ms, sah cost: "
+                << build_stats.sah_cost << ", nodes: " << build_stats.node_count << std::endl;
+        }
+    }
+#if GREEN_SCENE_NATIVE
+    if (scene_compile_native(scene, "native_cache")) {
+        std::cout << "native kernel loaded from native_cache" << std::endl;
+    }
+#endif
+#ifdef GREEN_BVH_BENCHMARK
+    bvh_benchmark(scene.primitives, 1 << 18);
+    bvh_benchmark(bvh_benchmark_primitives(1 << 20, 100.0f, 1), 1 << 20);
+    bvh_benchmark_splits(bvh_benchmark_capsule_lattice(30, 4.0f, 0.02f), 1 << 16);
+    {
+        std::vector<fvec3> vertices;
+        std::vector<int32_t> indices;
+        bvh_benchmark_triangles(1 << 21, 100.0f, 1, vertices, indices);
+        bvh_benchmark_paged(vertices, indices, 1 << 18, "mesh_pages");
+    }
+    return 0;
+#endif
+
+    /* the scene is only changed by new versions past this point, the render tasks share them */
+    scene_versions versions(scene_snapshot::freeze(std::move(scene)));
+    render_pass(versions, origin, img, &pool);
     std::cout <<"rendered" << std::endl;
 
     std::cout << "Time elapsed: " << t.get_elapsed_sec() << '\n';
-    bitmap_save_to_file(img, "img.bmp");
+    bitmap_save_to_file(img, "img.bmp", &pool);
 
     std::cout << "Time elapsed: " << t.get_elapsed_sec() << '\n';
 }
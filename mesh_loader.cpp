@@ -0,0 +1,618 @@
+#include "mesh_loader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bvh.hpp"
+#include "parallel.hpp"
+#include "thread_pool.h"
+#include "triangle_mesh.hpp"
+
+namespace green::core
+{
+
+/* read only mapping of the whole file, nullptr when it can not be mapped (or is empty) */
+static std::shared_ptr<const void> map_file(const std::string& path, size_t& size)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    size = static_cast<size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    /* every chunk is read front to back once */
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    return std::shared_ptr<const void>(data, [size](const void* p) {
+        ::munmap(const_cast<void*>(p), size);
+    });
+}
+
+/* one chunk per worker, none smaller than mesh_loader_chunk_size */
+static int32_t chunk_count(thread_pool* pool, size_t size)
+{
+    if (!pool) {
+        return 1;
+    }
+    size_t chunks = std::min<size_t>(pool->get_thread_count(), size / mesh_loader_chunk_size);
+    return std::max<int32_t>(1, static_cast<int32_t>(chunks));
+}
+
+/* calls fn(chunk) for the chunks, on the pool workers when there are several */
+template <class F>
+static void parallel_chunks(thread_pool* pool, int32_t chunks, F&& fn)
+{
+    if (!pool || chunks <= 1) {
+        for (int32_t i = 0; i < chunks; i++) {
+            fn(i);
+        }
+        return;
+    }
+    parallel_for(pool, 0, chunks, 1, [&fn](int32_t i, int32_t) {
+        fn(i);
+    });
+}
+
+/* the lines of one chunk of an OBJ file. The indices are 0 based in the vertices of the file except
+ * the ones at the positions listed in relative, these are from the first vertex of the chunk */
+struct obj_chunk
+{
+    std::vector<fvec3>      vertices;
+    std::vector<int32_t>    indices;
+    std::vector<size_t>     relative;
+    const char*             error = nullptr;    /* the line that could not be parsed */
+};
+
+static inline const char* skip_blanks(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+/* the number at p, moves p after it */
+static inline bool parse_float(const char*& p, const char* end, float& value)
+{
+    p = skip_blanks(p, end);
+    if (p < end && *p == '+') {
+        p++;
+    }
+    auto [next, ec] = std::from_chars(p, end, value);
+    if (ec != std::errc()) {
+        return false;
+    }
+    p = next;
+    return true;
+}
+
+/* parse_obj_chunk */
+static void parse_obj_chunk(const char* p, const char* end, obj_chunk& chunk)
+{
+    std::vector<int32_t> face;
+    while (p < end) {
+        const char* line = p;
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!eol) {
+            eol = end;
+        }
+        p = eol < end ? eol + 1 : end;
+        const char* q = skip_blanks(line, eol);
+        /* "v " and "f ", the vt, vn, comment and grouping lines are skipped */
+        if (eol - q < 2 || (q[1] != ' ' && q[1] != '\t')) {
+            continue;
+        }
+        if (q[0] == 'v') {
+            fvec3 v;
+            q += 2;
+            if (!parse_float(q, eol, v.x) || !parse_float(q, eol, v.y) || !parse_float(q, eol, v.z)) {
+                chunk.error = line;
+                return;
+            }
+            chunk.vertices.push_back(v);
+        } else if (q[0] == 'f') {
+            face.clear();
+            q += 2;
+            for (;;) {
+                q = skip_blanks(q, eol);
+                if (q == eol || *q == '\r' || *q == '#') {
+                    break;
+                }
+                int32_t index = 0;
+                auto [next, ec] = std::from_chars(q, eol, index);
+                if (ec != std::errc() || index == 0) {
+                    chunk.error = line;
+                    return;
+                }
+                face.push_back(index);
+                /* the texture and normal indices after the slashes */
+                for (q = next; q < eol && *q != ' ' && *q != '\t' && *q != '\r'; q++) {
+                }
+            }
+            for (size_t i = 1; i + 1 < face.size(); i++) {
+                for (int32_t index: {face[0], face[i], face[i + 1]}) {
+                    if (index < 0) {
+                        chunk.relative.push_back(chunk.indices.size());
+                        chunk.indices.push_back(static_cast<int32_t>(chunk.vertices.size()) + index);
+                    } else {
+                        chunk.indices.push_back(index - 1);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/* load_obj */
+bool load_obj(const std::string& path, std::vector<fvec3>& vertices, std::vector<int32_t>& indices, thread_pool* pool)
+{
+    size_t size = 0;
+    std::shared_ptr<const void> storage = map_file(path, size);
+    if (!storage) {
+        std::cout << "load_obj() error: cannot map " << path << std::endl;
+        return false;
+    }
+    const char* base = static_cast<const char*>(storage.get());
+    const char* end = base + size;
+
+    /* chunk i starts at the first line starting after i * size / chunks */
+    int32_t chunks = chunk_count(pool, size);
+    std::vector<const char*> starts(chunks + 1, end);
+    starts[0] = base;
+    for (int32_t i = 1; i < chunks; i++) {
+        const char* p = base + size * i / chunks;
+        const char* nl = static_cast<const char*>(std::memchr(p - 1, '\n', end - (p - 1)));
+        starts[i] = std::max(nl ? nl + 1 : end, starts[i - 1]);
+    }
+    std::vector<obj_chunk> parsed(chunks);
+    parallel_chunks(pool, chunks, [&](int32_t i) {
+        parse_obj_chunk(starts[i], starts[i + 1], parsed[i]);
+    });
+
+    /* the first vertex and index of each chunk in the joined arrays */
+    std::vector<size_t> first_vertex(chunks + 1, 0);
+    std::vector<size_t> first_index(chunks + 1, 0);
+    for (int32_t i = 0; i < chunks; i++) {
+        if (parsed[i].error) {
+            std::cout << "load_obj() error: cannot parse the line at byte " << parsed[i].error - base << " of " << path << std::endl;
+            return false;
+        }
+        first_vertex[i + 1] = first_vertex[i] + parsed[i].vertices.size();
+        first_index[i + 1] = first_index[i] + parsed[i].indices.size();
+    }
+    const size_t vertex_count = first_vertex[chunks];
+    if (vertex_count > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+        std::cout << "load_obj() error: too many vertices in " << path << std::endl;
+        return false;
+    }
+
+    vertices.resize(vertex_count);
+    indices.resize(first_index[chunks]);
+    std::vector<char> out_of_range(chunks, 0);
+    parallel_chunks(pool, chunks, [&](int32_t i) {
+        obj_chunk& chunk = parsed[i];
+        std::copy(chunk.vertices.begin(), chunk.vertices.end(), vertices.begin() + first_vertex[i]);
+        for (size_t r: chunk.relative) {
+            chunk.indices[r] += static_cast<int32_t>(first_vertex[i]);
+        }
+        int32_t* out = indices.data() + first_index[i];
+        for (size_t j = 0; j < chunk.indices.size(); j++) {
+            int32_t index = chunk.indices[j];
+            out_of_range[i] |= index < 0 || static_cast<size_t>(index) >= vertex_count;
+            out[j] = index;
+        }
+    });
+    if (std::find(out_of_range.begin(), out_of_range.end(), 1) != out_of_range.end()) {
+        std::cout << "load_obj() error: vertex index out of range in " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+enum class ply_type
+{
+    int8,
+    uint8,
+    int16,
+    uint16,
+    int32,
+    uint32,
+    float32,
+    float64
+};
+
+struct ply_property
+{
+    std::string     name;
+    ply_type        type = ply_type::float32;
+    bool            list = false;
+    ply_type        count_type = ply_type::uint8;   /* list only, type is the one of the items */
+};
+
+struct ply_element
+{
+    std::string     name;
+    int64_t         count = 0;
+    std::vector<ply_property>   properties;
+};
+
+static bool ply_parse_type(const std::string& name, ply_type& type)
+{
+    static const std::pair<const char*, ply_type> names[] = {
+        {"char", ply_type::int8}, {"int8", ply_type::int8}, {"uchar", ply_type::uint8}, {"uint8", ply_type::uint8},
+        {"short", ply_type::int16}, {"int16", ply_type::int16}, {"ushort", ply_type::uint16}, {"uint16", ply_type::uint16},
+        {"int", ply_type::int32}, {"int32", ply_type::int32}, {"uint", ply_type::uint32}, {"uint32", ply_type::uint32},
+        {"float", ply_type::float32}, {"float32", ply_type::float32}, {"double", ply_type::float64}, {"float64", ply_type::float64}};
+    for (const auto& n: names) {
+        if (name == n.first) {
+            type = n.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline size_t ply_type_size(ply_type type)
+{
+    switch (type) {
+    case ply_type::int8:
+    case ply_type::uint8:
+        return 1;
+    case ply_type::int16:
+    case ply_type::uint16:
+        return 2;
+    case ply_type::int32:
+    case ply_type::uint32:
+    case ply_type::float32:
+        return 4;
+    case ply_type::float64:
+        break;
+    }
+    return 8;
+}
+
+/* the value at p, the file and the host are little endian */
+template <class T>
+static inline T ply_load(const char* p)
+{
+    T ret;
+    std::memcpy(&ret, p, sizeof(T));
+    return ret;
+}
+
+static inline double ply_read(const char* p, ply_type type)
+{
+    switch (type) {
+    case ply_type::int8:
+        return ply_load<int8_t>(p);
+    case ply_type::uint8:
+        return ply_load<uint8_t>(p);
+    case ply_type::int16:
+        return ply_load<int16_t>(p);
+    case ply_type::uint16:
+        return ply_load<uint16_t>(p);
+    case ply_type::int32:
+        return ply_load<int32_t>(p);
+    case ply_type::uint32:
+        return ply_load<uint32_t>(p);
+    case ply_type::float32:
+        return ply_load<float>(p);
+    case ply_type::float64:
+        break;
+    }
+    return ply_load<double>(p);
+}
+
+/* size of one record of an element without list properties, 0 with one */
+static size_t ply_record_size(const ply_element& element)
+{
+    size_t ret = 0;
+    for (const auto& property: element.properties) {
+        if (property.list) {
+            return 0;
+        }
+        ret += ply_type_size(property.type);
+    }
+    return ret;
+}
+
+/* reads the header lines up to end_header, offset is set to the first byte of the data */
+static bool ply_parse_header(const char* base, size_t size, std::vector<ply_element>& elements, size_t& offset, std::string& error)
+{
+    bool binary_little_endian = false;
+    size_t pos = 0;
+    while (pos < size) {
+        const char* nl = static_cast<const char*>(std::memchr(base + pos, '\n', size - pos));
+        if (!nl) {
+            break;
+        }
+        std::istringstream line(std::string(base + pos, nl));
+        pos = nl - base + 1;
+        std::string keyword;
+        line >> keyword;
+        if (keyword == "end_header") {
+            if (!binary_little_endian) {
+                error = "only binary_little_endian is supported";
+                return false;
+            }
+            offset = pos;
+            return true;
+        } else if (keyword == "format") {
+            std::string format;
+            line >> format;
+            binary_little_endian = format == "binary_little_endian";
+        } else if (keyword == "element") {
+            elements.emplace_back();
+            line >> elements.back().name >> elements.back().count;
+            if (!line || elements.back().count < 0) {
+                error = "bad element line";
+                return false;
+            }
+        } else if (keyword == "property") {
+            if (elements.empty()) {
+                error = "property without element";
+                return false;
+            }
+            ply_property property;
+            std::string type;
+            line >> type;
+            if (type == "list") {
+                std::string count_type;
+                line >> count_type >> type;
+                property.list = true;
+                if (!ply_parse_type(count_type, property.count_type)) {
+                    type.clear();
+                }
+            }
+            line >> property.name;
+            if (!line || !ply_parse_type(type, property.type)) {
+                error = "bad property line";
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+    }
+    error = "no end_header";
+    return false;
+}
+
+/* the faces of all triangles with a uchar count, the records have a fixed size. False when a face
+ * is not a triangle */
+static bool ply_read_triangles(const char* data, int64_t count, ply_type index_type, int32_t vertex_count, std::vector<int32_t>& indices,
+    bool& out_of_range, thread_pool* pool)
+{
+    const size_t index_size = ply_type_size(index_type);
+    const size_t stride = 1 + 3 * index_size;
+    indices.resize(3 * count);
+    int32_t chunks = chunk_count(pool, count * stride);
+    std::vector<char> not_triangle(chunks, 0);
+    std::vector<char> bad(chunks, 0);
+    parallel_chunks(pool, chunks, [&](int32_t i) {
+        for (int64_t face = count * i / chunks; face < count * (i + 1) / chunks; face++) {
+            const char* record = data + face * stride;
+            not_triangle[i] |= static_cast<uint8_t>(record[0]) != 3;
+            for (int32_t k = 0; k < 3; k++) {
+                double index = ply_read(record + 1 + k * index_size, index_type);
+                /* checked before the conversion, a NaN or an index past int32_t can not be converted */
+                bool valid = index >= 0.0 && index < vertex_count;
+                bad[i] |= !valid;
+                indices[3 * face + k] = valid ? static_cast<int32_t>(index) : -1;
+            }
+        }
+    });
+    out_of_range = std::find(bad.begin(), bad.end(), 1) != bad.end();
+    return std::find(not_triangle.begin(), not_triangle.end(), 1) == not_triangle.end();
+}
+
+/* load_ply */
+bool load_ply(const std::string& path, std::vector<fvec3>& vertices, std::vector<int32_t>& indices, thread_pool* pool)
+{
+    size_t size = 0;
+    std::shared_ptr<const void> storage = map_file(path, size);
+    if (!storage) {
+        std::cout << "load_ply() error: cannot map " << path << std::endl;
+        return false;
+    }
+    const char* base = static_cast<const char*>(storage.get());
+    std::vector<ply_element> elements;
+    size_t offset = 0;
+    std::string error;
+    if (size < 4 || std::memcmp(base, "ply", 3) != 0) {
+        error = "not a ply file";
+    } else {
+        ply_parse_header(base, size, elements, offset, error);
+    }
+
+    /* the offsets of the vertex and face data, the elements after the faces are not read */
+    const ply_element* vertex_element = nullptr;
+    const ply_element* face_element = nullptr;
+    size_t vertex_offset = 0;
+    size_t face_offset = 0;
+    for (const auto& element: elements) {
+        if (!error.empty()) {
+            break;
+        }
+        size_t record_size = ply_record_size(element);
+        if (element.name == "face") {
+            face_element = &element;
+            face_offset = offset;
+            break;
+        }
+        if (record_size == 0) {
+            error = "list property in the element " + element.name;
+            break;
+        }
+        if (element.name == "vertex") {
+            vertex_element = &element;
+            vertex_offset = offset;
+        }
+        /* the count comes from the header, compared before the product can wrap */
+        if (static_cast<uint64_t>(element.count) > (size - offset) / record_size) {
+            error = "truncated file";
+            break;
+        }
+        offset += record_size * element.count;
+    }
+    if (error.empty() && (!vertex_element || !face_element)) {
+        error = "no vertex element before the face element";
+    }
+    if (error.empty() && vertex_element->count > std::numeric_limits<int32_t>::max()) {
+        error = "too many vertices";
+    }
+    if (!error.empty()) {
+        std::cout << "load_ply() error: " << error << " in " << path << std::endl;
+        return false;
+    }
+
+    /* the vertices, x y z at fixed offsets of fixed size records */
+    const size_t vertex_size = ply_record_size(*vertex_element);
+    size_t axis_offset[3] = {};
+    ply_type axis_type[3] = {};
+    int32_t found = 0;
+    size_t property_offset = 0;
+    for (const auto& property: vertex_element->properties) {
+        for (int32_t axis = 0; axis < 3; axis++) {
+            if (property.name == std::string(1, static_cast<char>('x' + axis))) {
+                axis_offset[axis] = property_offset;
+                axis_type[axis] = property.type;
+                found |= 1 << axis;
+            }
+        }
+        property_offset += ply_type_size(property.type);
+    }
+    if (found != 7) {
+        std::cout << "load_ply() error: no x y z vertex properties in " << path << std::endl;
+        return false;
+    }
+    const int32_t vertex_count = static_cast<int32_t>(vertex_element->count);
+    vertices.resize(vertex_count);
+    int32_t chunks = chunk_count(pool, vertex_size * vertex_count);
+    parallel_chunks(pool, chunks, [&](int32_t i) {
+        for (int64_t v = int64_t(vertex_count) * i / chunks; v < int64_t(vertex_count) * (i + 1) / chunks; v++) {
+            const char* record = base + vertex_offset + v * vertex_size;
+            vertices[v] = fvec3(static_cast<float>(ply_read(record + axis_offset[0], axis_type[0])),
+                static_cast<float>(ply_read(record + axis_offset[1], axis_type[1])), static_cast<float>(ply_read(record + axis_offset[2], axis_type[2])));
+        }
+    });
+
+    /* the faces: the first list property is the vertex indices */
+    auto list = std::find_if(face_element->properties.begin(), face_element->properties.end(), [](const ply_property& p) {
+        return p.list;
+    });
+    if (list == face_element->properties.end()) {
+        std::cout << "load_ply() error: no vertex index list in " << path << std::endl;
+        return false;
+    }
+    const int64_t face_count = face_element->count;
+    const size_t index_size = ply_type_size(list->type);
+    const size_t count_size = ply_type_size(list->count_type);
+    /* every face takes at least its fixed properties and the counts of its lists, a count of faces
+     * that can not fit is rejected before any size is computed from it */
+    size_t min_face_size = 0;
+    for (const auto& property: face_element->properties) {
+        min_face_size += ply_type_size(property.list ? property.count_type : property.type);
+    }
+    if (static_cast<uint64_t>(face_count) > (size - face_offset) / min_face_size) {
+        std::cout << "load_ply() error: truncated file " << path << std::endl;
+        return false;
+    }
+    bool out_of_range = false;
+    bool triangles = face_element->properties.size() == 1 && count_size == 1
+        && static_cast<uint64_t>(face_count) <= (size - face_offset) / (1 + 3 * index_size)
+        && ply_read_triangles(base + face_offset, face_count, list->type, vertex_count, indices, out_of_range, pool);
+    if (!triangles) {
+        /* any layout, one face after the other */
+        indices.clear();
+        out_of_range = false;
+        std::vector<int32_t> face;
+        size_t at = face_offset;
+        for (int64_t f = 0; f < face_count && at <= size; f++) {
+            for (const auto& property: face_element->properties) {
+                if (!property.list) {
+                    at += ply_type_size(property.type);
+                    continue;
+                }
+                const size_t item_size = ply_type_size(property.type);
+                if (at + ply_type_size(property.count_type) > size) {
+                    at = size + 1;
+                    break;
+                }
+                double n = ply_read(base + at, property.count_type);
+                at += ply_type_size(property.count_type);
+                /* compared as a double before the conversion, a float count may be anything */
+                if (n > static_cast<double>((size - at) / item_size)) {
+                    at = size + 1;
+                    break;
+                }
+                size_t item_count = n > 0.0 ? static_cast<size_t>(n) : 0;
+                if (&property == &*list) {
+                    face.clear();
+                    for (size_t k = 0; k < item_count; k++) {
+                        double index = ply_read(base + at + k * item_size, property.type);
+                        bool valid = index >= 0.0 && index < vertex_count;
+                        out_of_range |= !valid;
+                        face.push_back(valid ? static_cast<int32_t>(index) : -1);
+                    }
+                    for (size_t k = 1; k + 1 < face.size(); k++) {
+                        indices.insert(indices.end(), {face[0], face[k], face[k + 1]});
+                    }
+                }
+                at += item_count * item_size;
+            }
+        }
+        if (at > size) {
+            std::cout << "load_ply() error: truncated file " << path << std::endl;
+            return false;
+        }
+    }
+    if (out_of_range) {
+        std::cout << "load_ply() error: vertex index out of range in " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/* load_mesh */
+shared_ptr<triangle_mesh> load_mesh(const std::string& path, bvh_build_mode mode, thread_pool* pool)
+{
+    std::vector<fvec3> vertices;
+    std::vector<int32_t> indices;
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    bool loaded = false;
+    if (extension == ".obj") {
+        loaded = load_obj(path, vertices, indices, pool);
+    } else if (extension == ".ply") {
+        loaded = load_ply(path, vertices, indices, pool);
+    } else {
+        std::cout << "load_mesh() error: unknown format " << path << std::endl;
+    }
+    if (!loaded) {
+        return nullptr;
+    }
+    return std::make_shared<triangle_mesh>(std::move(vertices), std::move(indices), mode, pool);
+}
+
+} /* namespace green::core */
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scene.hpp"
+
+namespace green::core
+{
+
+class thread_pool;
+enum class bvh_build_mode;
+
+/* files over this size are cut into chunks parsed by the pool workers, one chunk per worker */
+constexpr size_t mesh_loader_chunk_size = 1 << 20;
+
+/* Wavefront OBJ: the v and f lines, the other lines are skipped. The polygons are split into fans,
+ * negative indices are relative to the last vertex. The mapped file is cut at line starts and the
+ * chunks are parsed on the pool, then joined. Returns false and prints the error when the file
+ * can not be read or an index is out of range. vertices and indices are the input of triangle_mesh */
+bool load_obj(const std::string& path, std::vector<fvec3>& vertices, std::vector<int32_t>& indices, thread_pool* pool = nullptr);
+
+/* binary little endian PLY: the x, y, z properties (float or double) of the vertex element and the
+ * first list property of the face element, the other properties are skipped. The vertex records
+ * have a fixed size and are read in chunks, so are the faces when all of them are triangles with a
+ * uchar count (the common layout). Other faces are split into fans on the calling thread */
+bool load_ply(const std::string& path, std::vector<fvec3>& vertices, std::vector<int32_t>& indices, thread_pool* pool = nullptr);
+
+/* load_obj() or load_ply() by the extension, the result is built straight into a triangle_mesh
+ * (there is no primitive per triangle). nullptr on error */
+shared_ptr<triangle_mesh> load_mesh(const std::string& path, bvh_build_mode mode, thread_pool* pool = nullptr);
+
+} /* namespace green::core */
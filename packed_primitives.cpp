@@ -0,0 +1,290 @@
+#include "packed_primitives.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#include "ray_intersection_test.hpp"
+#include "simd_lanes.hpp"
+
+namespace green::core
+{
+
+/* per ray invariants of the kernels */
+struct packed_ray_type
+{
+    fvec3           origin;
+    fvec3           dir;
+    fvec3           inv_dir;        /* ray_safe_inverse() */
+    fvec3           abs_inv_dir;
+    float           tmin;
+    float           tmax;
+};
+
+/* a block of 8 lanes is 1 (AVX), 2 (SSE) or 8 kernel calls. A block with up to 4 primitives is
+ * tested by one SSE call on AVX too */
+using block_lanes = wide_lanes;
+using half_block_lanes = half_wide_lanes;
+
+/* the kernels of simd_lanes.hpp on O::lanes primitives of the block starting at lane against one
+ * ray. Return the mask of the rejected lanes shifted to lane, near is written for the others */
+template <class O>
+static inline uint32_t lanes_intersection_test(const packed_sphere_block& block, int32_t lane, const packed_ray_type& ray, float* near)
+{
+    typename O::type n;
+    uint32_t miss = lanes_sphere_test<O>(lanes_set1<O>(ray.origin), lanes_set1<O>(ray.dir),
+        lanes_load<O>(block.center_x + lane, block.center_y + lane, block.center_z + lane), O::load(block.radius2 + lane),
+        O::set1(ray.tmin), O::set1(ray.tmax), n);
+    if (miss != lane_mask<O>) {
+        O::store(near + lane, n);
+    }
+    return miss << lane;
+}
+
+template <class O>
+static inline uint32_t lanes_intersection_test(const packed_capsule_block& block, int32_t lane, const packed_ray_type& ray, float* near)
+{
+    typename O::type n;
+    uint32_t miss = lanes_capsule_test<O>(lanes_set1<O>(ray.origin), lanes_set1<O>(ray.dir),
+        lanes_load<O>(block.a_x + lane, block.a_y + lane, block.a_z + lane), lanes_load<O>(block.b_x + lane, block.b_y + lane, block.b_z + lane),
+        lanes_load<O>(block.ba_x + lane, block.ba_y + lane, block.ba_z + lane), O::load(block.baba + lane), O::load(block.radius2 + lane),
+        O::set1(ray.tmin), O::set1(ray.tmax), n);
+    if (miss != lane_mask<O>) {
+        O::store(near + lane, n);
+    }
+    return miss << lane;
+}
+
+template <class O>
+static inline uint32_t lanes_intersection_test(const packed_aabb_block& block, int32_t lane, const packed_ray_type& ray, float* near)
+{
+    typename O::type n;
+    uint32_t miss = lanes_aabb_test<O>(lanes_set1<O>(ray.origin), lanes_set1<O>(ray.inv_dir), lanes_set1<O>(ray.abs_inv_dir),
+        lanes_load<O>(block.center_x + lane, block.center_y + lane, block.center_z + lane),
+        lanes_load<O>(block.size_x + lane, block.size_y + lane, block.size_z + lane), O::set1(ray.tmin), O::set1(ray.tmax), n);
+    O::store(near + lane, n);
+    return miss << lane;
+}
+
+template <class O>
+static inline uint32_t lanes_intersection_test(const packed_plane_block& block, int32_t lane, const packed_ray_type& ray, float* near)
+{
+    typename O::type n;
+    uint32_t miss = lanes_plane_test<O>(lanes_set1<O>(ray.origin), lanes_set1<O>(ray.dir),
+        lanes_load<O>(block.normal_x + lane, block.normal_y + lane, block.normal_z + lane), O::load(block.w + lane),
+        O::set1(ray.tmin), O::set1(ray.tmax), n);
+    O::store(near + lane, n);
+    return miss << lane;
+}
+
+/* mask of the hit lanes of the block, near is written for these lanes */
+template <class B>
+static inline uint32_t block_intersection_test(const B& block, const packed_ray_type& ray, float* near)
+{
+    uint32_t miss = 0;
+    if constexpr (block_lanes::lanes == 8) {
+        miss = block.count <= 4 ? lanes_intersection_test<half_block_lanes>(block, 0, ray, near) : lanes_intersection_test<block_lanes>(block, 0, ray, near);
+    } else {
+        for (int32_t lane = 0; lane < block.count; lane += block_lanes::lanes) {
+            miss |= lanes_intersection_test<block_lanes>(block, lane, ray, near);
+        }
+    }
+    return ~miss & ((1u << block.count) - 1u);
+}
+
+/* the bounds of the block overlap [tmin, max_dist] along the ray, always true for the planes */
+template <class B>
+static inline bool block_bounds_test(const B& block, const packed_ray_type& ray, float max_dist)
+{
+    if constexpr (requires { block.bounds; }) {
+        float near;
+        return block.bounds.intersection_test(ray.origin, ray.inv_dir, ray.tmin, max_dist, near);
+    }
+    return true;
+}
+
+/* keeps the lowest (near, id) of the hit lanes of the blocks, the order bvh::closest_hit() ends with.
+ * The lanes are tested against tmax, not the closest hit so far, so the order of the blocks does not
+ * change the result */
+template <class B>
+static inline void closest_hit_blocks(const std::vector<B>& blocks, const packed_ray_type& ray, float& near, int32_t& ret)
+{
+    alignas(32) float dist[packed_primitives::width];
+    for (const B& block: blocks) {
+        if (!block_bounds_test(block, ray, near)) {
+            continue;
+        }
+        for (uint32_t mask = block_intersection_test(block, ray, dist); mask; mask &= mask - 1) {
+            int32_t lane = std::countr_zero(mask);
+            if (dist[lane] < near || (dist[lane] == near && (ret == -1 || block.id[lane] < ret))) {
+                near = dist[lane];
+                ret = block.id[lane];
+            }
+        }
+    }
+}
+
+/* any hit lane in the blocks */
+template <class B>
+static inline bool occluded_blocks(const std::vector<B>& blocks, const packed_ray_type& ray)
+{
+    alignas(32) float dist[packed_primitives::width];
+    for (const B& block: blocks) {
+        if (block_bounds_test(block, ray, ray.tmax) && block_intersection_test(block, ray, dist)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* packed_primitives::packed_primitives */
+packed_primitives::packed_primitives(const block_vector<primitive>& primitives)
+{
+    build(primitives);
+}
+
+static inline float axis_value(const fvec3& v, int32_t axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+/* puts the primitives close to each other into the same block: splits the longest axis of the
+ * centroids at a multiple of the block width until the range fits in one block */
+static void order_blocks(const std::vector<fvec3>& centroids, std::vector<int32_t>& ids, size_t first, size_t last)
+{
+    constexpr size_t width = packed_primitives::width;
+    if (last - first <= width) {
+        return;
+    }
+    bounds_type bounds;
+    for (size_t i = first; i < last; i++) {
+        bounds.extend(centroids[ids[i]]);
+    }
+    fvec3 extent = bounds.max - bounds.min;
+    int32_t axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+    size_t middle = first + ((last - first) / 2 + width - 1) / width * width;
+    std::nth_element(ids.begin() + first, ids.begin() + middle, ids.begin() + last, [&](int32_t a, int32_t b) {
+        return axis_value(centroids[a], axis) < axis_value(centroids[b], axis);
+    });
+    order_blocks(centroids, ids, first, middle);
+    order_blocks(centroids, ids, middle, last);
+}
+
+/* appends a block when the last one is full, returns the lane of the next primitive */
+template <class B>
+static inline int32_t next_lane(std::vector<B>& blocks, int32_t id)
+{
+    if (blocks.empty() || blocks.back().count == packed_primitives::width) {
+        blocks.emplace_back();
+    }
+    B& block = blocks.back();
+    block.id[block.count] = id;
+    return block.count++;
+}
+
+/* writes lane and the unused lanes after it: they repeat the last primitive, so they miss whenever
+ * it misses and the early outs of the kernels still work. Their results are masked out by count */
+static inline void set_lane(float* field, int32_t lane, float value)
+{
+    std::fill(field + lane, field + packed_primitives::width, value);
+}
+
+/* packed_primitives::build */
+void packed_primitives::build(const block_vector<primitive>& primitives)
+{
+    m_spheres.clear();
+    m_capsules.clear();
+    m_aabbs.clear();
+    m_planes.clear();
+    /* indexed by geometry_type */
+    std::vector<int32_t> ids[4];
+    std::vector<bounds_type> bounds(primitives.size());
+    std::vector<fvec3> centroids(primitives.size());
+    for (size_t i = 0; i < primitives.size(); i++) {
+        ids[primitives[i].type].push_back(static_cast<int32_t>(i));
+        if (primitive_bounds(primitives[i], bounds[i])) {
+            centroids[i] = bounds[i].center();
+        }
+    }
+    for (int32_t type: {geometry_type::sphere, geometry_type::capsule, geometry_type::aabb}) {
+        order_blocks(centroids, ids[type], 0, ids[type].size());
+    }
+
+    for (int32_t id: ids[geometry_type::sphere]) {
+        const sphere_type& sphere = primitives[id].sphere;
+        int32_t lane = next_lane(m_spheres, id);
+        packed_sphere_block& block = m_spheres.back();
+        set_lane(block.center_x, lane, sphere.position.x);
+        set_lane(block.center_y, lane, sphere.position.y);
+        set_lane(block.center_z, lane, sphere.position.z);
+        set_lane(block.radius2, lane, sphere.radius * sphere.radius);
+        block.bounds.extend(bounds[id]);
+    }
+    for (int32_t id: ids[geometry_type::capsule]) {
+        const capsule_type& capsule = primitives[id].capsule;
+        int32_t lane = next_lane(m_capsules, id);
+        packed_capsule_block& block = m_capsules.back();
+        fvec3 ba = capsule.point2 - capsule.point1;
+        set_lane(block.a_x, lane, capsule.point1.x);
+        set_lane(block.a_y, lane, capsule.point1.y);
+        set_lane(block.a_z, lane, capsule.point1.z);
+        set_lane(block.b_x, lane, capsule.point2.x);
+        set_lane(block.b_y, lane, capsule.point2.y);
+        set_lane(block.b_z, lane, capsule.point2.z);
+        set_lane(block.ba_x, lane, ba.x);
+        set_lane(block.ba_y, lane, ba.y);
+        set_lane(block.ba_z, lane, ba.z);
+        set_lane(block.baba, lane, ba.dot(ba));
+        set_lane(block.radius2, lane, capsule.radius * capsule.radius);
+        block.bounds.extend(bounds[id]);
+    }
+    for (int32_t id: ids[geometry_type::aabb]) {
+        const aabb_type& aabb = primitives[id].aabb;
+        int32_t lane = next_lane(m_aabbs, id);
+        packed_aabb_block& block = m_aabbs.back();
+        set_lane(block.center_x, lane, aabb.center.x);
+        set_lane(block.center_y, lane, aabb.center.y);
+        set_lane(block.center_z, lane, aabb.center.z);
+        set_lane(block.size_x, lane, aabb.size.x);
+        set_lane(block.size_y, lane, aabb.size.y);
+        set_lane(block.size_z, lane, aabb.size.z);
+        block.bounds.extend(bounds[id]);
+    }
+    for (int32_t id: ids[geometry_type::plane]) {
+        const plane_type& plane = primitives[id].plane;
+        int32_t lane = next_lane(m_planes, id);
+        packed_plane_block& block = m_planes.back();
+        set_lane(block.normal_x, lane, plane.normal.x);
+        set_lane(block.normal_y, lane, plane.normal.y);
+        set_lane(block.normal_z, lane, plane.normal.z);
+        set_lane(block.w, lane, plane.position.dot(plane.normal));
+    }
+}
+
+/* packed_ray_type of the ray */
+static inline packed_ray_type make_packed_ray(const ray_type& ray, float tmin, float tmax)
+{
+    return packed_ray_type{ray.origin, ray.dir, ray.inv_dir, ray.abs_inv_dir, tmin, tmax};
+}
+
+/* packed_primitives::closest_hit */
+int32_t packed_primitives::closest_hit(const ray_type& ray, float tmin, float tmax, float& near) const
+{
+    packed_ray_type packed_ray = make_packed_ray(ray, tmin, tmax);
+    int32_t ret = -1;
+    near = tmax;
+    closest_hit_blocks(m_spheres, packed_ray, near, ret);
+    closest_hit_blocks(m_capsules, packed_ray, near, ret);
+    closest_hit_blocks(m_aabbs, packed_ray, near, ret);
+    closest_hit_blocks(m_planes, packed_ray, near, ret);
+    return ret;
+}
+
+/* packed_primitives::occluded */
+bool packed_primitives::occluded(const ray_type& ray, float tmin, float tmax) const
+{
+    packed_ray_type packed_ray = make_packed_ray(ray, tmin, tmax);
+    return occluded_blocks(m_spheres, packed_ray) || occluded_blocks(m_capsules, packed_ray)
+        || occluded_blocks(m_aabbs, packed_ray) || occluded_blocks(m_planes, packed_ray);
+}
+
+} /* namespace green::core */
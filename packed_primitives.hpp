@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "scene.hpp"
+
+namespace green::core
+{
+
+/* blocks of up to 8 primitives of one type, the fields read by the near distance test are stored as
+ * structure of arrays. The derived fields are computed once with the same expressions as
+ * ray_intersection_test.cpp, so the kernels return the same distances.
+ * lane: lane < count - id is the index in the source vector, the other lanes are never hit
+ * bounds: union of the lanes, a ray missing it skips the block. Planes are unbounded */
+struct alignas(32) packed_sphere_block
+{
+    float           center_x[8];
+    float           center_y[8];
+    float           center_z[8];
+    float           radius2[8];     /* radius * radius */
+    int32_t         id[8];
+    int32_t         count;
+    bounds_type     bounds;
+};
+
+struct alignas(32) packed_capsule_block
+{
+    float           a_x[8];
+    float           a_y[8];
+    float           a_z[8];
+    float           b_x[8];
+    float           b_y[8];
+    float           b_z[8];
+    float           ba_x[8];        /* b - a */
+    float           ba_y[8];
+    float           ba_z[8];
+    float           baba[8];        /* ba.dot(ba) */
+    float           radius2[8];
+    int32_t         id[8];
+    int32_t         count;
+    bounds_type     bounds;
+};
+
+struct alignas(32) packed_aabb_block
+{
+    float           center_x[8];
+    float           center_y[8];
+    float           center_z[8];
+    float           size_x[8];
+    float           size_y[8];
+    float           size_z[8];
+    int32_t         id[8];
+    int32_t         count;
+    bounds_type     bounds;
+};
+
+struct alignas(32) packed_plane_block
+{
+    float           normal_x[8];
+    float           normal_y[8];
+    float           normal_z[8];
+    float           w[8];           /* position.dot(normal) */
+    int32_t         id[8];
+    int32_t         count;
+};
+
+/* flat SIMD test of a small set of primitives: one AVX (8 lanes) or two SSE (4 lanes) kernel calls
+ * test a whole block without branching on the primitive type. The primitives close to each other
+ * share a block, so the block bounds cull like a one level bvh. Used instead of the bvh by the
+ * scene and the groups with min_flat_count to max_flat_count primitives: below that the blocks are
+ * mostly empty lanes and the bvh culls better, above it the bvh skips more blocks than a kernel
+ * call costs */
+class packed_primitives
+{
+public:
+    static constexpr int32_t    width = 8;
+    static constexpr int32_t    min_flat_count = 16;
+    static constexpr int32_t    max_flat_count = 64;
+
+public:
+                    packed_primitives() = default;
+    explicit        packed_primitives(const block_vector<primitive>& primitives);
+
+    void            build(const block_vector<primitive>& primitives);
+
+    /* the same result as bvh::closest_hit(), the lowest id wins a tie */
+    int32_t         closest_hit(const ray_type& ray, float tmin, float tmax, float& near) const;
+
+    /* the same result as bvh::occluded() */
+    bool            occluded(const ray_type& ray, float tmin, float tmax) const;
+
+private:
+    std::vector<packed_sphere_block>    m_spheres;
+    std::vector<packed_capsule_block>   m_capsules;
+    std::vector<packed_aabb_block>      m_aabbs;
+    std::vector<packed_plane_block>     m_planes;
+}; /* class packed_primitives */
+
+} /* namespace green::core */
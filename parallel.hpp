@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace green::core
+{
+
+/* tasks posted to a thread_pool and waited for together. wait() runs queued tasks of the pool on the
+ * calling thread until the ones of the group are done, so a group may be waited for inside a task of
+ * the same pool and a pool with no threads still completes. The first exception thrown by a task is
+ * rethrown by wait(). Without a pool run() calls the task at once. The destructor waits */
+class task_group
+{
+public:
+    explicit        task_group(thread_pool* pool);
+                    task_group(const task_group&) = delete;
+                    ~task_group();
+
+    task_group&     operator=(const task_group&) = delete;
+
+    template <class F>
+    void            run(F&& f);
+    void            wait();
+
+private:
+    /* shared with the tasks, the last one still notifies after wait() has returned */
+    struct state
+    {
+        std::atomic<int32_t>    pending{0};
+        std::mutex              mutex;
+        std::exception_ptr      error;
+    };
+
+    void            wait_pending();
+
+private:
+    thread_pool*            m_pool;
+    std::shared_ptr<state>  m_state;
+}; /* class task_group */
+
+/* calls fn(lo, hi) for the ranges of grain items covering [begin, end), the last one may be shorter.
+ * The calling thread and up to get_thread_count() tasks of the pool take the next range until none is
+ * left, a costly range does not hold a whole share of them */
+template <class F>
+void parallel_for(thread_pool* pool, int32_t begin, int32_t end, int32_t grain, F&& fn);
+
+/* parallel_for() over the blocks of grain_x x grain_y cells of a width x height grid, row by row:
+ * fn(x0, y0, x1, y1) for the cells [x0, x1) x [y0, y1) */
+template <class F>
+void parallel_for(thread_pool* pool, int32_t width, int32_t height, int32_t grain_x, int32_t grain_y, F&& fn);
+
+/* combine() of map(lo, hi) of the ranges of parallel_for(), starting from identity. The results are
+ * combined in the order of the ranges whatever thread ran them, so a combine() that is not associative
+ * in floating point (a sum) still gives the same result on every run */
+template <class T, class M, class C>
+T parallel_reduce(thread_pool* pool, int32_t begin, int32_t end, int32_t grain, T identity, M&& map, C&& combine);
+
+
+
+/* task_group::task_group */
+inline task_group::task_group(thread_pool* pool)
+    : m_pool{pool}
+    , m_state{std::make_shared<state>()}
+{}
+
+/* task_group::~task_group */
+inline task_group::~task_group()
+{
+    wait_pending();
+}
+
+/* task_group::run */
+template <class F>
+void task_group::run(F&& f)
+{
+    if (!m_pool) {
+        try {
+            f();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            if (!m_state->error) {
+                m_state->error = std::current_exception();
+            }
+        }
+        return;
+    }
+    m_state->pending.fetch_add(1, std::memory_order_relaxed);
+    m_pool->post([s = m_state, f = std::forward<F>(f)]() mutable {
+        try {
+            f();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            if (!s->error) {
+                s->error = std::current_exception();
+            }
+        }
+        if (s->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            s->pending.notify_all();
+        }
+    });
+}
+
+/* task_group::wait_pending */
+inline void task_group::wait_pending()
+{
+    for (;;) {
+        int32_t pending = m_state->pending.load(std::memory_order_acquire);
+        if (pending == 0) {
+            return;
+        }
+        if (m_pool && m_pool->run_one()) {
+            continue;
+        }
+        m_state->pending.wait(pending, std::memory_order_acquire);
+    }
+}
+
+/* task_group::wait */
+inline void task_group::wait()
+{
+    wait_pending();
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        std::swap(error, m_state->error);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/* parallel_for */
+template <class F>
+void parallel_for(thread_pool* pool, int32_t begin, int32_t end, int32_t grain, F&& fn)
+{
+    if (end <= begin) {
+        return;
+    }
+    grain = std::max(1, grain);
+    const int32_t ranges = static_cast<int32_t>((static_cast<int64_t>(end) - begin + grain - 1) / grain);
+    const int32_t workers = pool ? static_cast<int32_t>(std::min<int64_t>(ranges, static_cast<int64_t>(pool->get_thread_count()) + 1)) : 1;
+    std::atomic<int32_t> next{0};
+    auto worker = [&] {
+        for (int32_t r = next.fetch_add(1, std::memory_order_relaxed); r < ranges; r = next.fetch_add(1, std::memory_order_relaxed)) {
+            int32_t lo = begin + r * grain;
+            fn(lo, static_cast<int32_t>(std::min<int64_t>(end, static_cast<int64_t>(lo) + grain)));
+        }
+    };
+    if (workers <= 1) {
+        worker();
+        return;
+    }
+    task_group group(pool);
+    for (int32_t w = 1; w < workers; w++) {
+        group.run(worker);
+    }
+    /* the calling thread is a worker too */
+    worker();
+    group.wait();
+}
+
+/* parallel_for */
+template <class F>
+void parallel_for(thread_pool* pool, int32_t width, int32_t height, int32_t grain_x, int32_t grain_y, F&& fn)
+{
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    grain_x = std::max(1, grain_x);
+    grain_y = std::max(1, grain_y);
+    const int32_t columns = (width + grain_x - 1) / grain_x;
+    const int32_t rows = (height + grain_y - 1) / grain_y;
+    parallel_for(pool, 0, columns * rows, 1, [&](int32_t lo, int32_t hi) {
+        for (int32_t block = lo; block < hi; block++) {
+            int32_t x0 = block % columns * grain_x;
+            int32_t y0 = block / columns * grain_y;
+            fn(x0, y0, std::min(width, x0 + grain_x), std::min(height, y0 + grain_y));
+        }
+    });
+}
+
+/* parallel_reduce */
+template <class T, class M, class C>
+T parallel_reduce(thread_pool* pool, int32_t begin, int32_t end, int32_t grain, T identity, M&& map, C&& combine)
+{
+    if (end <= begin) {
+        return identity;
+    }
+    grain = std::max(1, grain);
+    std::vector<T> partial(static_cast<size_t>((static_cast<int64_t>(end) - begin + grain - 1) / grain), identity);
+    parallel_for(pool, begin, end, grain, [&](int32_t lo, int32_t hi) {
+        partial[(lo - begin) / grain] = map(lo, hi);
+    });
+    T ret = std::move(identity);
+    for (T& p: partial) {
+        ret = combine(std::move(ret), std::move(p));
+    }
+    return ret;
+}
+
+} /* namespace green::core */
@@ -10,19 +10,19 @@ namespace green::core
     }   \
     float a = -ro.dot(norm) + w;    \
     float dist = a / b; \
-    if (dist < 0.0) {   \
+    if (dist < tmin || dist > tmax) {   \
         return false;   \
     }
 
 /* ray_pane_intersection_test */
-bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w)
+bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float tmin, float tmax)
 {
     PLANE_TEST_CALC_COMMON_RET_FALSE();
     return true;
 }
 
 /* ray_pane_intersection_test */
-bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float& near)
+bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float tmin, float tmax, float& near)
 {
     PLANE_TEST_CALC_COMMON_RET_FALSE();
     near = dist;
@@ -30,7 +30,7 @@ bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& n
 }
 
 /* ray_pane_intersection_test */
-bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float& near, fvec3& near_norm)
+bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float tmin, float tmax, float& near, fvec3& near_norm)
 {
     PLANE_TEST_CALC_COMMON_RET_FALSE();
     near = dist;
@@ -39,28 +39,44 @@ bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& n
 }
 
 #define SPH_TEST_CALC_COMMON_RET_FALSE() \
-    fvec3 oc = ro - sph_pos; \
+    fvec3 oc = ro - sph.center; \
     float b = oc.dot(rd); \
-    float c = oc.dot(oc) - sph_r * sph_r; \
+    float c = oc.dot(oc) - sph.radius2; \
     float h = b * b - c; \
     if (h < 0.0) { \
         return false; \
     }
 
 /* ray_sphere_intersection_test */
-bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r)
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax)
 {
     SPH_TEST_CALC_COMMON_RET_FALSE();
+    /* the same condition as the overloads below */
+    h = green::core::math::sqrt(h);
+    float _n = -b - h;
+    return _n >= tmin && _n <= tmax;
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax, float& near)
+{
+    SPH_TEST_CALC_COMMON_RET_FALSE();
+    h = green::core::math::sqrt(h);
+    float _n = -b - h;
+    if (_n < tmin || _n > tmax) {
+        return false;
+    }
+    near = _n;
     return true;
 }
 
 /* ray_sphere_intersection_test */
-bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float& near, float& far)
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax, float& near, float& far)
 {
     SPH_TEST_CALC_COMMON_RET_FALSE();
     h = green::core::math::sqrt(h);
     float _n = -b - h;
-    if (_n < 0.0) {
+    if (_n < tmin || _n > tmax) {
         return false;
     }
     near = _n;
@@ -69,40 +85,75 @@ bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3&
 }
 
 /* ray_sphere_intersection_test */
-bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
 {
     SPH_TEST_CALC_COMMON_RET_FALSE();
     h = green::core::math::sqrt(h);
     float _n = -b - h;
-    if (_n < 0.0) {
+    if (_n < tmin || _n > tmax) {
         return false;
     }
     near = _n;
     far = -b + h;
-    near_norm = (ro + rd * near - sph_pos).normalize_self();
-    far_norm = (ro + rd * far - sph_pos).normalize_self();
+    near_norm = (ro + rd * near - sph.center).normalize_self();
+    far_norm = (ro + rd * far - sph.center).normalize_self();
     return true;
 }
 
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax)
+{
+    return ray_sphere_intersection_test(ro, rd, sphere_record(sph_pos, sph_r), tmin, tmax);
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near)
+{
+    return ray_sphere_intersection_test(ro, rd, sphere_record(sph_pos, sph_r), tmin, tmax, near);
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far)
+{
+    return ray_sphere_intersection_test(ro, rd, sphere_record(sph_pos, sph_r), tmin, tmax, near, far);
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    return ray_sphere_intersection_test(ro, rd, sphere_record(sph_pos, sph_r), tmin, tmax, near, far, near_norm, far_norm);
+}
+
+/* the inverse direction is taken from the precomputed ray */
 #define AABB_TEST_CALC_COMMON_RET_FALSE()   \
-    fvec3 m = 1.0 / rd;    \
-    fvec3 n = m * (ro - aabb_pos); \
-    fvec3 k = m.abs() * aabb_size; \
+    const fvec3& m = ray.inv_dir;  \
+    fvec3 n = m * (ray.origin - aabb_pos); \
+    fvec3 k = ray.abs_inv_dir * aabb_size; \
     fvec3 t1 = -n - k; \
     fvec3 t2 = -n + k; \
     float tN = t1.max();    \
     float tF = t2.min();    \
-    if (tN > tF || tN < 0.0 || tF <= 0.0) { \
+    if (tN > tF || tN < tmin || tN > tmax || tF <= 0.0) { \
         return false;   \
     }
 
-bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size)
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax)
+{
+    AABB_TEST_CALC_COMMON_RET_FALSE();
+    return true;
+}
+
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near)
 {
     AABB_TEST_CALC_COMMON_RET_FALSE();
+    near = tN;
     return true;
 }
 
-bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float& near, float& far)
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far)
 {
     AABB_TEST_CALC_COMMON_RET_FALSE();
     near = tN;
@@ -110,7 +161,8 @@ bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& a
     return true;
 }
 
-bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
 {
     AABB_TEST_CALC_COMMON_RET_FALSE();
     near = tN;
@@ -125,24 +177,81 @@ bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& a
         near_norm = step(t2, fvec3(tF));
         far_norm = step(fvec3(tN), t1);
     }
-    near_norm *= -rd.sign();
+    near_norm *= -ray.sign;
     return true;
 }
 
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax)
+{
+    return ray_aabb_intersection_test(ray_type(ro, rd), aabb_pos, aabb_size, tmin, tmax);
+}
+
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near)
+{
+    return ray_aabb_intersection_test(ray_type(ro, rd), aabb_pos, aabb_size, tmin, tmax, near);
+}
+
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far)
+{
+    return ray_aabb_intersection_test(ray_type(ro, rd), aabb_pos, aabb_size, tmin, tmax, near, far);
+}
+
+/* ray_aabb_intersection_test */
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    return ray_aabb_intersection_test(ray_type(ro, rd), aabb_pos, aabb_size, tmin, tmax, near, far, near_norm, far_norm);
+}
+
 #define AABB_TEST_CALC_COMMON() \
-    fvec3 ba = pb - pa;    \
-    fvec3 oa = ro - pa;    \
-    float baba = ba.dot(ba);    \
+    const fvec3& ba = cap.ba;  \
+    fvec3 oa = ro - cap.pa;    \
+    float baba = cap.baba;  \
     float bard = ba.dot(rd);    \
     float baoa = ba.dot(oa);    \
     float rdoa = rd.dot(oa);    \
     float oaoa = oa.dot(oa);    \
     float a = baba - bard * bard;   \
     float b = baba * rdoa - baoa * bard;    \
-    float c = baba * oaoa - baoa * baoa - cap_r * cap_r * baba; \
+    float c = baba * oaoa - baoa * baoa - cap.radius2 * baba; \
     float h = b * b - a * c;
 
-bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r)
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax)
+{
+    AABB_TEST_CALC_COMMON();
+    if (h >= 0.0) {
+        float sqrth = sqrt(h);
+        float t = (-b - sqrth) / a;
+        float y = baoa + t * bard;
+        // body
+        if (y > 0.0 && y < baba) {
+            if (t < tmin || t > tmax) {
+                return false;
+            }
+            return true;
+        }
+        // caps
+        fvec3 oc = (y <= 0.0) ? oa : ro - cap.pb;
+        b = rd.dot(oc);
+        c = oc.dot(oc) - cap.radius2;
+        h = b * b - c;
+        if (h >= 0.0) {
+            h = sqrt(h);
+            float _n = -b - h;
+            if (_n < tmin || _n > tmax) {
+                return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax, float& near)
 {
     AABB_TEST_CALC_COMMON();
     if (h >= 0.0) {
@@ -151,29 +260,32 @@ bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3
         float y = baoa + t * bard;
         // body
         if (y > 0.0 && y < baba) {
-            if (t < 0.0) {
+            if (t < tmin || t > tmax) {
                 return false;
             }
+            near = t;
             return true;
         }
         // caps
-        fvec3 oc = (y <= 0.0) ? oa : ro - pb;
+        fvec3 oc = (y <= 0.0) ? oa : ro - cap.pb;
         b = rd.dot(oc);
-        c = oc.dot(oc) - cap_r * cap_r;
+        c = oc.dot(oc) - cap.radius2;
         h = b * b - c;
         if (h >= 0.0) {
             h = sqrt(h);
             float _n = -b - h;
-            if (_n < 0.0) {
+            if (_n < tmin || _n > tmax) {
                 return false;
             }
+            near = _n;
             return true;
         }
     }
     return false;
 }
 
-bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float& near, float& far)
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax, float& near, float& far)
 {
     AABB_TEST_CALC_COMMON();
     if (h >= 0.0) {
@@ -182,7 +294,7 @@ bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3
         float y = baoa + t * bard;
         // body
         if (y > 0.0 && y < baba) {
-            if (t < 0.0) {
+            if (t < tmin || t > tmax) {
                 return false;
             }
             near = t;
@@ -190,14 +302,14 @@ bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3
             return true;
         }
         // caps
-        fvec3 oc = (y <= 0.0) ? oa : ro - pb;
+        fvec3 oc = (y <= 0.0) ? oa : ro - cap.pb;
         b = rd.dot(oc);
-        c = oc.dot(oc) - cap_r * cap_r;
+        c = oc.dot(oc) - cap.radius2;
         h = b * b - c;
         if (h >= 0.0) {
             h = sqrt(h);
             float _n = -b - h;
-            if (_n < 0.0) {
+            if (_n < tmin || _n > tmax) {
                 return false;
             }
             near = _n;
@@ -208,7 +320,8 @@ bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3
     return false;
 }
 
-bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
 {
     AABB_TEST_CALC_COMMON();
     if (h >= 0.0) {
@@ -217,7 +330,7 @@ bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3
         float y = baoa + t * bard;
         // body
         if (y > 0.0 && y < baba) {
-            if (t < 0.0) {
+            if (t < tmin || t > tmax) {
                 return false;
             }
             near = t;
@@ -225,14 +338,14 @@ bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3
             goto calc_norm;
         }
         // caps
-        fvec3 oc = (y <= 0.0) ? oa : ro - pb;
+        fvec3 oc = (y <= 0.0) ? oa : ro - cap.pb;
         b = rd.dot(oc);
-        c = oc.dot(oc) - cap_r * cap_r;
+        c = oc.dot(oc) - cap.radius2;
         h = b * b - c;
         if (h >= 0.0) {
             h = sqrt(h);
             float _n = -b - h;
-            if (_n < 0.0) {
+            if (_n < tmin || _n > tmax) {
                 return false;
             }
             near = _n;
@@ -243,14 +356,133 @@ bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3
     return false;
 
 calc_norm:
-    fvec3  p_a = (ro + rd * near) - pa;
-    float hh = math::clamp(p_a.dot(ba) / ba.dot(ba), 0.0f, 1.0f);
-    near_norm = (p_a - hh * ba) / cap_r;
-    p_a = (ro + rd * far) - pa;
-    hh = math::clamp(p_a.dot(ba) / ba.dot(ba), 0.0f, 1.0f);
-    far_norm = (p_a - hh * ba) / cap_r;
+    fvec3  p_a = (ro + rd * near) - cap.pa;
+    float hh = math::clamp(p_a.dot(ba) / baba, 0.0f, 1.0f);
+    near_norm = (p_a - hh * ba) / cap.radius;
+    p_a = (ro + rd * far) - cap.pa;
+    hh = math::clamp(p_a.dot(ba) / baba, 0.0f, 1.0f);
+    far_norm = (p_a - hh * ba) / cap.radius;
     
     return true;
 }
 
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax)
+{
+    return ray_capsule_intersection_test(ro, rd, capsule_record(pa, pb, cap_r), tmin, tmax);
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near)
+{
+    return ray_capsule_intersection_test(ro, rd, capsule_record(pa, pb, cap_r), tmin, tmax, near);
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far)
+{
+    return ray_capsule_intersection_test(ro, rd, capsule_record(pa, pb, cap_r), tmin, tmax, near, far);
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    return ray_capsule_intersection_test(ro, rd, capsule_record(pa, pb, cap_r), tmin, tmax, near, far, near_norm, far_norm);
+}
+
+/* Moller-Trumbore: u and v are the barycentric coordinates of the hit on the edges from v0. A ray
+ * in the plane of the triangle divides by a zero determinant, the comparisons reject the NaN */
+#define TRIANGLE_TEST_CALC_COMMON_RET_FALSE() \
+    fvec3 p = rd.cross(e2); \
+    float inv_det = 1.0f / e1.dot(p); \
+    fvec3 s = ro - v0; \
+    float u = s.dot(p) * inv_det; \
+    fvec3 q = s.cross(e1); \
+    float v = rd.dot(q) * inv_det; \
+    float dist = e2.dot(q) * inv_det; \
+    if (!(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && dist >= tmin && dist <= tmax)) { \
+        return false; \
+    }
+
+/* ray_triangle_intersection_test */
+bool ray_triangle_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& v0, const fvec3& e1, const fvec3& e2, float tmin, float tmax)
+{
+    TRIANGLE_TEST_CALC_COMMON_RET_FALSE();
+    return true;
+}
+
+/* ray_triangle_intersection_test */
+bool ray_triangle_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& v0, const fvec3& e1, const fvec3& e2, float tmin, float tmax, float& near)
+{
+    TRIANGLE_TEST_CALC_COMMON_RET_FALSE();
+    near = dist;
+    return true;
+}
+
+/* ray_pane_intersection_test */
+bool ray_pane_intersection_test(const ray_type& ray, const fvec3& norm, float w, float tmin, float tmax)
+{
+    return ray_pane_intersection_test(ray.origin, ray.dir, norm, w, tmin, tmax);
+}
+
+/* ray_pane_intersection_test */
+bool ray_pane_intersection_test(const ray_type& ray, const fvec3& norm, float w, float tmin, float tmax, float& near)
+{
+    return ray_pane_intersection_test(ray.origin, ray.dir, norm, w, tmin, tmax, near);
+}
+
+/* ray_pane_intersection_test */
+bool ray_pane_intersection_test(const ray_type& ray, const fvec3& norm, float w, float tmin, float tmax, float& near, fvec3& near_norm)
+{
+    return ray_pane_intersection_test(ray.origin, ray.dir, norm, w, tmin, tmax, near, near_norm);
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax)
+{
+    return ray_sphere_intersection_test(ray.origin, ray.dir, sph_pos, sph_r, tmin, tmax);
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near)
+{
+    return ray_sphere_intersection_test(ray.origin, ray.dir, sph_pos, sph_r, tmin, tmax, near);
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far)
+{
+    return ray_sphere_intersection_test(ray.origin, ray.dir, sph_pos, sph_r, tmin, tmax, near, far);
+}
+
+/* ray_sphere_intersection_test */
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    return ray_sphere_intersection_test(ray.origin, ray.dir, sph_pos, sph_r, tmin, tmax, near, far, near_norm, far_norm);
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax)
+{
+    return ray_capsule_intersection_test(ray.origin, ray.dir, pa, pb, cap_r, tmin, tmax);
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near)
+{
+    return ray_capsule_intersection_test(ray.origin, ray.dir, pa, pb, cap_r, tmin, tmax, near);
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far)
+{
+    return ray_capsule_intersection_test(ray.origin, ray.dir, pa, pb, cap_r, tmin, tmax, near, far);
+}
+
+/* ray_capsule_intersection_test */
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    return ray_capsule_intersection_test(ray.origin, ray.dir, pa, pb, cap_r, tmin, tmax, near, far, near_norm, far_norm);
+}
+
 } /* namespace green::core */
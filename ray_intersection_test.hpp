@@ -5,21 +5,161 @@
 namespace green::core
 {
 
-bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w);
-bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float& near);
-bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float& near, fvec3& near_norm);
+/* 1 / rd without infinities, so the slab tests never compute 0 * inf for axis aligned rays */
+inline fvec3 ray_safe_inverse(const fvec3& rd)
+{
+    constexpr float eps = 1e-20f;
+    auto inv = [](float d) {
+        return math::abs(d) > eps ? 1.0f / d : (d < 0.0f ? -1.0f / eps : 1.0f / eps);
+    };
+    return fvec3(inv(rd.x), inv(rd.y), inv(rd.z));
+}
+
+/* a ray with the invariants of the tests computed once, for a ray tested against many boxes and
+ * primitives (a bvh query). The values are the ones the tests compute from rd, the results of the
+ * overloads taking it are the same */
+struct ray_type
+{
+                    ray_type() = default;
+                    ray_type(const fvec3& ro, const fvec3& rd);
+
+    fvec3           origin;
+    fvec3           dir;
+    fvec3           inv_dir;        /* ray_safe_inverse(dir) */
+    fvec3           abs_inv_dir;    /* inv_dir.abs() */
+    fvec3           sign;           /* dir.sign() */
+};
+
+/* the terms of the tests depending only on the primitive, computed once by the render time form of
+ * the primitives (see compiled_primitive) with the expressions of the tests */
+struct sphere_record
+{
+                    sphere_record() = default;
+    constexpr       sphere_record(const fvec3& pos, float r);
+
+    fvec3           center;
+    float           radius;
+    float           radius2;        /* radius * radius */
+};
+
+struct capsule_record
+{
+                    capsule_record() = default;
+    constexpr       capsule_record(const fvec3& a, const fvec3& b, float r);
+
+    fvec3           pa;
+    fvec3           pb;
+    fvec3           ba;             /* pb - pa, the axis */
+    float           baba;           /* ba.dot(ba), the squared length */
+    float           radius;
+    float           radius2;        /* radius * radius */
+};
+
+struct plane_record
+{
+                    plane_record() = default;
+    constexpr       plane_record(const fvec3& pos, const fvec3& norm);
+
+    fvec3           normal;
+    float           w;              /* position.dot(normal), the offset */
+};
+
+/* near is the distance of the first surface along rd, a hit with near outside [tmin, tmax] is a miss.
+ * A ray starting inside a primitive misses it. The overloads returning only near are for finding the
+ * closest primitive, the others compute the far hit and the normals once it is known */
+bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float tmin, float tmax);
+bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float tmin, float tmax, float& near);
+bool ray_pane_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& norm, float w, float tmin, float tmax, float& near, fvec3& near_norm);
+
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax);
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near);
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far);
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax);
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near);
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far);
+bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
 
-bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r);
-bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float& near, float& far);
-bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& sph_pos, float sph_r, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax);
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near);
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far);
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
 
-bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size);
-bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float& near, float& far);
-bool ray_aabb_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& aabb_pos, const fvec3& aabb_size, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+/* two sided, e1 is v1 - v0 and e2 is v2 - v0. The normal is left to the caller (the mesh), see
+ * triangle_mesh::normal() */
+bool ray_triangle_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& v0, const fvec3& e1, const fvec3& e2, float tmin, float tmax);
+bool ray_triangle_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& v0, const fvec3& e1, const fvec3& e2, float tmin, float tmax, float& near);
 
-bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r);
-bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float& near, float& far);
-bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const fvec3& pa, const fvec3& pb, float cap_r, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+/* the overloads above for the precomputed terms of a primitive, the planes take w already */
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax);
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax, float& near);
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax, float& near, float& far);
+bool ray_sphere_intersection_test(const fvec3& ro, const fvec3& rd, const sphere_record& sph, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax);
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax, float& near);
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax, float& near, float& far);
+bool ray_capsule_intersection_test(const fvec3& ro, const fvec3& rd, const capsule_record& cap, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+
+/* the overloads above for a precomputed ray. The aabb test uses the cached inverse direction and
+ * signs, the others have no per ray terms besides the origin and the direction */
+bool ray_pane_intersection_test(const ray_type& ray, const fvec3& norm, float w, float tmin, float tmax);
+bool ray_pane_intersection_test(const ray_type& ray, const fvec3& norm, float w, float tmin, float tmax, float& near);
+bool ray_pane_intersection_test(const ray_type& ray, const fvec3& norm, float w, float tmin, float tmax, float& near, fvec3& near_norm);
+
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax);
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near);
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far);
+bool ray_sphere_intersection_test(const ray_type& ray, const fvec3& sph_pos, float sph_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax);
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near);
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far);
+bool ray_aabb_intersection_test(const ray_type& ray, const fvec3& aabb_pos, const fvec3& aabb_size, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax);
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near);
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far);
+bool ray_capsule_intersection_test(const ray_type& ray, const fvec3& pa, const fvec3& pb, float cap_r, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+
+
+
+/* sphere_record::sphere_record */
+constexpr sphere_record::sphere_record(const fvec3& pos, float r)
+    : center{pos}
+    , radius{r}
+    , radius2{r * r}
+{
+}
+
+/* plane_record::plane_record */
+constexpr plane_record::plane_record(const fvec3& pos, const fvec3& norm)
+    : normal{norm}
+    , w{pos.dot(norm)}
+{
+}
+
+/* capsule_record::capsule_record */
+constexpr capsule_record::capsule_record(const fvec3& a, const fvec3& b, float r)
+    : pa{a}
+    , pb{b}
+    , ba{b - a}
+    , baba{ba.dot(ba)}
+    , radius{r}
+    , radius2{r * r}
+{
+}
+
+/* ray_type::ray_type */
+inline ray_type::ray_type(const fvec3& ro, const fvec3& rd)
+    : origin{ro}
+    , dir{rd}
+    , inv_dir{ray_safe_inverse(rd)}
+    , abs_inv_dir{inv_dir.abs()}
+    , sign{rd.sign()}
+{
+}
 
 
 
@@ -0,0 +1,171 @@
+#include "ray_packet.hpp"
+
+#include <limits>
+
+#include "ray_intersection_test.hpp"
+#include "simd_lanes.hpp"
+#include "triangle_mesh.hpp"
+
+namespace green::core
+{
+
+/* one register per call: the 8 lanes of a packet are 1 (AVX), 2 (SSE) or 8 kernel calls */
+using packet_lanes_type = wide_lanes;
+
+/* ray_packet::set */
+void ray_packet::set(int32_t lane, const fvec3& ro, const fvec3& rd, float lane_tmin, float lane_tmax)
+{
+    fvec3 inv_rd = ray_safe_inverse(rd);
+    fvec3 abs_inv_rd = inv_rd.abs();
+    origin_x[lane] = ro.x;
+    origin_y[lane] = ro.y;
+    origin_z[lane] = ro.z;
+    dir_x[lane] = rd.x;
+    dir_y[lane] = rd.y;
+    dir_z[lane] = rd.z;
+    inv_dir_x[lane] = inv_rd.x;
+    inv_dir_y[lane] = inv_rd.y;
+    inv_dir_z[lane] = inv_rd.z;
+    abs_inv_dir_x[lane] = abs_inv_rd.x;
+    abs_inv_dir_y[lane] = abs_inv_rd.y;
+    abs_inv_dir_z[lane] = abs_inv_rd.z;
+    tmin[lane] = lane_tmin;
+    tmax[lane] = lane_tmax;
+}
+
+/* runs kernel<O>(lane) on the registers holding any lane of mask, returns the rejected lanes. The
+ * skipped registers are left to the mask of the caller */
+template <class O, class K>
+static inline uint32_t packet_kernel(uint32_t mask, K&& kernel)
+{
+    uint32_t miss = 0;
+    for (int32_t lane = 0; lane < ray_packet::width; lane += O::lanes) {
+        if ((mask >> lane) & lane_mask<O>) {
+            miss |= kernel.template operator()<O>(lane) << lane;
+        }
+    }
+    return miss;
+}
+
+/* packet_bounds_test */
+uint32_t packet_bounds_test(const bounds_type& bounds, const ray_packet& packet, uint32_t mask, const float* max_dist, float* near)
+{
+    /* the far_scale of bounds_type::intersection_test() */
+    constexpr float far_scale = 1.0f + 2.0f * 3.0f * std::numeric_limits<float>::epsilon() * 0.5f;
+    uint32_t miss = packet_kernel<packet_lanes_type>(mask, [&]<class O>(int32_t lane) {
+        using V = typename O::type;
+        V t1x = O::mul(O::sub(O::set1(bounds.min.x), O::load(packet.origin_x + lane)), O::load(packet.inv_dir_x + lane));
+        V t1y = O::mul(O::sub(O::set1(bounds.min.y), O::load(packet.origin_y + lane)), O::load(packet.inv_dir_y + lane));
+        V t1z = O::mul(O::sub(O::set1(bounds.min.z), O::load(packet.origin_z + lane)), O::load(packet.inv_dir_z + lane));
+        V t2x = O::mul(O::sub(O::set1(bounds.max.x), O::load(packet.origin_x + lane)), O::load(packet.inv_dir_x + lane));
+        V t2y = O::mul(O::sub(O::set1(bounds.max.y), O::load(packet.origin_y + lane)), O::load(packet.inv_dir_y + lane));
+        V t2z = O::mul(O::sub(O::set1(bounds.max.z), O::load(packet.origin_z + lane)), O::load(packet.inv_dir_z + lane));
+        V tN = O::max(O::max(O::min(t1x, t2x), O::min(t1y, t2y)), O::min(t1z, t2z));
+        V tF = O::mul(O::min(O::min(O::max(t1x, t2x), O::max(t1y, t2y)), O::max(t1z, t2z)), O::set1(far_scale));
+        O::store(near + lane, tN);
+        return O::bits(O::mask_or(O::mask_or(O::gt(tN, tF), O::lt(tF, O::load(packet.tmin + lane))), O::gt(tN, O::load(max_dist + lane))));
+    });
+    return ~miss & mask;
+}
+
+/* the rays of the lanes starting at lane */
+template <class O>
+static inline lanes_vec3<O> packet_origin(const ray_packet& packet, int32_t lane)
+{
+    return lanes_load<O>(packet.origin_x + lane, packet.origin_y + lane, packet.origin_z + lane);
+}
+
+template <class O>
+static inline lanes_vec3<O> packet_direction(const ray_packet& packet, int32_t lane)
+{
+    return lanes_load<O>(packet.dir_x + lane, packet.dir_y + lane, packet.dir_z + lane);
+}
+
+/* primitive_packet_intersection_test, the kernels of simd_lanes.hpp with the fields of the record in
+ * every lane */
+uint32_t primitive_packet_intersection_test(const compiled_primitive& p, const ray_packet& packet, uint32_t mask, const float* tmax, float* near,
+    int32_t* sub_ids)
+{
+    if (p.type == geometry_type::mesh) {
+        return p.mesh.mesh->closest_hit_packet(packet, mask, tmax, near, sub_ids);
+    }
+    for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+        sub_ids[lane] = -1;
+    }
+    uint32_t miss = 0;
+    switch (p.type) {
+    case geometry_type::plane: {
+        const fvec3& normal = p.plane.normal;
+        float w = p.plane.w;
+        miss = packet_kernel<packet_lanes_type>(mask, [&]<class O>(int32_t lane) {
+            typename O::type n;
+            uint32_t ret = lanes_plane_test<O>(packet_origin<O>(packet, lane), packet_direction<O>(packet, lane), lanes_set1<O>(normal), O::set1(w),
+                O::load(packet.tmin + lane), O::load(tmax + lane), n);
+            O::store(near + lane, n);
+            return ret;
+        });
+        break;
+    }
+    case geometry_type::sphere: {
+        const fvec3& center = p.sphere.center;
+        float radius2 = p.sphere.radius2;
+        miss = packet_kernel<packet_lanes_type>(mask, [&]<class O>(int32_t lane) {
+            typename O::type n;
+            uint32_t ret = lanes_sphere_test<O>(packet_origin<O>(packet, lane), packet_direction<O>(packet, lane), lanes_set1<O>(center), O::set1(radius2),
+                O::load(packet.tmin + lane), O::load(tmax + lane), n);
+            if (ret != lane_mask<O>) {
+                O::store(near + lane, n);
+            }
+            return ret;
+        });
+        break;
+    }
+    case geometry_type::capsule: {
+        const fvec3& pa = p.capsule.pa;
+        const fvec3& pb = p.capsule.pb;
+        const fvec3& ba = p.capsule.ba;
+        float baba = p.capsule.baba;
+        float radius2 = p.capsule.radius2;
+        miss = packet_kernel<packet_lanes_type>(mask, [&]<class O>(int32_t lane) {
+            typename O::type n;
+            uint32_t ret = lanes_capsule_test<O>(packet_origin<O>(packet, lane), packet_direction<O>(packet, lane), lanes_set1<O>(pa), lanes_set1<O>(pb),
+                lanes_set1<O>(ba), O::set1(baba), O::set1(radius2), O::load(packet.tmin + lane), O::load(tmax + lane), n);
+            if (ret != lane_mask<O>) {
+                O::store(near + lane, n);
+            }
+            return ret;
+        });
+        break;
+    }
+    case geometry_type::aabb: {
+        fvec3 center = p.aabb.center;
+        fvec3 size = p.aabb.size;
+        miss = packet_kernel<packet_lanes_type>(mask, [&]<class O>(int32_t lane) {
+            typename O::type n;
+            uint32_t ret = lanes_aabb_test<O>(packet_origin<O>(packet, lane),
+                lanes_load<O>(packet.inv_dir_x + lane, packet.inv_dir_y + lane, packet.inv_dir_z + lane),
+                lanes_load<O>(packet.abs_inv_dir_x + lane, packet.abs_inv_dir_y + lane, packet.abs_inv_dir_z + lane), lanes_set1<O>(center),
+                lanes_set1<O>(size), O::load(packet.tmin + lane), O::load(tmax + lane), n);
+            O::store(near + lane, n);
+            return ret;
+        });
+        break;
+    }
+    case geometry_type::mesh:
+        break;
+    }
+    return ~miss & mask;
+}
+
+/* primitive_packet_occlusion_test */
+uint32_t primitive_packet_occlusion_test(const compiled_primitive& p, const ray_packet& packet, uint32_t mask)
+{
+    if (p.type == geometry_type::mesh) {
+        return p.mesh.mesh->occluded_packet(packet, mask);
+    }
+    alignas(32) float near[ray_packet::width];
+    int32_t sub_ids[ray_packet::width];
+    return primitive_packet_intersection_test(p, packet, mask, packet.tmax, near, sub_ids);
+}
+
+} /* namespace green::core */
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+#include "scene.hpp"
+
+namespace green::core
+{
+
+/* up to 8 rays traced together, stored as structure of arrays so one SIMD kernel call tests a
+ * primitive or a box against all of them. The rays of a packet should be coherent (neighbouring
+ * pixels, shadow rays towards one light): they visit the same nodes and the traversal is shared.
+ * lane: bit lane of the active masks, the lanes outside the mask are never read as results */
+struct alignas(32) ray_packet
+{
+    static constexpr int32_t    width = 8;
+
+    /* the derived fields are computed as by the single ray code: inv_dir is ray_safe_inverse() */
+    void            set(int32_t lane, const fvec3& ro, const fvec3& rd, float lane_tmin, float lane_tmax);
+
+    fvec3           origin(int32_t lane) const noexcept;
+    fvec3           direction(int32_t lane) const noexcept;
+
+    float           origin_x[width] = {};
+    float           origin_y[width] = {};
+    float           origin_z[width] = {};
+    float           dir_x[width] = {};
+    float           dir_y[width] = {};
+    float           dir_z[width] = {};
+    float           inv_dir_x[width] = {};
+    float           inv_dir_y[width] = {};
+    float           inv_dir_z[width] = {};
+    float           abs_inv_dir_x[width] = {};
+    float           abs_inv_dir_y[width] = {};
+    float           abs_inv_dir_z[width] = {};
+    float           tmin[width] = {};
+    float           tmax[width] = {};
+}; /* struct ray_packet */
+
+/* the results of raycast() for each lane of a packet, id is -1 for the lanes without a hit */
+struct alignas(32) ray_packet_hit
+{
+    float           near[ray_packet::width];
+    float           far[ray_packet::width];
+    int32_t         id[ray_packet::width];
+    fvec3           normal_near[ray_packet::width];
+    fvec3           normal_far[ray_packet::width];
+};
+
+/* bounds_type::intersection_test() for the lanes in mask, max_dist and near are 32 byte aligned arrays
+ * of width. Returns the mask of the lanes overlapping the box, near is written for them */
+uint32_t packet_bounds_test(const bounds_type& bounds, const ray_packet& packet, uint32_t mask, const float* max_dist, float* near);
+
+/* primitive_intersection_test() returning near and sub_id for the lanes in mask, tmax replaces
+ * packet.tmax (the closest hit so far). Returns the mask of the hit lanes, near and sub_ids are
+ * written for them. The distances are the same as the ones of the single ray tests */
+uint32_t primitive_packet_intersection_test(const compiled_primitive& p, const ray_packet& packet, uint32_t mask, const float* tmax, float* near,
+    int32_t* sub_ids);
+
+/* primitive_occlusion_test() for the lanes in mask, returns the mask of the hit lanes */
+uint32_t primitive_packet_occlusion_test(const compiled_primitive& p, const ray_packet& packet, uint32_t mask);
+
+
+
+/* ray_packet::origin */
+inline fvec3 ray_packet::origin(int32_t lane) const noexcept
+{
+    return fvec3(origin_x[lane], origin_y[lane], origin_z[lane]);
+}
+
+/* ray_packet::direction */
+inline fvec3 ray_packet::direction(int32_t lane) const noexcept
+{
+    return fvec3(dir_x[lane], dir_y[lane], dir_z[lane]);
+}
+
+} /* namespace green::core */
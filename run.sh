@@ -1,2 +1,2 @@
 #!/bin/bash
-g++ -std=c++20 -O3 -Wall -Wextra -Wpedantic -oapp ray_intersection_test.cpp src/engine/camera.cpp main.cpp -Isrc/ -Ithird/ && ./app
+g++ -std=c++20 -O3 -Wall -Wextra -Wpedantic -oapp ray_intersection_test.cpp scene.cpp scene_snapshot.cpp bvh.cpp wide_bvh.cpp compressed_bvh.cpp bvh_benchmark.cpp scene_cache.cpp scene_codegen.cpp packed_primitives.cpp ray_packet.cpp triangle_mesh.cpp geometry_pager.cpp mesh_loader.cpp tile_scheduler.cpp thread_pool_benchmark.cpp src/engine/camera.cpp main.cpp -Isrc/ -Ithird/ -DGREEN_SOURCE_DIR="\"$PWD\"" -ldl "$@" && ./app
@@ -0,0 +1,882 @@
+#include "scene.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <iostream>
+#include <memory>
+
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "compressed_bvh.hpp"
+#include "packed_primitives.hpp"
+#include "ray_intersection_test.hpp"
+#include "ray_packet.hpp"
+#include "scene_codegen.hpp"
+#include "triangle_mesh.hpp"
+
+namespace green::core
+{
+
+static inline fvec3 transform_point(const fmat4& m, const fvec3& p)
+{
+    return fvec3(m.x.x * p.x + m.x.y * p.y + m.x.z * p.z + m.x.w,
+        m.y.x * p.x + m.y.y * p.y + m.y.z * p.z + m.y.w,
+        m.z.x * p.x + m.z.y * p.y + m.z.z * p.z + m.z.w);
+}
+
+static inline fvec3 transform_vector(const fmat4& m, const fvec3& v)
+{
+    return fvec3(m.x.x * v.x + m.x.y * v.y + m.x.z * v.z,
+        m.y.x * v.x + m.y.y * v.y + m.y.z * v.z,
+        m.z.x * v.x + m.z.y * v.y + m.z.z * v.z);
+}
+
+/* normals go back to world space with the transposed inverse */
+static inline fvec3 transform_normal(const fmat4& inverse, const fvec3& n)
+{
+    return fvec3(inverse.x.x * n.x + inverse.y.x * n.y + inverse.z.x * n.z,
+        inverse.x.y * n.x + inverse.y.y * n.y + inverse.z.y * n.z,
+        inverse.x.z * n.x + inverse.y.z * n.y + inverse.z.z * n.z).normalize_self();
+}
+
+/* inverse of the upper 3x4 part, the last row is taken as 0 0 0 1 */
+static fmat4 affine_inverse(const fmat4& m)
+{
+    float c00 = m.y.y * m.z.z - m.y.z * m.z.y;
+    float c01 = m.x.z * m.z.y - m.x.y * m.z.z;
+    float c02 = m.x.y * m.y.z - m.x.z * m.y.y;
+    float c10 = m.y.z * m.z.x - m.y.x * m.z.z;
+    float c11 = m.x.x * m.z.z - m.x.z * m.z.x;
+    float c12 = m.x.z * m.y.x - m.x.x * m.y.z;
+    float c20 = m.y.x * m.z.y - m.y.y * m.z.x;
+    float c21 = m.x.y * m.z.x - m.x.x * m.z.y;
+    float c22 = m.x.x * m.y.y - m.x.y * m.y.x;
+    float det = m.x.x * c00 + m.x.y * c10 + m.x.z * c20;
+    if (det == 0.0f) {
+        std::cout << "instance_type: singular transform" << std::endl;
+        return fmat4(1.0f);
+    }
+    float inv_det = 1.0f / det;
+    fmat4 r(c00 * inv_det, c01 * inv_det, c02 * inv_det, 0.0f,
+        c10 * inv_det, c11 * inv_det, c12 * inv_det, 0.0f,
+        c20 * inv_det, c21 * inv_det, c22 * inv_det, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f);
+    fvec3 t = -transform_vector(r, fvec3(m.x.w, m.y.w, m.z.w));
+    r.x.w = t.x;
+    r.y.w = t.y;
+    r.z.w = t.z;
+    return r;
+}
+
+/* closest hit by testing every primitive, the lowest index wins ties */
+static int32_t closest_hit_brute_force(const block_vector<primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near,
+    int32_t& sub_id)
+{
+    float dist;
+    int32_t dist_sub;
+    near = tmax;
+    sub_id = -1;
+    int32_t ret = -1;
+    for (int32_t i = 0; i < static_cast<int32_t>(primitives.size()); i++) {
+        if (primitive_intersection_test(primitives[i], ray, tmin, near, dist, dist_sub) && (dist < near || ret == -1)) {
+            near = dist;
+            ret = i;
+            sub_id = dist_sub;
+        }
+    }
+    return ret;
+}
+
+/* any hit by testing every primitive */
+static bool occluded_brute_force(const block_vector<primitive>& primitives, const ray_type& ray, float tmin, float tmax)
+{
+    for (const auto& p: primitives) {
+        if (primitive_occlusion_test(p, ray, tmin, tmax)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* builds the structures used by raycast() for the primitives of a scene or of a group */
+template <class T>
+static void build_acceleration(T& owner, bvh_build_mode mode, thread_pool* pool)
+{
+    auto binary = std::make_shared<bvh>(owner.primitives, mode, pool);
+#if GREEN_BVH_ORIENTED_LEAVES
+    binary->orient_leaves(owner.primitives);
+#endif
+    owner.accel = binary;
+#if GREEN_BVH_COMPRESSED
+    owner.compressed_accel = std::make_shared<compressed_bvh>(*binary);
+#elif GREEN_BVH_WIDTH > 2
+    owner.wide_accel = std::make_shared<wide_bvh<GREEN_BVH_WIDTH>>(*binary);
+#endif
+}
+
+/* the packed primitives replace the traversal of a small structure */
+template <class T>
+static void build_packed(T& owner)
+{
+    int32_t count = static_cast<int32_t>(owner.primitives.size());
+    /* a mesh is a traversal of its own, not a lane */
+    bool has_mesh = std::any_of(owner.primitives.begin(), owner.primitives.end(), [](const primitive& p) {
+        return p.type == geometry_type::mesh;
+    });
+    if (count < packed_primitives::min_flat_count || count > packed_primitives::max_flat_count || has_mesh) {
+        owner.packed = nullptr;
+        return;
+    }
+    owner.packed = std::make_shared<packed_primitives>(owner.primitives);
+}
+
+/* the structure used by accel_closest_hit() exists, built or loaded by scene_load_acceleration() */
+template <class T>
+static inline bool has_acceleration(const T& owner)
+{
+#if GREEN_BVH_COMPRESSED
+    return owner.compressed_accel != nullptr;
+#elif GREEN_BVH_WIDTH > 2
+    return owner.wide_accel != nullptr;
+#else
+    return owner.accel != nullptr;
+#endif
+}
+
+/* closest hit in the structure selected by GREEN_BVH_COMPRESSED and GREEN_BVH_WIDTH */
+template <class T>
+static inline int32_t accel_closest_hit(const T& owner, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id)
+{
+    if (owner.packed) {
+        /* never over a mesh */
+        sub_id = -1;
+        return owner.packed->closest_hit(ray, tmin, tmax, near);
+    }
+#if GREEN_BVH_COMPRESSED
+    return owner.compressed_accel->closest_hit(owner.compiled, ray, tmin, tmax, near, sub_id);
+#elif GREEN_BVH_WIDTH > 2
+    return owner.wide_accel->closest_hit(owner.compiled, ray, tmin, tmax, near, sub_id);
+#else
+    return owner.accel->closest_hit(owner.compiled, ray, tmin, tmax, near, sub_id);
+#endif
+}
+
+/* any hit in the structure selected by GREEN_BVH_COMPRESSED and GREEN_BVH_WIDTH */
+template <class T>
+static inline bool accel_occluded(const T& owner, const ray_type& ray, float tmin, float tmax)
+{
+    if (owner.packed) {
+        return owner.packed->occluded(ray, tmin, tmax);
+    }
+#if GREEN_BVH_COMPRESSED
+    return owner.compressed_accel->occluded(owner.compiled, ray, tmin, tmax);
+#elif GREEN_BVH_WIDTH > 2
+    return owner.wide_accel->occluded(owner.compiled, ray, tmin, tmax);
+#else
+    return owner.accel->occluded(owner.compiled, ray, tmin, tmax);
+#endif
+}
+
+/* the ray is moved to object space and normalized there, so the distances are scaled by its length */
+static int32_t instance_closest_hit(const scene& s, const instance_type& inst, bool brute_force, const ray_type& ray, float tmin, float tmax, float& near,
+    int32_t& sub_id)
+{
+    const primitive_group& group = *s.groups[inst.group];
+    float scale;
+    fvec3 local_rd = transform_vector(inst.inverse, ray.dir).normalize_self(scale);
+    ray_type local(transform_point(inst.inverse, ray.origin), local_rd);
+    int32_t ret;
+    if (brute_force || !has_acceleration(group)) {
+        ret = closest_hit_brute_force(group.primitives, local, tmin * scale, tmax * scale, near, sub_id);
+    } else {
+        ret = accel_closest_hit(group, local, tmin * scale, tmax * scale, near, sub_id);
+    }
+    if (ret == -1) {
+        return -1;
+    }
+    near /= scale;
+    return inst.first_id + ret;
+}
+
+/* normal of the triangle of a mesh hit, two sided: it faces the ray like the near normal of the solids */
+static inline fvec3 mesh_hit_normal(const primitive& p, int32_t sub_id, const fvec3& rd)
+{
+    fvec3 ret = p.mesh.mesh->normal(sub_id);
+    return ret.dot(rd) > 0.0f ? -ret : ret;
+}
+
+/* far hit and normals of the closest hit found by raycast(), instance is -1 for s.primitives and
+ * sub_id is the one of the distance phase. The test of a single solid repeats the distance
+ * computation, near is the same. A mesh is not traversed again, its triangle gives the normal */
+static void hit_attributes(const scene& s, int32_t instance, int32_t id, int32_t sub_id, const fvec3& ro, const fvec3& rd, float tmin, float tmax,
+    float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    if (id == -1) {
+        return;
+    }
+    if (instance == -1) {
+        const primitive& p = s.primitives[id];
+        if (p.type == geometry_type::mesh) {
+            near_norm = far_norm = mesh_hit_normal(p, sub_id, rd);
+            far = near;
+            return;
+        }
+        primitive_intersection_test(p, ro, rd, tmin, tmax, near, far, near_norm, far_norm);
+        return;
+    }
+    const instance_type& inst = s.instances[instance];
+    const primitive& p = s.groups[inst.group]->primitives[id - inst.first_id];
+    if (p.type == geometry_type::mesh) {
+        near_norm = far_norm = transform_normal(inst.inverse, mesh_hit_normal(p, sub_id, transform_vector(inst.inverse, rd)));
+        far = near;
+        return;
+    }
+    fvec3 local_ro = transform_point(inst.inverse, ro);
+    float scale;
+    fvec3 local_rd = transform_vector(inst.inverse, rd).normalize_self(scale);
+    primitive_intersection_test(p, local_ro, local_rd, tmin * scale, tmax * scale, near, far, near_norm, far_norm);
+    near /= scale;
+    far /= scale;
+    near_norm = transform_normal(inst.inverse, near_norm);
+    far_norm = transform_normal(inst.inverse, far_norm);
+}
+
+/* the same object space ray as instance_closest_hit() */
+static bool instance_occluded(const scene& s, const instance_type& inst, bool brute_force, const ray_type& ray, float tmin, float tmax)
+{
+    const primitive_group& group = *s.groups[inst.group];
+    float scale;
+    fvec3 local_rd = transform_vector(inst.inverse, ray.dir).normalize_self(scale);
+    ray_type local(transform_point(inst.inverse, ray.origin), local_rd);
+    if (brute_force || !has_acceleration(group)) {
+        return occluded_brute_force(group.primitives, local, tmin * scale, tmax * scale);
+    }
+    return accel_occluded(group, local, tmin * scale, tmax * scale);
+}
+
+/* primitive lists up to this size are tested against the whole packet without a structure */
+constexpr size_t packet_flat_count = 16;
+
+/* closest hit of the lanes in the primitives of a scene or of a group, the result of
+ * accel_closest_hit() (or of closest_hit_brute_force() without a structure) for each lane */
+template <class T>
+static void closest_hit_packet(const T& owner, const ray_packet& packet, uint32_t active, int32_t* ids, float* near, int32_t* sub_ids)
+{
+    if (owner.primitives.size() > packet_flat_count && owner.accel) {
+        owner.accel->closest_hit_packet(owner.compiled, packet, active, ids, near, sub_ids);
+        return;
+    }
+    for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+        ids[lane] = -1;
+        near[lane] = packet.tmax[lane];
+        sub_ids[lane] = -1;
+    }
+    alignas(32) float dist[ray_packet::width];
+    int32_t dist_sub[ray_packet::width];
+    for (int32_t i = 0; i < static_cast<int32_t>(owner.compiled.size()); i++) {
+        for (uint32_t hit = primitive_packet_intersection_test(owner.compiled[i], packet, active, near, dist, dist_sub); hit; hit &= hit - 1) {
+            int32_t lane = std::countr_zero(hit);
+            if (dist[lane] < near[lane] || ids[lane] == -1) {
+                near[lane] = dist[lane];
+                ids[lane] = i;
+                sub_ids[lane] = dist_sub[lane];
+            }
+        }
+    }
+}
+
+/* any hit of the lanes in the primitives of a scene or of a group, chosen as by closest_hit_packet() */
+template <class T>
+static uint32_t occluded_packet(const T& owner, const ray_packet& packet, uint32_t active)
+{
+    if (owner.primitives.size() > packet_flat_count && owner.accel) {
+        return owner.accel->occluded_packet(owner.compiled, packet, active);
+    }
+    uint32_t ret = 0;
+    for (size_t i = 0; i < owner.compiled.size() && ret != active; i++) {
+        ret |= primitive_packet_occlusion_test(owner.compiled[i], packet, active & ~ret);
+    }
+    return ret;
+}
+
+/* the object space packet of instance_closest_hit(), tmax is the closest hit of each lane so far.
+ * Returns the mask of the hit lanes, ids, near and sub_ids are written for them */
+static uint32_t instance_closest_hit_packet(const scene& s, const instance_type& inst, const ray_packet& packet, uint32_t mask, const float* tmax,
+    int32_t* ids, float* near, int32_t* sub_ids)
+{
+    const primitive_group& group = *s.groups[inst.group];
+    ray_packet local;
+    float scale[ray_packet::width];
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int32_t lane = std::countr_zero(m);
+        fvec3 local_ro = transform_point(inst.inverse, packet.origin(lane));
+        fvec3 local_rd = transform_vector(inst.inverse, packet.direction(lane)).normalize_self(scale[lane]);
+        local.set(lane, local_ro, local_rd, packet.tmin[lane] * scale[lane], tmax[lane] * scale[lane]);
+    }
+    closest_hit_packet(group, local, mask, ids, near, sub_ids);
+    uint32_t ret = 0;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int32_t lane = std::countr_zero(m);
+        if (ids[lane] != -1) {
+            near[lane] /= scale[lane];
+            ids[lane] += inst.first_id;
+            ret |= 1u << lane;
+        }
+    }
+    return ret;
+}
+
+/* the object space packet of instance_occluded() */
+static uint32_t instance_occluded_packet(const scene& s, const instance_type& inst, const ray_packet& packet, uint32_t mask)
+{
+    ray_packet local;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int32_t lane = std::countr_zero(m);
+        fvec3 local_ro = transform_point(inst.inverse, packet.origin(lane));
+        float scale;
+        fvec3 local_rd = transform_vector(inst.inverse, packet.direction(lane)).normalize_self(scale);
+        local.set(lane, local_ro, local_rd, packet.tmin[lane] * scale, packet.tmax[lane] * scale);
+    }
+    return occluded_packet(*s.groups[inst.group], local, mask);
+}
+
+/* instance_type::instance_type */
+instance_type::instance_type(int32_t group, const fmat4& transform)
+    : group{group}
+    , transform{transform}
+    , inverse{affine_inverse(transform)}
+{
+}
+
+/* instance_type::instance_type */
+instance_type::instance_type(int32_t group, const fquat& rotation, const fvec3& translation, float scale)
+    : group{group}
+{
+    transform = rotation.normalize().to_mat4() * scale;
+    transform.x.w = translation.x;
+    transform.y.w = translation.y;
+    transform.z.w = translation.z;
+    transform.w = fvec4(0.0f, 0.0f, 0.0f, 1.0f);
+    inverse = affine_inverse(transform);
+}
+
+/* mesh_type::mesh_type */
+mesh_type::mesh_type(const triangle_mesh& mesh)
+    : mesh{&mesh}
+    , bounds{mesh.get_bounds()}
+{
+}
+
+/* primitive_intersection_test */
+bool primitive_intersection_test(const primitive& p, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id)
+{
+    sub_id = -1;
+    switch (p.type) {
+    case geometry_type::plane:
+        return ray_pane_intersection_test(ray, p.plane.normal, p.plane.position.dot(p.plane.normal), tmin, tmax, near);
+    case geometry_type::sphere:
+        return ray_sphere_intersection_test(ray, p.sphere.position, p.sphere.radius, tmin, tmax, near);
+    case geometry_type::capsule:
+        return ray_capsule_intersection_test(ray, p.capsule.point1, p.capsule.point2, p.capsule.radius, tmin, tmax, near);
+    case geometry_type::aabb:
+        return ray_aabb_intersection_test(ray, p.aabb.center, p.aabb.size, tmin, tmax, near);
+    case geometry_type::mesh:
+        sub_id = p.mesh.mesh->closest_hit(ray, tmin, tmax, near);
+        return sub_id != -1;
+    }
+    return false;
+}
+
+/* primitive_intersection_test */
+bool primitive_intersection_test(const primitive& p, const ray_type& ray, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    switch (p.type) {
+    case geometry_type::plane:
+        if (ray_pane_intersection_test(ray, p.plane.normal, p.plane.position.dot(p.plane.normal), tmin, tmax, near, near_norm)) {
+            far = near;
+            far_norm = near_norm;
+            return true;
+        }
+        return false;
+    case geometry_type::sphere:
+        return ray_sphere_intersection_test(ray, p.sphere.position, p.sphere.radius, tmin, tmax, near, far, near_norm, far_norm);
+    case geometry_type::capsule:
+        return ray_capsule_intersection_test(ray, p.capsule.point1, p.capsule.point2, p.capsule.radius, tmin, tmax, near, far, near_norm, far_norm);
+    case geometry_type::aabb:
+        return ray_aabb_intersection_test(ray, p.aabb.center, p.aabb.size, tmin, tmax, near, far, near_norm, far_norm);
+    case geometry_type::mesh: {
+        int32_t triangle = p.mesh.mesh->closest_hit(ray, tmin, tmax, near);
+        if (triangle == -1) {
+            return false;
+        }
+        /* two sided, the normal faces the ray like the near normal of the solids */
+        near_norm = p.mesh.mesh->normal(triangle);
+        if (near_norm.dot(ray.dir) > 0.0f) {
+            near_norm = -near_norm;
+        }
+        far = near;
+        far_norm = near_norm;
+        return true;
+    }
+    }
+    return false;
+}
+
+/* primitive_occlusion_test */
+bool primitive_occlusion_test(const primitive& p, const ray_type& ray, float tmin, float tmax)
+{
+    switch (p.type) {
+    case geometry_type::plane:
+        return ray_pane_intersection_test(ray, p.plane.normal, p.plane.position.dot(p.plane.normal), tmin, tmax);
+    case geometry_type::sphere:
+        return ray_sphere_intersection_test(ray, p.sphere.position, p.sphere.radius, tmin, tmax);
+    case geometry_type::capsule:
+        return ray_capsule_intersection_test(ray, p.capsule.point1, p.capsule.point2, p.capsule.radius, tmin, tmax);
+    case geometry_type::aabb:
+        return ray_aabb_intersection_test(ray, p.aabb.center, p.aabb.size, tmin, tmax);
+    case geometry_type::mesh:
+        return p.mesh.mesh->occluded(ray, tmin, tmax);
+    }
+    return false;
+}
+
+/* primitive_intersection_test */
+bool primitive_intersection_test(const primitive& p, const fvec3& ro, const fvec3& rd, float tmin, float tmax, float& near)
+{
+    int32_t sub_id;
+    return primitive_intersection_test(p, ray_type(ro, rd), tmin, tmax, near, sub_id);
+}
+
+/* primitive_intersection_test */
+bool primitive_intersection_test(const primitive& p, const fvec3& ro, const fvec3& rd, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm)
+{
+    return primitive_intersection_test(p, ray_type(ro, rd), tmin, tmax, near, far, near_norm, far_norm);
+}
+
+/* primitive_occlusion_test */
+bool primitive_occlusion_test(const primitive& p, const fvec3& ro, const fvec3& rd, float tmin, float tmax)
+{
+    return primitive_occlusion_test(p, ray_type(ro, rd), tmin, tmax);
+}
+
+/* primitive_intersection_test */
+bool primitive_intersection_test(const compiled_primitive& p, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id)
+{
+    sub_id = -1;
+    switch (p.type) {
+    case geometry_type::plane:
+        return ray_pane_intersection_test(ray, p.plane.normal, p.plane.w, tmin, tmax, near);
+    case geometry_type::sphere:
+        return ray_sphere_intersection_test(ray.origin, ray.dir, p.sphere, tmin, tmax, near);
+    case geometry_type::capsule:
+        return ray_capsule_intersection_test(ray.origin, ray.dir, p.capsule, tmin, tmax, near);
+    case geometry_type::aabb:
+        return ray_aabb_intersection_test(ray, p.aabb.center, p.aabb.size, tmin, tmax, near);
+    case geometry_type::mesh:
+        sub_id = p.mesh.mesh->closest_hit(ray, tmin, tmax, near);
+        return sub_id != -1;
+    }
+    return false;
+}
+
+/* primitive_occlusion_test */
+bool primitive_occlusion_test(const compiled_primitive& p, const ray_type& ray, float tmin, float tmax)
+{
+    switch (p.type) {
+    case geometry_type::plane:
+        return ray_pane_intersection_test(ray, p.plane.normal, p.plane.w, tmin, tmax);
+    case geometry_type::sphere:
+        return ray_sphere_intersection_test(ray.origin, ray.dir, p.sphere, tmin, tmax);
+    case geometry_type::capsule:
+        return ray_capsule_intersection_test(ray.origin, ray.dir, p.capsule, tmin, tmax);
+    case geometry_type::aabb:
+        return ray_aabb_intersection_test(ray, p.aabb.center, p.aabb.size, tmin, tmax);
+    case geometry_type::mesh:
+        return p.mesh.mesh->occluded(ray, tmin, tmax);
+    }
+    return false;
+}
+
+/* compile_primitives */
+block_vector<compiled_primitive> compile_primitives(const block_vector<primitive>& primitives)
+{
+    block_vector<compiled_primitive> ret;
+    for (const auto& p: primitives) {
+        ret.push_back(compile_primitive(p));
+    }
+    return ret;
+}
+
+/* scene_build_acceleration */
+void scene_build_acceleration(scene& s)
+{
+    scene_build_acceleration(s, bvh_build_mode::sweep_sah, nullptr);
+}
+
+/* scene_build_acceleration */
+void scene_build_acceleration(scene& s, bvh_build_mode mode, thread_pool* pool)
+{
+    s.native = nullptr;
+    scene_compile(s);
+    build_acceleration(s, mode, pool);
+    for (size_t g = 0; g < s.groups.size(); g++) {
+        if (!has_acceleration(*s.groups[g])) {
+            primitive_group& group = scene_edit_group(s, static_cast<int32_t>(g));
+            build_acceleration(group, mode, pool);
+            group.bounds = group.accel->get_nodes().empty() ? bounds_type() : group.accel->get_nodes()[0].bounds;
+        }
+    }
+    scene_build_packed(s);
+    scene_update_instances(s, pool);
+}
+
+/* scene_compile */
+void scene_compile(scene& s)
+{
+    s.compiled = compile_primitives(s.primitives);
+    for (size_t g = 0; g < s.groups.size(); g++) {
+        primitive_group& group = scene_edit_group(s, static_cast<int32_t>(g));
+        group.compiled = compile_primitives(group.primitives);
+    }
+}
+
+/* scene_compile */
+void scene_compile(scene& s, const std::vector<int32_t>& touched)
+{
+    /* only the blocks of the touched records are copied */
+    for (int32_t i: touched) {
+        s.compiled.mutate(i) = compile_primitive(s.primitives[i]);
+    }
+}
+
+/* scene_build_packed */
+void scene_build_packed(scene& s)
+{
+    build_packed(s);
+    for (size_t g = 0; g < s.groups.size(); g++) {
+        build_packed(scene_edit_group(s, static_cast<int32_t>(g)));
+    }
+}
+
+/* scene_update_instances */
+void scene_update_instances(scene& s, thread_pool* pool)
+{
+    if (s.instances.empty()) {
+        s.instance_accel = nullptr;
+        return;
+    }
+    std::vector<bounds_type> bounds(s.instances.size());
+    int32_t first_id = static_cast<int32_t>(s.primitives.size());
+    for (size_t i = 0; i < s.instances.size(); i++) {
+        instance_type& inst = s.instances[i];
+        const primitive_group& group = *s.groups[inst.group];
+        inst.first_id = first_id;
+        first_id += static_cast<int32_t>(group.primitives.size());
+        if (group.bounds.is_empty()) {
+            continue;
+        }
+        const bounds_type& local = group.bounds;
+        for (int32_t corner = 0; corner < 8; corner++) {
+            fvec3 p((corner & 1) ? local.max.x : local.min.x, (corner & 2) ? local.max.y : local.min.y, (corner & 4) ? local.max.z : local.min.z);
+            bounds[i].extend(transform_point(inst.transform, p));
+        }
+    }
+    auto top = std::make_shared<bvh>();
+    top->build(bounds, bvh_build_mode::binned_sah, pool);
+    s.instance_accel = top;
+}
+
+/* scene_update_acceleration */
+void scene_update_acceleration(scene& s, const std::vector<int32_t>& moved)
+{
+    if (!s.accel) {
+        scene_build_acceleration(s);
+        return;
+    }
+    s.native = nullptr;
+    scene_compile(s, moved);
+    /* a structure shared with another version of the scene (scene_snapshot::edit()) is copied before
+     * the refit: the copy shares the blocks of nodes, the refit copies the blocks on the paths from the
+     * moved leaves to the root and the readers of that version keep the ones they traverse */
+    if (s.accel.use_count() > 1) {
+        s.accel = std::make_shared<bvh>(*s.accel);
+    }
+    s.accel->refit(s.primitives, moved);
+#if GREEN_BVH_COMPRESSED
+    if (s.compressed_accel.use_count() > 1) {
+        s.compressed_accel = std::make_shared<compressed_bvh>(*s.compressed_accel);
+    }
+    s.compressed_accel->refit(*s.accel);
+#elif GREEN_BVH_WIDTH > 2
+    if (s.wide_accel.use_count() > 1) {
+        s.wide_accel = std::make_shared<wide_bvh<GREEN_BVH_WIDTH>>(*s.wide_accel);
+    }
+    s.wide_accel->refit(*s.accel);
+#endif
+    /* at most max_flat_count primitives, built again */
+    if (s.packed.use_count() > 1) {
+        s.packed = std::make_shared<packed_primitives>(s.primitives);
+    } else if (s.packed) {
+        s.packed->build(s.primitives);
+    }
+}
+
+/* scene_update_group */
+void scene_update_group(scene& s, int32_t group, bvh_build_mode mode, thread_pool* pool)
+{
+    primitive_group& g = scene_edit_group(s, group);
+    g.compiled = compile_primitives(g.primitives);
+    /* new structures, the ones of the group may be shared with another version of the scene */
+    g.wide_accel = nullptr;
+    g.compressed_accel = nullptr;
+    build_acceleration(g, mode, pool);
+    g.bounds = g.accel->get_nodes().empty() ? bounds_type() : g.accel->get_nodes()[0].bounds;
+    build_packed(g);
+    scene_update_instances(s, pool);
+}
+
+/* scene_edit_group */
+primitive_group& scene_edit_group(scene& s, int32_t group)
+{
+    auto copy = std::make_shared<primitive_group>(*s.groups[group]);
+    s.groups[group] = copy;
+    return *copy;
+}
+
+/* scene_features */
+uint32_t scene_features(const scene& s)
+{
+    uint32_t ret = s.instances.empty() ? 0u : scene_feature_instances;
+    auto scan = [&ret](const block_vector<primitive>& primitives) {
+        for (const auto& p: primitives) {
+            ret |= scene_feature_plane << p.type;
+            ret |= p.glowing > 0.0f ? scene_feature_emissive : 0u;
+            ret |= p.transparent ? scene_feature_transparent : 0u;
+            ret |= p.specular > 0.0f ? scene_feature_specular : 0u;
+            ret |= p.roughness != 1.0f ? scene_feature_glossy : 0u;
+        }
+    };
+    scan(s.primitives);
+    std::vector<char> used(s.groups.size(), 0);
+    for (const auto& inst: s.instances) {
+        used[inst.group] = 1;
+    }
+    for (size_t g = 0; g < s.groups.size(); g++) {
+        if (used[g]) {
+            scan(s.groups[g]->primitives);
+        }
+    }
+    return ret;
+}
+
+/* scene_primitive */
+const primitive& scene_primitive(const scene& s, int32_t id)
+{
+    if (id < static_cast<int32_t>(s.primitives.size())) {
+        return s.primitives[id];
+    }
+    auto it = std::upper_bound(s.instances.begin(), s.instances.end(), id, [](int32_t v, const instance_type& inst) {
+        return v < inst.first_id;
+    });
+    const instance_type& inst = *(it - 1);
+    return s.groups[inst.group]->primitives[id - inst.first_id];
+}
+
+/* raycast */
+int raycast(const scene& s, const fvec3& origin, const fvec3& direction, float tmin, float tmax, float& near, float& far, fvec3& normal_near, fvec3& normal_far)
+{
+    if (!has_acceleration(s)) {
+        return raycast_brute_force(s, origin, direction, tmin, tmax, near, far, normal_near, normal_far);
+    }
+    /* the inverse direction is shared by the structures of the scene and the top level */
+    ray_type ray(origin, direction);
+    /* the native kernel is only compiled for scenes without meshes */
+    int32_t sub_id = -1;
+    int ret = s.native ? s.native->closest_hit(ray, tmin, tmax, near) : accel_closest_hit(s, ray, tmin, tmax, near, sub_id);
+    int32_t hit_instance = -1;
+    if (s.instance_accel) {
+        float dist;
+        int32_t dist_sub;
+        s.instance_accel->traverse(ray, tmin, near, [&](int32_t i) {
+            int32_t id = instance_closest_hit(s, s.instances[i], false, ray, tmin, near, dist, dist_sub);
+            if (id != -1 && (dist < near || (dist == near && (ret == -1 || id < ret)))) {
+                near = dist;
+                ret = id;
+                sub_id = dist_sub;
+                hit_instance = i;
+            }
+        });
+    }
+    hit_attributes(s, hit_instance, ret, sub_id, origin, direction, tmin, tmax, near, far, normal_near, normal_far);
+#ifdef GREEN_BVH_CROSS_CHECK
+    float check_near;
+    float check_far;
+    fvec3 check_normal_near;
+    fvec3 check_normal_far;
+    int check = raycast_brute_force(s, origin, direction, tmin, tmax, check_near, check_far, check_normal_near, check_normal_far);
+    if (check != ret || (ret != -1 && check_near != near)) {
+        std::cout << "raycast() error: bvh hit " << ret << " at " << near << ", brute force hit " << check << " at " << check_near << std::endl;
+    }
+#endif
+    return ret;
+}
+
+/* raycast_occluded */
+bool raycast_occluded(const scene& s, const fvec3& origin, const fvec3& direction, float tmin, float tmax)
+{
+    ray_type ray(origin, direction);
+    bool ret = false;
+    if (!has_acceleration(s)) {
+        ret = occluded_brute_force(s.primitives, ray, tmin, tmax);
+        for (size_t i = 0; i < s.instances.size() && !ret; i++) {
+            ret = instance_occluded(s, s.instances[i], true, ray, tmin, tmax);
+        }
+        return ret;
+    }
+    ret = s.native ? s.native->occluded(ray, tmin, tmax) : accel_occluded(s, ray, tmin, tmax);
+    if (!ret && s.instance_accel) {
+        float near = tmax;
+        s.instance_accel->traverse(ray, tmin, near, [&](int32_t i) {
+            if (instance_occluded(s, s.instances[i], false, ray, tmin, tmax)) {
+                ret = true;
+                near = -std::numeric_limits<float>::infinity();
+            }
+        });
+    }
+#ifdef GREEN_BVH_CROSS_CHECK
+    float check_near;
+    float check_far;
+    fvec3 check_normal_near;
+    fvec3 check_normal_far;
+    int check = raycast_brute_force(s, origin, direction, tmin, tmax, check_near, check_far, check_normal_near, check_normal_far);
+    if ((check != -1) != ret) {
+        std::cout << "raycast_occluded() error: bvh " << ret << ", brute force hit " << check << " at " << check_near << std::endl;
+    }
+#endif
+    return ret;
+}
+
+/* raycast_packet */
+uint32_t raycast_packet(const scene& s, const ray_packet& packet, uint32_t active, ray_packet_hit& hit)
+{
+    uint32_t ret = 0;
+    if (!has_acceleration(s)) {
+        for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+            hit.id[lane] = -1;
+            if ((active >> lane) & 1u) {
+                hit.id[lane] = raycast(s, packet.origin(lane), packet.direction(lane), packet.tmin[lane], packet.tmax[lane], hit.near[lane], hit.far[lane],
+                    hit.normal_near[lane], hit.normal_far[lane]);
+                ret |= hit.id[lane] != -1 ? 1u << lane : 0u;
+            }
+        }
+        return ret;
+    }
+    int32_t sub_ids[ray_packet::width];
+    closest_hit_packet(s, packet, active, hit.id, hit.near, sub_ids);
+    int32_t hit_instance[ray_packet::width] = {-1, -1, -1, -1, -1, -1, -1, -1};
+    if (s.instance_accel) {
+        alignas(32) float dist[ray_packet::width];
+        int32_t ids[ray_packet::width];
+        int32_t dist_sub[ray_packet::width];
+        s.instance_accel->traverse_packet(packet, active, hit.near, [&](int32_t i, uint32_t mask) {
+            for (uint32_t m = instance_closest_hit_packet(s, s.instances[i], packet, mask, hit.near, ids, dist, dist_sub); m; m &= m - 1) {
+                int32_t lane = std::countr_zero(m);
+                if (dist[lane] < hit.near[lane] || (dist[lane] == hit.near[lane] && (hit.id[lane] == -1 || ids[lane] < hit.id[lane]))) {
+                    hit.near[lane] = dist[lane];
+                    hit.id[lane] = ids[lane];
+                    sub_ids[lane] = dist_sub[lane];
+                    hit_instance[lane] = i;
+                }
+            }
+        });
+    }
+    for (uint32_t mask = active; mask; mask &= mask - 1) {
+        int32_t lane = std::countr_zero(mask);
+        hit_attributes(s, hit_instance[lane], hit.id[lane], sub_ids[lane], packet.origin(lane), packet.direction(lane), packet.tmin[lane], packet.tmax[lane],
+            hit.near[lane], hit.far[lane], hit.normal_near[lane], hit.normal_far[lane]);
+        ret |= hit.id[lane] != -1 ? 1u << lane : 0u;
+#ifdef GREEN_BVH_CROSS_CHECK
+        float check_near;
+        float check_far;
+        fvec3 check_normal_near;
+        fvec3 check_normal_far;
+        int check = raycast_brute_force(s, packet.origin(lane), packet.direction(lane), packet.tmin[lane], packet.tmax[lane], check_near, check_far,
+            check_normal_near, check_normal_far);
+        if (check != hit.id[lane] || (check != -1 && check_near != hit.near[lane])) {
+            std::cout << "raycast_packet() error: lane " << lane << " hit " << hit.id[lane] << " at " << hit.near[lane] << ", brute force hit " << check
+                << " at " << check_near << std::endl;
+        }
+#endif
+    }
+    return ret;
+}
+
+/* raycast_occluded_packet */
+uint32_t raycast_occluded_packet(const scene& s, const ray_packet& packet, uint32_t active)
+{
+    uint32_t ret = 0;
+    if (!has_acceleration(s)) {
+        for (uint32_t mask = active; mask; mask &= mask - 1) {
+            int32_t lane = std::countr_zero(mask);
+            if (raycast_occluded(s, packet.origin(lane), packet.direction(lane), packet.tmin[lane], packet.tmax[lane])) {
+                ret |= 1u << lane;
+            }
+        }
+        return ret;
+    }
+    ret = occluded_packet(s, packet, active);
+    if (ret != active && s.instance_accel) {
+        /* an occluded lane leaves the traversal */
+        alignas(32) float near[ray_packet::width];
+        for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+            near[lane] = (ret >> lane) & 1u ? -std::numeric_limits<float>::infinity() : packet.tmax[lane];
+        }
+        s.instance_accel->traverse_packet(packet, active & ~ret, near, [&](int32_t i, uint32_t mask) {
+            for (uint32_t m = instance_occluded_packet(s, s.instances[i], packet, mask); m; m &= m - 1) {
+                int32_t lane = std::countr_zero(m);
+                ret |= 1u << lane;
+                near[lane] = -std::numeric_limits<float>::infinity();
+            }
+        });
+    }
+#ifdef GREEN_BVH_CROSS_CHECK
+    for (uint32_t mask = active; mask; mask &= mask - 1) {
+        int32_t lane = std::countr_zero(mask);
+        float check_near;
+        float check_far;
+        fvec3 check_normal_near;
+        fvec3 check_normal_far;
+        int check = raycast_brute_force(s, packet.origin(lane), packet.direction(lane), packet.tmin[lane], packet.tmax[lane], check_near, check_far,
+            check_normal_near, check_normal_far);
+        if ((check != -1) != (((ret >> lane) & 1u) != 0)) {
+            std::cout << "raycast_occluded_packet() error: lane " << lane << " bvh " << ((ret >> lane) & 1u) << ", brute force hit " << check << " at "
+                << check_near << std::endl;
+        }
+    }
+#endif
+    return ret;
+}
+
+/* raycast_brute_force */
+int raycast_brute_force(const scene& s, const fvec3& origin, const fvec3& direction, float tmin, float tmax, float& near, float& far, fvec3& normal_near, fvec3& normal_far)
+{
+    ray_type ray(origin, direction);
+    float dist;
+    int32_t sub_id;
+    int32_t dist_sub;
+    int ret = closest_hit_brute_force(s.primitives, ray, tmin, tmax, near, sub_id);
+    int32_t hit_instance = -1;
+    for (int32_t i = 0; i < static_cast<int32_t>(s.instances.size()); i++) {
+        int32_t id = instance_closest_hit(s, s.instances[i], true, ray, tmin, near, dist, dist_sub);
+        if (id != -1 && (dist < near || ret == -1)) {
+            near = dist;
+            ret = id;
+            sub_id = dist_sub;
+            hit_instance = i;
+        }
+    }
+    hit_attributes(s, hit_instance, ret, sub_id, origin, direction, tmin, tmax, near, far, normal_near, normal_far);
+    return ret;
+}
+
+} /* namespace green::core */
@@ -0,0 +1,485 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include <core/pixel_format.hpp>
+#include <core/matrix.hpp>
+#include <core/math.hpp>
+
+#include "block_vector.hpp"
+#include "ray_intersection_test.hpp"
+
+/* width of the bvh used by raycast(): 2 - binary bvh, 4 - SSE, 8 - AVX (or 2 x SSE without -mavx) */
+#ifndef GREEN_BVH_WIDTH
+#define GREEN_BVH_WIDTH 4
+#endif
+
+/* 1 - raycast() uses the compressed_bvh with quantized 8 bit child boxes instead of GREEN_BVH_WIDTH */
+#ifndef GREEN_BVH_COMPRESSED
+#define GREEN_BVH_COMPRESSED 0
+#endif
+
+/* 1 - the binary bvh tests oriented boxes of its capsule leaves (bvh::orient_leaves()), raycast()
+ * uses it when GREEN_BVH_WIDTH is 2 */
+#ifndef GREEN_BVH_ORIENTED_LEAVES
+#define GREEN_BVH_ORIENTED_LEAVES 0
+#endif
+
+namespace green::core
+{
+
+class bvh;
+class thread_pool;
+enum class bvh_build_mode;
+template <int32_t N>
+class wide_bvh;
+class compressed_bvh;
+class packed_primitives;
+class triangle_mesh;
+class native_kernel;
+struct ray_packet;
+struct ray_packet_hit;
+
+using pixel_storage_fvec3 = basic_matrix<fvec3>;
+
+struct aabb_type
+{
+    constexpr aabb_type(const fvec3& center, const fvec3& size)
+        : center(center)
+        , size(size)
+    {}
+
+    fvec3 center;
+    fvec3 size;
+};
+
+struct plane_type
+{
+    constexpr plane_type(const fvec3& pos, const fvec3& norm)
+        : position{pos}
+        , normal{norm}
+    {}
+
+    fvec3 position;
+    fvec3 normal;
+};
+
+struct sphere_type
+{
+    constexpr sphere_type(const fvec3& pos, float r)
+        : position{pos}
+        , radius{r}
+    {}
+
+    fvec3 position;
+    float radius;
+};
+
+struct capsule_type
+{
+    constexpr capsule_type(const fvec3& p1, const fvec3& p2, float r)
+        : point1{p1}
+        , point2{p2}
+        , radius{r}
+    {}
+
+    fvec3 point1;
+    fvec3 point2;
+    float radius;
+};
+
+/* axis aligned box given by its corners, used by the acceleration structures */
+struct bounds_type
+{
+    constexpr bounds_type();
+    constexpr bounds_type(const fvec3& min, const fvec3& max)
+        : min{min}
+        , max{max}
+    {}
+
+    constexpr void  extend(const fvec3& p) noexcept;
+    constexpr void  extend(const bounds_type& b) noexcept;
+    constexpr fvec3 center() const noexcept;
+    constexpr float surface_area() const noexcept;
+    constexpr bool  is_empty() const noexcept;
+    /* slab test, accepts boxes overlapping [min_dist, max_dist] along the ray */
+    bool            intersection_test(const fvec3& ro, const fvec3& inv_rd, float min_dist, float max_dist, float& near) const noexcept;
+
+    fvec3 min;
+    fvec3 max;
+};
+
+/* a triangle_mesh placed as one primitive: one id and one material for all the triangles. The mesh
+ * is owned by scene::meshes, bounds are the ones of the mesh so the bounds and the cache never read it */
+struct mesh_type
+{
+    explicit mesh_type(const triangle_mesh& mesh);
+
+    const triangle_mesh*    mesh;
+    bounds_type             bounds;
+};
+
+enum geometry_type
+{
+    plane,
+    sphere,
+    capsule,
+    aabb,
+    mesh
+};
+
+struct primitive
+{
+    constexpr primitive(const sphere_type& sphere)
+        : type(geometry_type::sphere)
+        , sphere(sphere)
+    {}
+
+    constexpr primitive(const plane_type& plane)
+        : type(geometry_type::plane)
+        , plane(plane)
+    {}
+
+    constexpr primitive(const capsule_type& capsule)
+        : type(geometry_type::capsule)
+        , capsule(capsule)
+    {}
+
+    constexpr primitive(const aabb_type& aabb)
+        : type(geometry_type::aabb)
+        , aabb(aabb)
+    {}
+
+    primitive(const mesh_type& mesh)
+        : type(geometry_type::mesh)
+        , mesh(mesh)
+    {}
+
+    geometry_type       type;
+    //                  цвет
+    fvec3              diffuse = fvec3(1.0f);
+    //                  Отраженная часть (reflection)
+    //                  Преломленная часть (refraction)
+    float               specular = 0.0f;
+    //                  шероховатость
+    float               roughness = 1.0f;
+
+    float               glowing = 0.0f;
+
+    bool                transparent = false;
+    union
+    {
+        plane_type      plane;
+        sphere_type     sphere;
+        capsule_type    capsule;
+        aabb_type       aabb;
+        mesh_type       mesh;
+    };
+};
+
+/* render time form of a primitive: the terms of the intersection tests depending only on the
+ * geometry are computed once by compile_primitive(). The primitive stays the authoring form, an edit
+ * changes it and compiles its record again (scene_compile()). The material is not compiled */
+struct compiled_primitive
+{
+    constexpr compiled_primitive(const plane_type& plane)
+        : type(geometry_type::plane)
+        , plane(plane.position, plane.normal)
+    {}
+
+    constexpr compiled_primitive(const sphere_type& sphere)
+        : type(geometry_type::sphere)
+        , sphere(sphere.position, sphere.radius)
+    {}
+
+    constexpr compiled_primitive(const capsule_type& capsule)
+        : type(geometry_type::capsule)
+        , capsule(capsule.point1, capsule.point2, capsule.radius)
+    {}
+
+    constexpr compiled_primitive(const aabb_type& aabb)
+        : type(geometry_type::aabb)
+        , aabb(aabb)
+    {}
+
+    compiled_primitive(const mesh_type& mesh)
+        : type(geometry_type::mesh)
+        , mesh(mesh)
+    {}
+
+    geometry_type       type;
+    union
+    {
+        plane_record    plane;
+        sphere_record   sphere;
+        capsule_record  capsule;
+        aabb_type       aabb;
+        mesh_type       mesh;
+    };
+};
+
+/* primitives in object space placed in the scene by instances. The acceleration structures are
+ * built once by scene_build_acceleration() and shared by every instance of the group. Planes have
+ * no finite bounds and are not allowed in groups */
+struct primitive_group
+{
+    block_vector<primitive> primitives;
+    block_vector<compiled_primitive>    compiled;
+    shared_ptr<bvh>         accel;
+    shared_ptr<wide_bvh<GREEN_BVH_WIDTH>>   wide_accel;
+    shared_ptr<compressed_bvh>              compressed_accel;
+    shared_ptr<packed_primitives>           packed;
+    bounds_type             bounds;     /* object space bounds of the bounded primitives */
+};
+
+/* scene::groups[group] placed with an affine object to world transform */
+struct instance_type
+{
+    instance_type(int32_t group, const fmat4& transform);
+    /* rotation, uniform scale, then translation */
+    instance_type(int32_t group, const fquat& rotation, const fvec3& translation, float scale = 1.0f);
+
+    int32_t     group;
+    fmat4       transform;
+    fmat4       inverse;        /* world to object */
+    int32_t     first_id = 0;   /* raycast() id of the first primitive of the group, set by scene_build_acceleration() */
+};
+
+/* the primitives, the records and the structures are held in shared blocks and by shared_ptr, so a
+ * copy of the scene shares them all. An edit of the copy copies only the blocks and the groups it
+ * writes: mutate() the primitives, scene_edit_group() the groups */
+struct scene
+{
+    block_vector<primitive> primitives;
+    /* primitives compiled by scene_compile(), read by the acceleration structures */
+    block_vector<compiled_primitive>    compiled;
+    fvec3                  light_dir;
+    fvec3                  light_color;
+    pixel_storage_fvec3    sky;
+    /* built by scene_build_acceleration(), nullptr means brute force raycast */
+    shared_ptr<bvh>         accel;
+    /* collapsed accel, used instead of it when GREEN_BVH_WIDTH > 2 */
+    shared_ptr<wide_bvh<GREEN_BVH_WIDTH>>   wide_accel;
+    /* quantized accel, used instead of both when GREEN_BVH_COMPRESSED is 1 */
+    shared_ptr<compressed_bvh>              compressed_accel;
+    /* flat SIMD test used instead of the structures above for a few dozen primitives */
+    shared_ptr<packed_primitives>           packed;
+    std::vector<shared_ptr<const primitive_group>>  groups;
+    std::vector<instance_type>      instances;
+    /* the meshes of the mesh primitives of the scene and of the groups */
+    std::vector<shared_ptr<triangle_mesh>>  meshes;
+    /* top level over the instance bounds in world space, items index instances */
+    shared_ptr<bvh>         instance_accel;
+    /* generated code for s.primitives used instead of the structures, see scene_compile_native() */
+    shared_ptr<native_kernel>               native;
+};
+
+/* what the primitives of a scene and of its groups use, see scene_features(). The path tracing
+ * kernel is instantiated per set of material bits, the branches of the missing ones are compiled out */
+enum scene_feature : uint32_t
+{
+    scene_feature_emissive      = 1u << 0,      /* glowing > 0 */
+    scene_feature_transparent   = 1u << 1,
+    scene_feature_specular      = 1u << 2,      /* specular > 0 */
+    scene_feature_glossy        = 1u << 3,      /* roughness != 1, the diffuse bounce leans to the reflection */
+    scene_feature_materials     = (1u << 4) - 1,
+    /* geometry type t is present: scene_feature_plane << t */
+    scene_feature_plane         = 1u << 8,
+    scene_feature_sphere        = 1u << 9,
+    scene_feature_capsule       = 1u << 10,
+    scene_feature_aabb          = 1u << 11,
+    scene_feature_mesh          = 1u << 12,
+    scene_feature_instances     = 1u << 16
+};
+
+/* scans the primitives of the scene and of the instanced groups */
+uint32_t scene_features(const scene& s);
+
+/* false for primitives without finite bounds (planes) */
+constexpr bool primitive_bounds(const primitive& p, bounds_type& bounds);
+
+/* misses when the near distance is outside [tmin, tmax], see ray_intersection_test.hpp. The first
+ * overload finds the closest primitive, the second computes the attributes of that hit only. sub_id
+ * is the triangle of a mesh hit, -1 for the other geometry, the normal of the hit needs nothing else */
+bool primitive_intersection_test(const primitive& p, const fvec3& ro, const fvec3& rd, float tmin, float tmax, float& near);
+bool primitive_intersection_test(const primitive& p, const fvec3& ro, const fvec3& rd, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+/* the same hits as primitive_intersection_test() without the distances and normals */
+bool primitive_occlusion_test(const primitive& p, const fvec3& ro, const fvec3& rd, float tmin, float tmax);
+/* the tests above for a ray tested against many primitives, see ray_type */
+bool primitive_intersection_test(const primitive& p, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id);
+bool primitive_intersection_test(const primitive& p, const ray_type& ray, float tmin, float tmax, float& near, float& far, fvec3& near_norm, fvec3& far_norm);
+bool primitive_occlusion_test(const primitive& p, const ray_type& ray, float tmin, float tmax);
+/* the tests above on the compiled record, the same results */
+bool primitive_intersection_test(const compiled_primitive& p, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id);
+bool primitive_occlusion_test(const compiled_primitive& p, const ray_type& ray, float tmin, float tmax);
+
+constexpr compiled_primitive compile_primitive(const primitive& p);
+block_vector<compiled_primitive> compile_primitives(const block_vector<primitive>& primitives);
+
+/* (re)builds s.accel from s.primitives and the top level over s.instances, the groups are built only
+ * once (while they have no structure). Has to be called after editing the primitives */
+void scene_build_acceleration(scene& s);
+void scene_build_acceleration(scene& s, bvh_build_mode mode, thread_pool* pool);
+
+/* (re)compiles the records of s.primitives and of the groups, called by scene_build_acceleration()
+ * and after the structures were loaded */
+void scene_compile(scene& s);
+
+/* compiles again only the records of the touched s.primitives, after editing their geometry */
+void scene_compile(scene& s, const std::vector<int32_t>& touched);
+
+/* (re)builds the packed primitives of the scene and of the groups in their size range, called by
+ * scene_build_acceleration() and after the structures were loaded */
+void scene_build_packed(scene& s);
+
+/* recompiles the moved primitives and refits s.accel after they were edited, the cost depends on the number of moved primitives */
+void scene_update_acceleration(scene& s, const std::vector<int32_t>& moved);
+
+/* s.groups[group] for editing, the group is replaced by a copy first. The copy shares the blocks of
+ * primitives and records and the structures with the group it was made from, the versions of the
+ * scene holding that group never see the edit */
+primitive_group& scene_edit_group(scene& s, int32_t group);
+
+/* recompiles the records of s.groups[group] and rebuilds its structures after its primitives were
+ * edited, then the top level. The other groups are left as they are, shared by pointer */
+void scene_update_group(scene& s, int32_t group, bvh_build_mode mode, thread_pool* pool = nullptr);
+
+/* rebuilds only the top level after the instance transforms were edited */
+void scene_update_instances(scene& s, thread_pool* pool = nullptr);
+
+/* primitive with the raycast() id, ids of the instanced primitives follow s.primitives. The geometry
+ * of an instanced primitive is in object space, the material is shared by all the instances */
+const primitive& scene_primitive(const scene& s, int32_t id);
+
+/* tmin of the rays leaving a surface at p, far enough to miss the surface itself after rounding */
+float raycast_epsilon(const fvec3& p);
+
+/* returns id of the closest primitive with the near distance in [tmin, tmax] or -1, see scene_primitive() */
+int raycast(const scene& s, const fvec3& origin, const fvec3& direction, float tmin, float tmax, float& near, float& far, fvec3& normal_near, fvec3& normal_far);
+
+/* true when raycast() would hit anything, stops at the first hit found. Used by the shadow rays */
+bool raycast_occluded(const scene& s, const fvec3& origin, const fvec3& direction, float tmin, float tmax);
+
+/* raycast() for the lanes in active of a coherent packet (a block of pixels). A few primitives are
+ * tested against the whole packet, more share the traversal of the binary bvh, which is built, loaded
+ * and baked with every structure. The result of each lane is the one of raycast(), returns the mask of
+ * the hit lanes */
+uint32_t raycast_packet(const scene& s, const ray_packet& packet, uint32_t active, ray_packet_hit& hit);
+
+/* raycast_occluded() for the lanes in active, returns the mask of the occluded lanes */
+uint32_t raycast_occluded_packet(const scene& s, const ray_packet& packet, uint32_t active);
+
+/* tests every primitive, the reference for the acceleration structures */
+int raycast_brute_force(const scene& s, const fvec3& origin, const fvec3& direction, float tmin, float tmax, float& near, float& far, fvec3& normal_near, fvec3& normal_far);
+
+
+
+/* raycast_epsilon */
+inline float raycast_epsilon(const fvec3& p)
+{
+    /* relative to the magnitude of the coordinates, the error of the hit point grows with them */
+    return 1e-4f * math::max(1.0f, math::max(math::abs(p.x), math::max(math::abs(p.y), math::abs(p.z))));
+}
+
+/* bounds_type::bounds_type */
+constexpr bounds_type::bounds_type()
+    : min{std::numeric_limits<float>::infinity()}
+    , max{-std::numeric_limits<float>::infinity()}
+{
+}
+
+/* bounds_type::extend */
+constexpr void bounds_type::extend(const fvec3& p) noexcept
+{
+    min = fvec3(math::min(min.x, p.x), math::min(min.y, p.y), math::min(min.z, p.z));
+    max = fvec3(math::max(max.x, p.x), math::max(max.y, p.y), math::max(max.z, p.z));
+}
+
+/* bounds_type::extend */
+constexpr void bounds_type::extend(const bounds_type& b) noexcept
+{
+    min = fvec3(math::min(min.x, b.min.x), math::min(min.y, b.min.y), math::min(min.z, b.min.z));
+    max = fvec3(math::max(max.x, b.max.x), math::max(max.y, b.max.y), math::max(max.z, b.max.z));
+}
+
+/* bounds_type::center */
+constexpr fvec3 bounds_type::center() const noexcept
+{
+    return (min + max) * 0.5f;
+}
+
+/* bounds_type::surface_area */
+constexpr float bounds_type::surface_area() const noexcept
+{
+    if (is_empty()) {
+        return 0.0f;
+    }
+    fvec3 d = max - min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+/* bounds_type::is_empty */
+constexpr bool bounds_type::is_empty() const noexcept
+{
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+/* bounds_type::intersection_test */
+inline bool bounds_type::intersection_test(const fvec3& ro, const fvec3& inv_rd, float min_dist, float max_dist, float& near) const noexcept
+{
+    /* 1 + 2 * gamma(3), keeps the far distance conservative against rounding */
+    constexpr float far_scale = 1.0f + 2.0f * 3.0f * std::numeric_limits<float>::epsilon() * 0.5f;
+    fvec3 t1 = (min - ro) * inv_rd;
+    fvec3 t2 = (max - ro) * inv_rd;
+    float tN = math::max(math::max(math::min(t1.x, t2.x), math::min(t1.y, t2.y)), math::min(t1.z, t2.z));
+    float tF = math::min(math::min(math::max(t1.x, t2.x), math::max(t1.y, t2.y)), math::max(t1.z, t2.z)) * far_scale;
+    if (tN > tF || tF < min_dist || tN > max_dist) {
+        return false;
+    }
+    near = tN;
+    return true;
+}
+
+/* primitive_bounds */
+constexpr bool primitive_bounds(const primitive& p, bounds_type& bounds)
+{
+    switch (p.type) {
+    case geometry_type::sphere:
+        bounds = bounds_type(p.sphere.position - p.sphere.radius, p.sphere.position + p.sphere.radius);
+        return true;
+    case geometry_type::capsule:
+        bounds = bounds_type(p.capsule.point1 - p.capsule.radius, p.capsule.point1 + p.capsule.radius);
+        bounds.extend(bounds_type(p.capsule.point2 - p.capsule.radius, p.capsule.point2 + p.capsule.radius));
+        return true;
+    case geometry_type::aabb:
+        bounds = bounds_type(p.aabb.center - p.aabb.size.abs(), p.aabb.center + p.aabb.size.abs());
+        return true;
+    case geometry_type::mesh:
+        bounds = p.mesh.bounds;
+        return !bounds.is_empty();
+    case geometry_type::plane:
+        break;
+    }
+    return false;
+}
+
+/* compile_primitive */
+constexpr compiled_primitive compile_primitive(const primitive& p)
+{
+    switch (p.type) {
+    case geometry_type::plane:
+        return compiled_primitive(p.plane);
+    case geometry_type::sphere:
+        return compiled_primitive(p.sphere);
+    case geometry_type::capsule:
+        return compiled_primitive(p.capsule);
+    case geometry_type::mesh:
+        return compiled_primitive(p.mesh);
+    case geometry_type::aabb:
+        break;
+    }
+    return compiled_primitive(p.aabb);
+}
+
+} /* namespace green::core */
@@ -0,0 +1,520 @@
+#include "scene_cache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "compressed_bvh.hpp"
+
+namespace green::core
+{
+
+/* the collapsed structure traversed by raycast() next to the binary bvh, none when GREEN_BVH_WIDTH is 2 */
+#if GREEN_BVH_COMPRESSED
+using cache_node_type = compressed_bvh_node;
+constexpr uint32_t cache_layout = 0;
+#else
+using cache_node_type = wide_bvh_node<GREEN_BVH_WIDTH>;
+constexpr uint32_t cache_layout = GREEN_BVH_WIDTH;
+#endif
+
+constexpr char cache_magic[8] = {'G', 'R', 'E', 'E', 'N', 'B', 'V', 'H'};
+/* every section starts on a cache line, the nodes need at most 64 byte alignment */
+constexpr uint64_t cache_alignment = 64;
+
+/* all offsets are from the start of the file, there are no pointers */
+struct scene_cache_header
+{
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    layout;
+    uint32_t    node_size;
+    uint32_t    geometry_size;
+    uint64_t    hash;
+    uint64_t    file_size;
+    uint32_t    block_count;        /* the scene, then every group */
+    uint32_t    reserved;
+};
+
+/* the structures and the geometry of the primitives of the scene or of one group. The binary bvh is
+ * kept with the collapsed structure, so an edit of a loaded scene refits both */
+struct scene_cache_block
+{
+    uint64_t    binary_offset;      /* the nodes of the binary bvh */
+    uint64_t    node_offset;        /* the nodes of the collapsed structure */
+    uint64_t    index_offset;       /* the leaves of both reference the same indices */
+    uint64_t    unbounded_offset;
+    uint64_t    lane_offset;        /* wide_bvh::get_lane_of() or compressed_bvh::get_lanes() */
+    uint64_t    node_of_offset;     /* compressed_bvh::get_node_of() */
+    uint64_t    geometry_offset;    /* primitive_count scene_cache_geometry */
+    uint32_t    binary_count;
+    uint32_t    node_count;
+    uint32_t    index_count;
+    uint32_t    unbounded_count;
+    uint32_t    lane_count;
+    uint32_t    node_of_count;
+    uint32_t    primitive_count;
+    uint32_t    reserved;
+    float       bounds_min[3];
+    float       bounds_max[3];
+};
+
+/* geometry_values() of a primitive, the unused values are 0. Materials and the mesh pointer are not
+ * stored, the file holds the same bytes for the same geometry */
+struct scene_cache_geometry
+{
+    int32_t     type;
+    float       values[7];
+};
+
+static inline uint64_t cache_align(uint64_t offset)
+{
+    return (offset + cache_alignment - 1) & ~(cache_alignment - 1);
+}
+
+/* fnv-1a */
+static inline uint64_t hash_bytes(uint64_t h, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* the floats that define the geometry, returns their count */
+static int32_t geometry_values(const primitive& p, float* v)
+{
+    switch (p.type) {
+    case geometry_type::plane:
+        v[0] = p.plane.position.x; v[1] = p.plane.position.y; v[2] = p.plane.position.z;
+        v[3] = p.plane.normal.x; v[4] = p.plane.normal.y; v[5] = p.plane.normal.z;
+        return 6;
+    case geometry_type::sphere:
+        v[0] = p.sphere.position.x; v[1] = p.sphere.position.y; v[2] = p.sphere.position.z;
+        v[3] = p.sphere.radius;
+        return 4;
+    case geometry_type::capsule:
+        v[0] = p.capsule.point1.x; v[1] = p.capsule.point1.y; v[2] = p.capsule.point1.z;
+        v[3] = p.capsule.point2.x; v[4] = p.capsule.point2.y; v[5] = p.capsule.point2.z;
+        v[6] = p.capsule.radius;
+        return 7;
+    case geometry_type::aabb:
+        v[0] = p.aabb.center.x; v[1] = p.aabb.center.y; v[2] = p.aabb.center.z;
+        v[3] = p.aabb.size.x; v[4] = p.aabb.size.y; v[5] = p.aabb.size.z;
+        return 6;
+    case geometry_type::mesh:
+        /* the structures over the primitives depend only on the bounds, the pointer is not read */
+        v[0] = p.mesh.bounds.min.x; v[1] = p.mesh.bounds.min.y; v[2] = p.mesh.bounds.min.z;
+        v[3] = p.mesh.bounds.max.x; v[4] = p.mesh.bounds.max.y; v[5] = p.mesh.bounds.max.z;
+        return 6;
+    }
+    return 0;
+}
+
+static uint64_t hash_primitives(uint64_t h, const block_vector<primitive>& primitives)
+{
+    uint64_t count = primitives.size();
+    h = hash_bytes(h, &count, sizeof(count));
+    float v[7];
+    for (const auto& p: primitives) {
+        int32_t type = p.type;
+        h = hash_bytes(h, &type, sizeof(type));
+        h = hash_bytes(h, v, geometry_values(p, v) * sizeof(float));
+    }
+    return h;
+}
+
+static scene_cache_geometry cache_geometry(const primitive& p)
+{
+    scene_cache_geometry ret = scene_cache_geometry();
+    ret.type = p.type;
+    geometry_values(p, ret.values);
+    return ret;
+}
+
+/* the bytes of a binary node with the padding of its fvec3 zeroed, the same tree gives the same file */
+static void cache_binary_node(const bvh_node& node, unsigned char* out)
+{
+    const auto* bytes = reinterpret_cast<const unsigned char*>(&node);
+    std::memcpy(out, bytes, sizeof(bvh_node));
+    for (const fvec3* v: {&node.bounds.min, &node.bounds.max}) {
+        size_t at = reinterpret_cast<const unsigned char*>(v) - bytes + 3 * sizeof(float);
+        std::memset(out + at, 0, sizeof(fvec3) - 3 * sizeof(float));
+    }
+}
+
+/* guards against hash collisions, the cached structure is only valid for the same geometry */
+static bool same_geometry(const scene_cache_geometry* cached, const block_vector<primitive>& primitives)
+{
+    for (size_t i = 0; i < primitives.size(); i++) {
+        scene_cache_geometry g = cache_geometry(primitives[i]);
+        if (std::memcmp(&cached[i], &g, sizeof(g)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* scene_geometry_hash */
+uint64_t scene_geometry_hash(const scene& s, bvh_build_mode mode)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    uint32_t layout[4] = {scene_cache_version, cache_layout, static_cast<uint32_t>(sizeof(cache_node_type)), static_cast<uint32_t>(mode)};
+    h = hash_bytes(h, layout, sizeof(layout));
+    h = hash_primitives(h, s.primitives);
+    uint64_t group_count = s.groups.size();
+    h = hash_bytes(h, &group_count, sizeof(group_count));
+    for (const auto& group: s.groups) {
+        h = hash_primitives(h, group->primitives);
+    }
+    return h;
+}
+
+static std::filesystem::path cache_path(const scene& s, const std::string& directory, bvh_build_mode mode)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bvh", static_cast<unsigned long long>(scene_geometry_hash(s, mode)));
+    return std::filesystem::path(directory) / name;
+}
+
+/* the sections of a block, read from the structures of the scene or of a group */
+struct cache_sections
+{
+    const block_vector<bvh_node>*           binary;
+    const block_vector<cache_node_type>*    nodes;
+    const block_vector<int32_t>*            indices;
+    const std::vector<int32_t>*             unbounded;
+    const block_vector<int32_t>*            lanes;
+    const block_vector<int32_t>*            node_of;
+};
+
+/* false when the structures of the owner are not built */
+template <class T>
+static bool cached_sections(const T& owner, cache_sections& sections)
+{
+    static const block_vector<cache_node_type> no_nodes;
+    static const block_vector<int32_t> no_map;
+    if (!owner.accel) {
+        return false;
+    }
+    sections = {&owner.accel->get_nodes(), &no_nodes, &owner.accel->get_indices(), &owner.accel->get_unbounded(), &no_map, &no_map};
+#if GREEN_BVH_COMPRESSED
+    if (!owner.compressed_accel) {
+        return false;
+    }
+    sections.nodes = &owner.compressed_accel->get_nodes();
+    sections.lanes = &owner.compressed_accel->get_lanes();
+    sections.node_of = &owner.compressed_accel->get_node_of();
+#elif GREEN_BVH_WIDTH > 2
+    if (!owner.wide_accel) {
+        return false;
+    }
+    sections.nodes = &owner.wide_accel->get_nodes();
+    sections.lanes = &owner.wide_accel->get_lane_of();
+#endif
+    return true;
+}
+
+/* points the scene or a group at its block of the mapped file */
+template <class T>
+static void attach_block(T& owner, const char* base, const scene_cache_block& block, bvh_build_mode mode, const std::shared_ptr<const void>& storage)
+{
+    auto ints = [base](uint64_t offset, uint32_t count) {
+        return std::span<const int32_t>(reinterpret_cast<const int32_t*>(base + offset), count);
+    };
+    auto binary = std::make_shared<bvh>();
+    binary->attach(std::span<const bvh_node>(reinterpret_cast<const bvh_node*>(base + block.binary_offset), block.binary_count),
+        ints(block.index_offset, block.index_count), ints(block.unbounded_offset, block.unbounded_count),
+        static_cast<int32_t>(block.primitive_count), mode, storage);
+#if GREEN_BVH_ORIENTED_LEAVES
+    binary->orient_leaves(owner.primitives);
+#endif
+    owner.accel = binary;
+    owner.wide_accel = nullptr;
+    owner.compressed_accel = nullptr;
+#if GREEN_BVH_COMPRESSED
+    auto accel = std::make_shared<compressed_bvh>();
+    accel->attach(std::span<const cache_node_type>(reinterpret_cast<const cache_node_type*>(base + block.node_offset), block.node_count),
+        ints(block.index_offset, block.index_count), ints(block.unbounded_offset, block.unbounded_count),
+        ints(block.lane_offset, block.lane_count), ints(block.node_of_offset, block.node_of_count), storage);
+    owner.compressed_accel = accel;
+#elif GREEN_BVH_WIDTH > 2
+    auto accel = std::make_shared<wide_bvh<GREEN_BVH_WIDTH>>();
+    accel->attach(std::span<const cache_node_type>(reinterpret_cast<const cache_node_type*>(base + block.node_offset), block.node_count),
+        ints(block.index_offset, block.index_count), ints(block.unbounded_offset, block.unbounded_count),
+        ints(block.lane_offset, block.lane_count), storage);
+    owner.wide_accel = accel;
+#endif
+}
+
+/* the block lies in the file, matches the primitives and references only existing primitives and nodes */
+static bool valid_block(const char* base, uint64_t file_size, const scene_cache_block& block, const block_vector<primitive>& primitives)
+{
+    auto inside = [&](uint64_t offset, uint64_t count, uint64_t size) {
+        return offset % cache_alignment == 0 && offset <= file_size && count * size <= file_size - offset;
+    };
+    /* every value of the section in [-1, end) */
+    auto in_range = [base](uint64_t offset, uint32_t count, int64_t end) {
+        const auto* values = reinterpret_cast<const int32_t*>(base + offset);
+        return std::all_of(values, values + count, [end](int32_t v) {
+            return v >= -1 && v < end;
+        });
+    };
+#if GREEN_BVH_COMPRESSED
+    const uint32_t lane_count = block.node_count * compressed_bvh::width;
+    const int64_t lane_end = block.binary_count;
+    const uint32_t node_of_count = block.binary_count;
+#elif GREEN_BVH_WIDTH > 2
+    const uint32_t lane_count = block.binary_count;
+    const int64_t lane_end = static_cast<int64_t>(block.node_count) * GREEN_BVH_WIDTH;
+    const uint32_t node_of_count = 0;
+#else
+    const uint32_t lane_count = 0;
+    const int64_t lane_end = 0;
+    const uint32_t node_of_count = 0;
+#endif
+    if (block.primitive_count != primitives.size() || block.lane_count != lane_count || block.node_of_count != node_of_count
+        || !inside(block.binary_offset, block.binary_count, sizeof(bvh_node))
+        || !inside(block.node_offset, block.node_count, sizeof(cache_node_type))
+        || !inside(block.index_offset, block.index_count, sizeof(int32_t))
+        || !inside(block.unbounded_offset, block.unbounded_count, sizeof(int32_t))
+        || !inside(block.lane_offset, block.lane_count, sizeof(int32_t))
+        || !inside(block.node_of_offset, block.node_of_count, sizeof(int32_t))
+        || !inside(block.geometry_offset, block.primitive_count, sizeof(scene_cache_geometry))) {
+        return false;
+    }
+    if (!in_range(block.index_offset, block.index_count, block.primitive_count) || !in_range(block.unbounded_offset, block.unbounded_count, block.primitive_count)
+        || !in_range(block.lane_offset, block.lane_count, lane_end) || !in_range(block.node_of_offset, block.node_of_count, block.node_count)) {
+        return false;
+    }
+    const auto* indices = reinterpret_cast<const int32_t*>(base + block.index_offset);
+    const auto* unbounded = reinterpret_cast<const int32_t*>(base + block.unbounded_offset);
+    if (std::find(indices, indices + block.index_count, -1) != indices + block.index_count
+        || std::find(unbounded, unbounded + block.unbounded_count, -1) != unbounded + block.unbounded_count) {
+        return false;
+    }
+    /* the children come after their parent in every build, so the refit state derived by bvh::attach() ends */
+    const auto* binary = reinterpret_cast<const bvh_node*>(base + block.binary_offset);
+    for (uint32_t i = 0; i < block.binary_count; i++) {
+        const bvh_node& node = binary[i];
+        bool valid = node.count > 0
+            ? node.left_first >= 0 && static_cast<uint64_t>(node.left_first) + node.count <= block.index_count
+            : node.count == 0 && node.left_first > static_cast<int32_t>(i) && static_cast<uint32_t>(node.left_first) + 1 < block.binary_count;
+        if (!valid) {
+            return false;
+        }
+    }
+    return same_geometry(reinterpret_cast<const scene_cache_geometry*>(base + block.geometry_offset), primitives);
+}
+
+/* scene_load_acceleration */
+bool scene_load_acceleration(scene& s, const std::string& directory, bvh_build_mode mode)
+{
+    std::filesystem::path path = cache_path(s, directory, mode);
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < sizeof(scene_cache_header)) {
+        ::close(fd);
+        return false;
+    }
+    const uint64_t file_size = static_cast<uint64_t>(st.st_size);
+    void* data = ::mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cout << "scene_load_acceleration() error: cannot map " << path << std::endl;
+        return false;
+    }
+    std::shared_ptr<const void> storage(data, [file_size](const void* p) {
+        ::munmap(const_cast<void*>(p), file_size);
+    });
+
+    const char* base = static_cast<const char*>(data);
+    const auto* header = reinterpret_cast<const scene_cache_header*>(base);
+    const uint64_t block_count = 1 + s.groups.size();
+    if (std::memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0 || header->version != scene_cache_version
+        || header->layout != cache_layout || header->node_size != sizeof(cache_node_type) || header->geometry_size != sizeof(scene_cache_geometry)
+        || header->hash != scene_geometry_hash(s, mode) || header->file_size != file_size || header->block_count != block_count
+        || sizeof(scene_cache_header) + block_count * sizeof(scene_cache_block) > file_size) {
+        std::cout << "scene_load_acceleration(): " << path << " is outdated" << std::endl;
+        return false;
+    }
+    const auto* blocks = reinterpret_cast<const scene_cache_block*>(base + sizeof(scene_cache_header));
+    if (!valid_block(base, file_size, blocks[0], s.primitives)) {
+        std::cout << "scene_load_acceleration(): " << path << " does not match the scene" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < s.groups.size(); i++) {
+        if (!valid_block(base, file_size, blocks[i + 1], s.groups[i]->primitives)) {
+            std::cout << "scene_load_acceleration(): " << path << " does not match the scene" << std::endl;
+            return false;
+        }
+    }
+
+    attach_block(s, base, blocks[0], mode, storage);
+    for (size_t i = 0; i < s.groups.size(); i++) {
+        const scene_cache_block& block = blocks[i + 1];
+        primitive_group& group = scene_edit_group(s, static_cast<int32_t>(i));
+        attach_block(group, base, block, mode, storage);
+        group.bounds = bounds_type(fvec3(block.bounds_min[0], block.bounds_min[1], block.bounds_min[2]),
+            fvec3(block.bounds_max[0], block.bounds_max[1], block.bounds_max[2]));
+    }
+    /* the records, the instances and the packed primitives are not cached, all are cheap */
+    scene_compile(s);
+    scene_build_packed(s);
+    scene_update_instances(s);
+    return true;
+}
+
+/* scene_save_acceleration */
+bool scene_save_acceleration(const scene& s, const std::string& directory, bvh_build_mode mode)
+{
+    const size_t block_count = 1 + s.groups.size();
+    std::vector<cache_sections> sections(block_count);
+    std::vector<const block_vector<primitive>*> primitives(block_count);
+    std::vector<bounds_type> bounds(block_count);
+    bool built = cached_sections(s, sections[0]);
+    primitives[0] = &s.primitives;
+    for (size_t i = 0; i < s.groups.size(); i++) {
+        built = cached_sections(*s.groups[i], sections[i + 1]) && built;
+        primitives[i + 1] = &s.groups[i]->primitives;
+        bounds[i + 1] = s.groups[i]->bounds;
+    }
+    if (!built) {
+        std::cout << "scene_save_acceleration() error: the scene is not built" << std::endl;
+        return false;
+    }
+
+    /* layout: header, blocks, then the sections of every block */
+    std::vector<scene_cache_block> blocks(block_count);
+    uint64_t offset = sizeof(scene_cache_header) + block_count * sizeof(scene_cache_block);
+    auto place = [&offset](uint64_t count, uint64_t size) {
+        uint64_t at = offset = cache_align(offset);
+        offset += count * size;
+        return at;
+    };
+    for (size_t i = 0; i < block_count; i++) {
+        scene_cache_block& block = blocks[i];
+        block = scene_cache_block();
+        block.binary_count = static_cast<uint32_t>(sections[i].binary->size());
+        block.node_count = static_cast<uint32_t>(sections[i].nodes->size());
+        block.index_count = static_cast<uint32_t>(sections[i].indices->size());
+        block.unbounded_count = static_cast<uint32_t>(sections[i].unbounded->size());
+        block.lane_count = static_cast<uint32_t>(sections[i].lanes->size());
+        block.node_of_count = static_cast<uint32_t>(sections[i].node_of->size());
+        block.primitive_count = static_cast<uint32_t>(primitives[i]->size());
+        block.binary_offset = place(block.binary_count, sizeof(bvh_node));
+        block.node_offset = place(block.node_count, sizeof(cache_node_type));
+        block.index_offset = place(block.index_count, sizeof(int32_t));
+        block.unbounded_offset = place(block.unbounded_count, sizeof(int32_t));
+        block.lane_offset = place(block.lane_count, sizeof(int32_t));
+        block.node_of_offset = place(block.node_of_count, sizeof(int32_t));
+        block.geometry_offset = place(block.primitive_count, sizeof(scene_cache_geometry));
+        block.bounds_min[0] = bounds[i].min.x;
+        block.bounds_min[1] = bounds[i].min.y;
+        block.bounds_min[2] = bounds[i].min.z;
+        block.bounds_max[0] = bounds[i].max.x;
+        block.bounds_max[1] = bounds[i].max.y;
+        block.bounds_max[2] = bounds[i].max.z;
+    }
+    scene_cache_header header = scene_cache_header();
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = scene_cache_version;
+    header.layout = cache_layout;
+    header.node_size = sizeof(cache_node_type);
+    header.geometry_size = sizeof(scene_cache_geometry);
+    header.hash = scene_geometry_hash(s, mode);
+    header.file_size = offset;
+    header.block_count = static_cast<uint32_t>(block_count);
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::filesystem::path path = cache_path(s, directory, mode);
+    /* written next to the target and renamed, concurrent readers never see a partial file */
+    std::filesystem::path temporary_path = path;
+    temporary_path += ".";
+    temporary_path += std::to_string(::getpid());
+    std::fstream file;
+    file.open(temporary_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    uint64_t written = 0;
+    auto pad_to = [&](uint64_t at) {
+        static const char zeros[cache_alignment] = {};
+        while (written < at) {
+            uint64_t n = std::min<uint64_t>(at - written, sizeof(zeros));
+            file.write(zeros, n);
+            written += n;
+        }
+    };
+    auto write_at = [&](uint64_t at, const void* data, uint64_t size) {
+        pad_to(at);
+        file.write(static_cast<const char*>(data), size);
+        written += size;
+    };
+    /* the blocks of the items one after the other */
+    auto write_items = [&](uint64_t at, const auto& items) {
+        pad_to(at);
+        for (size_t b = 0; b < items.get_block_count(); b++) {
+            write_at(written, items.get_block(b).data(), items.get_block(b).size_bytes());
+        }
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(written, blocks.data(), blocks.size() * sizeof(scene_cache_block));
+    for (size_t i = 0; i < block_count; i++) {
+        pad_to(blocks[i].binary_offset);
+        for (const auto& node: *sections[i].binary) {
+            unsigned char bytes[sizeof(bvh_node)];
+            cache_binary_node(node, bytes);
+            write_at(written, bytes, sizeof(bytes));
+        }
+        write_items(blocks[i].node_offset, *sections[i].nodes);
+        write_items(blocks[i].index_offset, *sections[i].indices);
+        write_at(blocks[i].unbounded_offset, sections[i].unbounded->data(), blocks[i].unbounded_count * sizeof(int32_t));
+        write_items(blocks[i].lane_offset, *sections[i].lanes);
+        write_items(blocks[i].node_of_offset, *sections[i].node_of);
+        pad_to(blocks[i].geometry_offset);
+        for (const auto& p: *primitives[i]) {
+            scene_cache_geometry g = cache_geometry(p);
+            write_at(written, &g, sizeof(g));
+        }
+    }
+    file.close();
+    if (!file || written != header.file_size) {
+        std::cout << "scene_save_acceleration() error: writing error " << temporary_path << std::endl;
+        std::filesystem::remove(temporary_path, error);
+        return false;
+    }
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::cout << "scene_save_acceleration() error: " << error.message() << std::endl;
+        std::filesystem::remove(temporary_path, error);
+        return false;
+    }
+    return true;
+}
+
+/* scene_build_acceleration_cached */
+bool scene_build_acceleration_cached(scene& s, const std::string& directory, bvh_build_mode mode, thread_pool* pool)
+{
+    if (scene_load_acceleration(s, directory, mode)) {
+        return true;
+    }
+    scene_build_acceleration(s, mode, pool);
+    scene_save_acceleration(s, directory, mode);
+    return false;
+}
+
+} /* namespace green::core */
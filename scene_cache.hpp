@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "scene.hpp"
+
+namespace green::core
+{
+
+/* files of other versions are ignored and rebuilt */
+constexpr uint32_t scene_cache_version = 3;
+
+/* hash of the geometry of s.primitives and s.groups, of the build mode and of the node layout
+ * selected by GREEN_BVH_WIDTH / GREEN_BVH_COMPRESSED. Materials and instances are not included */
+uint64_t scene_geometry_hash(const scene& s, bvh_build_mode mode);
+
+/* maps directory/<hash>.bvh and traverses the nodes in place, nothing is copied. Returns false and
+ * leaves the scene unchanged when there is no valid file. The binary bvh is loaded with the traversed
+ * structure, scene_update_acceleration() refits them and copies only the blocks it writes */
+bool scene_load_acceleration(scene& s, const std::string& directory, bvh_build_mode mode);
+
+/* writes the structures built by scene_build_acceleration() to directory/<hash>.bvh */
+bool scene_save_acceleration(const scene& s, const std::string& directory, bvh_build_mode mode);
+
+/* loads the structures, or builds and saves them. Returns true when they were loaded */
+bool scene_build_acceleration_cached(scene& s, const std::string& directory, bvh_build_mode mode, thread_pool* pool);
+
+} /* namespace green::core */
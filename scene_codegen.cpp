@@ -0,0 +1,382 @@
+#include "scene_codegen.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include "bvh.hpp"
+
+/* directory of scene.hpp and src/, included by the generated source. Set by run.sh, the process may
+ * run from anywhere */
+#ifndef GREEN_SOURCE_DIR
+#error "GREEN_SOURCE_DIR has to be defined as the quoted absolute path of the sources"
+#endif
+
+namespace green::core
+{
+
+/* a string literal, not a path computed at run time */
+static constexpr const char source_dir[] = GREEN_SOURCE_DIR;
+
+/* changed with the interface of the generated functions, the objects of the older ones are not loaded */
+constexpr uint32_t native_format_version = 1;
+
+/* the same rounding as the generic path: no contraction into fma, the ISA of the machine is free */
+static const char* const native_flags = "-std=c++20 -O2 -march=native -ffp-contract=off -fPIC -shared -fvisibility=hidden";
+
+/* the records are filled field by field, the terms computed by compile_primitive() are kept exactly */
+static const char* const native_prologue = R"(
+using namespace green::core;
+
+namespace
+{
+
+struct hit_state
+{
+    float   near;
+    int32_t id;
+};
+
+inline bounds_type box(const fvec3& min, const fvec3& max)
+{
+    return bounds_type(min, max);
+}
+
+inline sphere_record sphere(const fvec3& center, float radius, float radius2)
+{
+    sphere_record r;
+    r.center = center;
+    r.radius = radius;
+    r.radius2 = radius2;
+    return r;
+}
+
+inline capsule_record capsule(const fvec3& pa, const fvec3& pb, const fvec3& ba, float baba, float radius, float radius2)
+{
+    capsule_record r;
+    r.pa = pa;
+    r.pb = pb;
+    r.ba = ba;
+    r.baba = baba;
+    r.radius = radius;
+    r.radius2 = radius2;
+    return r;
+}
+
+/* the tie rule of bvh::closest_hit() */
+inline void hit(hit_state& h, int32_t id, bool test, float dist)
+{
+    if (test && (dist < h.near || (dist == h.near && (h.id == -1 || id < h.id)))) {
+        h.near = dist;
+        h.id = id;
+    }
+}
+
+)";
+
+/* hex float literal, exact */
+static std::string literal(float v)
+{
+    if (std::isnan(v)) {
+        return "std::numeric_limits<float>::quiet_NaN()";
+    }
+    if (std::isinf(v)) {
+        return v > 0.0f ? "std::numeric_limits<float>::infinity()" : "-std::numeric_limits<float>::infinity()";
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), "%af", static_cast<double>(v));
+    return text;
+}
+
+static std::string literal(const fvec3& v)
+{
+    return "fvec3(" + literal(v.x) + ", " + literal(v.y) + ", " + literal(v.z) + ")";
+}
+
+/* the arguments of primitive_intersection_test() for the record, near and the dist output are appended */
+static std::string test_call(const compiled_primitive& p)
+{
+    switch (p.type) {
+    case geometry_type::plane:
+        return "ray_pane_intersection_test(ray, " + literal(p.plane.normal) + ", " + literal(p.plane.w) + ", tmin, ";
+    case geometry_type::sphere:
+        return "ray_sphere_intersection_test(ray.origin, ray.dir, sphere(" + literal(p.sphere.center) + ", " + literal(p.sphere.radius) + ", "
+            + literal(p.sphere.radius2) + "), tmin, ";
+    case geometry_type::capsule:
+        return "ray_capsule_intersection_test(ray.origin, ray.dir, capsule(" + literal(p.capsule.pa) + ", " + literal(p.capsule.pb) + ", "
+            + literal(p.capsule.ba) + ", " + literal(p.capsule.baba) + ", " + literal(p.capsule.radius) + ", " + literal(p.capsule.radius2) + "), tmin, ";
+    case geometry_type::aabb:
+        return "ray_aabb_intersection_test(ray, " + literal(p.aabb.center) + ", " + literal(p.aabb.size) + ", tmin, ";
+    case geometry_type::mesh:
+        break;
+    }
+    return {};
+}
+
+static void emit_closest_test(std::string& out, const scene& s, int32_t id)
+{
+    out += "    {\n        float dist;\n        bool test = " + test_call(s.compiled[id]) + "h.near, dist);\n        hit(h, " + std::to_string(id)
+        + ", test, dist);\n    }\n";
+}
+
+static void emit_occlusion_test(std::string& out, const scene& s, int32_t id)
+{
+    out += "    if (" + test_call(s.compiled[id]) + "tmax)) {\n        return true;\n    }\n";
+}
+
+static std::string box_literal(const bounds_type& b)
+{
+    return "box(" + literal(b.min) + ", " + literal(b.max) + ")";
+}
+
+/* one function per node for both queries, the children are visited front to back as by bvh::traverse() */
+static void emit_node(std::string& out, const scene& s, const bvh& tree, int32_t index)
+{
+    const bvh_node& node = tree.get_nodes()[index];
+    const std::string name = std::to_string(index);
+    if (node.count > 0) {
+        out += "void closest_" + name + "(const ray_type& ray, float tmin, hit_state& h)\n{\n";
+        for (int32_t i = node.left_first; i < node.left_first + node.count; i++) {
+            emit_closest_test(out, s, tree.get_indices()[i]);
+        }
+        out += "}\n\nbool occluded_" + name + "(const ray_type& ray, float tmin, float tmax)\n{\n";
+        for (int32_t i = node.left_first; i < node.left_first + node.count; i++) {
+            emit_occlusion_test(out, s, tree.get_indices()[i]);
+        }
+        out += "    return false;\n}\n\n";
+        return;
+    }
+    const std::string l = std::to_string(node.left_first);
+    const std::string r = std::to_string(node.left_first + 1);
+    const std::string box_l = box_literal(tree.get_nodes()[node.left_first].bounds);
+    const std::string box_r = box_literal(tree.get_nodes()[node.left_first + 1].bounds);
+    out += "void closest_" + name + "(const ray_type& ray, float tmin, hit_state& h)\n{\n"
+        "    float tl;\n    float tr;\n"
+        "    bool hit_l = " + box_l + ".intersection_test(ray.origin, ray.inv_dir, tmin, h.near, tl);\n"
+        "    bool hit_r = " + box_r + ".intersection_test(ray.origin, ray.inv_dir, tmin, h.near, tr);\n"
+        "    if (hit_l && hit_r) {\n"
+        "        if (tr < tl) {\n"
+        "            closest_" + r + "(ray, tmin, h);\n"
+        "            if (tl <= h.near) {\n                closest_" + l + "(ray, tmin, h);\n            }\n"
+        "        } else {\n"
+        "            closest_" + l + "(ray, tmin, h);\n"
+        "            if (tr <= h.near) {\n                closest_" + r + "(ray, tmin, h);\n            }\n"
+        "        }\n"
+        "    } else if (hit_l) {\n        closest_" + l + "(ray, tmin, h);\n"
+        "    } else if (hit_r) {\n        closest_" + r + "(ray, tmin, h);\n    }\n}\n\n";
+    out += "bool occluded_" + name + "(const ray_type& ray, float tmin, float tmax)\n{\n"
+        "    float t;\n"
+        "    return (" + box_l + ".intersection_test(ray.origin, ray.inv_dir, tmin, tmax, t) && occluded_" + l + "(ray, tmin, tmax))\n"
+        "        || (" + box_r + ".intersection_test(ray.origin, ray.inv_dir, tmin, tmax, t) && occluded_" + r + "(ray, tmin, tmax));\n}\n\n";
+}
+
+/* fnv-1a */
+static uint64_t hash_text(const std::string& text)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c: text) {
+        h = (h ^ c) * 1099511628211ull;
+    }
+    return h;
+}
+
+/* what the object depends on besides its source: the files it includes and the layout of the types
+ * passed to it, and the target -march=native resolves to on this machine. A shared native_cache never
+ * hands an object built from other headers or for another CPU */
+static std::string native_abi_key(const std::string& compiler)
+{
+    std::string key = "format " + std::to_string(native_format_version) + " ray_type " + std::to_string(sizeof(ray_type)) + " "
+        + std::to_string(offsetof(ray_type, origin)) + " " + std::to_string(offsetof(ray_type, sign)) + " compiled_primitive "
+        + std::to_string(sizeof(compiled_primitive)) + " " + std::to_string(alignof(compiled_primitive)) + "\n";
+    for (const char* file: {"ray_intersection_test.cpp", "ray_intersection_test.hpp", "scene.hpp"}) {
+        std::ifstream in(std::filesystem::path(source_dir) / file, std::ios_base::in | std::ios_base::binary);
+        std::ostringstream text;
+        text << in.rdbuf();
+        key += text.str();
+    }
+
+    /* resolved once, the answer does not change while the process runs */
+    static const std::string target = [&compiler] {
+        std::string ret;
+        std::string command = compiler + " -march=native -Q --help=target 2>/dev/null";
+        if (FILE* pipe = ::popen(command.c_str(), "r")) {
+            char buffer[4096];
+            size_t n;
+            while ((n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+                ret.append(buffer, n);
+            }
+            if (::pclose(pipe) != 0) {
+                ret.clear();
+            }
+        }
+        if (ret.empty()) {
+            /* a compiler without -Q --help=target, the features of the CPU stand for the target */
+            std::ifstream cpuinfo("/proc/cpuinfo");
+            std::string line;
+            while (std::getline(cpuinfo, line)) {
+                if (line.rfind("flags", 0) == 0) {
+                    ret = line;
+                    break;
+                }
+            }
+        }
+        return ret;
+    }();
+    return key + target;
+}
+
+/* native_kernel::native_kernel */
+native_kernel::native_kernel(void* handle, closest_hit_function closest_hit, occluded_function occluded)
+    : m_handle{handle}
+    , m_closest_hit{closest_hit}
+    , m_occluded{occluded}
+{
+}
+
+/* native_kernel::~native_kernel */
+native_kernel::~native_kernel()
+{
+    dlclose(m_handle);
+}
+
+/* scene_native_source */
+std::string scene_native_source(const scene& s)
+{
+    for (const auto& p: s.primitives) {
+        if (p.type == geometry_type::mesh) {
+            return {};
+        }
+    }
+    /* built here when the scene is not */
+    bvh temporary;
+    const bvh* tree = s.accel.get();
+    if (!tree) {
+        temporary.build(s.primitives, bvh_build_mode::binned_sah);
+        tree = &temporary;
+    }
+
+    /* the nodes left unreachable by the subtree rebuilds of refit() are skipped */
+    std::vector<int32_t> reachable;
+    if (!tree->get_nodes().empty()) {
+        reachable.push_back(0);
+    }
+    for (size_t i = 0; i < reachable.size(); i++) {
+        const bvh_node& node = tree->get_nodes()[reachable[i]];
+        if (node.count == 0) {
+            reachable.push_back(node.left_first);
+            reachable.push_back(node.left_first + 1);
+        }
+    }
+    if (reachable.size() > native_kernel_max_nodes) {
+        return {};
+    }
+
+    const std::string dir = source_dir;
+    std::string out = "/* generated by scene_compile_native() */\n#include \"" + dir + "/ray_intersection_test.cpp\"\n#include \"" + dir + "/scene.hpp\"\n";
+    out += native_prologue;
+    for (int32_t node: reachable) {
+        out += "void closest_" + std::to_string(node) + "(const ray_type& ray, float tmin, hit_state& h);\n";
+        out += "bool occluded_" + std::to_string(node) + "(const ray_type& ray, float tmin, float tmax);\n";
+    }
+    out += "\n";
+    for (int32_t node: reachable) {
+        emit_node(out, s, *tree, node);
+    }
+    out += "} /* namespace */\n\n";
+
+    out += "extern \"C\" __attribute__((visibility(\"default\"))) int32_t green_native_closest_hit(const ray_type& ray, float tmin, float tmax, float& near)\n{\n"
+        "    hit_state h{tmax, -1};\n";
+    for (int32_t i: tree->get_unbounded()) {
+        emit_closest_test(out, s, i);
+    }
+    if (!reachable.empty()) {
+        out += "    float t;\n    if (" + box_literal(tree->get_nodes()[0].bounds) + ".intersection_test(ray.origin, ray.inv_dir, tmin, h.near, t)) {\n"
+            "        closest_0(ray, tmin, h);\n    }\n";
+    }
+    out += "    near = h.near;\n    return h.id;\n}\n\n";
+
+    out += "extern \"C\" __attribute__((visibility(\"default\"))) bool green_native_occluded(const ray_type& ray, float tmin, float tmax)\n{\n";
+    for (int32_t i: tree->get_unbounded()) {
+        emit_occlusion_test(out, s, i);
+    }
+    if (!reachable.empty()) {
+        out += "    float t;\n    return " + box_literal(tree->get_nodes()[0].bounds) + ".intersection_test(ray.origin, ray.inv_dir, tmin, tmax, t)"
+            " && occluded_0(ray, tmin, tmax);\n}\n";
+    } else {
+        out += "    return false;\n}\n";
+    }
+    return out;
+}
+
+/* scene_compile_native */
+bool scene_compile_native(scene& s, const std::string& directory)
+{
+    s.native = nullptr;
+    std::string source = scene_native_source(s);
+    if (source.empty()) {
+        return false;
+    }
+    const char* env_compiler = std::getenv("CXX");
+    std::string compiler = env_compiler && *env_compiler ? env_compiler : "c++";
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash_text(compiler + native_flags + native_abi_key(compiler) + source)));
+    std::filesystem::path path = std::filesystem::path(directory) / name;
+    path += ".so";
+
+    std::error_code error;
+    if (!std::filesystem::exists(path, error)) {
+        std::filesystem::create_directories(directory, error);
+        std::filesystem::path source_path = std::filesystem::path(directory) / name;
+        source_path += ".cpp";
+        std::ofstream file(source_path, std::ios_base::out | std::ios_base::trunc);
+        file << source;
+        file.close();
+        if (!file) {
+            std::cout << "scene_compile_native() error: writing error " << source_path << std::endl;
+            return false;
+        }
+        /* compiled next to the target and renamed, concurrent processes never load a partial object */
+        std::filesystem::path temporary_path = path;
+        temporary_path += ".";
+        temporary_path += std::to_string(::getpid());
+        std::string command = compiler + " " + native_flags + " -I\"" + std::string(source_dir) + "/src\" -o \""
+            + temporary_path.string() + "\" \"" + source_path.string() + "\"";
+        int status = std::system(command.c_str());
+        if (status != 0) {
+            std::cout << "scene_compile_native() error: " << compiler << " failed (status " << status << "), using the generic path" << std::endl;
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+        std::filesystem::rename(temporary_path, path, error);
+        if (error) {
+            std::cout << "scene_compile_native() error: " << error.message() << std::endl;
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+    }
+
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        std::cout << "scene_compile_native() error: " << dlerror() << std::endl;
+        return false;
+    }
+    auto closest_hit = reinterpret_cast<native_kernel::closest_hit_function>(dlsym(handle, "green_native_closest_hit"));
+    auto occluded = reinterpret_cast<native_kernel::occluded_function>(dlsym(handle, "green_native_occluded"));
+    if (!closest_hit || !occluded) {
+        std::cout << "scene_compile_native() error: " << path << " has no kernel" << std::endl;
+        dlclose(handle);
+        return false;
+    }
+    s.native = std::make_shared<native_kernel>(handle, closest_hit, occluded);
+    return true;
+}
+
+} /* namespace green::core */
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "scene.hpp"
+
+/* 1 - the app compiles its scene with scene_compile_native() into native_cache/ after the build */
+#ifndef GREEN_SCENE_NATIVE
+#define GREEN_SCENE_NATIVE 0
+#endif
+
+namespace green::core
+{
+
+/* larger scenes keep the generic structures, the wide bvh is faster than the unrolled binary tree there */
+constexpr size_t native_kernel_max_nodes = 128;
+
+/* closest hit and any hit of the bounded and unbounded primitives of scene::primitives, generated as
+ * C++ by scene_compile_native() and loaded from a shared object. The bvh is unrolled into one function
+ * per node with the boxes and the compiled records as literals, so the tests are specialized on the
+ * constants by the system compiler. The results are the ones of the binary bvh of the scene */
+class native_kernel
+{
+public:
+    using closest_hit_function = int32_t (*)(const ray_type& ray, float tmin, float tmax, float& near);
+    using occluded_function = bool (*)(const ray_type& ray, float tmin, float tmax);
+
+                    native_kernel(void* handle, closest_hit_function closest_hit, occluded_function occluded);
+                    native_kernel(const native_kernel&) = delete;
+                    ~native_kernel();
+
+    native_kernel&  operator=(const native_kernel&) = delete;
+
+    int32_t         closest_hit(const ray_type& ray, float tmin, float tmax, float& near) const;
+    bool            occluded(const ray_type& ray, float tmin, float tmax) const;
+
+private:
+    void*                   m_handle;       /* dlopen() */
+    closest_hit_function    m_closest_hit;
+    occluded_function       m_occluded;
+}; /* class native_kernel */
+
+/* C++ source of the kernel of s, the structure is s.accel or a bvh built for it. Empty for the scenes
+ * with meshes or over native_kernel_max_nodes nodes */
+std::string scene_native_source(const scene& s);
+
+/* generates the kernel of s, compiles it with $CXX (c++ by default) into directory/<hash>.so and sets
+ * s.native, raycast() and raycast_occluded() use it instead of the structures. The hash covers the
+ * source, a scene compiled before is loaded without running the compiler. Returns false and keeps the
+ * generic path when the scene is not supported or when there is no compiler, the errors are printed.
+ * Edits drop s.native (scene_build_acceleration(), scene_update_acceleration()) */
+bool scene_compile_native(scene& s, const std::string& directory);
+
+
+
+/* native_kernel::closest_hit */
+inline int32_t native_kernel::closest_hit(const ray_type& ray, float tmin, float tmax, float& near) const
+{
+    return m_closest_hit(ray, tmin, tmax, near);
+}
+
+/* native_kernel::occluded */
+inline bool native_kernel::occluded(const ray_type& ray, float tmin, float tmax) const
+{
+    return m_occluded(ray, tmin, tmax);
+}
+
+} /* namespace green::core */
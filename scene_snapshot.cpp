@@ -0,0 +1,46 @@
+#include "scene_snapshot.hpp"
+
+namespace green::core
+{
+
+/* scene_snapshot::scene_snapshot */
+scene_snapshot::scene_snapshot(scene&& s, uint64_t version)
+    : m_scene{std::move(s)}
+    , m_version{version}
+    , m_features{scene_features(m_scene)}
+{}
+
+/* scene_snapshot::freeze */
+shared_ptr<const scene_snapshot> scene_snapshot::freeze(scene&& s)
+{
+    return shared_ptr<const scene_snapshot>(new scene_snapshot(std::move(s), 1));
+}
+
+/* scene_versions::scene_versions */
+scene_versions::scene_versions(shared_ptr<const scene_snapshot> snapshot)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    publish(std::move(snapshot));
+}
+
+/* scene_versions::publish */
+void scene_versions::publish(shared_ptr<const scene_snapshot> snapshot)
+{
+    std::erase_if(m_published, [](const std::weak_ptr<const scene_snapshot>& p) {
+        return p.expired();
+    });
+    m_published.push_back(snapshot);
+    m_current.store(std::move(snapshot), std::memory_order_release);
+}
+
+/* scene_versions::get_live_version_count */
+int32_t scene_versions::get_live_version_count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::erase_if(m_published, [](const std::weak_ptr<const scene_snapshot>& p) {
+        return p.expired();
+    });
+    return static_cast<int32_t>(m_published.size());
+}
+
+} /* namespace green::core */
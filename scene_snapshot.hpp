@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <core/shared_ptr.hpp>
+
+#include "scene.hpp"
+
+namespace green::core
+{
+
+/* a scene frozen for rendering. Nothing changes it once freeze() has taken it, so the tasks of a pass
+ * read it at the same time without locks and borrow it by reference while the pass holds the snapshot:
+ * starting a task costs the same whatever the size of the scene. An edit is made on a copy of the
+ * scene by edit(), which freezes the result as the next version; the records and the nodes are held in
+ * shared blocks, the groups, the structures, the meshes and the sky by shared_ptr, and the copy shares
+ * them with the snapshot it was made from until it writes them */
+class scene_snapshot
+{
+public:
+                    scene_snapshot(const scene_snapshot&) = delete;
+
+    scene_snapshot& operator=(const scene_snapshot&) = delete;
+
+    /* the scene is moved in, its structures are built already */
+    static shared_ptr<const scene_snapshot> freeze(scene&& s);
+
+    /* fn(scene&) edits a copy of the scene, the copy becomes the snapshot of the next version. This one
+     * is left unchanged for the passes still reading it: a write copies the block it lands in,
+     * scene_update_acceleration() copies the node blocks on the refitted paths and scene_update_group()
+     * builds new structures for the group */
+    template <class F>
+    shared_ptr<const scene_snapshot> edit(F&& fn) const;
+
+    const scene&    get_scene() const noexcept;
+    /* 1 for freeze(), one more for every edit() */
+    uint64_t        get_version() const noexcept;
+    /* scene_features() of the scene, scanned once */
+    uint32_t        get_features() const noexcept;
+
+private:
+                    scene_snapshot(scene&& s, uint64_t version);
+
+private:
+    const scene     m_scene;
+    uint64_t        m_version;
+    uint32_t        m_features;
+}; /* class scene_snapshot */
+
+/* the versions of a scene edited while it is rendered. A reader (a tile) takes the current version
+ * with acquire() and reads only that one until it is done, edit() makes the next version from the
+ * current one and publishes it for the readers starting after it. The edits are serialized between
+ * themselves and never wait for the readers, the readers never wait for the edits. A version is
+ * released with the last reader holding it, the unchanged structures live on in the versions made
+ * from it */
+class scene_versions
+{
+public:
+    explicit        scene_versions(shared_ptr<const scene_snapshot> snapshot);
+                    scene_versions(const scene_versions&) = delete;
+
+    scene_versions& operator=(const scene_versions&) = delete;
+
+    shared_ptr<const scene_snapshot>    acquire() const;
+
+    /* scene_snapshot::edit() of the current version, returns the published one */
+    template <class F>
+    shared_ptr<const scene_snapshot>    edit(F&& fn);
+
+    /* the published versions not released yet, the current one included */
+    int32_t         get_live_version_count() const;
+
+private:
+    /* m_mutex is held */
+    void            publish(shared_ptr<const scene_snapshot> snapshot);
+
+private:
+    std::atomic<std::shared_ptr<const scene_snapshot>>  m_current;
+    mutable std::mutex                                  m_mutex;        /* the edits and m_published */
+    mutable std::vector<std::weak_ptr<const scene_snapshot>>    m_published;
+}; /* class scene_versions */
+
+
+
+/* scene_snapshot::edit */
+template <class F>
+shared_ptr<const scene_snapshot> scene_snapshot::edit(F&& fn) const
+{
+    scene s = m_scene;
+    std::forward<F>(fn)(s);
+    return shared_ptr<const scene_snapshot>(new scene_snapshot(std::move(s), m_version + 1));
+}
+
+/* scene_snapshot::get_scene */
+inline const scene& scene_snapshot::get_scene() const noexcept
+{
+    return m_scene;
+}
+
+/* scene_snapshot::get_version */
+inline uint64_t scene_snapshot::get_version() const noexcept
+{
+    return m_version;
+}
+
+/* scene_snapshot::get_features */
+inline uint32_t scene_snapshot::get_features() const noexcept
+{
+    return m_features;
+}
+
+/* scene_versions::acquire */
+inline shared_ptr<const scene_snapshot> scene_versions::acquire() const
+{
+    return m_current.load(std::memory_order_acquire);
+}
+
+/* scene_versions::edit */
+template <class F>
+shared_ptr<const scene_snapshot> scene_versions::edit(F&& fn)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    shared_ptr<const scene_snapshot> next = acquire()->edit(std::forward<F>(fn));
+    publish(next);
+    return next;
+}
+
+} /* namespace green::core */
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include <core/math.hpp>
+
+namespace green::core
+{
+
+/* the operations of the SIMD intersection tests on one register of lanes. The tests below use only
+ * these, so the same code runs 1, 4 or 8 lanes at a time: 8 primitives against one ray
+ * (packed_primitives) or one primitive against 8 rays (ray_packet). No fused multiply add, the
+ * operations are rounded in the order of ray_intersection_test.cpp and the distances are the same */
+struct scalar_lanes
+{
+    using type = float;
+    using mask_type = bool;
+    static constexpr int32_t lanes = 1;
+
+    static type         load(const float* p) noexcept { return *p; }
+    static void         store(float* p, type a) noexcept { *p = a; }
+    static type         set1(float a) noexcept { return a; }
+    static type         add(type a, type b) noexcept { return a + b; }
+    static type         sub(type a, type b) noexcept { return a - b; }
+    static type         mul(type a, type b) noexcept { return a * b; }
+    static type         div(type a, type b) noexcept { return a / b; }
+    static type         neg(type a) noexcept { return -a; }
+    static type         sqrt(type a) noexcept { return math::sqrt(a); }
+    static type         min(type a, type b) noexcept { return math::min(a, b); }
+    static type         max(type a, type b) noexcept { return math::max(a, b); }
+    static type         select(mask_type m, type a, type b) noexcept { return m ? a : b; }
+    static mask_type    lt(type a, type b) noexcept { return a < b; }
+    static mask_type    le(type a, type b) noexcept { return a <= b; }
+    static mask_type    gt(type a, type b) noexcept { return a > b; }
+    static mask_type    ge(type a, type b) noexcept { return a >= b; }
+    static mask_type    eq(type a, type b) noexcept { return a == b; }
+    static mask_type    mask_and(mask_type a, mask_type b) noexcept { return a && b; }
+    static mask_type    mask_or(mask_type a, mask_type b) noexcept { return a || b; }
+    static mask_type    mask_select(mask_type m, mask_type a, mask_type b) noexcept { return m ? a : b; }
+    static mask_type    mask_not(mask_type a) noexcept { return !a; }
+    static uint32_t     bits(mask_type m) noexcept { return m ? 1u : 0u; }
+};
+
+#if defined(__SSE2__)
+struct sse_lanes
+{
+    using type = __m128;
+    using mask_type = __m128;
+    static constexpr int32_t lanes = 4;
+
+    static type         load(const float* p) noexcept { return _mm_load_ps(p); }
+    static void         store(float* p, type a) noexcept { _mm_storeu_ps(p, a); }
+    static type         set1(float a) noexcept { return _mm_set1_ps(a); }
+    static type         add(type a, type b) noexcept { return _mm_add_ps(a, b); }
+    static type         sub(type a, type b) noexcept { return _mm_sub_ps(a, b); }
+    static type         mul(type a, type b) noexcept { return _mm_mul_ps(a, b); }
+    static type         div(type a, type b) noexcept { return _mm_div_ps(a, b); }
+    /* flips the sign bit like the scalar -a, 0 - a would turn -0 into +0 */
+    static type         neg(type a) noexcept { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+    static type         sqrt(type a) noexcept { return _mm_sqrt_ps(a); }
+    /* a < b ? a : b like math::min(), also for NaN */
+    static type         min(type a, type b) noexcept { return _mm_min_ps(a, b); }
+    static type         max(type a, type b) noexcept { return _mm_max_ps(a, b); }
+    static type         select(mask_type m, type a, type b) noexcept { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static mask_type    lt(type a, type b) noexcept { return _mm_cmplt_ps(a, b); }
+    static mask_type    le(type a, type b) noexcept { return _mm_cmple_ps(a, b); }
+    static mask_type    gt(type a, type b) noexcept { return _mm_cmpgt_ps(a, b); }
+    static mask_type    ge(type a, type b) noexcept { return _mm_cmpge_ps(a, b); }
+    static mask_type    eq(type a, type b) noexcept { return _mm_cmpeq_ps(a, b); }
+    static mask_type    mask_and(mask_type a, mask_type b) noexcept { return _mm_and_ps(a, b); }
+    static mask_type    mask_or(mask_type a, mask_type b) noexcept { return _mm_or_ps(a, b); }
+    static mask_type    mask_select(mask_type m, mask_type a, mask_type b) noexcept { return select(m, a, b); }
+    static mask_type    mask_not(mask_type a) noexcept { return _mm_xor_ps(a, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+    static uint32_t     bits(mask_type m) noexcept { return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+};
+#endif
+
+#if defined(__AVX__)
+struct avx_lanes
+{
+    using type = __m256;
+    using mask_type = __m256;
+    static constexpr int32_t lanes = 8;
+
+    static type         load(const float* p) noexcept { return _mm256_load_ps(p); }
+    static void         store(float* p, type a) noexcept { _mm256_storeu_ps(p, a); }
+    static type         set1(float a) noexcept { return _mm256_set1_ps(a); }
+    static type         add(type a, type b) noexcept { return _mm256_add_ps(a, b); }
+    static type         sub(type a, type b) noexcept { return _mm256_sub_ps(a, b); }
+    static type         mul(type a, type b) noexcept { return _mm256_mul_ps(a, b); }
+    static type         div(type a, type b) noexcept { return _mm256_div_ps(a, b); }
+    static type         neg(type a) noexcept { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static type         sqrt(type a) noexcept { return _mm256_sqrt_ps(a); }
+    static type         min(type a, type b) noexcept { return _mm256_min_ps(a, b); }
+    static type         max(type a, type b) noexcept { return _mm256_max_ps(a, b); }
+    static type         select(mask_type m, type a, type b) noexcept { return _mm256_blendv_ps(b, a, m); }
+    static mask_type    lt(type a, type b) noexcept { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static mask_type    le(type a, type b) noexcept { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static mask_type    gt(type a, type b) noexcept { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static mask_type    ge(type a, type b) noexcept { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static mask_type    eq(type a, type b) noexcept { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static mask_type    mask_and(mask_type a, mask_type b) noexcept { return _mm256_and_ps(a, b); }
+    static mask_type    mask_or(mask_type a, mask_type b) noexcept { return _mm256_or_ps(a, b); }
+    static mask_type    mask_select(mask_type m, mask_type a, mask_type b) noexcept { return select(m, a, b); }
+    static mask_type    mask_not(mask_type a) noexcept { return _mm256_xor_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+    static uint32_t     bits(mask_type m) noexcept { return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+};
+#endif
+
+/* the widest lanes of the target and the lanes of half of them, 1 lane without SSE */
+#if defined(__SSE2__)
+using half_wide_lanes = sse_lanes;
+#else
+using half_wide_lanes = scalar_lanes;
+#endif
+#if defined(__AVX__)
+using wide_lanes = avx_lanes;
+#else
+using wide_lanes = half_wide_lanes;
+#endif
+
+/* all the lanes of one register */
+template <class O>
+constexpr uint32_t lane_mask = (1u << O::lanes) - 1u;
+
+template <class O>
+struct lanes_vec3
+{
+    typename O::type x;
+    typename O::type y;
+    typename O::type z;
+};
+
+template <class O>
+inline lanes_vec3<O> lanes_load(const float* x, const float* y, const float* z)
+{
+    return {O::load(x), O::load(y), O::load(z)};
+}
+
+template <class O>
+inline lanes_vec3<O> lanes_set1(const fvec3& v)
+{
+    return {O::set1(v.x), O::set1(v.y), O::set1(v.z)};
+}
+
+template <class O>
+inline lanes_vec3<O> lanes_sub(const lanes_vec3<O>& a, const lanes_vec3<O>& b)
+{
+    return {O::sub(a.x, b.x), O::sub(a.y, b.y), O::sub(a.z, b.z)};
+}
+
+/* in the order of fvec3::dot() */
+template <class O>
+inline typename O::type lanes_dot(const lanes_vec3<O>& a, const lanes_vec3<O>& b)
+{
+    return O::add(O::add(O::mul(a.x, b.x), O::mul(a.y, b.y)), O::mul(a.z, b.z));
+}
+
+/* in the order of fvec3::cross() */
+template <class O>
+inline lanes_vec3<O> lanes_cross(const lanes_vec3<O>& a, const lanes_vec3<O>& b)
+{
+    return {O::sub(O::mul(a.y, b.z), O::mul(a.z, b.y)), O::sub(O::mul(a.z, b.x), O::mul(a.x, b.z)), O::sub(O::mul(a.x, b.y), O::mul(a.y, b.x))};
+}
+
+/* near is outside [tmin, tmax], written as the scalar tests reject */
+template <class O>
+inline typename O::mask_type lanes_out_of_interval(typename O::type near, typename O::type tmin, typename O::type tmax)
+{
+    return O::mask_or(O::lt(near, tmin), O::gt(near, tmax));
+}
+
+/* the overloads of ray_intersection_test.cpp returning near, one lane each. Return the mask of the
+ * rejected lanes, near is written unless all of them missed. The only branches skip the work no
+ * lane needs */
+
+/* SPH_TEST_CALC_COMMON_RET_FALSE, radius2 is radius * radius */
+template <class O>
+inline uint32_t lanes_sphere_test(const lanes_vec3<O>& ro, const lanes_vec3<O>& rd, const lanes_vec3<O>& center, typename O::type radius2,
+    typename O::type tmin, typename O::type tmax, typename O::type& near)
+{
+    using V = typename O::type;
+    lanes_vec3<O> oc = lanes_sub(ro, center);
+    V b = lanes_dot(oc, rd);
+    V c = O::sub(lanes_dot(oc, oc), radius2);
+    V h = O::sub(O::mul(b, b), c);
+    auto miss = O::lt(h, O::set1(0.0f));
+    if (O::bits(miss) == lane_mask<O>) {
+        return lane_mask<O>;
+    }
+    near = O::sub(O::neg(b), O::sqrt(h));
+    return O::bits(O::mask_or(miss, lanes_out_of_interval<O>(near, tmin, tmax)));
+}
+
+/* AABB_TEST_CALC_COMMON, the body and the caps are selected per lane. ba is pb - pa, baba is
+ * ba.dot(ba) and radius2 is radius * radius */
+template <class O>
+inline uint32_t lanes_capsule_test(const lanes_vec3<O>& ro, const lanes_vec3<O>& rd, const lanes_vec3<O>& pa, const lanes_vec3<O>& pb,
+    const lanes_vec3<O>& ba, typename O::type baba, typename O::type radius2, typename O::type tmin, typename O::type tmax, typename O::type& near)
+{
+    using V = typename O::type;
+    V zero = O::set1(0.0f);
+    lanes_vec3<O> oa = lanes_sub(ro, pa);
+    V bard = lanes_dot(ba, rd);
+    V baoa = lanes_dot(ba, oa);
+    V rdoa = lanes_dot(rd, oa);
+    V oaoa = lanes_dot(oa, oa);
+    V a = O::sub(baba, O::mul(bard, bard));
+    V b = O::sub(O::mul(baba, rdoa), O::mul(baoa, bard));
+    V c = O::sub(O::sub(O::mul(baba, oaoa), O::mul(baoa, baoa)), O::mul(radius2, baba));
+    V h = O::sub(O::mul(b, b), O::mul(a, c));
+    /* h >= 0 is false for NaN like in the scalar test */
+    auto hit_infinite = O::ge(h, zero);
+    if (O::bits(hit_infinite) == 0) {
+        return lane_mask<O>;
+    }
+    V t = O::div(O::sub(O::neg(b), O::sqrt(h)), a);
+    V y = O::add(baoa, O::mul(t, bard));
+    auto body = O::mask_and(O::gt(y, zero), O::lt(y, baba));
+    auto body_hit = O::mask_not(lanes_out_of_interval<O>(t, tmin, tmax));
+    if (O::bits(O::mask_or(body, O::mask_not(hit_infinite))) == lane_mask<O>) {
+        near = t;
+        return O::bits(O::mask_not(O::mask_and(hit_infinite, body_hit)));
+    }
+    // caps
+    auto first_cap = O::le(y, zero);
+    lanes_vec3<O> ob = lanes_sub(ro, pb);
+    lanes_vec3<O> oc = {O::select(first_cap, oa.x, ob.x), O::select(first_cap, oa.y, ob.y), O::select(first_cap, oa.z, ob.z)};
+    V cap_b = lanes_dot(rd, oc);
+    V cap_c = O::sub(lanes_dot(oc, oc), radius2);
+    V cap_h = O::sub(O::mul(cap_b, cap_b), cap_c);
+    V cap_n = O::sub(O::neg(cap_b), O::sqrt(cap_h));
+    auto cap_hit = O::mask_and(O::ge(cap_h, zero), O::mask_not(lanes_out_of_interval<O>(cap_n, tmin, tmax)));
+    near = O::select(body, t, cap_n);
+    return O::bits(O::mask_not(O::mask_and(hit_infinite, O::mask_select(body, body_hit, cap_hit))));
+}
+
+/* AABB_TEST_CALC_COMMON_RET_FALSE, inv_rd is ray_safe_inverse(rd) */
+template <class O>
+inline uint32_t lanes_aabb_test(const lanes_vec3<O>& ro, const lanes_vec3<O>& inv_rd, const lanes_vec3<O>& abs_inv_rd, const lanes_vec3<O>& center,
+    const lanes_vec3<O>& size, typename O::type tmin, typename O::type tmax, typename O::type& near)
+{
+    using V = typename O::type;
+    V nx = O::mul(inv_rd.x, O::sub(ro.x, center.x));
+    V ny = O::mul(inv_rd.y, O::sub(ro.y, center.y));
+    V nz = O::mul(inv_rd.z, O::sub(ro.z, center.z));
+    V kx = O::mul(abs_inv_rd.x, size.x);
+    V ky = O::mul(abs_inv_rd.y, size.y);
+    V kz = O::mul(abs_inv_rd.z, size.z);
+    V tN = O::max(O::sub(O::neg(nx), kx), O::max(O::sub(O::neg(ny), ky), O::sub(O::neg(nz), kz)));
+    V tF = O::min(O::add(O::neg(nx), kx), O::min(O::add(O::neg(ny), ky), O::add(O::neg(nz), kz)));
+    near = tN;
+    return O::bits(O::mask_or(O::mask_or(O::gt(tN, tF), lanes_out_of_interval<O>(tN, tmin, tmax)), O::le(tF, O::set1(0.0f))));
+}
+
+/* PLANE_TEST_CALC_COMMON_RET_FALSE, w is position.dot(normal) */
+template <class O>
+inline uint32_t lanes_plane_test(const lanes_vec3<O>& ro, const lanes_vec3<O>& rd, const lanes_vec3<O>& normal, typename O::type w,
+    typename O::type tmin, typename O::type tmax, typename O::type& near)
+{
+    using V = typename O::type;
+    V b = lanes_dot(rd, normal);
+    V a = O::add(O::neg(lanes_dot(ro, normal)), w);
+    near = O::div(a, b);
+    return O::bits(O::mask_or(O::eq(b, O::set1(0.0f)), lanes_out_of_interval<O>(near, tmin, tmax)));
+}
+
+/* ray_triangle_intersection_test(), e1 is v1 - v0 and e2 is v2 - v0. NaN (a ray in the plane of
+ * the triangle) fails every comparison and is a miss like in the scalar test */
+template <class O>
+inline uint32_t lanes_triangle_test(const lanes_vec3<O>& ro, const lanes_vec3<O>& rd, const lanes_vec3<O>& v0, const lanes_vec3<O>& e1,
+    const lanes_vec3<O>& e2, typename O::type tmin, typename O::type tmax, typename O::type& near)
+{
+    using V = typename O::type;
+    V zero = O::set1(0.0f);
+    lanes_vec3<O> p = lanes_cross(rd, e2);
+    V inv_det = O::div(O::set1(1.0f), lanes_dot(e1, p));
+    lanes_vec3<O> s = lanes_sub(ro, v0);
+    V u = O::mul(lanes_dot(s, p), inv_det);
+    lanes_vec3<O> q = lanes_cross(s, e1);
+    V v = O::mul(lanes_dot(rd, q), inv_det);
+    near = O::mul(lanes_dot(e2, q), inv_det);
+    auto inside = O::mask_and(O::mask_and(O::ge(u, zero), O::ge(v, zero)), O::le(O::add(u, v), O::set1(1.0f)));
+    auto in_interval = O::mask_and(O::ge(near, tmin), O::le(near, tmax));
+    return O::bits(O::mask_not(O::mask_and(inside, in_interval)));
+}
+
+} /* namespace green::core */
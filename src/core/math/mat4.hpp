@@ -14,20 +14,20 @@ public:
     using value_type = T;
 
 public:
-                    basic_mat4() = default;
-    explicit        basic_mat4(T xx_yy_zz_ww) noexcept;
-    explicit        basic_mat4(const basic_vec4<T>& x, const basic_vec4<T>& y, const basic_vec4<T>& z, const basic_vec4<T>& w) noexcept;
-    explicit        basic_mat4(T xx, T xy, T xz, T xw, T yx, T yy, T yz, T yw, T zx, T zy, T zz, T zw, T wx, T wy, T wz, T ww) noexcept;
-
-    basic_mat4&     operator+=(const basic_mat4& val) noexcept;
-    basic_mat4&     operator-=(const basic_mat4& val) noexcept;
-    basic_mat4&     operator*=(const basic_mat4& val) noexcept;
+                              basic_mat4() = default;
+    explicit constexpr        basic_mat4(T xx_yy_zz_ww) noexcept;
+    explicit constexpr        basic_mat4(const basic_vec4<T>& x, const basic_vec4<T>& y, const basic_vec4<T>& z, const basic_vec4<T>& w) noexcept;
+    explicit constexpr        basic_mat4(T xx, T xy, T xz, T xw, T yx, T yy, T yz, T yw, T zx, T zy, T zz, T zw, T wx, T wy, T wz, T ww) noexcept;
+
+    constexpr basic_mat4&     operator+=(const basic_mat4& val) noexcept;
+    constexpr basic_mat4&     operator-=(const basic_mat4& val) noexcept;
+    constexpr basic_mat4&     operator*=(const basic_mat4& val) noexcept;
     template <typename S>
-    basic_mat4&     operator*=(S val) noexcept;
+    constexpr basic_mat4&     operator*=(S val) noexcept;
     template <typename S>
-    basic_mat4&     operator/=(S val) noexcept;
+    constexpr basic_mat4&     operator/=(S val) noexcept;
 
-    static basic_mat4   perspective(T fov, T aspect, T near, T far) noexcept;
+    static constexpr basic_mat4   perspective(T fov, T aspect, T near, T far) noexcept;
 
 public:
     basic_vec4<T>   x, y, z, w;
@@ -37,7 +37,7 @@ public:
 
 /* basic_mat4::basic_mat4 */
 template <typename T>
-inline basic_mat4<T>::basic_mat4(const basic_vec4<T>& x, const basic_vec4<T>& y, const basic_vec4<T>& z, const basic_vec4<T>& w) noexcept
+constexpr basic_mat4<T>::basic_mat4(const basic_vec4<T>& x, const basic_vec4<T>& y, const basic_vec4<T>& z, const basic_vec4<T>& w) noexcept
     : x(x)
     , y(y)
     , z(z)
@@ -46,7 +46,7 @@ inline basic_mat4<T>::basic_mat4(const basic_vec4<T>& x, const basic_vec4<T>& y,
 
 /* basic_mat4::basic_mat4 */
 template <typename T>
-inline basic_mat4<T>::basic_mat4(T xx_yy_zz_ww) noexcept
+constexpr basic_mat4<T>::basic_mat4(T xx_yy_zz_ww) noexcept
     : x(xx_yy_zz_ww, 0.0, 0.0, 0.0)
     , y(0.0, xx_yy_zz_ww, 0.0, 0.0)
     , z(0.0, 0.0, xx_yy_zz_ww, 0.0)
@@ -55,7 +55,7 @@ inline basic_mat4<T>::basic_mat4(T xx_yy_zz_ww) noexcept
 
 /* basic_mat4::basic_mat4 */
 template <typename T>
-inline basic_mat4<T>::basic_mat4(T xx, T xy, T xz, T xw, T yx, T yy, T yz, T yw, T zx, T zy, T zz, T zw, T wx, T wy, T wz, T ww) noexcept
+constexpr basic_mat4<T>::basic_mat4(T xx, T xy, T xz, T xw, T yx, T yy, T yz, T yw, T zx, T zy, T zz, T zw, T wx, T wy, T wz, T ww) noexcept
     : x(xx, xy, xz, xw)
     , y(yx, yy, yz, yw)
     , z(zx, zy, zz, zw)
@@ -64,7 +64,7 @@ inline basic_mat4<T>::basic_mat4(T xx, T xy, T xz, T xw, T yx, T yy, T yz, T yw,
 
 /* basic_mat4::operator+= */
 template <typename T>
-basic_mat4<T>& basic_mat4<T>::operator+=(const basic_mat4<T>& val) noexcept
+constexpr basic_mat4<T>& basic_mat4<T>::operator+=(const basic_mat4<T>& val) noexcept
 {
     x += val.x;
     y += val.y;
@@ -75,7 +75,7 @@ basic_mat4<T>& basic_mat4<T>::operator+=(const basic_mat4<T>& val) noexcept
 
 /* basic_mat4::operator-= */
 template <typename T>
-basic_mat4<T>& basic_mat4<T>::operator-=(const basic_mat4<T>& val) noexcept
+constexpr basic_mat4<T>& basic_mat4<T>::operator-=(const basic_mat4<T>& val) noexcept
 {
     x -= val.x;
     y -= val.y;
@@ -86,7 +86,7 @@ basic_mat4<T>& basic_mat4<T>::operator-=(const basic_mat4<T>& val) noexcept
 
 /* basic_mat4::operator*= */
 template <typename T>
-basic_mat4<T>& basic_mat4<T>::operator*=(const basic_mat4<T>& val) noexcept
+constexpr basic_mat4<T>& basic_mat4<T>::operator*=(const basic_mat4<T>& val) noexcept
 {
     basic_mat4<T> mat(
         // first row
@@ -117,7 +117,7 @@ basic_mat4<T>& basic_mat4<T>::operator*=(const basic_mat4<T>& val) noexcept
 /* basic_mat4::operator*= */
 template <typename T>
 template <typename S>
-basic_mat4<T>& basic_mat4<T>::operator*=(S val) noexcept
+constexpr basic_mat4<T>& basic_mat4<T>::operator*=(S val) noexcept
 {
     x *= val;
     y *= val;
@@ -129,7 +129,7 @@ basic_mat4<T>& basic_mat4<T>::operator*=(S val) noexcept
 /* basic_mat4::operator/= */
 template <typename T>
 template <typename S>
-basic_mat4<T>& basic_mat4<T>::operator/=(S val) noexcept
+constexpr basic_mat4<T>& basic_mat4<T>::operator/=(S val) noexcept
 {
     x /= val;
     y /= val;
@@ -140,7 +140,7 @@ basic_mat4<T>& basic_mat4<T>::operator/=(S val) noexcept
 
 /* static basic_mat4::perspective */
 template <typename T>
-basic_mat4<T> basic_mat4<T>::perspective(T fov, T aspect, T near, T far) noexcept
+constexpr basic_mat4<T> basic_mat4<T>::perspective(T fov, T aspect, T near, T far) noexcept
 {
     auto range = near - far;
     auto half_tan = math::tan(fov / 2.0);
@@ -155,21 +155,21 @@ basic_mat4<T> basic_mat4<T>::perspective(T fov, T aspect, T near, T far) noexcep
 
 /* operator+ */
 template <typename T>
-basic_mat4<T> operator+(const basic_mat4<T>& a, const basic_mat4<T>& b) noexcept
+constexpr basic_mat4<T> operator+(const basic_mat4<T>& a, const basic_mat4<T>& b) noexcept
 {
     return basic_mat4<T>(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
 }
 
 /* operator- */
 template <typename T>
-basic_mat4<T> operator-(const basic_mat4<T>& a, const basic_mat4<T>& b) noexcept
+constexpr basic_mat4<T> operator-(const basic_mat4<T>& a, const basic_mat4<T>& b) noexcept
 {
     return basic_mat4<T>(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
 }
 
 /* operator* */
 template <typename T>
-basic_mat4<T> operator*(const basic_mat4<T>& a, const basic_mat4<T>& b) noexcept
+constexpr basic_mat4<T> operator*(const basic_mat4<T>& a, const basic_mat4<T>& b) noexcept
 {
     return basic_mat4<T>(
         // first row
@@ -197,7 +197,7 @@ basic_mat4<T> operator*(const basic_mat4<T>& a, const basic_mat4<T>& b) noexcept
 
 /* operator* */
 template <typename T>
-basic_vec4<T> operator*(const basic_vec4<T>& v, const basic_mat4<T>& m) noexcept
+constexpr basic_vec4<T> operator*(const basic_vec4<T>& v, const basic_mat4<T>& m) noexcept
 {
     return basic_vec4<T>(
         v.x * m.x.x + v.y * m.y.x + v.z * m.z.x + v.w * m.w.x,
@@ -209,7 +209,7 @@ basic_vec4<T> operator*(const basic_vec4<T>& v, const basic_mat4<T>& m) noexcept
 
 /* operator* */
 template <typename T>
-basic_vec4<T> operator*(const basic_mat4<T>& m, const basic_vec4<T>& v) noexcept
+constexpr basic_vec4<T> operator*(const basic_mat4<T>& m, const basic_vec4<T>& v) noexcept
 {
     return basic_vec4<T>(
         v.x * m.x.x + v.y * m.x.y + v.z * m.x.z + v.w * m.x.w,
@@ -221,7 +221,7 @@ basic_vec4<T> operator*(const basic_mat4<T>& m, const basic_vec4<T>& v) noexcept
 
 /* operator* */
 template <typename T>
-basic_vec3<T> operator*(const basic_mat4<T>& m, const basic_vec3<T>& v) noexcept
+constexpr basic_vec3<T> operator*(const basic_mat4<T>& m, const basic_vec3<T>& v) noexcept
 {
     auto scale = m.w.x * v.x + m.w.y * v.y + m.w.z * v.z + m.w.w;
     if (scale == 1.0) {
@@ -242,28 +242,28 @@ basic_vec3<T> operator*(const basic_mat4<T>& m, const basic_vec3<T>& v) noexcept
 
 /* operator* */
 template <typename T, typename S>
-basic_mat4<T> operator*(const basic_mat4<T>& m, S s)
+constexpr basic_mat4<T> operator*(const basic_mat4<T>& m, S s)
 {
     return basic_mat4<T>(m.x * s, m.y * s, m.z * s, m.w * s);
 }
 
 /* operator* */
 template <typename T, typename S>
-basic_mat4<T> operator*(S s, const basic_mat4<T>& m)
+constexpr basic_mat4<T> operator*(S s, const basic_mat4<T>& m)
 {
     return basic_mat4<T>(m.x * s, m.y * s, m.z * s, m.w * s);
 }
 
 /* operator/ */
 template <typename T, typename S>
-basic_mat4<T> operator/(const basic_mat4<T>& m, S s)
+constexpr basic_mat4<T> operator/(const basic_mat4<T>& m, S s)
 {
     return m * (1.0 / s);
 }
 
 /* operator/ */
 template <typename T, typename S>
-basic_mat4<T> operator/(S s, const basic_mat4<T>& m)
+constexpr basic_mat4<T> operator/(S s, const basic_mat4<T>& m)
 {
     return basic_mat4<T>(s / m.x, s / m.y, s / m.z, s / m.w);
 }
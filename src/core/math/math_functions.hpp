@@ -1,12 +1,19 @@
 #pragma once
 
 #include <cmath>
+#include <limits>
+#include <type_traits>
 
 namespace green::core::math
 {
 
 constexpr double pi = 3.14159265358979323846;
 
+/* the functions declared constexpr can be evaluated at compile time. The <cmath> calls are not
+ * constexpr before C++23, a constant evaluation takes a series instead: exact for abs, floor and
+ * ceil, within an ulp of double for sqrt and a few ulps for the others. asin, acos, atan, atan2
+ * and pow are runtime only */
+
 #ifdef min
 #undef min
 #endif
@@ -15,85 +22,125 @@ constexpr double pi = 3.14159265358979323846;
 #undef max
 #endif
 
-template <typename T> T     min(T a, T b) noexcept;
-template <typename T> T     max(T a, T b) noexcept;
-template <typename T> T     sign(T a) noexcept;
-template <typename T> T     sqr(T a) noexcept;
-template <typename T> T     abs(T a) noexcept;
-template <typename T> T     sqrt(T a) noexcept;
-template <typename T> T     sin(T a) noexcept;
-template <typename T> T     cos(T a) noexcept;
-template <typename T> T     tan(T a) noexcept;
-template <typename T> T     asin(T a) noexcept;
-template <typename T> T     acos(T a) noexcept;
-template <typename T> T     atan(T a) noexcept;
-template <typename T> T     atan2(T x, T y) noexcept;
-template <typename T> T     log(T a) noexcept;
-template <typename T> T     exp(T a) noexcept;
+template <typename T> constexpr T     min(T a, T b) noexcept;
+template <typename T> constexpr T     max(T a, T b) noexcept;
+template <typename T> constexpr T     sign(T a) noexcept;
+template <typename T> constexpr T     sqr(T a) noexcept;
+template <typename T> constexpr T     abs(T a) noexcept;
+template <typename T> constexpr T     sqrt(T a) noexcept;
+template <typename T> constexpr T     sin(T a) noexcept;
+template <typename T> constexpr T     cos(T a) noexcept;
+template <typename T> constexpr T     tan(T a) noexcept;
+template <typename T> T               asin(T a) noexcept;
+template <typename T> T               acos(T a) noexcept;
+template <typename T> T               atan(T a) noexcept;
+template <typename T> T               atan2(T x, T y) noexcept;
+template <typename T> constexpr T     log(T a) noexcept;
+template <typename T> constexpr T     exp(T a) noexcept;
 template <typename Ta, typename Tb, typename Tr>
-Tr                          pow(Ta base, Tb power) noexcept;
-template <typename T> T     deg2rad(T a) noexcept;
-template <typename T> T     rad2deg(T a) noexcept;
-template <typename T> T     floor(T a) noexcept;
-template <typename T> T     ceil(T a) noexcept;
-template <typename T> T     frac(T a) noexcept;
-template <typename T> T     round(T a) noexcept;
-template <typename T> T     clamp(T val, T min, T max);
+Tr                                    pow(Ta base, Tb power) noexcept;
+template <typename T> constexpr T     deg2rad(T a) noexcept;
+template <typename T> constexpr T     rad2deg(T a) noexcept;
+template <typename T> constexpr T     floor(T a) noexcept;
+template <typename T> constexpr T     ceil(T a) noexcept;
+template <typename T> constexpr T     frac(T a) noexcept;
+template <typename T> constexpr T     round(T a) noexcept;
+template <typename T> constexpr T     clamp(T val, T min, T max);
 
 
 
 template <typename T>
-T min(T a, T b) noexcept
+constexpr T min(T a, T b) noexcept
 {
     return a < b ? a : b;
 }
 
 template <typename T>
-T max(T a, T b) noexcept
+constexpr T max(T a, T b) noexcept
 {
     return a > b ? a : b;
 }
 
 template <typename T>
-T sign(T a) noexcept
+constexpr T sign(T a) noexcept
 {
     constexpr T zero = static_cast<T>(0);
     return a > zero ? static_cast<T>(1) : (a < zero ? -static_cast<T>(1) : zero);
 }
 
 template <typename T>
-T sqr(T a) noexcept
+constexpr T sqr(T a) noexcept
 {
     return a * a;
 }
 
 template <typename T>
-T abs(T a) noexcept
+constexpr T abs(T a) noexcept
 {
+    if (std::is_constant_evaluated()) {
+        return a < static_cast<T>(0) ? -a : (a == static_cast<T>(0) ? static_cast<T>(0) : a);
+    }
     return std::abs(a);
 }
 
 template <typename T>
-T sqrt(T a) noexcept
+constexpr T sqrt(T a) noexcept
 {
+    if (std::is_constant_evaluated()) {
+        if (!(a > static_cast<T>(0)) || a == std::numeric_limits<T>::infinity()) {
+            return a == static_cast<T>(0) || a == std::numeric_limits<T>::infinity() ? a : std::numeric_limits<T>::quiet_NaN();
+        }
+        /* newton from above, stops when the step no longer decreases */
+        T x = a > static_cast<T>(1) ? a : static_cast<T>(1);
+        for (T next = (x + a / x) / static_cast<T>(2); next < x; next = (x + a / x) / static_cast<T>(2)) {
+            x = next;
+        }
+        return x;
+    }
     return std::sqrt(a);
 }
 
 template <typename T>
-T sin(T a) noexcept
+constexpr T sin(T a) noexcept
 {
+    if (std::is_constant_evaluated()) {
+        /* taylor series in double around 0 after the reduction to [-pi, pi] */
+        double x = static_cast<double>(a);
+        x -= 2.0 * pi * floor(x / (2.0 * pi) + 0.5);
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 30; n++) {
+            term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+            sum += term;
+        }
+        return static_cast<T>(sum);
+    }
     return std::sin(a);
 }
 
 template <typename T>
-T cos(T a) noexcept
+constexpr T cos(T a) noexcept
 {
+    if (std::is_constant_evaluated()) {
+        double x = static_cast<double>(a);
+        x -= 2.0 * pi * floor(x / (2.0 * pi) + 0.5);
+        double term = 1.0;
+        double sum = 1.0;
+        for (int n = 1; n < 30; n++) {
+            term *= -x * x / ((2.0 * n - 1.0) * (2.0 * n));
+            sum += term;
+        }
+        return static_cast<T>(sum);
+    }
     return std::cos(a);
 }
 
 template <typename T>
-T tan(T a) noexcept
+constexpr T tan(T a) noexcept
 {
+    if (std::is_constant_evaluated()) {
+        return sin(a) / cos(a);
+    }
     return std::tan(a);
 }
 
@@ -122,14 +169,58 @@ T atan2(T x, T y) noexcept
 }
 
 template <typename T>
-T log(T a) noexcept
+constexpr T log(T a) noexcept
 {
+    if (std::is_constant_evaluated()) {
+        if (!(a > static_cast<T>(0)) || a == std::numeric_limits<T>::infinity()) {
+            return a == static_cast<T>(0) ? -std::numeric_limits<T>::infinity() : (a > static_cast<T>(0) ? a : std::numeric_limits<T>::quiet_NaN());
+        }
+        /* a = m * 2^k with m in [1, 2), log(m) = 2 atanh((m - 1) / (m + 1)) */
+        constexpr double ln2 = 0.693147180559945309417;
+        double m = static_cast<double>(a);
+        int k = 0;
+        for (; m >= 2.0; m /= 2.0, k++) {
+        }
+        for (; m < 1.0; m *= 2.0, k--) {
+        }
+        double y = (m - 1.0) / (m + 1.0);
+        double term = y;
+        double sum = 0.0;
+        for (int n = 1; n < 80; n += 2) {
+            sum += term / n;
+            term *= y * y;
+        }
+        return static_cast<T>(k * ln2 + 2.0 * sum);
+    }
     return std::log(a);
 }
 
 template <typename T>
-T exp(T a) noexcept
+constexpr T exp(T a) noexcept
 {
+    if (std::is_constant_evaluated()) {
+        /* e^a = 2^k * e^r with |r| <= ln2 / 2 */
+        constexpr double ln2 = 0.693147180559945309417;
+        double x = static_cast<double>(a);
+        if (x != x || x > 1024.0 || x < -1100.0) {
+            return x != x ? a : (x > 0.0 ? std::numeric_limits<T>::infinity() : static_cast<T>(0));
+        }
+        double k = floor(x / ln2 + 0.5);
+        double r = x - k * ln2;
+        double term = 1.0;
+        double sum = 1.0;
+        for (int n = 1; n < 30; n++) {
+            term *= r / n;
+            sum += term;
+        }
+        for (; k > 0.0; k -= 1.0) {
+            sum *= 2.0;
+        }
+        for (; k < 0.0; k += 1.0) {
+            sum /= 2.0;
+        }
+        return static_cast<T>(sum);
+    }
     return std::exp(a);
 }
 
@@ -140,43 +231,64 @@ Tr pow(Ta base, Tb power) noexcept
 }
 
 template <typename T>
-T deg2rad(T a) noexcept
+constexpr T deg2rad(T a) noexcept
 {
     return a * pi / 180.0;
 }
 
 template <typename T>
-T rad2deg(T a) noexcept
+constexpr T rad2deg(T a) noexcept
 {
     return a * 180.0 / pi;
 }
 
 template <typename T>
-T floor(T a) noexcept
+constexpr T floor(T a) noexcept
 {
+    if constexpr (std::is_integral_v<T>) {
+        return a;
+    }
+    if (std::is_constant_evaluated()) {
+        /* nan, inf and the values without a fraction are returned as they are */
+        if (!(abs(a) < static_cast<T>(4503599627370496.0))) {
+            return a;
+        }
+        T i = static_cast<T>(static_cast<long long>(a));
+        return i > a ? i - static_cast<T>(1) : i;
+    }
     return std::floor(a);
 }
 
 template <typename T>
-T ceil(T a) noexcept
+constexpr T ceil(T a) noexcept
 {
+    if constexpr (std::is_integral_v<T>) {
+        return a;
+    }
+    if (std::is_constant_evaluated()) {
+        if (!(abs(a) < static_cast<T>(4503599627370496.0))) {
+            return a;
+        }
+        T i = static_cast<T>(static_cast<long long>(a));
+        return i < a ? i + static_cast<T>(1) : i;
+    }
     return std::ceil(a);
 }
 
 template <typename T>
-T frac(T a) noexcept
+constexpr T frac(T a) noexcept
 {
     return a - floor(a);
 }
 
 template <typename T>
-T round(T a) noexcept
+constexpr T round(T a) noexcept
 {
     return floor(a + static_cast<T>(0.5));
 }
 
 template <typename T>
-T clamp(T val, T min, T max)
+constexpr T clamp(T val, T min, T max)
 {
     if (val < min) {
         return min;
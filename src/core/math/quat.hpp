@@ -15,17 +15,17 @@ public:
 
 public:
 
-                    basic_quat() = default;
-                    basic_quat(T x, T y, T z, T w) noexcept;
-                    /* n - normalized vector. angle_w - angle in radians */
-                    basic_quat(const basic_vec3<T>& n, T radian_w) noexcept;
+                              basic_quat() = default;
+    constexpr                 basic_quat(T x, T y, T z, T w) noexcept;
+                              /* n - normalized vector. angle_w - angle in radians */
+    constexpr                 basic_quat(const basic_vec3<T>& n, T radian_w) noexcept;
 
-    basic_quat &    operator*=(const basic_quat& q) noexcept;
+    constexpr basic_quat &    operator*=(const basic_quat& q) noexcept;
 
-    basic_quat      normalize() const noexcept;
-    basic_quat &    normalize_self() noexcept;
+    constexpr basic_quat      normalize() const noexcept;
+    constexpr basic_quat &    normalize_self() noexcept;
 
-    basic_mat4<T>   to_mat4() const noexcept;
+    constexpr basic_mat4<T>   to_mat4() const noexcept;
 
 public:
     T               x, y, z, w;
@@ -35,7 +35,7 @@ public:
 
 /* basic_quat::basic_quat */
 template <typename T>
-inline basic_quat<T>::basic_quat(T x, T y, T z, T w) noexcept
+constexpr basic_quat<T>::basic_quat(T x, T y, T z, T w) noexcept
     : x(x)
     , y(y)
     , z(z)
@@ -45,7 +45,7 @@ inline basic_quat<T>::basic_quat(T x, T y, T z, T w) noexcept
 
 /* basic_quat::basic_quat */
 template <typename T>
-inline basic_quat<T>::basic_quat(const basic_vec3<T>& n, T radian_w) noexcept
+constexpr basic_quat<T>::basic_quat(const basic_vec3<T>& n, T radian_w) noexcept
 {
     auto half_angle = radian_w / 2.0;
     auto sin = math::sin(half_angle);
@@ -57,7 +57,7 @@ inline basic_quat<T>::basic_quat(const basic_vec3<T>& n, T radian_w) noexcept
 }
 
 template <typename T>
-inline basic_quat<T>& basic_quat<T>::operator*=(const basic_quat<T>& q) noexcept
+constexpr basic_quat<T>& basic_quat<T>::operator*=(const basic_quat<T>& q) noexcept
 {
     T qx = w * q.x + x * q.w + y * q.z - z * q.y;
     T qy = w * q.y - x * q.z + y * q.w + z * q.x;
@@ -71,7 +71,7 @@ inline basic_quat<T>& basic_quat<T>::operator*=(const basic_quat<T>& q) noexcept
 }
 
 template <typename T>
-inline basic_quat<T> basic_quat<T>::normalize() const noexcept
+constexpr basic_quat<T> basic_quat<T>::normalize() const noexcept
 {
     T len = math::sqrt(x * x + y * y + z * z + w * w);
     if (len != 0.0 ) {
@@ -81,7 +81,7 @@ inline basic_quat<T> basic_quat<T>::normalize() const noexcept
 }
 
 template <typename T>
-inline basic_quat<T>& basic_quat<T>::normalize_self() noexcept
+constexpr basic_quat<T>& basic_quat<T>::normalize_self() noexcept
 {
     T len = math::sqrt(x * x + y * y + z * z + w * w);
     if (len != 0.0 ) {
@@ -96,7 +96,7 @@ inline basic_quat<T>& basic_quat<T>::normalize_self() noexcept
 }
 
 template <typename T>
-basic_mat4<T> basic_quat<T>::to_mat4() const noexcept
+constexpr basic_mat4<T> basic_quat<T>::to_mat4() const noexcept
 {
     T x2 = x + x;
     T y2 = y + y;
@@ -122,14 +122,14 @@ basic_mat4<T> basic_quat<T>::to_mat4() const noexcept
 
 /* operator- */
 template<typename T>
-inline basic_quat<T> operator-(const basic_quat<T>& q) noexcept
+constexpr basic_quat<T> operator-(const basic_quat<T>& q) noexcept
 {
     return basic_quat<T>(-q.x, -q.y, -q.z, q.w);
 }
 
 /* operator* */
 template<typename T>
-inline basic_quat<T> operator*(const basic_quat<T>& a, const basic_quat<T>& b) noexcept
+constexpr basic_quat<T> operator*(const basic_quat<T>& a, const basic_quat<T>& b) noexcept
 {
     return basic_quat<T>(
         a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
@@ -141,7 +141,7 @@ inline basic_quat<T> operator*(const basic_quat<T>& a, const basic_quat<T>& b) n
 
 /* operator* */
 template<typename T>
-basic_vec3<T> operator*(const basic_quat<T>& q, const basic_vec3<T>& v) noexcept
+constexpr basic_vec3<T> operator*(const basic_quat<T>& q, const basic_vec3<T>& v) noexcept
 {
     T xxzz = q.x * q.x - q.z * q.z;
     T wwyy = q.w * q.w - q.y * q.y;
@@ -160,7 +160,7 @@ basic_vec3<T> operator*(const basic_quat<T>& q, const basic_vec3<T>& v) noexcept
 
 /* operator* */
 template<typename T>
-basic_vec3<T> operator*(const basic_vec3<T>& v, const basic_quat<T>& q)
+constexpr basic_vec3<T> operator*(const basic_vec3<T>& v, const basic_quat<T>& q)
 {
     return q * v;
 }
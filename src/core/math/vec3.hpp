@@ -12,38 +12,38 @@ public:
     using value_type = T;
 
 public:
-                    basic_vec3() = default;
-                    basic_vec3(T x) noexcept;
-                    basic_vec3(T x, T y, T z) noexcept;
+                              basic_vec3() = default;
+    constexpr                 basic_vec3(T x) noexcept;
+    constexpr                 basic_vec3(T x, T y, T z) noexcept;
 
-    basic_vec3 &    operator+=(const basic_vec3& val) noexcept;
-    basic_vec3 &    operator-=(const basic_vec3& val) noexcept;
+    constexpr basic_vec3 &    operator+=(const basic_vec3& val) noexcept;
+    constexpr basic_vec3 &    operator-=(const basic_vec3& val) noexcept;
     template <typename S>
-    basic_vec3 &    operator*=(S val) noexcept;
-    basic_vec3 &    operator*=(const basic_vec3& val) noexcept;
+    constexpr basic_vec3 &    operator*=(S val) noexcept;
+    constexpr basic_vec3 &    operator*=(const basic_vec3& val) noexcept;
     template <typename S>
-    basic_vec3 &    operator/=(S val) noexcept;
+    constexpr basic_vec3 &    operator/=(S val) noexcept;
 
-    basic_vec3      cross(const basic_vec3& val) const noexcept;
-    T               dot(const basic_vec3& val) const noexcept;
+    constexpr basic_vec3      cross(const basic_vec3& val) const noexcept;
+    constexpr T               dot(const basic_vec3& val) const noexcept;
 
-    basic_vec3      normalize() const noexcept;
+    constexpr basic_vec3      normalize() const noexcept;
     template <typename S>
-    basic_vec3      normalize(S& len) const noexcept;
-    basic_vec3 &    normalize_self() noexcept;
+    constexpr basic_vec3      normalize(S& len) const noexcept;
+    constexpr basic_vec3 &    normalize_self() noexcept;
     template <typename S>
-    basic_vec3 &    normalize_self(S& len) noexcept;
+    constexpr basic_vec3 &    normalize_self(S& len) noexcept;
 
-    basic_vec3      abs() const noexcept;
-    basic_vec3 &    abs_self() noexcept;
+    constexpr basic_vec3      abs() const noexcept;
+    constexpr basic_vec3 &    abs_self() noexcept;
 
-    basic_vec3      clamp(T min, T max) const noexcept;
-    basic_vec3 &    clamp_self(T min, T max) noexcept;
+    constexpr basic_vec3      clamp(T min, T max) const noexcept;
+    constexpr basic_vec3 &    clamp_self(T min, T max) noexcept;
 
-    T               min() const noexcept;
-    T               max() const noexcept;
+    constexpr T               min() const noexcept;
+    constexpr T               max() const noexcept;
 
-    basic_vec3      sign() const noexcept;
+    constexpr basic_vec3      sign() const noexcept;
 public:
     union {
         T x, r;
@@ -61,7 +61,7 @@ public:
 
 
 template <typename T>
-inline basic_vec3<T>::basic_vec3(T x) noexcept
+constexpr basic_vec3<T>::basic_vec3(T x) noexcept
     : x(x)
     , y(x)
     , z(x)
@@ -69,7 +69,7 @@ inline basic_vec3<T>::basic_vec3(T x) noexcept
 }
 
 template <typename T>
-inline basic_vec3<T>::basic_vec3(T x, T y, T z) noexcept
+constexpr basic_vec3<T>::basic_vec3(T x, T y, T z) noexcept
     : x(x)
     , y(y)
     , z(z)
@@ -77,7 +77,7 @@ inline basic_vec3<T>::basic_vec3(T x, T y, T z) noexcept
 }
 
 template <typename T>
-inline basic_vec3<T>& basic_vec3<T>::operator+=(const basic_vec3<T>& val) noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::operator+=(const basic_vec3<T>& val) noexcept
 {
     x += val.x;
     y += val.y;
@@ -86,7 +86,7 @@ inline basic_vec3<T>& basic_vec3<T>::operator+=(const basic_vec3<T>& val) noexce
 }
 
 template <typename T>
-inline basic_vec3<T>& basic_vec3<T>::operator-=(const basic_vec3<T>& val) noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::operator-=(const basic_vec3<T>& val) noexcept
 {
     x -= val.x;
     y -= val.y;
@@ -96,7 +96,7 @@ inline basic_vec3<T>& basic_vec3<T>::operator-=(const basic_vec3<T>& val) noexce
 
 template <typename T>
 template <typename S>
-inline basic_vec3<T>& basic_vec3<T>::operator*=(S val) noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::operator*=(S val) noexcept
 {
     x *= val;
     y *= val;
@@ -105,7 +105,7 @@ inline basic_vec3<T>& basic_vec3<T>::operator*=(S val) noexcept
 }
 
 template <typename T>
-inline basic_vec3<T>& basic_vec3<T>::operator*=(const basic_vec3<T>& val) noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::operator*=(const basic_vec3<T>& val) noexcept
 {
     x *= val.x;
     y *= val.y;
@@ -115,7 +115,7 @@ inline basic_vec3<T>& basic_vec3<T>::operator*=(const basic_vec3<T>& val) noexce
 
 template <typename T>
 template <typename S>
-inline basic_vec3<T>& basic_vec3<T>::operator/=(S val) noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::operator/=(S val) noexcept
 {
     x /= val;
     y /= val;
@@ -124,19 +124,19 @@ inline basic_vec3<T>& basic_vec3<T>::operator/=(S val) noexcept
 }
 
 template <typename T>
-inline basic_vec3<T> basic_vec3<T>::cross(const basic_vec3<T>& val) const noexcept
+constexpr basic_vec3<T> basic_vec3<T>::cross(const basic_vec3<T>& val) const noexcept
 {
     return basic_vec3<T>(y * val.z - z * val.y, z * val.x - x * val.z, x * val.y - y * val.x);
 }
 
 template <typename T>
-inline T basic_vec3<T>::dot(const basic_vec3<T>& val) const noexcept
+constexpr T basic_vec3<T>::dot(const basic_vec3<T>& val) const noexcept
 {
     return x * val.x + y * val.y + z * val.z;
 }
 
 template <typename T>
-inline basic_vec3<T> basic_vec3<T>::normalize() const noexcept
+constexpr basic_vec3<T> basic_vec3<T>::normalize() const noexcept
 {
     auto len = sqrt(dot(*this));
     return basic_vec3<T>(x / len, y / len, z / len);
@@ -144,14 +144,14 @@ inline basic_vec3<T> basic_vec3<T>::normalize() const noexcept
 
 template <typename T>
 template <typename S>
-inline basic_vec3<T> basic_vec3<T>::normalize(S& len) const noexcept
+constexpr basic_vec3<T> basic_vec3<T>::normalize(S& len) const noexcept
 {
     len = sqrt(dot(*this));
     return basic_vec3<T>(x / len, y / len, z / len);
 }
 
 template <typename T>
-inline basic_vec3<T>& basic_vec3<T>::normalize_self() noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::normalize_self() noexcept
 {
     *this /= sqrt(dot(*this));
     return *this;
@@ -159,7 +159,7 @@ inline basic_vec3<T>& basic_vec3<T>::normalize_self() noexcept
 
 template <typename T>
 template <typename S>
-inline basic_vec3<T>& basic_vec3<T>::normalize_self(S& len) noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::normalize_self(S& len) noexcept
 {
     len = sqrt(dot(*this));
     *this /= len;
@@ -167,13 +167,13 @@ inline basic_vec3<T>& basic_vec3<T>::normalize_self(S& len) noexcept
 }
 
 template <typename T>
-inline basic_vec3<T> basic_vec3<T>::abs() const noexcept
+constexpr basic_vec3<T> basic_vec3<T>::abs() const noexcept
 {
     return basic_vec3<T>(math::abs(x), math::abs(y), math::abs(z));
 }
 
 template <typename T>
-inline basic_vec3<T>& basic_vec3<T>::abs_self() noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::abs_self() noexcept
 {
     x = math::abs(x);
     y = math::abs(y);
@@ -182,13 +182,13 @@ inline basic_vec3<T>& basic_vec3<T>::abs_self() noexcept
 }
 
 template <typename T>
-inline basic_vec3<T> basic_vec3<T>::clamp(T min, T max) const noexcept
+constexpr basic_vec3<T> basic_vec3<T>::clamp(T min, T max) const noexcept
 {
     return basic_vec3<T>(math::clamp(x, min, max), math::clamp(y, min, max), math::clamp(z, min, max));
 }
 
 template <typename T>
-basic_vec3<T>& basic_vec3<T>::clamp_self(T min, T max) noexcept
+constexpr basic_vec3<T>& basic_vec3<T>::clamp_self(T min, T max) noexcept
 {
     x = math::clamp(x, min, max);
     y = math::clamp(y, min, max);
@@ -197,19 +197,19 @@ basic_vec3<T>& basic_vec3<T>::clamp_self(T min, T max) noexcept
 }
 
 template <typename T>
-inline T basic_vec3<T>::min() const noexcept
+constexpr T basic_vec3<T>::min() const noexcept
 {
     return math::min(x, math::min(y, z));
 }
 
 template <typename T>
-inline T basic_vec3<T>::max() const noexcept
+constexpr T basic_vec3<T>::max() const noexcept
 {
     return math::max(x, math::max(y, z));
 }
 
 template <typename T>
-inline basic_vec3<T> basic_vec3<T>::sign() const noexcept
+constexpr basic_vec3<T> basic_vec3<T>::sign() const noexcept
 {
     return basic_vec3<T>(math::sign(x), math::sign(y), math::sign(z));
 }
@@ -217,79 +217,79 @@ inline basic_vec3<T> basic_vec3<T>::sign() const noexcept
 
 
 template <typename T>
-inline basic_vec3<T> operator-(const basic_vec3<T>& v) noexcept
+constexpr basic_vec3<T> operator-(const basic_vec3<T>& v) noexcept
 {
     return basic_vec3<T>(-v.x, -v.y, -v.z);
 }
 
 template <typename T>
-inline basic_vec3<T> operator+(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
+constexpr basic_vec3<T> operator+(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
 {
     return basic_vec3<T>(a.x + b.x, a.y + b.y, a.z + b.z);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator+(const basic_vec3<T>& v, S s) noexcept
+constexpr basic_vec3<T> operator+(const basic_vec3<T>& v, S s) noexcept
 {
     return basic_vec3<T>(v.x + s, v.y + s, v.z + s);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator+(S s, const basic_vec3<T>& v) noexcept
+constexpr basic_vec3<T> operator+(S s, const basic_vec3<T>& v) noexcept
 {
     return basic_vec3<T>(v.x + s, v.y + s, v.z + s);
 }
 
 template <typename T>
-inline basic_vec3<T> operator-(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
+constexpr basic_vec3<T> operator-(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
 {
     return basic_vec3<T>(a.x - b.x, a.y - b.y, a.z - b.z);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator-(const basic_vec3<T>& v, S s) noexcept
+constexpr basic_vec3<T> operator-(const basic_vec3<T>& v, S s) noexcept
 {
     return basic_vec3<T>(v.x - s, v.y - s, v.z - s);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator-(S s, const basic_vec3<T>& v) noexcept
+constexpr basic_vec3<T> operator-(S s, const basic_vec3<T>& v) noexcept
 {
     return basic_vec3<T>(v.x - s, v.y - s, v.z - s);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator*(const basic_vec3<T>& v, S s) noexcept
+constexpr basic_vec3<T> operator*(const basic_vec3<T>& v, S s) noexcept
 {
     return basic_vec3<T>(v.x * s, v.y * s, v.z * s);
 }
 
 template <typename T>
-inline basic_vec3<T> operator*(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
+constexpr basic_vec3<T> operator*(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
 {
     return basic_vec3<T>(a.x * b.x, a.y * b.y, a.z * b.z);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator*(S s, const basic_vec3<T>& v) noexcept
+constexpr basic_vec3<T> operator*(S s, const basic_vec3<T>& v) noexcept
 {
     return basic_vec3<T>(s * v.x, s * v.y, s * v.z);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator/(const basic_vec3<T>& v, S s) noexcept
+constexpr basic_vec3<T> operator/(const basic_vec3<T>& v, S s) noexcept
 {
     return basic_vec3<T>(v.x / s, v.y / s, v.z / s);
 }
 
 template <typename T>
-inline basic_vec3<T> operator/(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
+constexpr basic_vec3<T> operator/(const basic_vec3<T>& a, const basic_vec3<T>& b) noexcept
 {
     return basic_vec3<T>(a.x / b.x, a.y / b.y, a.z / b.z);
 }
 
 template <typename T, typename S>
-inline basic_vec3<T> operator/(S s, const basic_vec3<T>& v) noexcept
+constexpr basic_vec3<T> operator/(S s, const basic_vec3<T>& v) noexcept
 {
     return basic_vec3<T>(s / v.x, s / v.y, s / v.z);
 }
@@ -13,21 +13,21 @@ public:
     using value_type = T;
 
 public:
-                    basic_vec4() = default;
-                    basic_vec4(T x) noexcept;
-                    basic_vec4(T x, T y, T z, T w) noexcept;
+                              basic_vec4() = default;
+    constexpr                 basic_vec4(T x) noexcept;
+    constexpr                 basic_vec4(T x, T y, T z, T w) noexcept;
 
-    basic_vec4&     operator+=(const basic_vec4& val) noexcept;
-    basic_vec4&     operator-=(const basic_vec4& val) noexcept;
-    basic_vec4&     operator*=(const basic_vec4& val) noexcept;
+    constexpr basic_vec4&     operator+=(const basic_vec4& val) noexcept;
+    constexpr basic_vec4&     operator-=(const basic_vec4& val) noexcept;
+    constexpr basic_vec4&     operator*=(const basic_vec4& val) noexcept;
     template <typename S>
-    basic_vec4&     operator*=(S val) noexcept;
-    basic_vec4&     operator/=(const basic_vec4& val) noexcept;
+    constexpr basic_vec4&     operator*=(S val) noexcept;
+    constexpr basic_vec4&     operator/=(const basic_vec4& val) noexcept;
     template <typename S>
-    basic_vec4&     operator/=(S val) noexcept;
+    constexpr basic_vec4&     operator/=(S val) noexcept;
 
-    const basic_vec3<T>&  vec3() const noexcept;
-    basic_vec3<T>&  vec3() noexcept;
+    const basic_vec3<T>&          vec3() const noexcept;
+    basic_vec3<T>&                vec3() noexcept;
 
 public:
     union {
@@ -51,7 +51,7 @@ public:
 
 /* basic_vec4::basic_vec4 */
 template <typename T>
-inline basic_vec4<T>::basic_vec4(T x) noexcept
+constexpr basic_vec4<T>::basic_vec4(T x) noexcept
     : x(x)
     , y(x)
     , z(x)
@@ -61,7 +61,7 @@ inline basic_vec4<T>::basic_vec4(T x) noexcept
 
 /* basic_vec4::basic_vec4 */
 template <typename T>
-inline basic_vec4<T>::basic_vec4(T x, T y, T z, T w) noexcept
+constexpr basic_vec4<T>::basic_vec4(T x, T y, T z, T w) noexcept
     : x(x)
     , y(y)
     , z(z)
@@ -71,7 +71,7 @@ inline basic_vec4<T>::basic_vec4(T x, T y, T z, T w) noexcept
 
 /* basic_vec4::operator+= */
 template <typename T>
-inline basic_vec4<T>& basic_vec4<T>::operator+=(const basic_vec4<T>& val) noexcept
+constexpr basic_vec4<T>& basic_vec4<T>::operator+=(const basic_vec4<T>& val) noexcept
 {
     x += val.x;
     y += val.y;
@@ -82,7 +82,7 @@ inline basic_vec4<T>& basic_vec4<T>::operator+=(const basic_vec4<T>& val) noexce
 
 /* basic_vec4::operator-= */
 template <typename T>
-inline basic_vec4<T>& basic_vec4<T>::operator-=(const basic_vec4<T>& val) noexcept
+constexpr basic_vec4<T>& basic_vec4<T>::operator-=(const basic_vec4<T>& val) noexcept
 {
     x -= val.x;
     y -= val.y;
@@ -93,7 +93,7 @@ inline basic_vec4<T>& basic_vec4<T>::operator-=(const basic_vec4<T>& val) noexce
 
 /* basic_vec4::operator*= */
 template <typename T>
-inline basic_vec4<T>& basic_vec4<T>::operator*=(const basic_vec4<T>& val) noexcept
+constexpr basic_vec4<T>& basic_vec4<T>::operator*=(const basic_vec4<T>& val) noexcept
 {
     x *= val.x;
     y *= val.y;
@@ -105,7 +105,7 @@ inline basic_vec4<T>& basic_vec4<T>::operator*=(const basic_vec4<T>& val) noexce
 /* basic_vec4::operator*= */
 template <typename T>
 template <typename S>
-inline basic_vec4<T>& basic_vec4<T>::operator*=(S val) noexcept
+constexpr basic_vec4<T>& basic_vec4<T>::operator*=(S val) noexcept
 {
     x *= val;
     y *= val;
@@ -116,7 +116,7 @@ inline basic_vec4<T>& basic_vec4<T>::operator*=(S val) noexcept
 
 /* basic_vec4::operator/= */
 template <typename T>
-inline basic_vec4<T>& basic_vec4<T>::operator/=(const basic_vec4<T>& val) noexcept
+constexpr basic_vec4<T>& basic_vec4<T>::operator/=(const basic_vec4<T>& val) noexcept
 {
     x /= val.x;
     y /= val.y;
@@ -128,7 +128,7 @@ inline basic_vec4<T>& basic_vec4<T>::operator/=(const basic_vec4<T>& val) noexce
 /* basic_vec4::operator/= */
 template <typename T>
 template <typename S>
-inline basic_vec4<T>& basic_vec4<T>::operator/=(S val) noexcept
+constexpr basic_vec4<T>& basic_vec4<T>::operator/=(S val) noexcept
 {
     x /= val;
     y /= val;
@@ -155,56 +155,56 @@ inline basic_vec3<T>& basic_vec4<T>::vec3() noexcept
 
 /* operator+ */
 template <typename T>
-inline basic_vec4<T> operator+(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
+constexpr basic_vec4<T> operator+(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
 {
     return basic_vec4<T>(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
 }
 
 /* operator- */
 template <typename T>
-inline basic_vec4<T> operator-(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
+constexpr basic_vec4<T> operator-(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
 {
     return basic_vec4<T>(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
 }
 
 /* operator* */
 template <typename T>
-inline basic_vec4<T> operator*(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
+constexpr basic_vec4<T> operator*(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
 {
     return basic_vec4<T>(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w);
 }
 
 /* operator* */
 template <typename T, typename S>
-inline basic_vec4<T> operator*(const basic_vec4<T>& v, S s) noexcept
+constexpr basic_vec4<T> operator*(const basic_vec4<T>& v, S s) noexcept
 {
     return basic_vec4<T>(v.x * s, v.y * s, v.z * s, v.w * s);
 }
 
 /* operator* */
 template <typename T, typename S>
-inline basic_vec4<T> operator*(S s, const basic_vec4<T>& v) noexcept
+constexpr basic_vec4<T> operator*(S s, const basic_vec4<T>& v) noexcept
 {
     return basic_vec4<T>(v.x * s, v.y * s, v.z * s, v.w * s);
 }
 
 /* operator/ */
 template <typename T>
-inline basic_vec4<T> operator/(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
+constexpr basic_vec4<T> operator/(const basic_vec4<T>& a, const basic_vec4<T>& b) noexcept
 {
     return basic_vec4<T>(a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w);
 }
 
 /* operator/ */
 template <typename T, typename S>
-inline basic_vec4<T> operator/(const basic_vec4<T>& v, S s) noexcept
+constexpr basic_vec4<T> operator/(const basic_vec4<T>& v, S s) noexcept
 {
     return basic_vec4<T>(v.x / s, v.y / s, v.z / s, v.w / s);
 }
 
 /* operator/ */
 template <typename T, typename S>
-inline basic_vec4<T> operator/(S s, const basic_vec4<T>& v) noexcept
+constexpr basic_vec4<T> operator/(S s, const basic_vec4<T>& v) noexcept
 {
     return basic_vec4<T>(s / v.x, s / v.y, s / v.z, s / v.w);
 }
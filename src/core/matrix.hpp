@@ -1,5 +1,8 @@
 #pragma once
 
+#include <functional>
+#include <cstdlib>
+
 #include <core/shared_ptr.hpp>
 #include <core/types.hpp>
 
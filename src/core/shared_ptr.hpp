@@ -11,6 +11,9 @@ class shared_ptr : public std::shared_ptr<T>
 public:
     /* inherit all constructors */
     using std::shared_ptr<T>::shared_ptr;
+    /* the copy and move constructors are not inherited, accept std::make_shared() results */
+    shared_ptr(const std::shared_ptr<T>& ptr) noexcept : std::shared_ptr<T>(ptr) {}
+    shared_ptr(std::shared_ptr<T>&& ptr) noexcept : std::shared_ptr<T>(std::move(ptr)) {}
 }; /* class shared_ptr */
 
 } /* namespace green::core */
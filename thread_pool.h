@@ -26,27 +26,128 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <future>
 #include <functional>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <iostream>
 
+// 1 - the pools are created with the lock free queue (thread_pool_queue::lock_free) by default
+#ifndef GREEN_THREAD_POOL_LOCK_FREE
+#define GREEN_THREAD_POOL_LOCK_FREE 1
+#endif
+
 namespace green::core
 {
+    enum class thread_pool_queue
+    {
+        locked,     // std::queue of std::function under a mutex, a condition variable for the idle workers
+        lock_free   // bounded MPMC ring of pool_task, the idle workers spin then park on an atomic
+    };
+
+    // move only callable, stored in place when it fits in inline_size bytes and on the heap otherwise
+    class pool_task
+    {
+    public:
+        static constexpr size_t inline_size = 64;
+
+        pool_task() noexcept = default;
+        template<class F>
+        explicit pool_task(F&& f);
+        pool_task(pool_task&& other) noexcept;
+        pool_task& operator=(pool_task&& other) noexcept;
+        pool_task(const pool_task&) = delete;
+        pool_task& operator=(const pool_task&) = delete;
+        ~pool_task();
+
+        void operator()();
+        explicit operator bool() const noexcept;
+
+    private:
+        enum class operation
+        {
+            relocate,   // move constructs the callable of src into dst and destroys the one of src
+            destroy
+        };
+        using invoke_function = void (*)(void*);
+        using manage_function = void (*)(operation, void*, void*);
+
+        template<class F>
+        static constexpr bool stored_inline = sizeof(F) <= inline_size && alignof(F) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<F>;
+
+        void reset() noexcept;
+
+    private:
+        alignas(std::max_align_t) unsigned char storage[inline_size];
+        invoke_function invoke = nullptr;
+        manage_function manage = nullptr;
+    };
+
+    // bounded multi producer multi consumer queue of pool_task (D. Vyukov): a producer or a consumer
+    // claims a cell with one compare and swap of the tail or the head, the sequence of the cell tells
+    // whether it is full or empty for that turn, no lock is taken
+    class pool_task_ring
+    {
+    public:
+        // capacity: a power of 2
+        explicit pool_task_ring(size_t capacity);
+
+        // false when full, task is left untouched
+        bool try_push(pool_task& task);
+        // false when empty
+        bool try_pop(pool_task& task);
+
+    private:
+        struct alignas(64) cell
+        {
+            std::atomic<size_t> sequence;
+            pool_task task;
+        };
+
+        std::unique_ptr<cell[]> cells;
+        size_t mask;
+        alignas(64) std::atomic<size_t> tail;
+        alignas(64) std::atomic<size_t> head;
+    };
+
     class thread_pool
     {
     public:
-        thread_pool(size_t);
+        static constexpr size_t ring_capacity = 4096;
+        // pop attempts of an idle lock_free worker before it parks
+        static constexpr int spin_count = 2048;
+
+        thread_pool(size_t, thread_pool_queue queue = GREEN_THREAD_POOL_LOCK_FREE ? thread_pool_queue::lock_free : thread_pool_queue::locked);
 
         template<class F, class... Args>
         auto enqueue(F&& f, Args&&... args)
             -> std::future<typename std::invoke_result<F, Args...>::type>;
+        // enqueue() without the future, the lock_free queue allocates nothing for a small f
+        template<class F>
+        void post(F&& f);
+        // runs one queued task on the calling thread, false when there is none. A thread waiting for
+        // tasks of the pool helps with it instead of blocking (task_group::wait())
+        bool run_one();
+        size_t get_thread_count() const noexcept;
+        thread_pool_queue get_queue() const noexcept;
         ~thread_pool();
 
+    private:
+        void run_locked();
+        void run_lock_free();
+        void push(pool_task task);
+
     private:
         // need to keep track of threads so we can join them
         std::vector<std::thread> workers;
+        thread_pool_queue queue;
         // the task queue
         std::queue<std::function<void()>> tasks;
 
@@ -54,28 +155,243 @@ namespace green::core
         std::mutex queue_mutex;
         std::condition_variable condition;
         bool stop;
+
+        // lock_free: the workers parked on epoch are counted by sleeping, a producer seeing them bumps it
+        pool_task_ring ring;
+        std::atomic<uint32_t> epoch{0};
+        std::atomic<int32_t> sleeping{0};
+        std::atomic<bool> stopping{false};
     };
 
+    // pool_task::pool_task
+    template<class F>
+    inline pool_task::pool_task(F&& f)
+    {
+        using T = std::decay_t<F>;
+        if constexpr (stored_inline<T>) {
+            ::new (static_cast<void*>(storage)) T(std::forward<F>(f));
+            invoke = [](void* p) {
+                (*static_cast<T*>(p))();
+            };
+            manage = [](operation op, void* dst, void* src) {
+                if (op == operation::relocate) {
+                    ::new (dst) T(std::move(*static_cast<T*>(src)));
+                }
+                static_cast<T*>(src)->~T();
+            };
+        } else {
+            *reinterpret_cast<T**>(storage) = new T(std::forward<F>(f));
+            invoke = [](void* p) {
+                (**static_cast<T**>(p))();
+            };
+            manage = [](operation op, void* dst, void* src) {
+                if (op == operation::relocate) {
+                    *static_cast<T**>(dst) = *static_cast<T**>(src);
+                } else {
+                    delete *static_cast<T**>(src);
+                }
+            };
+        }
+    }
+
+    // pool_task::pool_task
+    inline pool_task::pool_task(pool_task&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    // pool_task::operator=
+    inline pool_task& pool_task::operator=(pool_task&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            if (other.manage) {
+                other.manage(operation::relocate, storage, other.storage);
+                invoke = other.invoke;
+                manage = other.manage;
+                other.invoke = nullptr;
+                other.manage = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    // pool_task::~pool_task
+    inline pool_task::~pool_task()
+    {
+        reset();
+    }
+
+    // pool_task::reset
+    inline void pool_task::reset() noexcept
+    {
+        if (manage) {
+            manage(operation::destroy, nullptr, storage);
+            invoke = nullptr;
+            manage = nullptr;
+        }
+    }
+
+    // pool_task::operator()
+    inline void pool_task::operator()()
+    {
+        invoke(storage);
+    }
+
+    // pool_task::operator bool
+    inline pool_task::operator bool() const noexcept
+    {
+        return invoke != nullptr;
+    }
+
+    // pool_task_ring::pool_task_ring
+    inline pool_task_ring::pool_task_ring(size_t capacity)
+        : cells(new cell[capacity])
+        , mask(capacity - 1)
+        , tail(0)
+        , head(0)
+    {
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // pool_task_ring::try_push
+    inline bool pool_task_ring::try_push(pool_task& task)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;) {
+            c = &cells[pos & mask];
+            size_t sequence = c->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        c->task = std::move(task);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // pool_task_ring::try_pop
+    inline bool pool_task_ring::try_pop(pool_task& task)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;) {
+            c = &cells[pos & mask];
+            size_t sequence = c->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (difference == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+        task = std::move(c->task);
+        c->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
     // the constructor just launches some amount of workers
-    inline thread_pool::thread_pool(size_t threads)
-        : stop(false)
+    inline thread_pool::thread_pool(size_t threads, thread_pool_queue queue)
+        : queue(queue)
+        , stop(false)
+        , ring(queue == thread_pool_queue::lock_free ? ring_capacity : 1)
     {
         for (size_t i = 0; i < threads; ++i) {
-            workers.emplace_back([this] {
-                for (;;) {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
-                        if (this->stop && this->tasks.empty()) {
-                            return;
-                        }
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-                    task();
+            if (queue == thread_pool_queue::lock_free) {
+                workers.emplace_back([this] { run_lock_free(); });
+            } else {
+                workers.emplace_back([this] { run_locked(); });
+            }
+        }
+    }
+
+    // the worker loop of the locked queue
+    inline void thread_pool::run_locked()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(this->queue_mutex);
+                this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
+                if (this->stop && this->tasks.empty()) {
+                    return;
                 }
-            });
+                task = std::move(this->tasks.front());
+                this->tasks.pop();
+            }
+            task();
+        }
+    }
+
+    // the worker loop of the lock free queue: pops, spins on an empty ring for a while, then parks
+    inline void thread_pool::run_lock_free()
+    {
+        for (;;) {
+            pool_task task;
+            bool found = ring.try_pop(task);
+            for (int i = 0; i < spin_count && !found; ++i) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#else
+                std::this_thread::yield();
+#endif
+                found = ring.try_pop(task);
+            }
+            if (found) {
+                task();
+                continue;
+            }
+            // the producer pushes then reads sleeping, this worker counts itself then pops again: one of
+            // the two sees the other, a task is never left with every worker parked
+            uint32_t seen = epoch.load(std::memory_order_acquire);
+            sleeping.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ring.try_pop(task)) {
+                sleeping.fetch_sub(1, std::memory_order_relaxed);
+                task();
+                continue;
+            }
+            if (stopping.load(std::memory_order_acquire)) {
+                sleeping.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+            epoch.wait(seen, std::memory_order_acquire);
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // adds a task to the ring, a full ring is drained by the producer, so workers enqueueing tasks never wait for each other
+    inline void thread_pool::push(pool_task task)
+    {
+        if (stopping.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("enqueue on stopped thread_pool");
+        }
+        while (!ring.try_push(task)) {
+            pool_task other;
+            if (ring.try_pop(other)) {
+                other();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) > 0) {
+            epoch.fetch_add(1, std::memory_order_release);
+            epoch.notify_one();
         }
     }
 
@@ -87,11 +403,51 @@ namespace green::core
             stop = true;
         }
         condition.notify_all();
+        stopping.store(true, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        epoch.fetch_add(1, std::memory_order_release);
+        epoch.notify_all();
         for (std::thread& worker : workers) {
             worker.join();
         }
     }
 
+    // run a queued task on the calling thread
+    inline bool thread_pool::run_one()
+    {
+        if (queue == thread_pool_queue::lock_free) {
+            pool_task task;
+            if (!ring.try_pop(task)) {
+                return false;
+            }
+            task();
+            return true;
+        }
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (tasks.empty()) {
+                return false;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+        return true;
+    }
+
+    // number of workers
+    inline size_t thread_pool::get_thread_count() const noexcept
+    {
+        return workers.size();
+    }
+
+    // queue selected at the construction
+    inline thread_pool_queue thread_pool::get_queue() const noexcept
+    {
+        return queue;
+    }
+
     // add new work item to the pool
     template<class F, class... Args>
     auto thread_pool::enqueue(F&& f, Args&&... args)
@@ -99,6 +455,25 @@ namespace green::core
     {
         using return_type = typename std::invoke_result<F, Args...>::type;
 
+        if (queue == thread_pool_queue::lock_free) {
+            // the promise is the only allocation, the callable is stored in the cell of the ring
+            std::promise<return_type> promise;
+            std::future<return_type> res = promise.get_future();
+            push(pool_task([promise = std::move(promise), f = std::forward<F>(f), ... args = std::forward<Args>(args)]() mutable {
+                try {
+                    if constexpr (std::is_void_v<return_type>) {
+                        std::invoke(f, args...);
+                        promise.set_value();
+                    } else {
+                        promise.set_value(std::invoke(f, args...));
+                    }
+                } catch (...) {
+                    promise.set_exception(std::current_exception());
+                }
+            }));
+            return res;
+        }
+
         auto task = std::make_shared<std::packaged_task<return_type()>>(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
@@ -117,4 +492,27 @@ namespace green::core
         return res;
     }
 
+    // add new work item to the pool without a future
+    template<class F>
+    void thread_pool::post(F&& f)
+    {
+        if (queue == thread_pool_queue::lock_free) {
+            push(pool_task(std::forward<F>(f)));
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (stop) {
+                throw std::runtime_error("enqueue on stopped thread_pool");
+            }
+            // std::function copies its callable
+            if constexpr (std::is_copy_constructible_v<std::decay_t<F>>) {
+                tasks.emplace(std::forward<F>(f));
+            } else {
+                tasks.emplace([task = std::make_shared<std::decay_t<F>>(std::forward<F>(f))]() { (*task)(); });
+            }
+        }
+        condition.notify_one();
+    }
+
 } // namespace green::core
@@ -0,0 +1,80 @@
+#include "thread_pool_benchmark.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <core/timer.hpp>
+
+#include "thread_pool.h"
+
+namespace green::core
+{
+
+/* a few hundred cycles of work, the size of the cheapest tasks of the renderer */
+static uint32_t benchmark_task_work(uint32_t seed)
+{
+    for (int i = 0; i < 64; i++) {
+        seed = seed * 1664525u + 1013904223u;
+    }
+    return seed;
+}
+
+/* tasks per second of one pool, the tasks are enqueued by the calling thread */
+static void benchmark_pool(size_t threads, thread_pool_queue queue, bool futures, int32_t task_count)
+{
+    std::atomic<uint32_t> sink{0};
+    std::atomic<int32_t> done{0};
+    double msec;
+    {
+        thread_pool pool(threads, queue);
+        timer t;
+        if (futures) {
+            std::vector<std::future<void>> results;
+            results.reserve(task_count);
+            for (int32_t i = 0; i < task_count; i++) {
+                results.push_back(pool.enqueue([&sink, i] {
+                    sink.fetch_add(benchmark_task_work(i), std::memory_order_relaxed);
+                }));
+            }
+            for (auto& r: results) {
+                r.get();
+            }
+        } else {
+            for (int32_t i = 0; i < task_count; i++) {
+                pool.post([&sink, &done, i] {
+                    sink.fetch_add(benchmark_task_work(i), std::memory_order_relaxed);
+                    done.fetch_add(1, std::memory_order_release);
+                });
+            }
+            while (done.load(std::memory_order_acquire) < task_count) {
+                std::this_thread::yield();
+            }
+        }
+        msec = t.get_elapsed_msec();
+    }
+    std::cout << (queue == thread_pool_queue::lock_free ? "lock free" : "locked") << (futures ? " enqueue" : " post") << ", " << threads
+        << " threads: " << msec << " ms, " << task_count / (msec * 1000.0) << " Mtasks/s" << std::endl;
+}
+
+/* thread_pool_benchmark */
+void thread_pool_benchmark(int32_t task_count)
+{
+    std::vector<size_t> thread_counts = {1, 2, 4, 8};
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    if (std::find(thread_counts.begin(), thread_counts.end(), hardware) == thread_counts.end()) {
+        thread_counts.push_back(hardware);
+    }
+    std::cout << "thread_pool_benchmark: " << task_count << " tasks, " << hardware << " hardware threads" << std::endl;
+    for (size_t threads: thread_counts) {
+        for (thread_pool_queue queue: {thread_pool_queue::locked, thread_pool_queue::lock_free}) {
+            benchmark_pool(threads, queue, true, task_count);
+            benchmark_pool(threads, queue, false, task_count);
+        }
+    }
+}
+
+} /* namespace green::core */
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+namespace green::core
+{
+
+/* runs task_count small tasks on pools of 1, 2, 4, 8 and std::thread::hardware_concurrency() threads
+ * with each thread_pool_queue, through enqueue() and post(), and prints the tasks per second of each */
+void thread_pool_benchmark(int32_t task_count);
+
+} /* namespace green::core */
@@ -0,0 +1,144 @@
+#include "tile_scheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+#include "parallel.hpp"
+
+namespace green::core
+{
+
+/* tiles left to one worker, the owner takes the front and the thieves the back */
+struct alignas(64) tile_deque
+{
+    std::mutex              mutex;
+    std::deque<int32_t>     tiles;
+    std::atomic<int32_t>    size{0};    /* of tiles, read by the thieves without the lock */
+};
+
+/* x and y interleaved, x in the even bits */
+static uint64_t tile_morton_code(uint32_t x, uint32_t y)
+{
+    auto spread = [](uint64_t v) {
+        v &= 0xffffffffull;
+        v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+        v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+        v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+/* render_tiles */
+std::vector<render_tile> render_tiles(int32_t width, int32_t height, int32_t tile_size)
+{
+    const int32_t columns = (width + tile_size - 1) / tile_size;
+    const int32_t rows = (height + tile_size - 1) / tile_size;
+    std::vector<std::pair<uint64_t, render_tile>> order;
+    order.reserve(static_cast<size_t>(columns) * rows);
+    for (int32_t ty = 0; ty < rows; ty++) {
+        for (int32_t tx = 0; tx < columns; tx++) {
+            render_tile tile{tx * tile_size, ty * tile_size, std::min(width, (tx + 1) * tile_size), std::min(height, (ty + 1) * tile_size)};
+            order.emplace_back(tile_morton_code(tx, ty), tile);
+        }
+    }
+    /* the codes are unique */
+    std::sort(order.begin(), order.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    std::vector<render_tile> tiles;
+    tiles.reserve(order.size());
+    for (const auto& o: order) {
+        tiles.push_back(o.second);
+    }
+    return tiles;
+}
+
+/* tile_scheduler::tile_scheduler */
+tile_scheduler::tile_scheduler(thread_pool* pool)
+    : m_pool{pool}
+    , m_threads{pool ? static_cast<int32_t>(pool->get_thread_count()) + 1 : 1}
+{}
+
+/* tile_scheduler::run */
+void tile_scheduler::run(int32_t width, int32_t height, const std::function<void(const render_tile&)>& fn)
+{
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+    const std::vector<render_tile> tiles = render_tiles(width, height, tile_size);
+    const int32_t count = static_cast<int32_t>(tiles.size());
+    const int32_t workers = std::max(1, std::min(m_threads, count));
+
+    /* equal runs of the order */
+    std::vector<tile_deque> deques(workers);
+    for (int32_t w = 0; w < workers; w++) {
+        for (int32_t i = static_cast<int32_t>(static_cast<int64_t>(count) * w / workers); i < static_cast<int64_t>(count) * (w + 1) / workers; i++) {
+            deques[w].tiles.push_back(i);
+        }
+        deques[w].size.store(static_cast<int32_t>(deques[w].tiles.size()), std::memory_order_relaxed);
+    }
+
+    std::atomic<int32_t> steals{0};
+    std::vector<clock::time_point> finished(workers);
+    auto worker = [&](int32_t w) {
+        for (;;) {
+            int32_t tile = -1;
+            {
+                tile_deque& own = deques[w];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.tiles.empty()) {
+                    tile = own.tiles.front();
+                    own.tiles.pop_front();
+                    own.size.store(static_cast<int32_t>(own.tiles.size()), std::memory_order_relaxed);
+                }
+            }
+            while (tile == -1) {
+                /* the fullest deque, its back tile is the furthest from where its owner is */
+                int32_t victim = -1;
+                int32_t most = 0;
+                for (int32_t v = 0; v < workers; v++) {
+                    int32_t size = deques[v].size.load(std::memory_order_relaxed);
+                    if (v != w && size > most) {
+                        most = size;
+                        victim = v;
+                    }
+                }
+                if (victim == -1) {
+                    /* no tile is queued anywhere and none is ever added */
+                    finished[w] = clock::now();
+                    return;
+                }
+                tile_deque& other = deques[victim];
+                std::lock_guard<std::mutex> lock(other.mutex);
+                if (!other.tiles.empty()) {
+                    tile = other.tiles.back();
+                    other.tiles.pop_back();
+                    other.size.store(static_cast<int32_t>(other.tiles.size()), std::memory_order_relaxed);
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            fn(tiles[tile]);
+        }
+    };
+
+    /* the calling thread is worker 0 */
+    task_group group(m_pool);
+    for (int32_t w = 1; w < workers; w++) {
+        group.run([&worker, w] { worker(w); });
+    }
+    worker(0);
+    group.wait();
+
+    const clock::time_point end = clock::now();
+    m_stats.tiles = count;
+    m_stats.steals = steals.load(std::memory_order_relaxed);
+    m_stats.msec = std::chrono::duration<double, std::milli>(end - start).count();
+    m_stats.tail_msec = count > 0 ? std::chrono::duration<double, std::milli>(end - *std::min_element(finished.begin(), finished.end())).count() : 0.0;
+}
+
+} /* namespace green::core */
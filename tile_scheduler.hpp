@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace green::core
+{
+
+class thread_pool;
+
+/* pixels [x0, x1) x [y0, y1) of an image */
+struct render_tile
+{
+    int32_t         x0;
+    int32_t         y0;
+    int32_t         x1;
+    int32_t         y1;
+};
+
+/* result of the last tile_scheduler::run() */
+struct tile_scheduler_stats
+{
+    int32_t         tiles = 0;
+    int32_t         steals = 0;         /* tiles taken from the deque of another worker */
+    double          msec = 0.0;
+    double          tail_msec = 0.0;    /* from the first worker running out of tiles to the end */
+};
+
+/* runs a function over the tiles of an image on a thread_pool. The tiles are numbered along a
+ * Z-order curve, so the tiles of a run of the order are close in the image (and their rays in the
+ * scene), and every worker starts with an equal run of them in its deque. A worker takes its tiles
+ * front to back and, when its deque is empty, steals the back tile of the fullest deque: the tile the
+ * owner would reach last, far from the ones it works on. A row of costly tiles is spread over all
+ * the workers instead of holding the end of the run */
+class tile_scheduler
+{
+public:
+    static constexpr int32_t    tile_size = 32;
+
+public:
+    /* the workers are the calling thread and one task per thread of the pool, only the calling thread
+     * without a pool */
+    explicit        tile_scheduler(thread_pool* pool);
+
+    /* calls fn(tile) once for every tile of a width x height image, returns when all are done */
+    void            run(int32_t width, int32_t height, const std::function<void(const render_tile&)>& fn);
+
+    int32_t                         get_thread_count() const noexcept;
+    const tile_scheduler_stats&     get_stats() const noexcept;
+
+private:
+    thread_pool*            m_pool;
+    int32_t                 m_threads;
+    tile_scheduler_stats    m_stats;
+}; /* class tile_scheduler */
+
+/* the tiles of a width x height image in the order of tile_scheduler */
+std::vector<render_tile> render_tiles(int32_t width, int32_t height, int32_t tile_size);
+
+
+
+/* tile_scheduler::get_thread_count */
+inline int32_t tile_scheduler::get_thread_count() const noexcept
+{
+    return m_threads;
+}
+
+/* tile_scheduler::get_stats */
+inline const tile_scheduler_stats& tile_scheduler::get_stats() const noexcept
+{
+    return m_stats;
+}
+
+} /* namespace green::core */
@@ -0,0 +1,400 @@
+#include "triangle_mesh.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+#include "simd_lanes.hpp"
+
+namespace green::core
+{
+
+/* a block is 1 (AVX), 2 (SSE) or 8 kernel calls, a block with up to 4 triangles is tested by one
+ * SSE call on AVX too. The 8 lanes of a packet are tested the same way */
+using block_lanes = wide_lanes;
+using half_block_lanes = half_wide_lanes;
+
+/* the pages of page_out() are whole pages of the mapping */
+static_assert(triangle_mesh::page_blocks * sizeof(packed_triangle_block) % 4096 == 0);
+
+/* lanes_triangle_test() on O::lanes triangles of the block starting at lane against one ray.
+ * Returns the mask of the rejected lanes shifted to lane, near is written for the others */
+template <class O>
+static inline uint32_t lanes_intersection_test(const packed_triangle_block& block, int32_t lane, const ray_type& ray, float tmin, float tmax, float* near)
+{
+    typename O::type n;
+    uint32_t miss = lanes_triangle_test<O>(lanes_set1<O>(ray.origin), lanes_set1<O>(ray.dir),
+        lanes_load<O>(block.v0_x + lane, block.v0_y + lane, block.v0_z + lane), lanes_load<O>(block.e1_x + lane, block.e1_y + lane, block.e1_z + lane),
+        lanes_load<O>(block.e2_x + lane, block.e2_y + lane, block.e2_z + lane), O::set1(tmin), O::set1(tmax), n);
+    O::store(near + lane, n);
+    return miss << lane;
+}
+
+/* mask of the hit lanes of the block, near is written for these lanes */
+static inline uint32_t block_intersection_test(const packed_triangle_block& block, const ray_type& ray, float tmin, float tmax, float* near)
+{
+    uint32_t miss = 0;
+    if constexpr (block_lanes::lanes == 8) {
+        miss = block.count <= 4 ? lanes_intersection_test<half_block_lanes>(block, 0, ray, tmin, tmax, near)
+                                : lanes_intersection_test<block_lanes>(block, 0, ray, tmin, tmax, near);
+    } else {
+        for (int32_t lane = 0; lane < block.count; lane += block_lanes::lanes) {
+            miss |= lanes_intersection_test<block_lanes>(block, lane, ray, tmin, tmax, near);
+        }
+    }
+    return ~miss & ((1u << block.count) - 1u);
+}
+
+/* lanes_triangle_test() of the triangle in lane of the block against the rays of the packet in mask,
+ * tmax is the array of the lanes. Returns the mask of the hit lanes, near is written for them */
+static inline uint32_t packet_triangle_test(const packed_triangle_block& block, int32_t lane, const ray_packet& packet, uint32_t mask,
+    const float* tmax, float* near)
+{
+    using O = block_lanes;
+    lanes_vec3<O> v0 = lanes_set1<O>(fvec3(block.v0_x[lane], block.v0_y[lane], block.v0_z[lane]));
+    lanes_vec3<O> e1 = lanes_set1<O>(fvec3(block.e1_x[lane], block.e1_y[lane], block.e1_z[lane]));
+    lanes_vec3<O> e2 = lanes_set1<O>(fvec3(block.e2_x[lane], block.e2_y[lane], block.e2_z[lane]));
+    uint32_t miss = 0;
+    for (int32_t i = 0; i < ray_packet::width; i += O::lanes) {
+        if ((mask >> i) & lane_mask<O>) {
+            typename O::type n;
+            miss |= lanes_triangle_test<O>(lanes_load<O>(packet.origin_x + i, packet.origin_y + i, packet.origin_z + i),
+                lanes_load<O>(packet.dir_x + i, packet.dir_y + i, packet.dir_z + i), v0, e1, e2, O::load(packet.tmin + i), O::load(tmax + i), n) << i;
+            O::store(near + i, n);
+        }
+    }
+    return ~miss & mask;
+}
+
+/* triangle_mesh::triangle_mesh */
+triangle_mesh::triangle_mesh(std::vector<fvec3> vertices, std::vector<int32_t> indices, bvh_build_mode mode, thread_pool* pool)
+{
+    build(std::move(vertices), std::move(indices), mode, pool);
+}
+
+/* triangle_mesh::build */
+void triangle_mesh::build(std::vector<fvec3> vertices, std::vector<int32_t> indices, bvh_build_mode mode, thread_pool* pool)
+{
+    m_vertices = std::move(vertices);
+    m_indices = std::move(indices);
+    m_pager = nullptr;
+    m_node_page.clear();
+    const int32_t n = static_cast<int32_t>(m_indices.size() / 3);
+    std::vector<bounds_type> bounds(n);
+    for (int32_t i = 0; i < n; i++) {
+        bounds[i].extend(m_vertices[m_indices[3 * i]]);
+        bounds[i].extend(m_vertices[m_indices[3 * i + 1]]);
+        bounds[i].extend(m_vertices[m_indices[3 * i + 2]]);
+    }
+    /* the triangles with NaN coordinates are unbounded, they are never hit */
+    m_accel.build(bounds, mode, pool);
+
+    const auto& nodes = m_accel.get_nodes();
+    const auto& items = m_accel.get_indices();
+    m_bounds = nodes.empty() ? bounds_type() : nodes[0].bounds;
+    m_blocks.clear();
+    m_leaf_block.assign(nodes.size(), -1);
+    m_slot.assign(n, -1);
+    for (size_t node = 0; node < nodes.size(); node++) {
+        if (nodes[node].count == 0) {
+            continue;
+        }
+        /* the leaves over width triangles (at max_depth) take the next blocks */
+        m_leaf_block[node] = static_cast<int32_t>(m_blocks.size());
+        for (int32_t i = 0; i < nodes[node].count; i++) {
+            int32_t lane = i % width;
+            if (lane == 0) {
+                m_blocks.emplace_back();
+            }
+            packed_triangle_block& block = m_blocks.back();
+            int32_t id = items[nodes[node].left_first + i];
+            const fvec3& v0 = m_vertices[m_indices[3 * id]];
+            fvec3 e1 = m_vertices[m_indices[3 * id + 1]] - v0;
+            fvec3 e2 = m_vertices[m_indices[3 * id + 2]] - v0;
+            block.v0_x[lane] = v0.x;
+            block.v0_y[lane] = v0.y;
+            block.v0_z[lane] = v0.z;
+            block.e1_x[lane] = e1.x;
+            block.e1_y[lane] = e1.y;
+            block.e1_z[lane] = e1.z;
+            block.e2_x[lane] = e2.x;
+            block.e2_y[lane] = e2.y;
+            block.e2_z[lane] = e2.z;
+            block.id[lane] = id;
+            block.count = lane + 1;
+            m_slot[id] = static_cast<int32_t>(m_blocks.size() - 1) * width + lane;
+        }
+    }
+}
+
+/* triangle_mesh::leaf_closest_hit */
+void triangle_mesh::leaf_closest_hit(int32_t leaf, const ray_type& ray, float tmin, float& near, int32_t& id) const
+{
+    alignas(32) float dist[width];
+    int32_t index = m_leaf_block[leaf];
+    for (int32_t count = m_accel.get_nodes()[leaf].count; count > 0; count -= width, index++) {
+        const packed_triangle_block& b = block(index);
+        for (uint32_t mask = block_intersection_test(b, ray, tmin, near, dist); mask; mask &= mask - 1) {
+            int32_t lane = std::countr_zero(mask);
+            if (dist[lane] < near || (dist[lane] == near && (id == -1 || b.id[lane] < id))) {
+                near = dist[lane];
+                id = b.id[lane];
+            }
+        }
+    }
+}
+
+/* triangle_mesh::prefetch_subtree */
+void triangle_mesh::prefetch_subtree(int32_t node) const
+{
+    m_pager->prefetch(m_node_page[node]);
+}
+
+/* triangle_mesh::closest_hit */
+int32_t triangle_mesh::closest_hit(const ray_type& ray, float tmin, float tmax, float& near) const
+{
+    int32_t ret = -1;
+    near = tmax;
+    auto test = [&](int32_t leaf) {
+        leaf_closest_hit(leaf, ray, tmin, near, ret);
+    };
+    if (m_pager) {
+        m_accel.traverse_leaves(ray, tmin, near, test, [this](int32_t node) {
+            prefetch_subtree(node);
+        });
+    } else {
+        m_accel.traverse_leaves(ray, tmin, near, test);
+    }
+    return ret;
+}
+
+/* triangle_mesh::occluded */
+bool triangle_mesh::occluded(const ray_type& ray, float tmin, float tmax) const
+{
+    alignas(32) float dist[width];
+    bool ret = false;
+    float near = tmax;
+    auto test = [&](int32_t leaf) {
+        int32_t index = m_leaf_block[leaf];
+        for (int32_t count = m_accel.get_nodes()[leaf].count; count > 0; count -= width, index++) {
+            if (block_intersection_test(block(index), ray, tmin, tmax, dist)) {
+                ret = true;
+                near = -std::numeric_limits<float>::infinity();
+                return;
+            }
+        }
+    };
+    if (m_pager) {
+        m_accel.traverse_leaves(ray, tmin, near, test, [this](int32_t node) {
+            prefetch_subtree(node);
+        });
+    } else {
+        m_accel.traverse_leaves(ray, tmin, near, test);
+    }
+    return ret;
+}
+
+/* triangle_mesh::closest_hit_packet */
+uint32_t triangle_mesh::closest_hit_packet(const ray_packet& packet, uint32_t mask, const float* tmax, float* near, int32_t* triangles) const
+{
+    alignas(32) float closest[ray_packet::width];
+    alignas(32) float dist[ray_packet::width];
+    int32_t ids[ray_packet::width];
+    for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+        ids[lane] = -1;
+        closest[lane] = tmax[lane];
+    }
+
+    /* the tie rule of closest_hit() per hit lane */
+    auto test = [&](int32_t i, uint32_t lanes) {
+        int32_t slot = m_slot[i];
+        const packed_triangle_block& b = block(slot / width);
+        for (uint32_t hit = packet_triangle_test(b, slot % width, packet, lanes, closest, dist); hit; hit &= hit - 1) {
+            int32_t lane = std::countr_zero(hit);
+            if (dist[lane] < closest[lane] || (dist[lane] == closest[lane] && (ids[lane] == -1 || i < ids[lane]))) {
+                closest[lane] = dist[lane];
+                ids[lane] = i;
+            }
+        }
+    };
+    if (m_pager) {
+        m_accel.traverse_packet(packet, mask, closest, test, [this](int32_t node) {
+            prefetch_subtree(node);
+        });
+    } else {
+        m_accel.traverse_packet(packet, mask, closest, test);
+    }
+
+    uint32_t ret = 0;
+    for (uint32_t m = mask; m; m &= m - 1) {
+        int32_t lane = std::countr_zero(m);
+        if (ids[lane] != -1) {
+            near[lane] = closest[lane];
+            triangles[lane] = ids[lane];
+            ret |= 1u << lane;
+        }
+    }
+    return ret;
+}
+
+/* triangle_mesh::occluded_packet */
+uint32_t triangle_mesh::occluded_packet(const ray_packet& packet, uint32_t mask) const
+{
+    /* an occluded lane leaves the traversal */
+    alignas(32) float near[ray_packet::width];
+    alignas(32) float dist[ray_packet::width];
+    for (int32_t lane = 0; lane < ray_packet::width; lane++) {
+        near[lane] = packet.tmax[lane];
+    }
+    uint32_t ret = 0;
+    auto test = [&](int32_t i, uint32_t lanes) {
+        int32_t slot = m_slot[i];
+        for (uint32_t hit = packet_triangle_test(block(slot / width), slot % width, packet, lanes, packet.tmax, dist); hit; hit &= hit - 1) {
+            int32_t lane = std::countr_zero(hit);
+            ret |= 1u << lane;
+            near[lane] = -std::numeric_limits<float>::infinity();
+        }
+    };
+    if (m_pager) {
+        m_accel.traverse_packet(packet, mask, near, test, [this](int32_t node) {
+            prefetch_subtree(node);
+        });
+    } else {
+        m_accel.traverse_packet(packet, mask, near, test);
+    }
+    return ret;
+}
+
+/* triangle_mesh::closest_hit_batch */
+void triangle_mesh::closest_hit_batch(const ray_type* rays, int32_t count, float tmin, const float* tmax, int32_t* ids, float* near) const
+{
+    if (!m_pager) {
+        for (int32_t i = 0; i < count; i++) {
+            ids[i] = closest_hit(rays[i], tmin, tmax[i], near[i]);
+        }
+        return;
+    }
+
+    /* a leaf over width triangles may end on the next page, it waits for both */
+    struct deferred_leaf
+    {
+        int32_t     page;
+        int32_t     ray;
+        int32_t     leaf;
+    };
+    std::vector<deferred_leaf> queue;
+    const auto& nodes = m_accel.get_nodes();
+    auto last_page = [&](int32_t leaf) {
+        return (m_leaf_block[leaf] + (nodes[leaf].count - 1) / width) / page_blocks;
+    };
+    for (int32_t i = 0; i < count; i++) {
+        ids[i] = -1;
+        near[i] = tmax[i];
+        m_accel.traverse_leaves(rays[i], tmin, near[i], [&](int32_t leaf) {
+            int32_t first = m_leaf_block[leaf] / page_blocks;
+            int32_t last = last_page(leaf);
+            if (m_pager->is_resident(first) && m_pager->is_resident(last)) {
+                leaf_closest_hit(leaf, rays[i], tmin, near[i], ids[i]);
+                return;
+            }
+            m_pager->prefetch(first);
+            m_pager->prefetch(last);
+            queue.push_back({first, i, leaf});
+        });
+    }
+    if (queue.empty()) {
+        return;
+    }
+    m_pager->add_deferred(static_cast<int64_t>(queue.size()));
+
+    /* the pages in file order, the rays of a page in batch order */
+    std::sort(queue.begin(), queue.end(), [](const deferred_leaf& a, const deferred_leaf& b) {
+        return a.page < b.page || (a.page == b.page && (a.ray < b.ray || (a.ray == b.ray && a.leaf < b.leaf)));
+    });
+    int32_t page = -1;
+    for (const deferred_leaf& d: queue) {
+        if (d.page != page) {
+            page = d.page;
+            m_pager->make_resident(page);
+        }
+        /* the closest hit may have moved in front of the leaf since it was queued */
+        float entry;
+        const ray_type& ray = rays[d.ray];
+        if (!nodes[d.leaf].bounds.intersection_test(ray.origin, ray.inv_dir, tmin, near[d.ray], entry)) {
+            continue;
+        }
+        int32_t last = last_page(d.leaf);
+        if (last != page) {
+            m_pager->make_resident(last);
+        }
+        leaf_closest_hit(d.leaf, ray, tmin, near[d.ray], ids[d.ray]);
+    }
+}
+
+/* triangle_mesh::page_out */
+bool triangle_mesh::page_out(const std::string& path, int32_t max_resident_pages)
+{
+    if (m_pager) {
+        return true;
+    }
+    if (m_blocks.empty()) {
+        std::cout << "triangle_mesh::page_out() error: the mesh has no triangles" << std::endl;
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent, error);
+    }
+    std::ofstream file(path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    file.write(reinterpret_cast<const char*>(m_blocks.data()), static_cast<std::streamsize>(m_blocks.size() * sizeof(packed_triangle_block)));
+    file.close();
+    if (!file) {
+        std::cout << "triangle_mesh::page_out() error: writing error " << path << std::endl;
+        return false;
+    }
+    auto pager = std::make_shared<geometry_pager>();
+    if (!pager->open(path, page_blocks * sizeof(packed_triangle_block), max_resident_pages)) {
+        return false;
+    }
+
+    /* the children follow their parent in the breadth first order, its reverse sees them first */
+    const auto& nodes = m_accel.get_nodes();
+    std::vector<int32_t> order;
+    if (!nodes.empty()) {
+        order.push_back(0);
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        if (nodes[order[i]].count == 0) {
+            order.push_back(nodes[order[i]].left_first);
+            order.push_back(nodes[order[i]].left_first + 1);
+        }
+    }
+    m_node_page.assign(nodes.size(), 0);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        const bvh_node& node = nodes[*it];
+        m_node_page[*it] = node.count > 0 ? m_leaf_block[*it] / page_blocks
+                                          : std::min(m_node_page[node.left_first], m_node_page[node.left_first + 1]);
+    }
+    m_pager = pager;
+    m_blocks = std::vector<packed_triangle_block>();
+    m_vertices = std::vector<fvec3>();
+    m_indices = std::vector<int32_t>();
+    return true;
+}
+
+/* triangle_mesh::normal */
+fvec3 triangle_mesh::normal(int32_t triangle) const
+{
+    /* the edges of the block are the ones of (v1 - v0) x (v2 - v0) */
+    int32_t slot = m_slot[triangle];
+    const packed_triangle_block& b = block(slot / width);
+    int32_t lane = slot % width;
+    return fvec3(b.e1_x[lane], b.e1_y[lane], b.e1_z[lane]).cross(fvec3(b.e2_x[lane], b.e2_y[lane], b.e2_z[lane])).normalize();
+}
+
+} /* namespace green::core */
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scene.hpp"
+#include "bvh.hpp"
+#include "geometry_pager.hpp"
+#include "ray_packet.hpp"
+
+/* pages of triangle blocks the app keeps in memory for the mesh given on the command line, the blocks
+ * are written to mesh_pages/ and read back on demand (triangle_mesh::page_out()). 0 - all in memory */
+#ifndef GREEN_MESH_RESIDENT_PAGES
+#define GREEN_MESH_RESIDENT_PAGES 0
+#endif
+
+namespace green::core
+{
+
+/* up to 8 triangles of one leaf of the mesh bvh, the fields of the intersection test are stored as
+ * structure of arrays. The edges are computed once with the expressions of the scalar test.
+ * lane: lane < count - id is the triangle index, the other lanes are never hit */
+struct alignas(32) packed_triangle_block
+{
+    float           v0_x[8];
+    float           v0_y[8];
+    float           v0_z[8];
+    float           e1_x[8];        /* v1 - v0 */
+    float           e1_y[8];
+    float           e1_z[8];
+    float           e2_x[8];        /* v2 - v0 */
+    float           e2_y[8];
+    float           e2_z[8];
+    int32_t         id[8];
+    int32_t         count;
+};
+
+/* triangles of an indexed vertex buffer, placed in a scene as one primitive (mesh_type). The bvh
+ * over the triangle bounds is built once and the triangles of each leaf are copied to blocks, so
+ * one AVX (or two SSE) kernel call tests a whole leaf against a ray. The normals are taken from the
+ * edges of the blocks. The triangles are two sided, a ray in the plane of a triangle misses it.
+ * After page_out() the blocks live in a file and only the bvh is kept in memory */
+class triangle_mesh
+{
+public:
+    static constexpr int32_t    width = 8;
+    /* blocks of one page of page_out(), 11 pages of 4 KiB */
+    static constexpr int32_t    page_blocks = 128;
+
+public:
+                    triangle_mesh() = default;
+    /* indices: 3 per triangle, in the range of vertices */
+                    triangle_mesh(std::vector<fvec3> vertices, std::vector<int32_t> indices, bvh_build_mode mode = bvh_build_mode::binned_sah,
+                        thread_pool* pool = nullptr);
+
+    void            build(std::vector<fvec3> vertices, std::vector<int32_t> indices, bvh_build_mode mode = bvh_build_mode::binned_sah,
+                        thread_pool* pool = nullptr);
+
+    /* index of the closest triangle with the near distance in [tmin, tmax] or -1, the lowest index
+     * wins a tie like in bvh::closest_hit(). On a paged mesh this and the other traversals prefetch the
+     * page of the farther child they push, it is read while the nearer one is tested */
+    int32_t         closest_hit(const ray_type& ray, float tmin, float tmax, float& near) const;
+
+    /* any triangle hit, not necessarily the closest one */
+    bool            occluded(const ray_type& ray, float tmin, float tmax) const;
+
+    /* closest_hit() for the lanes in mask sharing one traversal, tmax is the array of the lanes (the
+     * closest hit so far). Returns the mask of the hit lanes, near and the triangles are written for them */
+    uint32_t        closest_hit_packet(const ray_packet& packet, uint32_t mask, const float* tmax, float* near, int32_t* triangles) const;
+
+    /* occluded() for the lanes in mask, returns the mask of the occluded lanes */
+    uint32_t        occluded_packet(const ray_packet& packet, uint32_t mask) const;
+
+    /* closest_hit() of count rays sharing tmin, ids is -1 for the misses. On a paged mesh a leaf of a
+     * page that is not resident is not waited for: the page is prefetched, the ray is queued on it and
+     * goes on with the other leaves. The queues are then served in page order, each page is made
+     * resident once for all its rays and the leaves are culled by the closest hits found meanwhile */
+    void            closest_hit_batch(const ray_type* rays, int32_t count, float tmin, const float* tmax, int32_t* ids, float* near) const;
+
+    /* writes the blocks to path and reads them from there through a geometry_pager keeping at most
+     * max_resident_pages of page_blocks blocks in memory. The blocks, vertices and indices are freed.
+     * Returns false and keeps the mesh in memory on error, build() brings the blocks back */
+    bool            page_out(const std::string& path, int32_t max_resident_pages);
+
+    /* unit normal of the winding (v1 - v0) x (v2 - v0) */
+    fvec3           normal(int32_t triangle) const;
+
+    int32_t                         get_triangle_count() const noexcept;
+    const bounds_type&              get_bounds() const noexcept;
+    /* empty after page_out() */
+    const std::vector<fvec3>&       get_vertices() const noexcept;
+    const std::vector<int32_t>&     get_indices() const noexcept;
+    const bvh&                      get_accel() const noexcept;
+    /* nullptr when the blocks are in memory */
+    geometry_pager*                 get_pager() noexcept;
+    const geometry_pager*           get_pager() const noexcept;
+
+private:
+    /* block of m_blocks or of the pager, touching its page */
+    const packed_triangle_block&    block(int32_t index) const;
+    /* the tests of the blocks of leaf, lowering near and setting id on a hit as closest_hit() */
+    void            leaf_closest_hit(int32_t leaf, const ray_type& ray, float tmin, float& near, int32_t& id) const;
+    /* asks the pager for the page of the first block under node, the one its first leaf starts on */
+    void            prefetch_subtree(int32_t node) const;
+
+private:
+    std::vector<fvec3>      m_vertices;
+    std::vector<int32_t>    m_indices;
+    bvh                     m_accel;        /* items are triangles */
+    bounds_type             m_bounds;
+    std::vector<packed_triangle_block>  m_blocks;
+    std::vector<int32_t>    m_leaf_block;   /* node -> first block of the leaf, -1 for the interior nodes */
+    std::vector<int32_t>    m_slot;         /* triangle -> block * width + lane */
+    shared_ptr<geometry_pager>  m_pager;    /* set by page_out() */
+    std::vector<int32_t>    m_node_page;    /* node -> page of the first block of its subtree, set by page_out() */
+}; /* class triangle_mesh */
+
+
+
+/* triangle_mesh::block */
+inline const packed_triangle_block& triangle_mesh::block(int32_t index) const
+{
+    if (m_pager) {
+        m_pager->touch(index / page_blocks);
+        return static_cast<const packed_triangle_block*>(m_pager->get_data())[index];
+    }
+    return m_blocks[index];
+}
+
+/* triangle_mesh::get_triangle_count */
+inline int32_t triangle_mesh::get_triangle_count() const noexcept
+{
+    return static_cast<int32_t>(m_slot.size());
+}
+
+/* triangle_mesh::get_bounds */
+inline const bounds_type& triangle_mesh::get_bounds() const noexcept
+{
+    return m_bounds;
+}
+
+/* triangle_mesh::get_vertices */
+inline const std::vector<fvec3>& triangle_mesh::get_vertices() const noexcept
+{
+    return m_vertices;
+}
+
+/* triangle_mesh::get_indices */
+inline const std::vector<int32_t>& triangle_mesh::get_indices() const noexcept
+{
+    return m_indices;
+}
+
+/* triangle_mesh::get_accel */
+inline const bvh& triangle_mesh::get_accel() const noexcept
+{
+    return m_accel;
+}
+
+/* triangle_mesh::get_pager */
+inline geometry_pager* triangle_mesh::get_pager() noexcept
+{
+    return m_pager.get();
+}
+
+/* triangle_mesh::get_pager */
+inline const geometry_pager* triangle_mesh::get_pager() const noexcept
+{
+    return m_pager.get();
+}
+
+} /* namespace green::core */
@@ -0,0 +1,370 @@
+#include "wide_bvh.hpp"
+
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "ray_intersection_test.hpp"
+
+namespace green::core
+{
+
+/* per ray invariants of the node slab test */
+struct wide_ray_type
+{
+    fvec3           origin;
+    fvec3           inv_dir;
+    fvec3           abs_inv_dir;
+    float           tmin;
+};
+
+/* the slab test rounds more than the corner form in bvh.cpp, keep the far distance conservative */
+constexpr float wide_far_scale = 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+
+/* AABB_TEST_CALC_COMMON_RET_FALSE for one lane, accepts boxes overlapping [tmin, max_dist] */
+template <int32_t N>
+static inline uint32_t node_intersection_test_scalar(const wide_bvh_node<N>& node, const wide_ray_type& ray, float max_dist, float* near)
+{
+    uint32_t mask = 0;
+    for (int32_t lane = 0; lane < N; lane++) {
+        float nx = ray.inv_dir.x * (ray.origin.x - node.center_x[lane]);
+        float ny = ray.inv_dir.y * (ray.origin.y - node.center_y[lane]);
+        float nz = ray.inv_dir.z * (ray.origin.z - node.center_z[lane]);
+        float kx = ray.abs_inv_dir.x * node.size_x[lane];
+        float ky = ray.abs_inv_dir.y * node.size_y[lane];
+        float kz = ray.abs_inv_dir.z * node.size_z[lane];
+        float tN = math::max(math::max(-nx - kx, -ny - ky), math::max(-nz - kz, ray.tmin));
+        float tF = math::min(math::min(kx - nx, ky - ny), kz - nz) * wide_far_scale;
+        if (tN <= tF && tN <= max_dist) {
+            near[lane] = tN;
+            mask |= 1u << lane;
+        }
+    }
+    return mask;
+}
+
+#if defined(__SSE2__)
+/* AABB_TEST_CALC_COMMON_RET_FALSE for 4 lanes starting at lane */
+template <int32_t N>
+static inline uint32_t node_intersection_test_sse(const wide_bvh_node<N>& node, int32_t lane, const wide_ray_type& ray, float max_dist, float* near)
+{
+    __m128 nx = _mm_mul_ps(_mm_set1_ps(ray.inv_dir.x), _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(node.center_x + lane)));
+    __m128 ny = _mm_mul_ps(_mm_set1_ps(ray.inv_dir.y), _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(node.center_y + lane)));
+    __m128 nz = _mm_mul_ps(_mm_set1_ps(ray.inv_dir.z), _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(node.center_z + lane)));
+    __m128 kx = _mm_mul_ps(_mm_set1_ps(ray.abs_inv_dir.x), _mm_load_ps(node.size_x + lane));
+    __m128 ky = _mm_mul_ps(_mm_set1_ps(ray.abs_inv_dir.y), _mm_load_ps(node.size_y + lane));
+    __m128 kz = _mm_mul_ps(_mm_set1_ps(ray.abs_inv_dir.z), _mm_load_ps(node.size_z + lane));
+    __m128 zero = _mm_setzero_ps();
+    __m128 t1x = _mm_sub_ps(_mm_sub_ps(zero, nx), kx);
+    __m128 t1y = _mm_sub_ps(_mm_sub_ps(zero, ny), ky);
+    __m128 t1z = _mm_sub_ps(_mm_sub_ps(zero, nz), kz);
+    __m128 tN = _mm_max_ps(_mm_max_ps(t1x, t1y), _mm_max_ps(t1z, _mm_set1_ps(ray.tmin)));
+    __m128 tF = _mm_min_ps(_mm_min_ps(_mm_sub_ps(kx, nx), _mm_sub_ps(ky, ny)), _mm_sub_ps(kz, nz));
+    tF = _mm_mul_ps(tF, _mm_set1_ps(wide_far_scale));
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(tN, tF), _mm_cmple_ps(tN, _mm_set1_ps(max_dist)));
+    _mm_storeu_ps(near + lane, tN);
+    return static_cast<uint32_t>(_mm_movemask_ps(hit)) << lane;
+}
+#endif
+
+#if defined(__AVX__)
+/* AABB_TEST_CALC_COMMON_RET_FALSE for 8 lanes */
+static inline uint32_t node_intersection_test_avx(const wide_bvh_node<8>& node, const wide_ray_type& ray, float max_dist, float* near)
+{
+    __m256 nx = _mm256_mul_ps(_mm256_set1_ps(ray.inv_dir.x), _mm256_sub_ps(_mm256_set1_ps(ray.origin.x), _mm256_load_ps(node.center_x)));
+    __m256 ny = _mm256_mul_ps(_mm256_set1_ps(ray.inv_dir.y), _mm256_sub_ps(_mm256_set1_ps(ray.origin.y), _mm256_load_ps(node.center_y)));
+    __m256 nz = _mm256_mul_ps(_mm256_set1_ps(ray.inv_dir.z), _mm256_sub_ps(_mm256_set1_ps(ray.origin.z), _mm256_load_ps(node.center_z)));
+    __m256 kx = _mm256_mul_ps(_mm256_set1_ps(ray.abs_inv_dir.x), _mm256_load_ps(node.size_x));
+    __m256 ky = _mm256_mul_ps(_mm256_set1_ps(ray.abs_inv_dir.y), _mm256_load_ps(node.size_y));
+    __m256 kz = _mm256_mul_ps(_mm256_set1_ps(ray.abs_inv_dir.z), _mm256_load_ps(node.size_z));
+    __m256 zero = _mm256_setzero_ps();
+    __m256 t1x = _mm256_sub_ps(_mm256_sub_ps(zero, nx), kx);
+    __m256 t1y = _mm256_sub_ps(_mm256_sub_ps(zero, ny), ky);
+    __m256 t1z = _mm256_sub_ps(_mm256_sub_ps(zero, nz), kz);
+    __m256 tN = _mm256_max_ps(_mm256_max_ps(t1x, t1y), _mm256_max_ps(t1z, _mm256_set1_ps(ray.tmin)));
+    __m256 tF = _mm256_min_ps(_mm256_min_ps(_mm256_sub_ps(kx, nx), _mm256_sub_ps(ky, ny)), _mm256_sub_ps(kz, nz));
+    tF = _mm256_mul_ps(tF, _mm256_set1_ps(wide_far_scale));
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(tN, tF, _CMP_LE_OQ), _mm256_cmp_ps(tN, _mm256_set1_ps(max_dist), _CMP_LE_OQ));
+    _mm256_storeu_ps(near, tN);
+    return static_cast<uint32_t>(_mm256_movemask_ps(hit));
+}
+#endif
+
+/* returns the mask of the intersected lanes, near is written for these lanes */
+template <int32_t N>
+static inline uint32_t node_intersection_test(const wide_bvh_node<N>& node, const wide_ray_type& ray, float max_dist, float* near)
+{
+#if defined(__AVX__)
+    if constexpr (N == 8) {
+        return node_intersection_test_avx(node, ray, max_dist, near);
+    }
+#endif
+#if defined(__SSE2__)
+    if constexpr (N == 4) {
+        return node_intersection_test_sse(node, 0, ray, max_dist, near);
+    } else if constexpr (N == 8) {
+        return node_intersection_test_sse(node, 0, ray, max_dist, near) | node_intersection_test_sse(node, 4, ray, max_dist, near);
+    }
+#endif
+    return node_intersection_test_scalar(node, ray, max_dist, near);
+}
+
+/* wide_bvh::wide_bvh */
+template <int32_t N>
+wide_bvh<N>::wide_bvh(const bvh& binary)
+{
+    build(binary);
+}
+
+/* wide_bvh::build */
+template <int32_t N>
+void wide_bvh<N>::build(const bvh& binary)
+{
+    /* the leaves reference the same ranges, the blocks of indices are shared with the binary bvh */
+    m_indices = binary.get_indices();
+    m_unbounded.assign(binary.get_unbounded().begin(), binary.get_unbounded().end());
+    std::vector<wide_bvh_node<N>> nodes;
+    std::vector<int32_t> lane_of(binary.get_nodes().size(), -1);
+    if (!binary.get_nodes().empty()) {
+        nodes.reserve(binary.get_nodes().size() / (N - 1) + 1);
+        collapse(binary, 0, nodes, lane_of);
+    }
+    m_nodes.assign(nodes.begin(), nodes.end());
+    m_lane_of.assign(lane_of.begin(), lane_of.end());
+}
+
+/* wide_bvh::attach */
+template <int32_t N>
+void wide_bvh<N>::attach(std::span<const wide_bvh_node<N>> nodes, std::span<const int32_t> indices, std::span<const int32_t> unbounded,
+    std::span<const int32_t> lane_of, std::shared_ptr<const void> storage)
+{
+    m_nodes.attach(nodes, storage);
+    m_indices.attach(indices, storage);
+    m_unbounded.attach(unbounded, storage);
+    m_lane_of.attach(lane_of, std::move(storage));
+}
+
+/* wide_bvh::collapse */
+template <int32_t N>
+int32_t wide_bvh<N>::collapse(const bvh& binary, int32_t binary_index, std::vector<wide_bvh_node<N>>& out, std::vector<int32_t>& lane_of)
+{
+    const auto& nodes = binary.get_nodes();
+    int32_t children[N];
+    int32_t n = 0;
+    if (nodes[binary_index].count > 0) {
+        /* the root is a leaf */
+        children[n++] = binary_index;
+    } else {
+        children[n++] = nodes[binary_index].left_first;
+        children[n++] = nodes[binary_index].left_first + 1;
+    }
+    /* open the interior child with the largest surface area until the node is full */
+    while (n < N) {
+        int32_t best = -1;
+        float best_area = -1.0f;
+        for (int32_t i = 0; i < n; i++) {
+            const bvh_node& child = nodes[children[i]];
+            if (child.count == 0 && child.bounds.surface_area() > best_area) {
+                best_area = child.bounds.surface_area();
+                best = i;
+            }
+        }
+        if (best == -1) {
+            break;
+        }
+        int32_t opened = children[best];
+        children[best] = nodes[opened].left_first;
+        children[n++] = nodes[opened].left_first + 1;
+    }
+
+    int32_t index = static_cast<int32_t>(out.size());
+    out.emplace_back();
+    for (int32_t lane = 0; lane < N; lane++) {
+        if (lane >= n) {
+            auto& node = out[index];
+            node.center_x[lane] = node.center_y[lane] = node.center_z[lane] = 0.0f;
+            node.size_x[lane] = node.size_y[lane] = node.size_z[lane] = -std::numeric_limits<float>::infinity();
+            node.child[lane] = -1;
+            node.count[lane] = 0;
+            continue;
+        }
+        const bvh_node& child = nodes[children[lane]];
+        int32_t child_index = child.count > 0 ? child.left_first : collapse(binary, children[lane], out, lane_of);
+        auto& node = out[index];
+        set_lane_bounds(node, lane, child.bounds);
+        lane_of[children[lane]] = index * N + lane;
+        node.child[lane] = child_index;
+        node.count[lane] = child.count;
+    }
+    return index;
+}
+
+/* wide_bvh::set_lane_bounds */
+template <int32_t N>
+void wide_bvh<N>::set_lane_bounds(wide_bvh_node<N>& node, int32_t lane, const bounds_type& bounds)
+{
+    /* round the half size up so the box never shrinks */
+    fvec3 c = bounds.center();
+    fvec3 s = bounds.max - c;
+    fvec3 s2 = c - bounds.min;
+    s = fvec3(std::nextafter(math::max(s.x, s2.x), std::numeric_limits<float>::infinity()),
+        std::nextafter(math::max(s.y, s2.y), std::numeric_limits<float>::infinity()),
+        std::nextafter(math::max(s.z, s2.z), std::numeric_limits<float>::infinity()));
+    node.center_x[lane] = c.x;
+    node.center_y[lane] = c.y;
+    node.center_z[lane] = c.z;
+    node.size_x[lane] = s.x;
+    node.size_y[lane] = s.y;
+    node.size_z[lane] = s.z;
+}
+
+/* wide_bvh::refit */
+template <int32_t N>
+void wide_bvh<N>::refit(const bvh& binary)
+{
+    const bvh_update_stats& stats = binary.get_update_stats();
+    /* nodes attached without their m_lane_of */
+    if (stats.topology_changed || m_lane_of.size() != binary.get_nodes().size()) {
+        build(binary);
+        return;
+    }
+    for (int32_t i: stats.changed_nodes) {
+        int32_t slot = m_lane_of[i];
+        if (slot != -1) {
+            set_lane_bounds(m_nodes.mutate(slot / N), slot % N, binary.get_nodes()[i].bounds);
+        }
+    }
+}
+
+/* wide_bvh::closest_hit */
+template <int32_t N>
+int32_t wide_bvh<N>::closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near, int32_t& sub_id) const
+{
+    float dist_near;
+    int32_t dist_sub;
+    int32_t ret = -1;
+    near = tmax;
+    sub_id = -1;
+
+    /* primitives behind the closest hit are rejected by the test itself */
+    auto test_primitive = [&](int32_t i) {
+        if (primitive_intersection_test(primitives[i], ray, tmin, near, dist_near, dist_sub)
+            && (dist_near < near || (dist_near == near && (ret == -1 || i < ret)))) {
+            near = dist_near;
+            ret = i;
+            sub_id = dist_sub;
+        }
+    };
+
+    for (int32_t i: m_unbounded) {
+        test_primitive(i);
+    }
+    if (m_nodes.empty()) {
+        return ret;
+    }
+
+    wide_ray_type node_ray{ray.origin, ray.inv_dir, ray.abs_inv_dir, tmin};
+
+    /* count > 0 - leaf, otherwise child is a node */
+    struct stack_entry
+    {
+        int32_t     child;
+        int32_t     count;
+        float       near;
+    };
+    stack_entry stack[max_stack_size];
+    int32_t sp = 0;
+    stack[sp++] = {0, 0, tmin};
+
+    alignas(32) float dist[N];
+    int32_t order[N];
+    while (sp > 0) {
+        stack_entry e = stack[--sp];
+        /* a closer hit was found after the entry was pushed */
+        if (e.near > near) {
+            continue;
+        }
+        if (e.count > 0) {
+            for (int32_t i = e.child; i < e.child + e.count; i++) {
+                test_primitive(m_indices[i]);
+            }
+            continue;
+        }
+        const wide_bvh_node<N>& node = m_nodes[e.child];
+        uint32_t mask = node_intersection_test(node, node_ray, near, dist);
+        /* insertion sort of the intersected lanes by distance */
+        int32_t hits = 0;
+        while (mask != 0) {
+            int32_t lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            int32_t k = hits++;
+            while (k > 0 && dist[order[k - 1]] > dist[lane]) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = lane;
+        }
+        /* the nearest child is popped first */
+        for (int32_t k = hits - 1; k >= 0; k--) {
+            int32_t lane = order[k];
+            stack[sp++] = {node.child[lane], node.count[lane], dist[lane]};
+        }
+    }
+    return ret;
+}
+
+/* wide_bvh::occluded */
+template <int32_t N>
+bool wide_bvh<N>::occluded(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax) const
+{
+    for (int32_t i: m_unbounded) {
+        if (primitive_occlusion_test(primitives[i], ray, tmin, tmax)) {
+            return true;
+        }
+    }
+    if (m_nodes.empty()) {
+        return false;
+    }
+
+    wide_ray_type node_ray{ray.origin, ray.inv_dir, ray.abs_inv_dir, tmin};
+
+    /* count > 0 - leaf, otherwise child is a node */
+    struct stack_entry
+    {
+        int32_t     child;
+        int32_t     count;
+    };
+    stack_entry stack[max_stack_size];
+    int32_t sp = 0;
+    stack[sp++] = {0, 0};
+
+    alignas(32) float dist[N];
+    while (sp > 0) {
+        stack_entry e = stack[--sp];
+        if (e.count > 0) {
+            for (int32_t i = e.child; i < e.child + e.count; i++) {
+                if (primitive_occlusion_test(primitives[m_indices[i]], ray, tmin, tmax)) {
+                    return true;
+                }
+            }
+            continue;
+        }
+        const wide_bvh_node<N>& node = m_nodes[e.child];
+        uint32_t mask = node_intersection_test(node, node_ray, tmax, dist);
+        while (mask != 0) {
+            int32_t lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            stack[sp++] = {node.child[lane], node.count[lane]};
+        }
+    }
+    return false;
+}
+
+template class wide_bvh<2>;
+template class wide_bvh<4>;
+template class wide_bvh<8>;
+
+} /* namespace green::core */
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "block_vector.hpp"
+#include "bvh.hpp"
+
+namespace green::core
+{
+
+/* N children per node, the bounds are stored as structure of arrays in the center / half size
+ * form of the aabb test, so one SSE (N = 4) or AVX (N = 8) slab test covers the whole node.
+ * lane: count > 0 - leaf, child - first index in wide_bvh::get_indices()
+ *       count == 0 - interior, child - index of the node
+ *       child == -1 - empty, the bounds never intersect */
+template <int32_t N>
+struct alignas(32) wide_bvh_node
+{
+    float           center_x[N];
+    float           center_y[N];
+    float           center_z[N];
+    float           size_x[N];
+    float           size_y[N];
+    float           size_z[N];
+    int32_t         child[N];
+    int32_t         count[N];
+};
+
+/* collapsed bvh, every node takes up to N nodes of the binary bvh opening the largest ones first */
+template <int32_t N>
+class wide_bvh
+{
+    static_assert(N == 2 || N == 4 || N == 8);
+public:
+    static constexpr int32_t    width = N;
+    static constexpr int32_t    max_stack_size = bvh::max_depth * (N - 1) + 2;
+
+public:
+                    wide_bvh() = default;
+    explicit        wide_bvh(const bvh& binary);
+
+    void            build(const bvh& binary);
+
+    /* follows bvh::refit(), rewrites only the lanes of the changed nodes unless the topology changed. A copy
+     * shares the blocks of nodes with its source, the refit copies the blocks of the rewritten lanes */
+    void            refit(const bvh& binary);
+
+    /* the same result as bvh::closest_hit() */
+    int32_t         closest_hit(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax, float& near,
+                        int32_t& sub_id) const;
+
+    /* the same result as bvh::occluded(), the children are not sorted */
+    bool            occluded(const block_vector<compiled_primitive>& primitives, const ray_type& ray, float tmin, float tmax) const;
+
+    /* traverses nodes stored elsewhere (a mapped file), storage keeps the memory alive. Nothing is
+     * copied. lane_of is get_lane_of() of the build, refit() then rewrites the lanes as after it.
+     * Without it refit() builds again */
+    void            attach(std::span<const wide_bvh_node<N>> nodes, std::span<const int32_t> indices, std::span<const int32_t> unbounded,
+                        std::span<const int32_t> lane_of, std::shared_ptr<const void> storage);
+
+    const block_vector<wide_bvh_node<N>>&   get_nodes() const noexcept;
+    const block_vector<int32_t>&            get_indices() const noexcept;
+    const block_vector<int32_t>&            get_unbounded() const noexcept;
+    /* binary node -> node * N + lane, -1 if collapsed */
+    const block_vector<int32_t>&            get_lane_of() const noexcept;
+
+private:
+    /* appends the node of binary_index and its subtree to nodes */
+    static int32_t  collapse(const bvh& binary, int32_t binary_index, std::vector<wide_bvh_node<N>>& nodes, std::vector<int32_t>& lane_of);
+    static void     set_lane_bounds(wide_bvh_node<N>& node, int32_t lane, const bounds_type& bounds);
+
+private:
+    /* owned blocks or attached memory, a copy of the wide_bvh shares both */
+    block_vector<wide_bvh_node<N>>  m_nodes;
+    block_vector<int32_t>           m_indices;
+    block_vector<int32_t>           m_unbounded;
+    block_vector<int32_t>           m_lane_of;      /* binary node -> node * N + lane, -1 if collapsed. Empty when unknown */
+}; /* class wide_bvh */
+
+
+
+/* wide_bvh::get_nodes */
+template <int32_t N>
+inline const block_vector<wide_bvh_node<N>>& wide_bvh<N>::get_nodes() const noexcept
+{
+    return m_nodes;
+}
+
+/* wide_bvh::get_indices */
+template <int32_t N>
+inline const block_vector<int32_t>& wide_bvh<N>::get_indices() const noexcept
+{
+    return m_indices;
+}
+
+/* wide_bvh::get_unbounded */
+template <int32_t N>
+inline const block_vector<int32_t>& wide_bvh<N>::get_unbounded() const noexcept
+{
+    return m_unbounded;
+}
+
+/* wide_bvh::get_lane_of */
+template <int32_t N>
+inline const block_vector<int32_t>& wide_bvh<N>::get_lane_of() const noexcept
+{
+    return m_lane_of;
+}
+
+extern template class wide_bvh<2>;
+extern template class wide_bvh<4>;
+extern template class wide_bvh<8>;
+
+} /* namespace green::core */